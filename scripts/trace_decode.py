@@ -0,0 +1,135 @@
+import json
+import struct
+import subprocess
+import sys
+
+# Decodes a "trace dump" captured from the serial log into Chrome trace JSON
+# (load it in chrome://tracing or ui.perfetto.dev).
+#
+# Record layout and event ids must match src/kernel/trace.h.
+
+RECORD = struct.Struct("<QHHIQQ")  # tsc, event, cpu, arg0, arg1, arg2
+
+IRQ_ENTER, IRQ_EXIT = 0x0000, 0x0001
+SCHED_SWITCH, SCHED_WAKE = 0x0100, 0x0101
+TIMER_FIRE = 0x0200
+WORK_BEGIN, WORK_END = 0x0300, 0x0301
+INPUT_KEY, INPUT_MOUSE = 0x0400, 0x0401
+UI_FRAME_BEGIN, UI_FRAME_END = 0x0500, 0x0501
+SYSCALL_ENTER, SYSCALL_EXIT = 0x0600, 0x0601
+
+PID_CPU = 0    # Interrupts, bottom halves and syscalls, one row per CPU
+PID_TASKS = 1  # Which task each CPU is running
+PID_UI = 2     # Compositor frames
+
+SYSCALL_NAMES = {0: "exit", 1: "null", 2: "clock", 3: "report"}
+
+
+def load_symbols(elf_path):
+    """Address -> name for every code symbol, via nm."""
+    out = subprocess.run(["nm", "-n", elf_path], capture_output=True, text=True, check=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            syms.append((int(parts[0], 16), parts[2]))
+    return syms
+
+
+def symbolize(syms, addr):
+    if not syms:
+        return hex(addr)
+    lo, hi, best = 0, len(syms) - 1, None
+    while lo <= hi:
+        mid = (lo + hi) // 2
+        if syms[mid][0] <= addr:
+            best, lo = syms[mid][1], mid + 1
+        else:
+            hi = mid - 1
+    return best or hex(addr)
+
+
+def parse_log(path):
+    tsc_hz, tasks, records, inside = 0, {0: "idle"}, [], False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line == "--- trace begin ---":
+                inside, records = True, []
+                continue
+            if line == "--- trace end ---":
+                inside = False
+                continue
+            if not inside or len(line) < 2:
+                continue
+            kind, rest = line[0], line[2:]
+            if kind == "H":
+                tsc_hz = int(rest.split()[0])
+            elif kind == "N":
+                task_id, _, name = rest.partition(" ")
+                tasks[int(task_id)] = name
+            elif kind == "R":
+                records.append(RECORD.unpack(bytes.fromhex(rest)))
+    if not tsc_hz:
+        sys.exit("no trace dump found in " + path)
+    records.sort(key=lambda r: r[0])
+    return tsc_hz, tasks, records
+
+
+def convert(tsc_hz, tasks, records, syms):
+    t0 = records[0][0] if records else 0
+    us = lambda tsc: (tsc - t0) * 1e6 / tsc_hz
+    events, running = [], {}
+
+    def task_name(task_id):
+        return tasks.get(task_id, "task %d" % task_id)
+
+    for tsc, ev, cpu, a0, a1, a2 in records:
+        ts = us(tsc)
+        base = {"ts": ts, "pid": PID_CPU, "tid": cpu}
+        if ev in (IRQ_ENTER, IRQ_EXIT):
+            events.append(dict(base, name="irq %#x" % a0, ph="B" if ev == IRQ_ENTER else "E"))
+        elif ev in (WORK_BEGIN, WORK_END):
+            name = ("softirq " if a0 else "kworker ") + symbolize(syms, a1)
+            events.append(dict(base, name=name, ph="B" if ev == WORK_BEGIN else "E"))
+        elif ev in (SYSCALL_ENTER, SYSCALL_EXIT):
+            name = "sys_" + SYSCALL_NAMES.get(a0, str(a0))
+            events.append(dict(base, name=name, ph="B" if ev == SYSCALL_ENTER else "E"))
+        elif ev == SCHED_SWITCH:
+            start = running.pop(cpu, None)
+            if start is not None:
+                events.append({"name": task_name(a0), "ph": "X", "ts": start, "dur": ts - start,
+                               "pid": PID_TASKS, "tid": cpu})
+            running[cpu] = ts
+        elif ev == SCHED_WAKE:
+            events.append(dict(base, name="wake " + task_name(a0), ph="i", s="t", args={"target_cpu": a1}))
+        elif ev == TIMER_FIRE:
+            events.append(dict(base, name="timer " + symbolize(syms, a2), ph="i", s="t",
+                               args={"late_ns": a1}))
+        elif ev == INPUT_KEY:
+            events.append(dict(base, name="key %#04x" % a0, ph="i", s="t",
+                               args={"irq_to_bh_us": us(tsc) - us(a1)}))
+        elif ev == INPUT_MOUSE:
+            events.append(dict(base, name="mouse x%d" % a0, ph="i", s="t",
+                               args={"irq_to_bh_us": us(tsc) - us(a1)}))
+        elif ev in (UI_FRAME_BEGIN, UI_FRAME_END):
+            e = {"name": "frame", "ph": "B" if ev == UI_FRAME_BEGIN else "E", "ts": ts,
+                 "pid": PID_UI, "tid": 0, "args": {"frame": a1}}
+            if ev == UI_FRAME_END:
+                e["args"]["repainted"] = a0
+            events.append(e)
+
+    for pid, name in ((PID_CPU, "cpus"), (PID_TASKS, "tasks"), (PID_UI, "compositor")):
+        events.append({"name": "process_name", "ph": "M", "pid": pid, "args": {"name": name}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python trace_decode.py <serial.log> <out.json> [kernel.elf]")
+    else:
+        syms = load_symbols(sys.argv[3]) if len(sys.argv) > 3 else []
+        tsc_hz, tasks, records = parse_log(sys.argv[1])
+        with open(sys.argv[2], "w") as f:
+            json.dump(convert(tsc_hz, tasks, records, syms), f)
+        print("%d records -> %s" % (len(records), sys.argv[2]))
@@ -0,0 +1,79 @@
+#include "acpi.h"
+#include "memory/vmm.h"
+#include "../boot/limine.h"
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    /* ACPI 2.0+ */
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+__attribute__((used, section(".rodata"), aligned(8)))
+volatile struct limine_rsdp_request rsdp_request = {
+    .id = LIMINE_RSDP_REQUEST,
+    .revision = 0
+};
+
+static acpi_sdt_header_t *root_table = 0;
+static int root_is_xsdt = 0;
+
+/* Firmware tables may sit outside the HHDM, so map before touching them */
+static acpi_sdt_header_t *map_table(uint64_t phys) {
+    acpi_sdt_header_t *h = vmm_map_mmio(phys, sizeof(acpi_sdt_header_t));
+    if (!h) return 0;
+    return vmm_map_mmio(phys, h->length);
+}
+
+static int checksum_ok(const void *p, uint32_t len) {
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += b[i];
+    return sum == 0;
+}
+
+int acpi_init() {
+    if (!rsdp_request.response || !rsdp_request.response->address) return 0;
+
+    uint64_t addr = (uint64_t)(uintptr_t)rsdp_request.response->address;
+    uint64_t hhdm = vmm_hhdm_offset();
+    if (addr >= hhdm) addr -= hhdm; // Older base revisions hand out HHDM pointers
+
+    acpi_rsdp_t *rsdp = vmm_map_mmio(addr, sizeof(acpi_rsdp_t));
+    if (!rsdp || !checksum_ok(rsdp, 20)) return 0;
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address) {
+        root_table = map_table(rsdp->xsdt_address);
+        root_is_xsdt = 1;
+    } else {
+        root_table = map_table(rsdp->rsdt_address);
+        root_is_xsdt = 0;
+    }
+    return root_table && checksum_ok(root_table, root_table->length);
+}
+
+acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    if (!root_table) return 0;
+
+    uint32_t entry_size = root_is_xsdt ? 8 : 4;
+    uint32_t entries = (root_table->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t *base = (uint8_t *)root_table + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < entries; i++) {
+        uint64_t phys = root_is_xsdt ? ((uint64_t *)base)[i] : ((uint32_t *)base)[i];
+        acpi_sdt_header_t *h = vmm_map_mmio(phys, sizeof(acpi_sdt_header_t));
+        if (!h) continue;
+        if (h->signature[0] == signature[0] && h->signature[1] == signature[1] &&
+            h->signature[2] == signature[2] && h->signature[3] == signature[3]) {
+            h = map_table(phys);
+            if (h && checksum_ok(h, h->length)) return h;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+int acpi_init();
+
+/* Find a table by its 4-character signature, e.g. "APIC". NULL if absent. */
+acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+#endif
@@ -0,0 +1,384 @@
+#include "aio.h"
+#include "timer.h"
+#include "serial.h"
+#include "memory/pmm.h"
+
+typedef struct {
+    const char *name;
+    const void *key;            // Driver the queue serves; 0 for the default queue
+    spinlock_t lock;
+    lock_stats_t lock_stats;
+    aio_request_t *head;
+    aio_request_t *tail;
+    uint32_t depth;
+    uint32_t max_depth;
+    sched_event_t kick;
+    task_t *worker;
+    aio_start_t start;          // Optional, see aio_device_register()
+
+    /* Counters */
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t cancelled;
+    uint64_t bytes;
+    uint64_t latency_ns;        // Submission to completion, summed
+} aio_queue_t;
+
+static aio_queue_t queues[AIO_MAX_QUEUES];
+static volatile uint32_t queue_count = 0;
+
+/* Nodes of one driver share its ops table, so that identifies the device */
+static const void *device_key(fs_node_t *node) {
+    return node->ops;
+}
+
+static aio_queue_t *queue_for(fs_node_t *node) {
+    const void *key = device_key(node);
+    uint32_t n = __atomic_load_n(&queue_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 1; i < n; i++) {
+        if (queues[i].key == key) return &queues[i];
+    }
+    return &queues[0];
+}
+
+/* --- Completion queues --- */
+
+void aio_cq_init(aio_cq_t *cq, sched_event_t *notify) {
+    cq->lock = (spinlock_t)SPINLOCK_INIT;
+    cq->head = cq->tail = 0;
+    cq->count = 0;
+    cq->own_event.signaled = 0;
+    cq->own_event.waiter = 0;
+    cq->event = notify ? notify : &cq->own_event;
+}
+
+/* Publishes AIO_DONE under the cq lock, so a consumer that pops the
+ * request can resubmit it straight away. The signal goes out under the
+ * lock too: consumers pop under it, so once the last request is taken
+ * nothing touches the cq any more and it may live on the stack. */
+static void cq_post(aio_cq_t *cq, aio_request_t *req) {
+    uint64_t flags = spin_lock_irqsave(&cq->lock);
+    req->next = 0;
+    if (cq->tail) cq->tail->next = req;
+    else cq->head = req;
+    cq->tail = req;
+    cq->count++;
+    __atomic_store_n(&req->state, AIO_DONE, __ATOMIC_RELEASE);
+    sched_event_signal(cq->event);
+    spin_unlock_irqrestore(&cq->lock, flags);
+}
+
+aio_request_t *aio_poll(aio_cq_t *cq) {
+    if (!__atomic_load_n(&cq->head, __ATOMIC_ACQUIRE)) return 0;
+    uint64_t flags = spin_lock_irqsave(&cq->lock);
+    aio_request_t *req = cq->head;
+    if (req) {
+        cq->head = req->next;
+        if (!cq->head) cq->tail = 0;
+        cq->count--;
+        req->next = 0;
+    }
+    spin_unlock_irqrestore(&cq->lock, flags);
+    return req;
+}
+
+aio_request_t *aio_wait(aio_cq_t *cq, uint64_t timeout_ns) {
+    uint64_t deadline = timeout_ns ? ktime_get_ns() + timeout_ns : 0;
+    for (;;) {
+        aio_request_t *req = aio_poll(cq);
+        if (req) return req;
+
+        uint64_t left = 0;
+        if (deadline) {
+            uint64_t now = ktime_get_ns();
+            if (now >= deadline) return 0;
+            left = deadline - now;
+        }
+        sched_event_wait(cq->event, left);
+    }
+}
+
+/* --- Submission --- */
+
+void aio_prep(aio_request_t *req, aio_op_t op, fs_node_t *node, uint64_t offset,
+              uint32_t size, void *buffer, aio_callback_t callback, aio_cq_t *cq, void *arg) {
+    req->op = op;
+    req->node = node;
+    req->offset = offset;
+    req->size = size;
+    req->buffer = buffer;
+    req->callback = callback;
+    req->cq = cq;
+    req->arg = arg;
+    req->state = AIO_IDLE;
+    req->result = 0;
+    req->next = 0;
+    req->queue = 0;
+}
+
+/* Claims the request for submission; 0 if it is already in flight */
+static int claim(aio_request_t *req) {
+    if (!req->node) return 0;
+    uint32_t s = __atomic_load_n(&req->state, __ATOMIC_ACQUIRE);
+    if (s != AIO_IDLE && s != AIO_DONE && s != AIO_CANCELLED) return 0;
+    if (!__atomic_compare_exchange_n(&req->state, &s, AIO_QUEUED, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return 0;
+    req->result = 0;
+    req->next = 0;
+    req->submit_ns = ktime_get_ns();
+    return 1;
+}
+
+static void enqueue_locked(aio_queue_t *q, aio_request_t *req) {
+    req->queue = q;
+    if (q->tail) q->tail->next = req;
+    else q->head = req;
+    q->tail = req;
+    q->submitted++;
+    if (++q->depth > q->max_depth) q->max_depth = q->depth;
+}
+
+int aio_submit(aio_request_t *req) {
+    if (!claim(req)) return 0;
+    aio_queue_t *q = queue_for(req->node);
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    enqueue_locked(q, req);
+    spin_unlock_irqrestore(&q->lock, flags);
+    sched_event_signal(&q->kick);
+    return 1;
+}
+
+uint32_t aio_submit_batch(aio_request_t **reqs, uint32_t count) {
+    struct { aio_queue_t *q; aio_request_t *head, *tail; } chains[AIO_MAX_QUEUES];
+    uint32_t nchains = 0, accepted = 0;
+
+    // Chain the requests per queue first, so each lock is taken once
+    for (uint32_t i = 0; i < count; i++) {
+        if (!claim(reqs[i])) continue;
+        aio_queue_t *q = queue_for(reqs[i]->node);
+        uint32_t c = 0;
+        while (c < nchains && chains[c].q != q) c++;
+        if (c == nchains) {
+            chains[c].q = q;
+            chains[c].head = chains[c].tail = 0;
+            nchains++;
+        }
+        if (chains[c].tail) chains[c].tail->next = reqs[i];
+        else chains[c].head = reqs[i];
+        chains[c].tail = reqs[i];
+    }
+
+    for (uint32_t c = 0; c < nchains; c++) {
+        aio_queue_t *q = chains[c].q;
+        uint64_t flags = spin_lock_irqsave(&q->lock);
+        for (aio_request_t *req = chains[c].head, *next; req; req = next) {
+            next = req->next;
+            req->next = 0;
+            enqueue_locked(q, req);
+            accepted++;
+        }
+        spin_unlock_irqrestore(&q->lock, flags);
+        sched_event_signal(&q->kick);
+    }
+    return accepted;
+}
+
+int aio_cancel(aio_request_t *req) {
+    aio_queue_t *q = req->queue;
+    if (!q || __atomic_load_n(&req->state, __ATOMIC_ACQUIRE) != AIO_QUEUED) return 0;
+
+    int found = 0;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    aio_request_t *prev = 0;
+    for (aio_request_t *r = q->head; r; prev = r, r = r->next) {
+        if (r != req) continue;
+        if (prev) prev->next = r->next;
+        else q->head = r->next;
+        if (q->tail == r) q->tail = prev;
+        q->depth--;
+        q->cancelled++;
+        r->next = 0;
+        __atomic_store_n(&r->state, AIO_CANCELLED, __ATOMIC_RELEASE);
+        found = 1;
+        break;
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+    return found;
+}
+
+void aio_complete(aio_request_t *req, uint32_t result) {
+    aio_queue_t *q = req->queue;
+    aio_callback_t callback = req->callback;
+    aio_cq_t *cq = req->cq;
+
+    req->result = result;
+    req->complete_ns = ktime_get_ns();
+    if (q) {
+        __atomic_fetch_add(&q->completed, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&q->bytes, result, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&q->latency_ns, req->complete_ns - req->submit_ns, __ATOMIC_RELAXED);
+    }
+    // Not resubmittable until it is off every list but the cq
+    __atomic_store_n(&req->state, AIO_COMPLETING, __ATOMIC_RELEASE);
+    if (cq) cq_post(cq, req);
+    else __atomic_store_n(&req->state, AIO_DONE, __ATOMIC_RELEASE);
+
+    if (callback) callback(req);
+}
+
+/* --- Workers --- */
+
+static aio_request_t *dequeue(aio_queue_t *q) {
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    aio_request_t *req = q->head;
+    if (req) {
+        q->head = req->next;
+        if (!q->head) q->tail = 0;
+        q->depth--;
+        req->next = 0;
+        req->state = AIO_RUNNING; // From here aio_cancel() leaves it alone
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+    return req;
+}
+
+static void aio_worker(void *arg) {
+    aio_queue_t *q = arg;
+    for (;;) {
+        aio_request_t *req = dequeue(q);
+        if (!req) {
+            sched_event_wait(&q->kick, 0);
+            continue;
+        }
+        if (q->start && q->start(req)) continue; // Completes on its own
+
+        uint32_t n;
+        if (req->op == AIO_WRITE) n = vfs_write(req->node, req->offset, req->size, req->buffer);
+        else n = vfs_read(req->node, req->offset, req->size, req->buffer);
+        aio_complete(req, n);
+    }
+}
+
+static aio_queue_t *queue_create(const char *name, const void *key, aio_start_t start) {
+    if (queue_count >= AIO_MAX_QUEUES) return 0;
+    aio_queue_t *q = &queues[queue_count];
+    q->name = name;
+    q->key = key;
+    q->start = start;
+    q->lock = (spinlock_t)SPINLOCK_INIT;
+    q->lock_stats.name = "aio";
+    q->lock.stats = &q->lock_stats;
+
+    char tname[TASK_NAME_LEN] = "aio/";
+    uint32_t i = 4;
+    for (const char *c = name; *c && i < TASK_NAME_LEN - 1; c++) tname[i++] = *c;
+    tname[i] = 0;
+    q->worker = task_create(tname, aio_worker, q, SCHED_PRIO_HIGH, TASK_ANY_CPU);
+    if (!q->worker) return 0;
+
+    __atomic_store_n(&queue_count, queue_count + 1, __ATOMIC_RELEASE);
+    return q;
+}
+
+int aio_device_register(const char *name, fs_node_t *node, aio_start_t start) {
+    if (!node || (!node->ops->read && !node->ops->write)) return 0;
+    const void *key = device_key(node);
+    for (uint32_t i = 1; i < queue_count; i++) {
+        if (queues[i].key == key) return 1;
+    }
+    return queue_create(name, key, start) != 0;
+}
+
+/* --- Shell --- */
+
+void aio_dump() {
+    for (uint32_t i = 0; i < queue_count; i++) {
+        aio_queue_t *q = &queues[i];
+        serial_print("[AIO] ");
+        serial_print(q->name);
+        serial_print(": submitted ");
+        serial_print_dec(q->submitted);
+        serial_print(", done ");
+        serial_print_dec(q->completed);
+        serial_print(", cancelled ");
+        serial_print_dec(q->cancelled);
+        serial_print(", queued ");
+        serial_print_dec(q->depth);
+        serial_print(" (max ");
+        serial_print_dec(q->max_depth);
+        serial_print("), ");
+        serial_print_dec(q->bytes / 1024);
+        serial_print(" KiB");
+        if (q->completed) {
+            serial_print(", avg ");
+            serial_print_dec(q->latency_ns / q->completed / 1000);
+            serial_print(" us");
+        }
+        serial_print("\n");
+    }
+}
+
+#define AIO_TEST_CHUNK PAGE_SIZE
+#define AIO_TEST_MAX   64 // Chunks per "aio <path>" run
+
+/* "aio <path>": read a file as one batch of page-sized requests */
+static void aio_test(const char *path) {
+    fs_node_t *node = vfs_lookup(path);
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY) {
+        serial_print("[AIO] No such file.\n");
+        return;
+    }
+    vfs_open(node);
+
+    uint64_t size = node->length ? node->length : 1;
+    uint32_t chunks = AIO_TEST_MAX;
+    if (size < (uint64_t)AIO_TEST_MAX * AIO_TEST_CHUNK) chunks = (size + AIO_TEST_CHUNK - 1) / AIO_TEST_CHUNK;
+    uint32_t req_pages = (chunks * sizeof(aio_request_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint8_t *buf = pmm_alloc(chunks);
+    aio_request_t *reqs = pmm_alloc(req_pages);
+    if (!buf || !reqs) {
+        if (buf) pmm_free(buf, chunks);
+        if (reqs) pmm_free(reqs, req_pages);
+        vfs_close(node);
+        serial_print("[AIO] Out of memory.\n");
+        return;
+    }
+
+    static aio_request_t *batch[AIO_TEST_MAX];
+    aio_cq_t cq;
+    aio_cq_init(&cq, 0);
+    for (uint32_t i = 0; i < chunks; i++) {
+        aio_prep(&reqs[i], AIO_READ, node, i * AIO_TEST_CHUNK, AIO_TEST_CHUNK,
+                 buf + i * AIO_TEST_CHUNK, 0, &cq, 0);
+        batch[i] = &reqs[i];
+    }
+
+    uint64_t start = ktime_get_ns();
+    uint32_t n = aio_submit_batch(batch, chunks);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < n; i++) bytes += aio_wait(&cq, 0)->result;
+    uint64_t ns = ktime_get_ns() - start;
+
+    serial_print("[AIO] ");
+    serial_print_dec(n);
+    serial_print(" requests, ");
+    serial_print_dec(bytes);
+    serial_print(" bytes in ");
+    serial_print_dec(ns / 1000);
+    serial_print(" us\n");
+
+    pmm_free(reqs, req_pages);
+    pmm_free(buf, chunks);
+    vfs_close(node);
+}
+
+static void aio_command(const char *args) {
+    while (args && *args == ' ') args++;
+    if (args && *args) aio_test(args);
+    else aio_dump();
+}
+
+void aio_init() {
+    queue_create("default", 0, 0);
+    serial_register_command("aio", aio_command);
+}
@@ -0,0 +1,121 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stdint.h>
+#include "vfs.h"
+#include "sync.h"
+#include "sched.h"
+
+/*
+ * Asynchronous file I/O.
+ *
+ * A request names a node, an offset, a buffer and what to do when it is
+ * finished. aio_submit() queues it on the queue of the device serving the
+ * node and returns at once; that queue's worker thread performs the
+ * vfs_read()/vfs_write() (so FS_CACHED nodes still go through the page
+ * cache) and completes it. A device queue may also have a start hook: the
+ * worker offers it each request first, and a request it takes is finished
+ * later with aio_complete(), normally from the driver's completion path,
+ * so the worker moves on without waiting for the hardware.
+ *
+ * On completion the request is appended to its completion queue, if it has
+ * one, and marked done; then its callback runs in the completing context.
+ * With a cq the consumer may already own the request again by then, so
+ * such a callback should only look at what it knows stays put (arg). A
+ * completion queue is drained by one consumer with aio_poll() or aio_wait();
+ * it can also signal an event the consumer already sleeps on, so the UI
+ * thread picks up loaded assets between frames instead of blocking in one.
+ *
+ * Requests are owned by the submitter and must stay put until completed or
+ * cancelled. A callback may free its request only when it has no cq.
+ */
+
+#define AIO_MAX_QUEUES 8    // Queue 0 serves every node without a device queue
+
+typedef enum {
+    AIO_READ,
+    AIO_WRITE
+} aio_op_t;
+
+typedef enum {
+    AIO_IDLE,
+    AIO_QUEUED,
+    AIO_RUNNING,
+    AIO_COMPLETING,             // Being posted; can't be resubmitted yet
+    AIO_DONE,
+    AIO_CANCELLED
+} aio_state_t;
+
+typedef struct aio_request aio_request_t;
+typedef struct aio_cq aio_cq_t;
+typedef void (*aio_callback_t)(aio_request_t *req);
+
+struct aio_request {
+    /* Set by the submitter */
+    uint32_t op;                // aio_op_t
+    fs_node_t *node;
+    uint64_t offset;
+    uint32_t size;
+    uint8_t *buffer;
+    aio_callback_t callback;    // May be 0
+    aio_cq_t *cq;               // May be 0
+    void *arg;
+
+    /* Set by the I/O layer */
+    volatile uint32_t state;    // aio_state_t
+    uint32_t result;            // Bytes transferred
+    uint64_t submit_ns;
+    uint64_t complete_ns;
+    aio_request_t *next;
+    void *queue;
+};
+
+struct aio_cq {
+    spinlock_t lock;
+    aio_request_t *head;
+    aio_request_t *tail;
+    uint32_t count;
+    sched_event_t own_event;
+    sched_event_t *event;       // Signaled on every completion
+};
+
+void aio_init(); // After sched_init(); starts the default queue's worker
+
+/* Starts a request without waiting for it; 0 leaves it to the worker's
+ * vfs_read()/vfs_write(). Runs in the worker thread. */
+typedef int (*aio_start_t)(aio_request_t *req);
+
+/* Give nodes sharing `node`'s ops table a queue and worker of their
+ * own, so a slow device never holds up requests for another. start may
+ * be 0. 0 if full. */
+int aio_device_register(const char *name, fs_node_t *node, aio_start_t start);
+
+/* Fill in the common fields of a request; buffer must hold `size` bytes */
+void aio_prep(aio_request_t *req, aio_op_t op, fs_node_t *node, uint64_t offset,
+              uint32_t size, void *buffer, aio_callback_t callback, aio_cq_t *cq, void *arg);
+
+/* 0 if the request is already in flight or has no node */
+int aio_submit(aio_request_t *req);
+/* Queues all of them taking each queue's lock and waking its worker once;
+ * returns how many were accepted */
+uint32_t aio_submit_batch(aio_request_t **reqs, uint32_t count);
+
+/* 1 if the request was still queued and now won't run (it is not posted to
+ * its cq and its callback is not called) */
+int aio_cancel(aio_request_t *req);
+
+/* For start hooks' completions; safe in interrupt context */
+void aio_complete(aio_request_t *req, uint32_t result);
+
+static inline int aio_done(aio_request_t *req) {
+    return __atomic_load_n(&req->state, __ATOMIC_ACQUIRE) == AIO_DONE;
+}
+
+/* notify: event to signal on completion instead of the queue's own, or 0 */
+void aio_cq_init(aio_cq_t *cq, sched_event_t *notify);
+aio_request_t *aio_poll(aio_cq_t *cq);                       // 0 if empty
+aio_request_t *aio_wait(aio_cq_t *cq, uint64_t timeout_ns);  // 0 = no timeout
+
+void aio_dump();
+
+#endif
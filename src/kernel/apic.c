@@ -0,0 +1,221 @@
+#include "apic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "memory/vmm.h"
+
+/* MADT entry types */
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_ISO            2
+#define MADT_LAPIC_NMI      4
+#define MADT_LAPIC_OVERRIDE 5
+#define MADT_X2APIC         9
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) madt_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    uint8_t id;
+    volatile uint32_t *regs;
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+} ioapic_t;
+
+typedef struct {
+    uint32_t gsi;
+    uint16_t flags;
+    uint8_t present;
+} irq_override_t;
+
+static volatile uint32_t *lapic_regs = 0;
+static ioapic_t ioapics[APIC_MAX_IOAPICS];
+static int ioapic_count = 0;
+static irq_override_t overrides[16];
+static uint32_t cpu_ids[APIC_MAX_CPUS];
+static uint32_t cpu_count = 0;
+static uint8_t lint_nmi_pin = 0xFF;
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic_regs[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_regs[reg / 4] = value;
+}
+
+uint32_t lapic_id() {
+    return lapic_regs ? lapic_read(LAPIC_ID) >> 24 : 0;
+}
+
+void lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    while (lapic_read(LAPIC_ICR_LOW) & (1 << 12)); // Delivery pending
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, vector);
+}
+
+static uint32_t ioapic_read(ioapic_t *io, uint32_t reg) {
+    io->regs[0] = reg;
+    return io->regs[4];
+}
+
+static void ioapic_write(ioapic_t *io, uint32_t reg, uint32_t value) {
+    io->regs[0] = reg;
+    io->regs[4] = value;
+}
+
+static ioapic_t *ioapic_for_gsi(uint32_t gsi) {
+    for (int i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].gsi_count) return &ioapics[i];
+    }
+    return 0;
+}
+
+int ioapic_route_gsi(uint32_t gsi, uint8_t vector, uint32_t dest_apic_id, int level, int active_low) {
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return 0;
+
+    uint32_t pin = gsi - io->gsi_base;
+    uint32_t low = vector;          // Fixed delivery, physical destination
+    if (active_low) low |= 1 << 13;
+    if (level) low |= 1 << 15;
+
+    ioapic_write(io, 0x10 + pin * 2 + 1, dest_apic_id << 24);
+    ioapic_write(io, 0x10 + pin * 2, low);
+    return 1;
+}
+
+int ioapic_route_irq(uint8_t irq, uint8_t vector, uint32_t dest_apic_id) {
+    uint32_t gsi = irq;
+    int level = 0, active_low = 0; // ISA default: edge, active high
+
+    if (irq < 16 && overrides[irq].present) {
+        gsi = overrides[irq].gsi;
+        uint16_t polarity = overrides[irq].flags & 0x3;
+        uint16_t trigger = (overrides[irq].flags >> 2) & 0x3;
+        if (polarity == 3) active_low = 1;
+        if (trigger == 3) level = 1;
+    }
+    return ioapic_route_gsi(gsi, vector, dest_apic_id, level, active_low);
+}
+
+void ioapic_mask_gsi(uint32_t gsi, int masked) {
+    ioapic_t *io = ioapic_for_gsi(gsi);
+    if (!io) return;
+    uint32_t reg = 0x10 + (gsi - io->gsi_base) * 2;
+    uint32_t low = ioapic_read(io, reg);
+    ioapic_write(io, reg, masked ? (low | LAPIC_LVT_MASKED) : (low & ~LAPIC_LVT_MASKED));
+}
+
+static void parse_madt(madt_t *madt, uint64_t *lapic_phys) {
+    *lapic_phys = madt->lapic_address;
+
+    uint8_t *p = (uint8_t *)madt + sizeof(madt_t);
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    while (p + sizeof(madt_entry_t) <= end) {
+        madt_entry_t *e = (madt_entry_t *)p;
+        if (e->length < 2) break;
+
+        switch (e->type) {
+        case MADT_LAPIC: {
+            uint8_t apic_id = p[3];
+            uint32_t flags = *(uint32_t *)(p + 4);
+            if ((flags & 3) && cpu_count < APIC_MAX_CPUS) cpu_ids[cpu_count++] = apic_id;
+            break;
+        }
+        case MADT_X2APIC: {
+            uint32_t apic_id = *(uint32_t *)(p + 4);
+            uint32_t flags = *(uint32_t *)(p + 8);
+            if ((flags & 3) && cpu_count < APIC_MAX_CPUS) cpu_ids[cpu_count++] = apic_id;
+            break;
+        }
+        case MADT_IOAPIC:
+            if (ioapic_count < APIC_MAX_IOAPICS) {
+                ioapic_t *io = &ioapics[ioapic_count];
+                io->id = p[2];
+                io->regs = vmm_map_mmio(*(uint32_t *)(p + 4), 0x20);
+                io->gsi_base = *(uint32_t *)(p + 8);
+                if (io->regs) ioapic_count++;
+            }
+            break;
+        case MADT_ISO: {
+            uint8_t source = p[3];
+            if (source < 16) {
+                overrides[source].gsi = *(uint32_t *)(p + 4);
+                overrides[source].flags = *(uint16_t *)(p + 8);
+                overrides[source].present = 1;
+            }
+            break;
+        }
+        case MADT_LAPIC_NMI:
+            if (p[2] == 0xFF || p[2] == 0) lint_nmi_pin = p[5];
+            break;
+        case MADT_LAPIC_OVERRIDE:
+            *lapic_phys = *(uint64_t *)(p + 4);
+            break;
+        }
+        p += e->length;
+    }
+}
+
+void lapic_init() {
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | (1 << 11));
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    if (lint_nmi_pin <= 1)
+        lapic_write(lint_nmi_pin ? LAPIC_LVT_LINT1 : LAPIC_LVT_LINT0, 4 << 8); // NMI delivery
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, 0x100 | APIC_SPURIOUS_VECTOR);
+    lapic_eoi();
+}
+
+int apic_init() {
+    madt_t *madt = (madt_t *)acpi_find_table("APIC");
+    if (!madt) return 0;
+
+    uint64_t lapic_phys;
+    parse_madt(madt, &lapic_phys);
+    lapic_regs = vmm_map_mmio(lapic_phys, 0x1000);
+    if (!lapic_regs || ioapic_count == 0) {
+        lapic_regs = 0;
+        return 0;
+    }
+
+    lapic_init();
+
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapic_t *io = &ioapics[i];
+        io->gsi_count = ((ioapic_read(io, 1) >> 16) & 0xFF) + 1;
+        for (uint32_t pin = 0; pin < io->gsi_count; pin++) {
+            ioapic_write(io, 0x10 + pin * 2, LAPIC_LVT_MASKED);
+        }
+    }
+    return 1;
+}
+
+int apic_available() {
+    return lapic_regs != 0;
+}
+
+uint32_t apic_cpu_count() {
+    return cpu_count;
+}
+
+uint32_t apic_cpu_id(uint32_t index) {
+    return index < cpu_count ? cpu_ids[index] : 0;
+}
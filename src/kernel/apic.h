@@ -0,0 +1,50 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+#define APIC_MAX_CPUS        64
+#define APIC_MAX_IOAPICS     8
+
+/* Local APIC register offsets */
+#define LAPIC_ID          0x020
+#define LAPIC_VERSION     0x030
+#define LAPIC_TPR         0x080
+#define LAPIC_EOI         0x0B0
+#define LAPIC_SVR         0x0F0
+#define LAPIC_ESR         0x280
+#define LAPIC_ICR_LOW     0x300
+#define LAPIC_ICR_HIGH    0x310
+#define LAPIC_LVT_TIMER   0x320
+#define LAPIC_LVT_LINT0   0x350
+#define LAPIC_LVT_LINT1   0x360
+#define LAPIC_LVT_ERROR   0x370
+#define LAPIC_TIMER_INIT  0x380
+#define LAPIC_TIMER_COUNT 0x390
+#define LAPIC_TIMER_DIV   0x3E0
+
+#define LAPIC_LVT_MASKED  (1 << 16)
+
+/* Parses the MADT and brings up the BSP's LAPIC and every IOAPIC with all
+ * redirection entries masked. Returns 0 if no usable MADT was found. */
+int apic_init();
+int apic_available();
+
+void lapic_init();          // Per-CPU LAPIC enable (BSP and APs)
+uint32_t lapic_id();
+void lapic_eoi();
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/* Route an ISA IRQ (after MADT source overrides) or a raw GSI to a vector */
+int ioapic_route_irq(uint8_t irq, uint8_t vector, uint32_t dest_apic_id);
+int ioapic_route_gsi(uint32_t gsi, uint8_t vector, uint32_t dest_apic_id, int level, int active_low);
+void ioapic_mask_gsi(uint32_t gsi, int masked);
+
+/* CPUs listed in the MADT (enabled or online-capable) */
+uint32_t apic_cpu_count();
+uint32_t apic_cpu_id(uint32_t index);
+
+#endif
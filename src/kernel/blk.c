@@ -0,0 +1,646 @@
+#include "blk.h"
+#include "sched.h"
+#include "smp.h"
+#include "timer.h"
+#include "serial.h"
+#include "devfs.h"
+#include "aio.h"
+#include "pagecache.h"
+#include "memory/pmm.h"
+#include "memory/slab.h"
+#include "memory/vmm.h"
+
+static blk_device_t *devices[BLK_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+static void node_setup(blk_device_t *dev);
+
+int blk_register(blk_device_t *dev) {
+    if (device_count == BLK_MAX_DEVICES || !dev->nr_hw_queues || dev->nr_hw_queues > BLK_MAX_HW_QUEUES) return 0;
+    for (uint32_t i = 0; i < dev->nr_hw_queues; i++) {
+        blk_hw_queue_t *q = &dev->hw[i];
+        q->lock = (spinlock_t)SPINLOCK_INIT;
+        q->lock_stats.name = "blk";
+        q->lock.stats = &q->lock_stats;
+    }
+    devices[device_count++] = dev;
+    node_setup(dev);
+
+    serial_print("[BLK] ");
+    serial_print(dev->name);
+    serial_print(": ");
+    serial_print_dec(dev->sectors * BLK_SECTOR_SIZE / (1024 * 1024));
+    serial_print(" MiB, ");
+    serial_print_dec(dev->nr_hw_queues);
+    serial_print(dev->nr_hw_queues == 1 ? " queue" : " queues");
+    serial_print(dev->read_only ? ", read-only\n" : "\n");
+    return 1;
+}
+
+blk_device_t *blk_get(const char *name) {
+    if (!name || !*name) return device_count ? devices[0] : 0;
+    for (uint32_t i = 0; i < device_count; i++) {
+        const char *a = devices[i]->name, *b = name;
+        while (*a && *a == *b) a++, b++;
+        if (!*a && (!*b || *b == ' ')) return devices[i];
+    }
+    return 0;
+}
+
+int blk_prep(blk_request_t *req, blk_op_t op, uint64_t sector, void *buf, uint32_t bytes,
+             blk_callback_t done, void *arg) {
+    req->op = op;
+    req->sector = sector;
+    req->count = bytes / BLK_SECTOR_SIZE;
+    req->nsegs = 0;
+    req->done = done;
+    req->arg = arg;
+    req->next = 0;
+    req->merged = 0;
+    req->merged_tail = 0;
+    if (bytes % BLK_SECTOR_SIZE) return 0;
+
+    // One segment per physically contiguous run of the buffer
+    uint64_t virt = (uint64_t)(uintptr_t)buf;
+    while (bytes) {
+        uint32_t len = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+        if (len > bytes) len = bytes;
+        uint64_t phys = vmm_virt_to_phys(virt);
+        if (!phys) return 0;
+        blk_seg_t *last = req->nsegs ? &req->segs[req->nsegs - 1] : 0;
+        if (last && last->phys + last->len == phys) {
+            last->len += len;
+        } else {
+            if (req->nsegs == BLK_REQ_SEGS) return 0;
+            req->segs[req->nsegs].phys = phys;
+            req->segs[req->nsegs].len = len;
+            req->nsegs++;
+        }
+        virt += len;
+        bytes -= len;
+    }
+    return 1;
+}
+
+/* --- Software queues --- */
+
+/* b starts where a's chain ends and the two fit in one dispatch */
+static int mergeable(blk_device_t *dev, blk_request_t *a, blk_request_t *b) {
+    return a->op == b->op && a->op != BLK_FLUSH &&
+           a->sector + a->total_count == b->sector &&
+           a->total_count + b->total_count <= dev->max_sectors &&
+           a->total_segs + b->total_segs <= dev->max_segs;
+}
+
+/* Append b's chain to a's */
+static void absorb(blk_request_t *a, blk_request_t *b) {
+    blk_request_t *last = a->merged_tail ? a->merged_tail : a;
+    last->merged = b;
+    a->merged_tail = b->merged_tail ? b->merged_tail : b;
+    b->merged_tail = 0;
+    a->total_count += b->total_count;
+    a->total_segs += b->total_segs;
+}
+
+/* Queue behind everything waiting, or fold into a waiting neighbour.
+ * Only requests after the last flush are merge candidates. Lock held. */
+static void enqueue(blk_device_t *dev, blk_hw_queue_t *q, blk_request_t *req) {
+    blk_request_t **scan = &q->head;
+    blk_request_t **link = &q->head;
+    for (; *link; link = &(*link)->next) {
+        if ((*link)->op == BLK_FLUSH) scan = &(*link)->next;
+    }
+
+    for (blk_request_t **l = scan; req->op != BLK_FLUSH && *l; l = &(*l)->next) {
+        blk_request_t *e = *l;
+        if (mergeable(dev, e, req)) {
+            absorb(e, req);
+            q->merged++;
+            // The gap req filled may have been all that separated e from another
+            for (blk_request_t **m = scan; *m; m = &(*m)->next) {
+                blk_request_t *f = *m;
+                if (f == e || !mergeable(dev, e, f)) continue;
+                *m = f->next;
+                absorb(e, f);
+                q->waiting--;
+                q->merged++;
+                break;
+            }
+            return;
+        }
+        if (mergeable(dev, req, e)) {
+            req->next = e->next;
+            absorb(req, e);
+            *l = req;
+            q->merged++;
+            return;
+        }
+    }
+
+    req->next = 0;
+    *link = req;
+    q->waiting++;
+}
+
+static int request_ok(blk_device_t *dev, blk_request_t *req) {
+    if (req->op == BLK_FLUSH) return 1;
+    if (req->op != BLK_READ && req->op != BLK_WRITE) return 0;
+    if (req->op == BLK_WRITE && dev->read_only) return 0;
+    if (!req->count || !req->nsegs || req->nsegs > BLK_REQ_SEGS) return 0;
+    if (req->nsegs > dev->max_segs || req->count > dev->max_sectors) return 0;
+    return req->sector < dev->sectors && req->count <= dev->sectors - req->sector;
+}
+
+void blk_run_queue(blk_device_t *dev, uint32_t hwq) {
+    blk_hw_queue_t *q = &dev->hw[hwq];
+    uint32_t queued = 0;
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    while (q->head) {
+        blk_request_t *req = q->head;
+        if (!dev->ops->queue_rq(dev, hwq, req)) break;
+        q->head = req->next;
+        req->next = 0;
+        q->waiting--;
+        q->dispatched++;
+        __atomic_add_fetch(&q->in_flight, 1, __ATOMIC_RELAXED);
+        queued++;
+    }
+    // One doorbell for the whole run
+    if (queued) dev->ops->commit(dev, hwq);
+    spin_unlock_irqrestore(&q->lock, flags);
+}
+
+uint32_t blk_submit_batch(blk_device_t *dev, blk_request_t **reqs, uint32_t count) {
+    if (!dev) return 0;
+    uint32_t hwq = this_cpu()->cpu_id % dev->nr_hw_queues;
+    blk_hw_queue_t *q = &dev->hw[hwq];
+    uint64_t now = ktime_get_ns();
+    uint32_t accepted = 0;
+
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        blk_request_t *req = reqs[i];
+        if (!request_ok(dev, req)) continue;
+        req->status = BLK_OK;
+        req->submit_ns = now;
+        req->merged = 0;
+        req->merged_tail = 0;
+        req->total_count = req->op == BLK_FLUSH ? 0 : req->count;
+        req->total_segs = req->op == BLK_FLUSH ? 0 : req->nsegs;
+        req->hwq = hwq;
+        q->submitted++;
+        enqueue(dev, q, req);
+        accepted++;
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    if (accepted) blk_run_queue(dev, hwq);
+    return accepted;
+}
+
+int blk_submit(blk_device_t *dev, blk_request_t *req) {
+    return blk_submit_batch(dev, &req, 1) == 1;
+}
+
+void blk_complete(blk_device_t *dev, blk_request_t *req, int status) {
+    blk_hw_queue_t *q = &dev->hw[req->hwq];
+    __atomic_sub_fetch(&q->in_flight, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->completed, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->sectors, req->total_count, __ATOMIC_RELAXED);
+    if (status != BLK_OK) __atomic_add_fetch(&q->errors, 1, __ATOMIC_RELAXED);
+
+    while (req) {
+        blk_request_t *next = req->merged; // The callback may reuse req
+        req->merged = 0;
+        req->merged_tail = 0;
+        req->status = status;
+        if (req->done) req->done(req);
+        req = next;
+    }
+}
+
+/* --- Synchronous I/O --- */
+
+/* Waits for `left` requests; status is the last error seen. Lives on the
+ * waiter's stack, so completions signal under the lock and the waiter
+ * only returns after taking it: by then no completer still touches it. */
+typedef struct {
+    spinlock_t lock;
+    sched_event_t event;
+    uint32_t left;
+    int status;
+} blk_waiter_t;
+
+static void waiter_drop(blk_waiter_t *w, uint32_t n, int status) {
+    uint64_t flags = spin_lock_irqsave(&w->lock);
+    if (status != BLK_OK) w->status = status;
+    w->left -= n;
+    if (!w->left) sched_event_signal(&w->event);
+    spin_unlock_irqrestore(&w->lock, flags);
+}
+
+static void rw_done(blk_request_t *req) {
+    waiter_drop(req->arg, 1, req->status);
+}
+
+static int rw_wait(blk_waiter_t *w) {
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&w->lock);
+        uint32_t left = w->left;
+        spin_unlock_irqrestore(&w->lock, flags);
+        if (!left) return w->status;
+        sched_event_wait(&w->event, 0);
+    }
+}
+
+int blk_rw(blk_device_t *dev, blk_op_t op, uint64_t sector, void *buf, uint32_t bytes) {
+    blk_request_t req;
+    blk_waiter_t w = { SPINLOCK_INIT, { 0, 0 }, 1, BLK_OK };
+    if (!dev || !blk_prep(&req, op, sector, buf, bytes, rw_done, &w)) return BLK_EIO;
+    if (!blk_submit(dev, &req)) return BLK_EIO;
+    return rw_wait(&w);
+}
+
+/* --- /dev/<name> --- */
+
+/* One segment is kept spare for a buffer that doesn't start on a page */
+#define NODE_CHUNK ((BLK_REQ_SEGS - 1) * PAGE_SIZE)
+#define NODE_BATCH 4
+
+/* The page cache only ever asks for whole pages inside the device, which
+ * is a whole number of sectors; split that into chunks one request can
+ * carry and submit them as a batch, so the layer merges them back into
+ * as few device requests as its limits allow. */
+static uint32_t node_io(fs_node_t *node, blk_op_t op, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    blk_device_t *dev = (blk_device_t *)(uintptr_t)node->impl;
+    uint64_t capacity = dev->sectors * BLK_SECTOR_SIZE;
+    if (offset >= capacity || offset % BLK_SECTOR_SIZE || (op == BLK_WRITE && dev->read_only)) return 0;
+    if (size > capacity - offset) size = capacity - offset;
+    size -= size % BLK_SECTOR_SIZE;
+
+    blk_request_t reqs[NODE_BATCH];
+    blk_request_t *batch[NODE_BATCH];
+    uint32_t done = 0;
+    while (done < size) {
+        blk_waiter_t w = { SPINLOCK_INIT, { 0, 0 }, 0, BLK_OK };
+        uint32_t n = 0, bytes = 0;
+        while (n < NODE_BATCH && done + bytes < size) {
+            uint32_t chunk = size - done - bytes;
+            if (chunk > NODE_CHUNK) chunk = NODE_CHUNK;
+            if (!blk_prep(&reqs[n], op, (offset + done + bytes) / BLK_SECTOR_SIZE,
+                          buffer + done + bytes, chunk, rw_done, &w)) break;
+            batch[n] = &reqs[n];
+            n++;
+            bytes += chunk;
+        }
+        if (!n) break;
+        w.left = n;
+        // Rejected requests never complete; wait only for the rest
+        uint32_t queued = blk_submit_batch(dev, batch, n);
+        if (queued < n) waiter_drop(&w, n - queued, BLK_EIO);
+        if (rw_wait(&w) != BLK_OK) break;
+        done += bytes;
+    }
+    return done;
+}
+
+static uint32_t node_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    return node_io(node, BLK_READ, offset, size, buffer);
+}
+
+static uint32_t node_write(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    return node_io(node, BLK_WRITE, offset, size, buffer);
+}
+
+/* aio reads that miss the page cache entirely go straight to the device
+ * and complete from the driver's completion path. Everything else is left
+ * to the aio worker, which goes through the cache: a write around it
+ * could leave the cache holding stale pages. */
+static void aio_read_done(blk_request_t *breq) {
+    aio_request_t *req = breq->arg;
+    uint32_t bytes = breq->status == BLK_OK ? breq->count * BLK_SECTOR_SIZE : 0;
+    kfree(breq);
+    aio_complete(req, bytes);
+}
+
+static int node_aio_start(aio_request_t *req) {
+    fs_node_t *node = req->node;
+    blk_device_t *dev = (blk_device_t *)(uintptr_t)node->impl;
+    if (req->op != AIO_READ || req->offset >= node->length) return 0;
+    uint32_t size = req->size;
+    if (size > node->length - req->offset) size = node->length - req->offset;
+    if (!size || req->offset % BLK_SECTOR_SIZE || size % BLK_SECTOR_SIZE) return 0;
+    if (pagecache_holds(node, req->offset, size)) return 0;
+
+    blk_request_t *breq = kmalloc(sizeof(blk_request_t));
+    if (!breq) return 0;
+    if (!blk_prep(breq, BLK_READ, req->offset / BLK_SECTOR_SIZE, req->buffer, size, aio_read_done, req) ||
+        !blk_submit(dev, breq)) {
+        kfree(breq);
+        return 0;
+    }
+    return 1;
+}
+
+static const fs_ops_t node_ops = {
+    .read = node_read,
+    .write = node_write,
+};
+
+static void node_setup(blk_device_t *dev) {
+    fs_node_t *node = &dev->node;
+    uint32_t len = 0;
+    while (dev->name[len]) len++;
+    node->ops = &node_ops;
+    node->impl = (uint64_t)(uintptr_t)dev;
+    node->length = dev->sectors * BLK_SECTOR_SIZE;
+    node->flags = FS_DEVICE | FS_CACHED;
+    node->mask = dev->read_only ? 0444 : 0644;
+    vfs_set_name(node, dev->name, len);
+    devfs_register(node);
+    aio_device_register("blk", node, node_aio_start); // One queue for every block device
+}
+
+/* --- Benchmark --- */
+
+#define BENCH_MAX_DEPTH 64
+#define BENCH_MAX_BS    (BLK_REQ_SEGS * PAGE_SIZE)
+#define BENCH_NS        2000000000ULL
+
+/* One per CPU, each pinned and keeping `depth` requests in flight */
+typedef struct {
+    blk_device_t *dev;
+    int write;
+    int random;
+    uint32_t bs;                // Bytes per request
+    uint32_t depth;
+    uint64_t first, span;       // Sectors this job covers
+    uint64_t cursor;
+    uint64_t seed;
+    uint64_t deadline;
+    blk_request_t *reqs;
+    uint8_t *buf;
+    uint32_t req_pages, buf_pages;
+
+    spinlock_t lock;
+    blk_request_t *done_head;   // Completed, waiting for the job to refill
+    sched_event_t event;
+
+    uint64_t ios;
+    uint64_t errors;
+    uint64_t latency_ns;
+} bench_job_t;
+
+static bench_job_t bench_jobs[MAX_CPUS];
+static volatile uint32_t bench_left = 0;
+static sched_event_t bench_finished;
+static volatile int bench_running = 0;
+
+static void bench_done(blk_request_t *req) {
+    bench_job_t *job = req->arg;
+    uint64_t flags = spin_lock_irqsave(&job->lock);
+    req->next = job->done_head;
+    job->done_head = req;
+    spin_unlock_irqrestore(&job->lock, flags);
+    sched_event_signal(&job->event);
+}
+
+static void bench_prep(bench_job_t *job, uint32_t slot) {
+    uint64_t per = job->bs / BLK_SECTOR_SIZE;
+    uint64_t sector;
+    if (job->random) {
+        job->seed ^= job->seed << 13;
+        job->seed ^= job->seed >> 7;
+        job->seed ^= job->seed << 17;
+        sector = (job->seed % (job->span / per)) * per;
+    } else {
+        if (job->cursor + per > job->span) job->cursor = 0;
+        sector = job->cursor;
+        job->cursor += per;
+    }
+    blk_prep(&job->reqs[slot], job->write ? BLK_WRITE : BLK_READ, job->first + sector,
+             job->buf + (uint64_t)slot * job->bs, job->bs, bench_done, job);
+}
+
+static void bench_job(void *arg) {
+    bench_job_t *job = arg;
+    blk_request_t *batch[BENCH_MAX_DEPTH];
+    for (uint32_t i = 0; i < job->depth; i++) {
+        bench_prep(job, i);
+        batch[i] = &job->reqs[i];
+    }
+    uint32_t in_flight = blk_submit_batch(job->dev, batch, job->depth);
+
+    while (in_flight) {
+        sched_event_wait(&job->event, 0);
+        uint64_t flags = spin_lock_irqsave(&job->lock);
+        blk_request_t *req = job->done_head;
+        job->done_head = 0;
+        spin_unlock_irqrestore(&job->lock, flags);
+
+        // Everything that came back goes out again as one batch
+        uint64_t now = ktime_get_ns();
+        uint32_t n = 0;
+        while (req) {
+            blk_request_t *next = req->next;
+            in_flight--;
+            job->ios++;
+            job->latency_ns += now - req->submit_ns;
+            if (req->status != BLK_OK) job->errors++;
+            if (now < job->deadline) {
+                uint32_t slot = req - job->reqs;
+                bench_prep(job, slot);
+                batch[n++] = req;
+            }
+            req = next;
+        }
+        in_flight += blk_submit_batch(job->dev, batch, n);
+    }
+
+    if (__atomic_sub_fetch(&bench_left, 1, __ATOMIC_ACQ_REL) == 0) sched_event_signal(&bench_finished);
+    task_exit();
+}
+
+static uint32_t parse_number(const char **s) {
+    uint32_t n = 0;
+    while (**s >= '0' && **s <= '9') n = n * 10 + (*(*s)++ - '0');
+    return n;
+}
+
+/* "blkbench [read|write] [seq|rand] [bs KiB] [depth]": every CPU drives
+ * its own queue for two seconds. Writes destroy the disk's contents. */
+static void blkbench_command(const char *args) {
+    blk_device_t *dev = blk_get(0);
+    int write = 0, random = 0;
+    uint32_t bs = 4096, depth = 32, numbers = 0;
+    while (*args) {
+        while (*args == ' ') args++;
+        if (*args >= '0' && *args <= '9') {
+            uint32_t n = parse_number(&args);
+            if (numbers++ == 0) bs = n * 1024;
+            else depth = n;
+        } else if (*args) {
+            if (args[0] == 'w') write = 1;
+            if (args[0] == 'r' && args[1] == 'a') random = 1;
+            while (*args && *args != ' ') args++;
+        }
+    }
+    if (!dev) {
+        serial_print("[BLK] No block device.\n");
+        return;
+    }
+    if (bs < BLK_SECTOR_SIZE || bs > BENCH_MAX_BS || bs % BLK_SECTOR_SIZE || !depth || depth > BENCH_MAX_DEPTH) {
+        serial_print("[BLK] Block size must be 1-64 KiB and depth 1-64.\n");
+        return;
+    }
+    if (write && dev->read_only) {
+        serial_print("[BLK] Device is read-only.\n");
+        return;
+    }
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&bench_running, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        serial_print("[BLK] Benchmark already running.\n");
+        return;
+    }
+
+    uint32_t jobs = smp_cpu_count();
+    uint64_t span = dev->sectors / jobs;
+    span -= span % (bs / BLK_SECTOR_SIZE);
+    if (span < bs / BLK_SECTOR_SIZE) {
+        jobs = 1;
+        span = dev->sectors - dev->sectors % (bs / BLK_SECTOR_SIZE);
+    }
+    uint64_t merged = 0, completed = 0;
+    for (uint32_t i = 0; i < dev->nr_hw_queues; i++) {
+        merged += dev->hw[i].merged;
+        completed += dev->hw[i].completed;
+    }
+
+    uint32_t started = 0;
+    bench_finished.signaled = 0;
+    bench_finished.waiter = 0;
+    bench_left = jobs;
+    uint64_t start = ktime_get_ns();
+    for (uint32_t c = 0; c < jobs; c++) {
+        bench_job_t *job = &bench_jobs[c];
+        job->dev = dev;
+        job->write = write;
+        job->random = random;
+        job->bs = bs;
+        job->depth = depth;
+        job->first = c * span;
+        job->span = span;
+        job->cursor = 0;
+        job->seed = 0x9E3779B97F4A7C15ULL * (c + 1);
+        job->deadline = start + BENCH_NS;
+        job->lock = (spinlock_t)SPINLOCK_INIT;
+        job->done_head = 0;
+        job->event.signaled = 0;
+        job->event.waiter = 0;
+        job->ios = job->errors = job->latency_ns = 0;
+        job->req_pages = (depth * sizeof(blk_request_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+        job->buf_pages = (depth * bs + PAGE_SIZE - 1) / PAGE_SIZE;
+        job->reqs = pmm_alloc(job->req_pages);
+        job->buf = pmm_alloc(job->buf_pages);
+        if (!job->reqs || !job->buf || !task_create("blkbench", bench_job, job, SCHED_PRIO_HIGH, c)) {
+            if (job->reqs) pmm_free(job->reqs, job->req_pages);
+            if (job->buf) pmm_free(job->buf, job->buf_pages);
+            job->reqs = 0;
+            job->buf = 0;
+            if (__atomic_sub_fetch(&bench_left, 1, __ATOMIC_ACQ_REL) == 0) sched_event_signal(&bench_finished);
+            continue;
+        }
+        started++;
+    }
+    while (__atomic_load_n(&bench_left, __ATOMIC_ACQUIRE)) sched_event_wait(&bench_finished, 0);
+    uint64_t ns = ktime_get_ns() - start;
+
+    uint64_t ios = 0, errors = 0, latency = 0;
+    for (uint32_t c = 0; c < jobs; c++) {
+        bench_job_t *job = &bench_jobs[c];
+        if (!job->reqs) continue;
+        ios += job->ios;
+        errors += job->errors;
+        latency += job->latency_ns;
+        pmm_free(job->reqs, job->req_pages);
+        pmm_free(job->buf, job->buf_pages);
+    }
+    uint64_t merged_before = merged, completed_before = completed;
+    merged = completed = 0;
+    for (uint32_t i = 0; i < dev->nr_hw_queues; i++) {
+        merged += dev->hw[i].merged;
+        completed += dev->hw[i].completed;
+    }
+    merged -= merged_before;
+    completed -= completed_before;
+    __atomic_store_n(&bench_running, 0, __ATOMIC_RELEASE);
+
+    serial_print("[BLK] ");
+    serial_print(dev->name);
+    serial_print(random ? " rand" : " seq");
+    serial_print(write ? " write, " : " read, ");
+    serial_print_dec(bs / 1024);
+    serial_print(" KiB x ");
+    serial_print_dec(depth);
+    serial_print(" deep on ");
+    serial_print_dec(started);
+    serial_print(" CPUs: ");
+    serial_print_dec(ns ? ios * 1000000000ULL / ns : 0);
+    serial_print(" IOPS, ");
+    serial_print_dec(ns ? ios * bs * 1000ULL / ns : 0);
+    serial_print(" MB/s, avg ");
+    serial_print_dec(ios ? latency / ios / 1000 : 0);
+    serial_print(" us, ");
+    serial_print_dec(completed);
+    serial_print(" device requests, ");
+    serial_print_dec(merged);
+    serial_print(" merged");
+    if (errors) {
+        serial_print(", ");
+        serial_print_dec(errors);
+        serial_print(" errors");
+    }
+    serial_print("\n");
+}
+
+/* --- Shell --- */
+
+static void blk_command(const char *args) {
+    (void)args;
+    if (!device_count) serial_print("[BLK] No block devices.\n");
+    for (uint32_t d = 0; d < device_count; d++) {
+        blk_device_t *dev = devices[d];
+        for (uint32_t i = 0; i < dev->nr_hw_queues; i++) {
+            blk_hw_queue_t *q = &dev->hw[i];
+            serial_print("[BLK] ");
+            serial_print(dev->name);
+            serial_print(" q");
+            serial_print_dec(i);
+            serial_print(": submitted ");
+            serial_print_dec(q->submitted);
+            serial_print(", merged ");
+            serial_print_dec(q->merged);
+            serial_print(", dispatched ");
+            serial_print_dec(q->dispatched);
+            serial_print(", done ");
+            serial_print_dec(q->completed);
+            serial_print(", waiting ");
+            serial_print_dec(q->waiting);
+            serial_print(", in flight ");
+            serial_print_dec(q->in_flight);
+            serial_print(", ");
+            serial_print_dec(q->sectors * BLK_SECTOR_SIZE / 1024);
+            serial_print(" KiB");
+            if (q->errors) {
+                serial_print(", errors ");
+                serial_print_dec(q->errors);
+            }
+            serial_print("\n");
+        }
+    }
+}
+
+void blk_init() {
+    serial_register_command("blk", blk_command);
+    serial_register_command("blkbench", blkbench_command);
+}
@@ -0,0 +1,140 @@
+#ifndef BLK_H
+#define BLK_H
+
+#include <stdint.h>
+#include "sync.h"
+#include "vfs.h"
+
+/*
+ * Block request layer.
+ *
+ * A request is a run of 512-byte sectors plus the scatter-gather list of
+ * physical buffers they move through. blk_submit() puts it on a software
+ * queue tied to one of the driver's hardware queues (the submitting CPU's,
+ * when there are enough), and the layer hands requests to the driver while
+ * the hardware has room. Requests that have to wait stay in arrival order,
+ * but one that continues or precedes a waiting request (same direction,
+ * adjacent sectors) is folded into it: the driver then sees a single
+ * request whose segments are the concatenation of both, and every original
+ * request is completed when that one is. Nothing moves across a flush.
+ * blk_submit_batch() queues a whole batch before dispatching anything, so
+ * neighbours in one batch always merge.
+ *
+ * Drivers complete requests with blk_complete(), normally from their
+ * interrupt handler, then call blk_run_queue() to refill the hardware.
+ *
+ * Every device also shows up as /dev/<name>, a node whose reads and writes
+ * go through the page cache.
+ */
+
+#define BLK_SECTOR_SIZE   512
+#define BLK_MAX_DEVICES   4
+#define BLK_MAX_HW_QUEUES 16
+#define BLK_REQ_SEGS      16    // Segments one submitted request can carry
+
+typedef enum {
+    BLK_READ,
+    BLK_WRITE,
+    BLK_FLUSH                   // Never merged; sector and segments unused
+} blk_op_t;
+
+typedef enum {
+    BLK_OK,
+    BLK_EIO,
+    BLK_UNSUPPORTED
+} blk_status_t;
+
+typedef struct blk_request blk_request_t;
+typedef struct blk_device blk_device_t;
+typedef void (*blk_callback_t)(blk_request_t *req);
+
+typedef struct {
+    uint64_t phys;
+    uint32_t len;               // A multiple of the sector size
+} blk_seg_t;
+
+struct blk_request {
+    /* Set by the submitter, see blk_prep() */
+    uint32_t op;                // blk_op_t
+    uint64_t sector;
+    uint32_t count;             // Sectors, the sum of the segment lengths
+    uint32_t nsegs;
+    blk_seg_t segs[BLK_REQ_SEGS];
+    blk_callback_t done;        // Called in the completing context
+    void *arg;
+
+    /* Set by the block layer */
+    volatile int status;        // blk_status_t, once done has been called
+    uint64_t submit_ns;
+    blk_request_t *next;        // Software queue link
+    blk_request_t *merged;      // Requests folded into this one, by sector
+    blk_request_t *merged_tail;
+    uint32_t total_count;       // Sectors in the whole merged chain
+    uint32_t total_segs;
+    uint32_t hwq;
+    uint32_t tag;               // Driver's own slot number
+};
+
+typedef struct {
+    /* Put one (possibly merged) request on hardware queue `hwq`; walk
+     * req->merged for the rest of its segments. 0 if the queue is full. */
+    int (*queue_rq)(blk_device_t *dev, uint32_t hwq, blk_request_t *req);
+    /* Tell the device about everything queued since the last call */
+    void (*commit)(blk_device_t *dev, uint32_t hwq);
+} blk_ops_t;
+
+typedef struct {
+    spinlock_t lock;
+    lock_stats_t lock_stats;
+    blk_request_t *head;        // Waiting for the hardware, oldest first
+    uint32_t waiting;
+    uint32_t in_flight;
+
+    /* Counters */
+    uint64_t submitted;
+    uint64_t merged;
+    uint64_t dispatched;
+    uint64_t completed;
+    uint64_t errors;
+    uint64_t sectors;
+} blk_hw_queue_t;
+
+struct blk_device {
+    const char *name;
+    const blk_ops_t *ops;
+    void *driver;
+    uint64_t sectors;           // Capacity
+    uint32_t max_segs;          // Per dispatched request
+    uint32_t max_sectors;       // Per dispatched request
+    int read_only;
+    uint32_t nr_hw_queues;
+    blk_hw_queue_t hw[BLK_MAX_HW_QUEUES];
+    fs_node_t node;             // /dev/<name>, set up by blk_register()
+};
+
+/* Fill in name, ops, driver, capacity, limits and nr_hw_queues first */
+int blk_register(blk_device_t *dev);
+blk_device_t *blk_get(const char *name); // 0 for the first device
+
+/* Set up a request over the kernel buffer `buf` (any mapped memory, split
+ * into physically contiguous segments). 0 if it needs more than
+ * BLK_REQ_SEGS segments or isn't a whole number of sectors. */
+int blk_prep(blk_request_t *req, blk_op_t op, uint64_t sector, void *buf, uint32_t bytes,
+             blk_callback_t done, void *arg);
+
+/* 0 if the request is out of range or on a read-only device */
+int blk_submit(blk_device_t *dev, blk_request_t *req);
+uint32_t blk_submit_batch(blk_device_t *dev, blk_request_t **reqs, uint32_t count);
+
+/* Wait for one request; returns its status */
+int blk_rw(blk_device_t *dev, blk_op_t op, uint64_t sector, void *buf, uint32_t bytes);
+
+/* For drivers: finish every request merged into req. Safe in interrupt
+ * context; follow a batch of completions with one blk_run_queue(). */
+void blk_complete(blk_device_t *dev, blk_request_t *req, int status);
+/* Dispatch waiting requests while the driver accepts them */
+void blk_run_queue(blk_device_t *dev, uint32_t hwq);
+
+void blk_init(); // Shell commands "blk" and "blkbench"
+
+#endif
@@ -1,28 +1,42 @@
 #include "cpu.h"
-#include "ports.h"
 
-static struct gdt_entry gdt[5];
-static struct gdt_ptr g_ptr;
+#define GDT_ENTRIES 7 // null, kcode, kdata, udata, ucode, TSS (two slots)
+
+static struct gdt_entry gdt[MAX_CPUS][GDT_ENTRIES];
+static struct gdt_ptr g_ptr[MAX_CPUS];
+static struct tss tss[MAX_CPUS];
 static struct idt_entry idt[256];
 static struct idt_ptr i_ptr;
 
-/* Assembly wrapper to load GDT */
-extern void gdt_load(struct gdt_ptr* ptr);
-
-void gdt_set_entry(int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
-    gdt[i].base_low = (base & 0xFFFF);
-    gdt[i].base_middle = (base >> 16) & 0xFF;
-    gdt[i].base_high = (base >> 24) & 0xFF;
-    gdt[i].limit_low = (limit & 0xFFFF);
-    gdt[i].granularity = (limit >> 16) & 0x0F;
-    gdt[i].granularity |= gran & 0xF0;
-    gdt[i].access = access;
+/* Separate stack for #DF so a blown kernel stack still gets reported */
+static uint8_t df_stack[MAX_CPUS][4096] __attribute__((aligned(16)));
+
+/* Entry stubs from isr.S, one per vector */
+extern void* isr_stub_table[256];
+
+static void gdt_set_entry(struct gdt_entry *table, int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    table[i].base_low = (base & 0xFFFF);
+    table[i].base_middle = (base >> 16) & 0xFF;
+    table[i].base_high = (base >> 24) & 0xFF;
+    table[i].limit_low = (limit & 0xFFFF);
+    table[i].granularity = (limit >> 16) & 0x0F;
+    table[i].granularity |= gran & 0xF0;
+    table[i].access = access;
+}
+
+/* A 64-bit TSS descriptor takes two GDT slots; the second holds base[63:32] */
+static void gdt_set_tss(struct gdt_entry *table, int i, struct tss *t) {
+    uint64_t base = (uint64_t)t;
+    gdt_set_entry(table, i, (uint32_t)base, sizeof(struct tss) - 1, 0x89, 0x00);
+    uint32_t *high = (uint32_t *)&table[i + 1];
+    high[0] = (uint32_t)(base >> 32);
+    high[1] = 0;
 }
 
 void idt_set_descriptor(uint8_t vector, void* isr, uint8_t flags) {
     struct idt_entry* descriptor = &idt[vector];
     descriptor->isr_low = (uint64_t)isr & 0xFFFF;
-    descriptor->kernel_cs = 0x08; // Kernel Code Segment
+    descriptor->kernel_cs = GDT_KERNEL_CODE;
     descriptor->ist = 0;
     descriptor->attributes = flags;
     descriptor->isr_mid = ((uint64_t)isr >> 16) & 0xFFFF;
@@ -30,38 +44,68 @@ void idt_set_descriptor(uint8_t vector, void* isr, uint8_t flags) {
     descriptor->reserved = 0;
 }
 
-/* Generic Interrupt Handler */
-__attribute__((interrupt))
-void generic_handler(void* frame) {
-    // If we have no way to know the vector, we can't safely EOI.
-    // However, we can try to EOI both PICs just in case it's an IRQ.
-    // This is a "dirty" but effective way to keep the system alive if unhandled IRQs fire.
-    outb(0xA0, 0x20);
-    outb(0x20, 0x20);
-    (void)frame;
-}
+void cpu_load_tables(uint32_t cpu, uint64_t kernel_stack) {
+    struct gdt_entry *table = gdt[cpu];
 
-void cpu_init() {
     /* 1. Setup GDT */
-    gdt_set_entry(0, 0, 0, 0, 0);                // Null segment
-    gdt_set_entry(1, 0, 0xFFFFFFFF, 0x9A, 0xA0); // Kernel Code
-    gdt_set_entry(2, 0, 0xFFFFFFFF, 0x92, 0xA0); // Kernel Data
-    
-    g_ptr.limit = (sizeof(struct gdt_entry) * 5) - 1;
-    g_ptr.base = (uint64_t)&gdt;
-    
+    gdt_set_entry(table, 0, 0, 0, 0, 0);                // Null segment
+    gdt_set_entry(table, 1, 0, 0xFFFFFFFF, 0x9A, 0xA0); // Kernel Code
+    gdt_set_entry(table, 2, 0, 0xFFFFFFFF, 0x92, 0xA0); // Kernel Data
+    gdt_set_entry(table, 3, 0, 0xFFFFFFFF, 0xF2, 0xA0); // User Data (DPL 3)
+    gdt_set_entry(table, 4, 0, 0xFFFFFFFF, 0xFA, 0xA0); // User Code (DPL 3)
+    gdt_set_tss(table, GDT_TSS / 8, &tss[cpu]);
+
+    tss[cpu].rsp[0] = kernel_stack;
+    tss[cpu].ist[0] = (uint64_t)&df_stack[cpu][sizeof(df_stack[cpu])];
+    tss[cpu].iomap_base = sizeof(struct tss);
+
+    g_ptr[cpu].limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    g_ptr[cpu].base = (uint64_t)table;
+
+    // Reloading GS below may clear its base; keep any per-CPU pointer
+    uint64_t gs_base = rdmsr(MSR_GS_BASE);
+
     // Load GDT (Directly via inline asm to avoid extra files)
-    __asm__ volatile ("lgdt %0" : : "m"(g_ptr));
+    __asm__ volatile ("lgdt %0" : : "m"(g_ptr[cpu]));
 
-    /* 2. Setup IDT */
+    // Limine leaves CS at its own 64-bit selector (0x28); switch to ours so
+    // iretq from an interrupt doesn't fault on a selector we never defined
+    __asm__ volatile (
+        "pushq $0x08\n"
+        "leaq 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        "movw $0x10, %%ax\n"
+        "movw %%ax, %%ds\n"
+        "movw %%ax, %%es\n"
+        "movw %%ax, %%ss\n"
+        "xorw %%ax, %%ax\n"
+        "movw %%ax, %%fs\n"
+        "movw %%ax, %%gs\n"
+        : : : "rax", "memory");
+
+    wrmsr(MSR_GS_BASE, gs_base);
+    __asm__ volatile ("ltr %0" : : "r"((uint16_t)GDT_TSS));
+
+    /* 2. IDT is shared by every CPU */
+    __asm__ volatile ("lidt %0" : : "m"(i_ptr));
+}
+
+void cpu_set_kernel_stack(uint32_t cpu, uint64_t kernel_stack) {
+    tss[cpu].rsp[0] = kernel_stack;
+}
+
+void cpu_init() {
     for (int i = 0; i < 256; i++) {
-        idt_set_descriptor(i, generic_handler, 0x8E);
+        idt_set_descriptor(i, isr_stub_table[i], 0x8E);
     }
+    idt[8].ist = 1; // Double fault runs on the IST1 stack
 
     i_ptr.limit = (sizeof(struct idt_entry) * 256) - 1;
     i_ptr.base = (uint64_t)&idt;
-    
-    __asm__ volatile ("lidt %0" : : "m"(i_ptr));
+
+    cpu_load_tables(0, 0);
 }
 
 void cpu_enable_interrupts() {
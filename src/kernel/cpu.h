@@ -18,6 +18,26 @@ struct gdt_ptr {
     uint64_t base;
 } __attribute__((packed));
 
+/* 64-bit Task State Segment: only the stack pointers matter in long mode */
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+#define MAX_CPUS 64
+
+/* GDT selectors */
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_DATA   0x18    // SYSRET needs user data directly below user code
+#define GDT_USER_CODE   0x20
+#define GDT_TSS         0x28
+
 /* IDT Structure */
 struct idt_entry {
     uint16_t isr_low;
@@ -34,8 +54,53 @@ struct idt_ptr {
     uint64_t base;
 } __attribute__((packed));
 
+/* Model specific registers */
+#define MSR_APIC_BASE      0x1B
+#define MSR_TSC_DEADLINE   0x6E0
+#define MSR_EFER           0xC0000080
+#define MSR_STAR           0xC0000081
+#define MSR_LSTAR          0xC0000082
+#define MSR_SFMASK         0xC0000084
+#define MSR_GS_BASE        0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(subleaf));
+}
+
+/* Disable interrupts and return the previous RFLAGS for cpu_irq_restore */
+static inline uint64_t cpu_irq_save() {
+    uint64_t flags;
+    __asm__ volatile ("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void cpu_irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) __asm__ volatile ("sti" : : : "memory");
+}
+
+static inline int cpu_irqs_enabled() {
+    uint64_t flags;
+    __asm__ volatile ("pushfq; popq %0" : "=r"(flags));
+    return (flags & (1 << 9)) != 0;
+}
+
 void cpu_init();
 void cpu_enable_interrupts();
+
+/* Per-CPU GDT/TSS setup plus the shared IDT; cpu_init() covers the BSP */
+void cpu_load_tables(uint32_t cpu, uint64_t kernel_stack);
+void cpu_set_kernel_stack(uint32_t cpu, uint64_t kernel_stack);
 void idt_set_descriptor(uint8_t vector, void* isr, uint8_t flags);
 
 #endif
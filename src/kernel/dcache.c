@@ -0,0 +1,211 @@
+#include "dcache.h"
+#include "sync.h"
+#include "serial.h"
+
+typedef struct dentry {
+    fs_node_t *parent;          // 0 while the entry is unused
+    fs_node_t *node;            // 0 for a negative entry
+    uint32_t hash;
+    uint32_t len;
+    struct dentry *hash_next;
+    struct dentry *lru_prev;
+    struct dentry *lru_next;
+    char name[DCACHE_NAME_LEN];
+} dentry_t;
+
+static dentry_t entries[DCACHE_ENTRIES];
+static dentry_t *buckets[DCACHE_BUCKETS];
+static dentry_t lru;            // Sentinel: lru.lru_next is the most recently used
+static uint32_t generation = 0;
+static uint32_t in_use = 0;
+
+/* Hits move entries on the LRU list, so lookups take the lock exclusively */
+DEFINE_SPINLOCK(dcache_lock, "dcache");
+
+/* Counters */
+static uint64_t hits = 0;
+static uint64_t negative_hits = 0;
+static uint64_t misses = 0;
+static uint64_t evictions = 0;
+static uint64_t stale_inserts = 0;
+
+/* FNV-1a over the name, folded with the parent so equal names in different
+ * directories spread across buckets */
+static uint32_t dentry_hash(fs_node_t *parent, const char *name, uint32_t len) {
+    uint32_t h = strtab_hash(name, len);
+    uint64_t p = (uint64_t)(uintptr_t)parent;
+    return h ^ (uint32_t)((p >> 4) * 0x9E3779B1u);
+}
+
+static int name_equal(const char *a, const char *b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) if (a[i] != b[i]) return 0;
+    return 1;
+}
+
+static void lru_unlink(dentry_t *d) {
+    d->lru_prev->lru_next = d->lru_next;
+    d->lru_next->lru_prev = d->lru_prev;
+}
+
+static void lru_push_front(dentry_t *d) {
+    d->lru_next = lru.lru_next;
+    d->lru_prev = &lru;
+    lru.lru_next->lru_prev = d;
+    lru.lru_next = d;
+}
+
+static void lru_push_back(dentry_t *d) {
+    d->lru_prev = lru.lru_prev;
+    d->lru_next = &lru;
+    lru.lru_prev->lru_next = d;
+    lru.lru_prev = d;
+}
+
+static dentry_t *find_locked(fs_node_t *parent, const char *name, uint32_t len, uint32_t h) {
+    for (dentry_t *d = buckets[h & (DCACHE_BUCKETS - 1)]; d; d = d->hash_next) {
+        if (d->hash == h && d->parent == parent && d->len == len && name_equal(d->name, name, len)) return d;
+    }
+    return 0;
+}
+
+/* Unhash and park at the LRU tail, where it is reused first */
+static void retire_locked(dentry_t *d) {
+    dentry_t **pp = &buckets[d->hash & (DCACHE_BUCKETS - 1)];
+    while (*pp != d) pp = &(*pp)->hash_next;
+    *pp = d->hash_next;
+    d->parent = 0;
+    d->node = 0;
+    in_use--;
+    lru_unlink(d);
+    lru_push_back(d);
+}
+
+int dcache_lookup(fs_node_t *parent, const char *name, uint32_t len, fs_node_t **node) {
+    if (len >= DCACHE_NAME_LEN) return 0;
+    uint32_t h = dentry_hash(parent, name, len);
+
+    spin_lock(&dcache_lock);
+    dentry_t *d = find_locked(parent, name, len, h);
+    if (!d) {
+        misses++;
+        spin_unlock(&dcache_lock);
+        return 0;
+    }
+    if (d != lru.lru_next) {
+        lru_unlink(d);
+        lru_push_front(d);
+    }
+    *node = d->node;
+    if (d->node) hits++;
+    else negative_hits++;
+    spin_unlock(&dcache_lock);
+    return 1;
+}
+
+uint32_t dcache_generation() {
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+void dcache_insert(fs_node_t *parent, const char *name, uint32_t len, fs_node_t *node, uint32_t gen) {
+    if (len >= DCACHE_NAME_LEN) return;
+    uint32_t h = dentry_hash(parent, name, len);
+
+    spin_lock(&dcache_lock);
+    if (gen != generation) { // The filesystem changed under the caller's lookup
+        stale_inserts++;
+        spin_unlock(&dcache_lock);
+        return;
+    }
+
+    dentry_t *d = find_locked(parent, name, len, h);
+    if (!d) {
+        d = lru.lru_prev;
+        if (d->parent) {
+            retire_locked(d);
+            evictions++;
+        }
+        d->parent = parent;
+        d->hash = h;
+        d->len = len;
+        for (uint32_t i = 0; i < len; i++) d->name[i] = name[i];
+        d->name[len] = 0;
+        d->hash_next = buckets[h & (DCACHE_BUCKETS - 1)];
+        buckets[h & (DCACHE_BUCKETS - 1)] = d;
+        in_use++;
+    }
+    d->node = node;
+    lru_unlink(d);
+    lru_push_front(d);
+    spin_unlock(&dcache_lock);
+}
+
+void dcache_invalidate(fs_node_t *parent, const char *name, uint32_t len) {
+    uint32_t h = dentry_hash(parent, name, len);
+    spin_lock(&dcache_lock);
+    __atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+    dentry_t *d = len < DCACHE_NAME_LEN ? find_locked(parent, name, len, h) : 0;
+    if (d) retire_locked(d);
+    spin_unlock(&dcache_lock);
+}
+
+void dcache_forget(fs_node_t *node) {
+    spin_lock(&dcache_lock);
+    __atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        dentry_t *d = &entries[i];
+        if (d->parent && (d->parent == node || d->node == node)) retire_locked(d);
+    }
+    spin_unlock(&dcache_lock);
+}
+
+void dcache_dump() {
+    serial_print("[DCACHE] ");
+    serial_print_dec(in_use);
+    serial_print("/");
+    serial_print_dec(DCACHE_ENTRIES);
+    serial_print(" entries, hits ");
+    serial_print_dec(hits);
+    serial_print(" (negative ");
+    serial_print_dec(negative_hits);
+    serial_print("), misses ");
+    serial_print_dec(misses);
+    serial_print(", evictions ");
+    serial_print_dec(evictions);
+    serial_print(", stale inserts ");
+    serial_print_dec(stale_inserts);
+    serial_print("\n");
+}
+
+/* "dcache" for stats, "dcache <path>" to resolve a path through the cache */
+static void dcache_command(const char *args) {
+    while (args && *args == ' ') args++;
+    if (!args || !*args) {
+        dcache_dump();
+        return;
+    }
+
+    uint64_t misses_before = misses;
+    uint64_t start = __builtin_ia32_rdtsc();
+    fs_node_t *node = vfs_lookup(args);
+    uint64_t cycles = __builtin_ia32_rdtsc() - start;
+
+    serial_print("[DCACHE] ");
+    serial_print(args);
+    serial_print(node ? (node->flags & 0x07) == FS_DIRECTORY ? " -> directory" : " -> file" : " -> not found");
+    if (node && (node->flags & 0x07) != FS_DIRECTORY) {
+        serial_print(", ");
+        serial_print_dec(node->length);
+        serial_print(" bytes");
+    }
+    serial_print(", ");
+    serial_print_dec(misses - misses_before);
+    serial_print(" misses, ");
+    serial_print_dec(cycles);
+    serial_print(" cycles\n");
+}
+
+void dcache_init() {
+    lru.lru_next = lru.lru_prev = &lru;
+    for (int i = 0; i < DCACHE_ENTRIES; i++) lru_push_back(&entries[i]);
+    serial_register_command("dcache", dcache_command);
+}
@@ -0,0 +1,33 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+/*
+ * Global dentry cache: (parent node, name) -> node, including negative
+ * entries for names that don't exist. Entries are recycled in LRU order.
+ * Filesystems must call dcache_invalidate() whenever a name appears or
+ * disappears, and dcache_forget() before a node is freed.
+ */
+
+#define DCACHE_ENTRIES  1024
+#define DCACHE_BUCKETS  512     // Power of two
+#define DCACHE_NAME_LEN 48      // Longer names bypass the cache
+
+void dcache_init();
+
+/* 1 on a hit, with *node set (0 for a negative entry) */
+int dcache_lookup(fs_node_t *parent, const char *name, uint32_t len, fs_node_t **node);
+
+/* Sample before asking the filesystem; an insert is dropped if any
+ * invalidation happened since, so a racing create can't be shadowed */
+uint32_t dcache_generation();
+void dcache_insert(fs_node_t *parent, const char *name, uint32_t len, fs_node_t *node, uint32_t gen);
+
+void dcache_invalidate(fs_node_t *parent, const char *name, uint32_t len);
+void dcache_forget(fs_node_t *node); // Entries naming it or looked up inside it
+
+void dcache_dump();
+
+#endif
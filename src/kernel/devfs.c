@@ -0,0 +1,50 @@
+#include "devfs.h"
+#include "dcache.h"
+#include "sync.h"
+
+static fs_node_t devfs_root;
+static fs_node_t *nodes[DEVFS_MAX_NODES];
+static volatile uint32_t node_count = 0;
+
+DEFINE_SPINLOCK(devfs_lock, "devfs");
+
+/* Entries are only ever appended, so readers need no lock */
+static fs_node_t *devfs_readdir(fs_node_t *node, uint32_t index) {
+    (void)node;
+    return index < __atomic_load_n(&node_count, __ATOMIC_ACQUIRE) ? nodes[index] : 0;
+}
+
+static fs_node_t *devfs_finddir(fs_node_t *node, const char *name, uint32_t len) {
+    (void)node;
+    uint32_t hash = strtab_hash(name, len);
+    uint32_t n = __atomic_load_n(&node_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < n; i++) {
+        if (vfs_name_is(nodes[i], name, len, hash)) return nodes[i];
+    }
+    return 0;
+}
+
+static const fs_ops_t devfs_ops = {
+    .readdir = devfs_readdir,
+    .finddir = devfs_finddir,
+};
+
+int devfs_register(fs_node_t *node) {
+    spin_lock(&devfs_lock);
+    int ok = node_count < DEVFS_MAX_NODES &&
+             !devfs_finddir(&devfs_root, vfs_name(node), node->name_len);
+    if (ok) {
+        nodes[node_count] = node;
+        __atomic_store_n(&node_count, node_count + 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock(&devfs_lock);
+    if (ok) dcache_invalidate(&devfs_root, vfs_name(node), node->name_len); // Drop the negative entry
+    return ok;
+}
+
+fs_node_t *devfs_init() {
+    devfs_root.ops = &devfs_ops;
+    devfs_root.flags = FS_DIRECTORY;
+    vfs_set_name(&devfs_root, "dev", 3);
+    return &devfs_root;
+}
@@ -0,0 +1,20 @@
+#ifndef DEVFS_H
+#define DEVFS_H
+
+#include "vfs.h"
+
+/*
+ * Flat directory of device nodes, mounted at /dev. Drivers own their
+ * nodes (named with vfs_set_name()) and register them once they can serve
+ * I/O; nodes are never removed.
+ */
+
+#define DEVFS_MAX_NODES 16
+
+/* Returns the directory, ready for vfs_mount() */
+fs_node_t *devfs_init();
+
+/* 0 if the directory is full or the name is taken */
+int devfs_register(fs_node_t *node);
+
+#endif
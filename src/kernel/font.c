@@ -33,6 +33,10 @@ void font_draw_char(char c, uint32_t x, uint32_t y, color_t color) {
 }
 
 void font_draw_string(const char *str, uint32_t x, uint32_t y, color_t color) {
+    if (gfx_dl_is_recording()) {
+        gfx_dl_text(str, x, y, color);
+        return;
+    }
     while (*str) {
         font_draw_char(*str, x, y, color);
         x += 8;
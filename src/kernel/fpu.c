@@ -0,0 +1,264 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "smp.h"
+#include "sync.h"
+#include "sched.h"
+#include "serial.h"
+#include "interrupts.h"
+#include "syscall.h"
+#include "memory/pmm.h"
+#include "libk/string/string.h"
+
+#define CR0_MP (1ULL << 1)
+#define CR0_EM (1ULL << 2)
+#define CR0_TS (1ULL << 3)
+#define CR0_NE (1ULL << 5)
+
+#define CR4_OSFXSR     (1ULL << 9)
+#define CR4_OSXMMEXCPT (1ULL << 10)
+#define CR4_OSXSAVE    (1ULL << 18)
+
+#define XCR0_X87 (1ULL << 0)
+#define XCR0_SSE (1ULL << 1)
+#define XCR0_AVX (1ULL << 2)
+
+#define FXSAVE_SIZE   512
+#define MXCSR_DEFAULT 0x1F80    // All exceptions masked, round to nearest
+
+typedef enum {
+    FPU_FXSAVE,
+    FPU_XSAVE,
+    FPU_XSAVEOPT    // Skips components untouched since the last XRSTOR
+} fpu_mode_t;
+
+static const char *mode_names[] = { "fxsave", "xsave", "xsaveopt" };
+
+static fpu_mode_t fpu_mode = FPU_FXSAVE;
+static uint64_t xcr0 = 0;
+static uint32_t state_size = FXSAVE_SIZE;
+static int fpu_ready = 0;
+static const uint32_t mxcsr_default = MXCSR_DEFAULT;
+
+/* Clean register image every task starts from; save areas are 64-byte aligned */
+static uint8_t init_state[PAGE_SIZE] __attribute__((aligned(64)));
+
+/* Counters */
+static uint64_t nm_traps = 0;
+static uint64_t switch_saves = 0;
+static uint64_t switch_reuses = 0;   // Registers still held the incoming task's state
+static uint64_t kernel_sections = 0;
+static uint64_t kernel_saves = 0;    // Sections that had to spill a task's live state
+
+static inline uint64_t read_cr0() {
+    uint64_t v;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uint64_t v) {
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(v) : "memory");
+}
+
+static inline uint64_t read_cr4() {
+    uint64_t v;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v) {
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(v) : "memory");
+}
+
+static inline void clts() {
+    __asm__ volatile ("clts" : : : "memory");
+}
+
+static inline void stts() {
+    uint64_t cr0 = read_cr0();
+    if (!(cr0 & CR0_TS)) write_cr0(cr0 | CR0_TS);
+}
+
+static inline void fpu_save(void *area) {
+    uint32_t lo = (uint32_t)xcr0, hi = (uint32_t)(xcr0 >> 32);
+    switch (fpu_mode) {
+    case FPU_XSAVEOPT:
+        __asm__ volatile ("xsaveopt64 (%0)" : : "r"(area), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_XSAVE:
+        __asm__ volatile ("xsave64 (%0)" : : "r"(area), "a"(lo), "d"(hi) : "memory");
+        break;
+    default:
+        __asm__ volatile ("fxsave64 (%0)" : : "r"(area) : "memory");
+        break;
+    }
+}
+
+static inline void fpu_restore(const void *area) {
+    uint32_t lo = (uint32_t)xcr0, hi = (uint32_t)(xcr0 >> 32);
+    if (fpu_mode == FPU_FXSAVE) __asm__ volatile ("fxrstor64 (%0)" : : "r"(area) : "memory");
+    else __asm__ volatile ("xrstor64 (%0)" : : "r"(area), "a"(lo), "d"(hi) : "memory");
+}
+
+/* #NM: the running task touched the FPU with CR0.TS set */
+static void fpu_trap(interrupt_frame_t *frame) {
+    percpu_t *cpu = this_cpu();
+    task_t *t = task_current();
+    if ((frame->cs & 3) != 3 || !t) exception_panic(frame); // Kernel FPU use outside kernel_fpu_begin()
+
+    if (!t->fpu_state) {
+        t->fpu_state = pmm_alloc(1);
+        if (!t->fpu_state) {
+            // Nothing nests under a ring 3 trap; unwind like the dispatcher does
+            cpu->irq_frame = 0;
+            cpu->irq_depth--;
+            syscall_user_fault(frame);
+        }
+        k_memcpy(t->fpu_state, init_state, state_size);
+    }
+
+    clts();
+    fpu_restore(t->fpu_state);
+    cpu->fpu_owner = t;
+    t->fpu_cpu = cpu->cpu_id;
+    nm_traps++;
+}
+
+void fpu_switch(task_t *prev, task_t *next) {
+    percpu_t *cpu = this_cpu();
+    uint64_t cr0 = read_cr0();
+
+    // TS clear means prev used the FPU since it was switched in
+    if (!(cr0 & CR0_TS) && cpu->fpu_owner == prev) {
+        fpu_save(prev->fpu_state);
+        switch_saves++;
+    }
+
+    // If nothing has touched the registers since next last ran here, skip the trap
+    if (cpu->fpu_owner == next && next->fpu_cpu == (int32_t)cpu->cpu_id) {
+        if (cr0 & CR0_TS) write_cr0(cr0 & ~CR0_TS);
+        switch_reuses++;
+    } else if (!(cr0 & CR0_TS)) {
+        write_cr0(cr0 | CR0_TS);
+    }
+}
+
+void fpu_release(task_t *t) {
+    percpu_t *cpu = this_cpu();
+    if (cpu->fpu_owner == t) cpu->fpu_owner = 0;
+    if (t->fpu_state) pmm_free(t->fpu_state, 1);
+    t->fpu_state = 0;
+}
+
+int kernel_fpu_begin() {
+    percpu_t *cpu = this_cpu();
+    // An interrupt or softirq may have landed in the middle of another section
+    if (!fpu_ready || cpu->irq_depth || cpu->in_softirq) return 0;
+
+    preempt_disable();
+    if (cpu->fpu_depth++ == 0) {
+        uint64_t cr0 = read_cr0();
+        task_t *owner = cpu->fpu_owner;
+
+        // Only a task that ran FPU code since its switch-in has unsaved state
+        if (owner && !(cr0 & CR0_TS)) {
+            fpu_save(owner->fpu_state);
+            kernel_saves++;
+        }
+        cpu->fpu_owner = 0;
+        if (cr0 & CR0_TS) clts();
+        __asm__ volatile ("ldmxcsr %0" : : "m"(mxcsr_default));
+        kernel_sections++;
+    }
+    return 1;
+}
+
+void kernel_fpu_end() {
+    percpu_t *cpu = this_cpu();
+    if (--cpu->fpu_depth == 0) stts(); // The owner reloads on its next #NM
+    preempt_enable();
+}
+
+static void fpu_command(const char *args) {
+    (void)args;
+    serial_print("[FPU] ");
+    serial_print(mode_names[fpu_mode]);
+    serial_print(", ");
+    serial_print_dec(state_size);
+    serial_print("-byte state, xcr0=");
+    serial_print_hex(xcr0);
+    serial_print("\n[FPU] #NM traps ");
+    serial_print_dec(nm_traps);
+    serial_print(", switch saves ");
+    serial_print_dec(switch_saves);
+    serial_print(", reused ");
+    serial_print_dec(switch_reuses);
+    serial_print("\n[FPU] kernel sections ");
+    serial_print_dec(kernel_sections);
+    serial_print(", of which spilled a task ");
+    serial_print_dec(kernel_saves);
+    serial_print("\n");
+}
+
+/* Per-CPU control register setup; leaves the FPU usable with TS clear */
+static void fpu_setup_cpu() {
+    uint64_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (fpu_mode != FPU_FXSAVE) cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+
+    if (fpu_mode != FPU_FXSAVE) {
+        __asm__ volatile ("xsetbv" : : "c"(0), "a"((uint32_t)xcr0), "d"((uint32_t)(xcr0 >> 32)));
+    }
+    __asm__ volatile ("fninit; ldmxcsr %0" : : "m"(mxcsr_default));
+}
+
+void fpu_init_ap() {
+    fpu_setup_cpu();
+    this_cpu()->fpu_owner = 0;
+    stts();
+}
+
+void fpu_init() {
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (c & (1 << 26)) { // XSAVE
+        fpu_mode = FPU_XSAVE;
+        xcr0 = XCR0_X87 | XCR0_SSE;
+        if (c & (1 << 28)) xcr0 |= XCR0_AVX;
+    }
+
+    fpu_setup_cpu();
+
+    if (fpu_mode != FPU_FXSAVE) {
+        cpuid(0xD, 0, &a, &b, &c, &d);
+        state_size = b; // Covers exactly the components enabled in XCR0
+        cpuid(0xD, 1, &a, &b, &c, &d);
+        if (a & 1) fpu_mode = FPU_XSAVEOPT;
+        if (state_size > sizeof(init_state)) { // Can't happen without AVX-512
+            fpu_mode = FPU_FXSAVE;
+            state_size = FXSAVE_SIZE;
+        }
+    }
+
+    // XSAVE writes only the header and enabled components; the rest stays zero
+    k_memset(init_state, 0, sizeof(init_state));
+    fpu_save(init_state);
+
+    this_cpu()->fpu_owner = 0;
+    stts();
+    interrupt_register(FPU_VECTOR_NM, fpu_trap, "fpu-lazy");
+    serial_register_command("fpu", fpu_command);
+    fpu_ready = 1;
+
+    serial_print("[PARADOX] FPU: ");
+    serial_print(mode_names[fpu_mode]);
+    serial_print(", ");
+    serial_print_dec(state_size);
+    serial_print("-byte lazy context");
+    if (xcr0 & XCR0_AVX) serial_print(", AVX enabled");
+    serial_print("\n");
+}
@@ -0,0 +1,31 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+/*
+ * Lazy x87/SSE/AVX context switching. CR0.TS stays set while a task runs
+ * until its first FPU instruction traps with #NM; only then is its state
+ * restored, and only tasks that touched the FPU are saved at switch-out.
+ * The kernel itself is built with -mgeneral-regs-only and may only use
+ * vector registers between kernel_fpu_begin() and kernel_fpu_end().
+ */
+
+#define FPU_VECTOR_NM 7
+
+void fpu_init();    // BSP, after cpu_init()
+void fpu_init_ap();
+
+struct task;
+
+/* Scheduler hooks, called with interrupts disabled */
+void fpu_switch(struct task *prev, struct task *next);
+void fpu_release(struct task *t); // Frees the save area of a dead task
+
+/* Returns 0 when vector registers may not be used here (interrupt context),
+ * in which case the caller must take its scalar path and skip the end call.
+ * Preemption stays disabled until kernel_fpu_end(). */
+int kernel_fpu_begin();
+void kernel_fpu_end();
+
+#endif
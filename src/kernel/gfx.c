@@ -1,9 +1,86 @@
 #include "gfx.h"
+#include "font.h"
+#include "gfx_simd.h"
+#include "fpu.h"
+#include "memory/pmm.h"
 
 static framebuffer_t back_buffer;
 static framebuffer_t front_buffer;
 static uint32_t buffer_data[1280 * 800]; // SAFE MODE: Small buffer
 
+/* Overlay plane state (see gfx_overlay_set) */
+static gfx_sprite_t overlay[GFX_OVERLAY_MAX_SPRITES];
+static uint32_t overlay_saved[GFX_OVERLAY_MAX_SPRITES][GFX_OVERLAY_MAX_DIM * GFX_OVERLAY_MAX_DIM];
+static int overlay_count = 0;
+static int overlay_visible = 0;
+
+static inline color_t blend(color_t bg, color_t color, uint8_t alpha) {
+    uint8_t r_bg = (bg >> 16) & 0xFF;
+    uint8_t g_bg = (bg >> 8) & 0xFF;
+    uint8_t b_bg = bg & 0xFF;
+
+    uint8_t r_fg = (color >> 16) & 0xFF;
+    uint8_t g_fg = (color >> 8) & 0xFF;
+    uint8_t b_fg = color & 0xFF;
+
+    uint8_t r = ((r_fg * alpha) + (r_bg * (255 - alpha))) / 255;
+    uint8_t g = ((g_fg * alpha) + (g_bg * (255 - alpha))) / 255;
+    uint8_t b = ((b_fg * alpha) + (b_bg * (255 - alpha))) / 255;
+
+    return (0xFF << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* ------------------------------------------------------------------------
+ * Clipping & damage
+ *
+ * Every rasterizer clips against `clip` (the whole back buffer unless a
+ * display list is replaying) and adds what it touched to `damage`, which is
+ * the only region gfx_swap_buffers copies to the screen.
+ * ---------------------------------------------------------------------- */
+
+static gfx_rect_t clip;
+static gfx_rect_t damage;
+
+static inline int rect_empty(const gfx_rect_t *r) {
+    return r->x0 >= r->x1 || r->y0 >= r->y1;
+}
+
+static inline gfx_rect_t rect_make(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    /* Coordinates are signed on purpose: windows dragged past the left/top
+     * edge arrive here as wrapped uint32_t values. */
+    int64_t x0 = (int32_t)x, y0 = (int32_t)y;
+    int64_t x1 = x0 + w, y1 = y0 + h;
+    gfx_rect_t r;
+    r.x0 = x0 < INT32_MIN ? INT32_MIN : (int32_t)x0;
+    r.y0 = y0 < INT32_MIN ? INT32_MIN : (int32_t)y0;
+    r.x1 = x1 > INT32_MAX ? INT32_MAX : (int32_t)x1;
+    r.y1 = y1 > INT32_MAX ? INT32_MAX : (int32_t)y1;
+    return r;
+}
+
+static inline gfx_rect_t rect_intersect(gfx_rect_t a, gfx_rect_t b) {
+    gfx_rect_t r;
+    r.x0 = a.x0 > b.x0 ? a.x0 : b.x0;
+    r.y0 = a.y0 > b.y0 ? a.y0 : b.y0;
+    r.x1 = a.x1 < b.x1 ? a.x1 : b.x1;
+    r.y1 = a.y1 < b.y1 ? a.y1 : b.y1;
+    return r;
+}
+
+static inline void rect_union(gfx_rect_t *dst, gfx_rect_t r) {
+    if (rect_empty(&r)) return;
+    if (rect_empty(dst)) { *dst = r; return; }
+    if (r.x0 < dst->x0) dst->x0 = r.x0;
+    if (r.y0 < dst->y0) dst->y0 = r.y0;
+    if (r.x1 > dst->x1) dst->x1 = r.x1;
+    if (r.y1 > dst->y1) dst->y1 = r.y1;
+}
+
+static inline gfx_rect_t screen_rect() {
+    gfx_rect_t r = { 0, 0, (int32_t)back_buffer.width, (int32_t)back_buffer.height };
+    return r;
+}
+
 void gfx_init(struct limine_framebuffer *fb) {
     front_buffer.address = (uint32_t *)fb->address;
     front_buffer.width = fb->width;
@@ -15,53 +92,45 @@ void gfx_init(struct limine_framebuffer *fb) {
     back_buffer.width = (fb->width > 1280) ? 1280 : fb->width;
     back_buffer.height = (fb->height > 800) ? 800 : fb->height;
     back_buffer.pitch = back_buffer.width * 4;
-}
 
-void gfx_put_pixel(uint32_t x, uint32_t y, color_t color) {
-    if (x >= back_buffer.width || y >= back_buffer.height) return;
-    back_buffer.address[y * (back_buffer.width) + x] = color;
+    clip = screen_rect();
+    damage = screen_rect();
 }
 
-void gfx_blend_pixel(uint32_t x, uint32_t y, color_t color, uint8_t alpha) {
-    if (x >= back_buffer.width || y >= back_buffer.height) return;
-    
-    uint32_t idx = y * (back_buffer.width) + x;
-    color_t bg = back_buffer.address[idx];
-
-    uint8_t r_bg = (bg >> 16) & 0xFF;
-    uint8_t g_bg = (bg >> 8) & 0xFF;
-    uint8_t b_bg = bg & 0xFF;
-
-    uint8_t r_fg = (color >> 16) & 0xFF;
-    uint8_t g_fg = (color >> 8) & 0xFF;
-    uint8_t b_fg = color & 0xFF;
-
-    uint8_t r = ((r_fg * alpha) + (r_bg * (255 - alpha))) / 255;
-    uint8_t g = ((g_fg * alpha) + (g_bg * (255 - alpha))) / 255;
-    uint8_t b = ((b_fg * alpha) + (b_bg * (255 - alpha))) / 255;
-
-    back_buffer.address[idx] = (0xFF << 24) | (r << 16) | (g << 8) | b;
+/* Clip a primitive to the active clip and record it as damage */
+static inline gfx_rect_t raster_begin(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    gfx_rect_t r = rect_intersect(rect_make(x, y, w, h), clip);
+    rect_union(&damage, r);
+    return r;
 }
 
-void gfx_draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color) {
-    for (uint32_t i = 0; i < h; i++) {
-        for (uint32_t j = 0; j < w; j++) {
-            gfx_put_pixel(x + j, y + i, color);
-        }
+/* ------------------------------------------------------------------------
+ * Rasterizers
+ * ---------------------------------------------------------------------- */
+
+static void raster_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color) {
+    gfx_rect_t r = raster_begin(x, y, w, h);
+    for (int32_t i = r.y0; i < r.y1; i++) {
+        uint32_t *row = &back_buffer.address[i * back_buffer.width];
+        for (int32_t j = r.x0; j < r.x1; j++) row[j] = color;
     }
 }
 
-void gfx_draw_rect_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha) {
-    for (uint32_t i = 0; i < h; i++) {
-        for (uint32_t j = 0; j < w; j++) {
-            gfx_blend_pixel(x + j, y + i, color, alpha);
-        }
+static void raster_rect_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha) {
+    gfx_rect_t r = raster_begin(x, y, w, h);
+    for (int32_t i = r.y0; i < r.y1; i++) {
+        uint32_t *row = &back_buffer.address[i * back_buffer.width];
+        for (int32_t j = r.x0; j < r.x1; j++) row[j] = blend(row[j], color, alpha);
     }
 }
 
-void gfx_draw_rounded_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t r, color_t color) {
-    for (uint32_t i = 0; i < h; i++) {
-        for (uint32_t j = 0; j < w; j++) {
+static void raster_rounded_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t r, color_t color) {
+    gfx_rect_t c = raster_begin(x, y, w, h);
+    int32_t ox = (int32_t)x, oy = (int32_t)y;
+    for (int32_t row = c.y0; row < c.y1; row++) {
+        uint32_t i = row - oy;
+        for (int32_t col = c.x0; col < c.x1; col++) {
+            uint32_t j = col - ox;
             int dx = 0, dy = 0;
             int is_corner = 0;
 
@@ -70,58 +139,776 @@ void gfx_draw_rounded_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint3
             else if (j < r && i > h - r - 1) { dx = r - j; dy = i - (h - r - 1); is_corner = 1; }
             else if (j > w - r - 1 && i > h - r - 1) { dx = j - (w - r - 1); dy = i - (h - r - 1); is_corner = 1; }
 
-            if (is_corner) {
-                if ((uint32_t)(dx * dx + dy * dy) <= r * r) gfx_put_pixel(x + j, y + i, color);
-            } else {
-                gfx_put_pixel(x + j, y + i, color);
-            }
+            if (!is_corner || (uint32_t)(dx * dx + dy * dy) <= r * r)
+                back_buffer.address[row * back_buffer.width + col] = color;
         }
     }
 }
 
-void gfx_draw_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t c1, color_t c2) {
-    for (uint32_t i = 0; i < h; i++) {
+static void raster_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t c1, color_t c2) {
+    gfx_rect_t c = raster_begin(x, y, w, h);
+    uint8_t r1 = (c1 >> 16) & 0xFF, g1 = (c1 >> 8) & 0xFF, b1 = c1 & 0xFF;
+    uint8_t r2 = (c2 >> 16) & 0xFF, g2 = (c2 >> 8) & 0xFF, b2 = c2 & 0xFF;
+
+    for (int32_t row = c.y0; row < c.y1; row++) {
         /* Integer interpolation: color = c1 + (c2 - c1) * i / h */
-        uint8_t r1 = (c1 >> 16) & 0xFF, g1 = (c1 >> 8) & 0xFF, b1 = c1 & 0xFF;
-        uint8_t r2 = (c2 >> 16) & 0xFF, g2 = (c2 >> 8) & 0xFF, b2 = c2 & 0xFF;
-        
-        uint8_t r = r1 + ((int)r2 - r1) * i / h;
-        uint8_t g = g1 + ((int)g2 - g1) * i / h;
-        uint8_t b = b1 + ((int)b2 - b1) * i / h;
+        uint32_t i = row - (int32_t)y;
+        uint8_t r = r1 + ((int)r2 - r1) * (int)i / (int)h;
+        uint8_t g = g1 + ((int)g2 - g1) * (int)i / (int)h;
+        uint8_t b = b1 + ((int)b2 - b1) * (int)i / (int)h;
         
         uint32_t row_color = (0xFF << 24) | (r << 16) | (g << 8) | b;
-        
-        for (uint32_t j = 0; j < w; j++) {
-            gfx_put_pixel(x + j, y + i, row_color);
-        }
+        uint32_t *dst = &back_buffer.address[row * back_buffer.width];
+        for (int32_t col = c.x0; col < c.x1; col++) dst[col] = row_color;
     }
 }
 
-void gfx_draw_image(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t* data) {
-    for (uint32_t i = 0; i < h; i++) {
-        for (uint32_t j = 0; j < w; j++) {
-            uint32_t color = data[i * w + j];
+static void raster_image(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t* data) {
+    gfx_rect_t c = raster_begin(x, y, w, h);
+    for (int32_t row = c.y0; row < c.y1; row++) {
+        const uint32_t *src = &data[(row - (int32_t)y) * w];
+        uint32_t *dst = &back_buffer.address[row * back_buffer.width];
+        for (int32_t col = c.x0; col < c.x1; col++) {
+            uint32_t color = src[col - (int32_t)x];
             uint8_t alpha = (color >> 24) & 0xFF;
             if (alpha == 255) {
-                gfx_put_pixel(x + j, y + i, color);
+                dst[col] = color;
             } else if (alpha > 0) {
-                gfx_blend_pixel(x + j, y + i, color, alpha);
+                dst[col] = blend(dst[col], color, alpha);
             }
         }
     }
 }
 
+/* ------------------------------------------------------------------------
+ * Backdrop blur
+ *
+ * The area under a panel is downsampled 2x, run through three box-blur
+ * passes (a cheap Gaussian approximation) and upsampled bilinearly under a
+ * tint. Pixels are widened to three 16-bit lanes of a uint64_t so every
+ * add/subtract of the sliding window sums handles B, G and R in one go.
+ * The low-res result is cached per panel and reused while its backdrop is
+ * unchanged (see gfx_dl_end).
+ * ---------------------------------------------------------------------- */
+
+#define BLUR_SLOTS      2
+#define BLUR_PASSES     3
+#define BLUR_MAX_RADIUS 64
+
+typedef struct {
+    uint32_t *pixels;       /* Downsampled, blurred backdrop */
+    gfx_rect_t rect;        /* Screen area it was taken from */
+    uint32_t dw, dh;
+    uint32_t radius;
+    uint64_t key;           /* Backdrop hash, 0 = never reuse */
+    uint32_t last_used;
+} blur_slot_t;
+
+static blur_slot_t blur_slots[BLUR_SLOTS];
+static uint32_t *blur_tmp;
+static uint64_t blur_colsum[1280 / 2 + 1];
+static uint16_t blur_col_idx[1280];
+static uint8_t blur_col_frac[1280];
+static uint32_t blur_clock = 0;
+static int blur_state = 0; /* 0 = not allocated yet, 1 = ready, -1 = no memory */
+
+#define LANE_MASK 0x000000FF00FF00FFULL
+
+static inline uint64_t lanes(uint32_t p) {
+    return (uint64_t)(p & 0xFF) | ((uint64_t)((p >> 8) & 0xFF) << 16) | ((uint64_t)((p >> 16) & 0xFF) << 32);
+}
+
+static inline uint32_t lanes_pack(uint64_t v) {
+    return 0xFF000000 | (uint32_t)((v >> 16) & 0xFF0000) | (uint32_t)((v >> 8) & 0xFF00) | (uint32_t)(v & 0xFF);
+}
+
+/* Per-lane sum / n via a 16.16 reciprocal */
+static inline uint32_t lanes_div(uint64_t sum, uint32_t inv) {
+    uint32_t b = ((sum & 0xFFFF) * inv) >> 16;
+    uint32_t g = (((sum >> 16) & 0xFFFF) * inv) >> 16;
+    uint32_t r = (((sum >> 32) & 0xFFFF) * inv) >> 16;
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+/* (a * (256 - f) + b * f) / 256 on all lanes at once; lanes never carry */
+static inline uint64_t lanes_lerp(uint64_t a, uint64_t b, uint32_t f) {
+    return ((a * (256 - f) + b * f) >> 8) & LANE_MASK;
+}
+
+static int blur_alloc() {
+    if (blur_state != 0) return blur_state == 1;
+
+    uint64_t bytes = (uint64_t)(back_buffer.width / 2 + 1) * (back_buffer.height / 2 + 1) * 4;
+    size_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    blur_tmp = pmm_alloc(pages);
+    for (int i = 0; i < BLUR_SLOTS; i++) blur_slots[i].pixels = pmm_alloc(pages);
+
+    blur_state = 1;
+    if (!blur_tmp) blur_state = -1;
+    for (int i = 0; i < BLUR_SLOTS; i++) if (!blur_slots[i].pixels) blur_state = -1;
+    return blur_state == 1;
+}
+
+static void blur_rows(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t h, uint32_t r) {
+    uint32_t inv = (65536 + 2 * r) / (2 * r + 1);
+    for (uint32_t y = 0; y < h; y++) {
+        const uint32_t *in = &src[y * w];
+        uint32_t *out = &dst[y * w];
+        uint64_t sum = lanes(in[0]) * (r + 1);
+        for (uint32_t i = 1; i <= r; i++) sum += lanes(in[i < w ? i : w - 1]);
+        for (uint32_t x = 0; x < w; x++) {
+            out[x] = lanes_div(sum, inv);
+            uint32_t add = x + r + 1 < w ? x + r + 1 : w - 1;
+            uint32_t sub = x >= r ? x - r : 0;
+            sum += lanes(in[add]) - lanes(in[sub]);
+        }
+    }
+}
+
+/* Column pass keeps one running sum per column and walks rows in order */
+static void blur_cols(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t h, uint32_t r) {
+    uint32_t inv = (65536 + 2 * r) / (2 * r + 1);
+    for (uint32_t x = 0; x < w; x++) blur_colsum[x] = lanes(src[x]) * (r + 1);
+    for (uint32_t i = 1; i <= r; i++) {
+        const uint32_t *in = &src[(i < h ? i : h - 1) * w];
+        for (uint32_t x = 0; x < w; x++) blur_colsum[x] += lanes(in[x]);
+    }
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t *out = &dst[y * w];
+        const uint32_t *add = &src[(y + r + 1 < h ? y + r + 1 : h - 1) * w];
+        const uint32_t *sub = &src[(y >= r ? y - r : 0) * w];
+        for (uint32_t x = 0; x < w; x++) {
+            out[x] = lanes_div(blur_colsum[x], inv);
+            blur_colsum[x] += lanes(add[x]) - lanes(sub[x]);
+        }
+    }
+}
+
+static void blur_compute(blur_slot_t *slot, gfx_rect_t rect, uint32_t radius) {
+    uint32_t w = rect.x1 - rect.x0, h = rect.y1 - rect.y0;
+    uint32_t dw = (w + 1) / 2, dh = (h + 1) / 2;
+    uint32_t *lo = slot->pixels;
+
+    /* 2x2 box downsample */
+    for (uint32_t v = 0; v < dh; v++) {
+        uint32_t y0 = rect.y0 + 2 * v;
+        uint32_t y1 = (y0 + 1 < (uint32_t)rect.y1) ? y0 + 1 : y0;
+        const uint32_t *r0 = &back_buffer.address[y0 * back_buffer.width];
+        const uint32_t *r1 = &back_buffer.address[y1 * back_buffer.width];
+        for (uint32_t u = 0; u < dw; u++) {
+            uint32_t x0 = rect.x0 + 2 * u;
+            uint32_t x1 = (x0 + 1 < (uint32_t)rect.x1) ? x0 + 1 : x0;
+            uint64_t sum = lanes(r0[x0]) + lanes(r0[x1]) + lanes(r1[x0]) + lanes(r1[x1]);
+            lo[v * dw + u] = lanes_pack((sum >> 2) & LANE_MASK);
+        }
+    }
+
+    uint32_t r = (radius + 1) / 2;
+    if (r < 1) r = 1;
+    for (int pass = 0; pass < BLUR_PASSES; pass++) {
+        blur_rows(lo, blur_tmp, dw, dh, r);
+        // Short sections so the compositor stays preemptible between passes
+        if (kernel_fpu_begin()) {
+            blur_cols_sse2(blur_tmp, lo, blur_colsum, dw, dh, r);
+            kernel_fpu_end();
+        } else {
+            blur_cols(blur_tmp, lo, dw, dh, r);
+        }
+    }
+
+    slot->rect = rect;
+    slot->dw = dw;
+    slot->dh = dh;
+    slot->radius = radius;
+}
+
+/* Bilinear upsample of a cached slot under a tint, limited to `area` */
+static void blur_composite(const blur_slot_t *slot, gfx_rect_t area, color_t tint, uint8_t alpha) {
+    uint64_t t = lanes(tint);
+    uint32_t ta = alpha + (alpha >> 7); /* 0..256 */
+
+    for (int32_t X = area.x0; X < area.x1; X++) {
+        int32_t u = (X - slot->rect.x0) * 128 - 64;
+        if (u < 0) u = 0;
+        blur_col_idx[X] = u >> 8;
+        blur_col_frac[X] = u & 0xFF;
+    }
+
+    for (int32_t Y = area.y0; Y < area.y1; Y++) {
+        int32_t v = (Y - slot->rect.y0) * 128 - 64;
+        if (v < 0) v = 0;
+        uint32_t y0 = v >> 8, fy = v & 0xFF;
+        uint32_t y1 = y0 + 1 < slot->dh ? y0 + 1 : y0;
+        const uint32_t *r0 = &slot->pixels[y0 * slot->dw];
+        const uint32_t *r1 = &slot->pixels[y1 * slot->dw];
+        uint32_t *dst = &back_buffer.address[Y * back_buffer.width];
+
+        for (int32_t X = area.x0; X < area.x1; X++) {
+            uint32_t x0 = blur_col_idx[X], fx = blur_col_frac[X];
+            uint32_t x1 = x0 + 1 < slot->dw ? x0 + 1 : x0;
+            uint64_t top = lanes_lerp(lanes(r0[x0]), lanes(r0[x1]), fx);
+            uint64_t bot = lanes_lerp(lanes(r1[x0]), lanes(r1[x1]), fx);
+            uint64_t px = lanes_lerp(top, bot, fy);
+            dst[X] = lanes_pack(lanes_lerp(px, t, ta));
+        }
+    }
+}
+
+static void raster_blur(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t radius, color_t tint, uint8_t alpha, uint64_t key) {
+    gfx_rect_t full = rect_intersect(rect_make(x, y, w, h), screen_rect());
+    if (rect_empty(&full)) return;
+    if (!blur_alloc()) {
+        raster_rect_alpha(x, y, w, h, tint, alpha);
+        return;
+    }
+    gfx_rect_t area = raster_begin(x, y, w, h);
+    if (rect_empty(&area)) return;
+    if (radius > BLUR_MAX_RADIUS) radius = BLUR_MAX_RADIUS;
+
+    blur_slot_t *slot = NULL;
+    for (int i = 0; i < BLUR_SLOTS && key; i++) {
+        blur_slot_t *s = &blur_slots[i];
+        if (s->key == key && s->radius == radius && s->rect.x0 == full.x0 && s->rect.y0 == full.y0 &&
+            s->rect.x1 == full.x1 && s->rect.y1 == full.y1) {
+            slot = s;
+            break;
+        }
+    }
+    if (!slot) {
+        slot = &blur_slots[0];
+        for (int i = 1; i < BLUR_SLOTS; i++)
+            if (blur_slots[i].last_used < slot->last_used) slot = &blur_slots[i];
+        blur_compute(slot, full, radius);
+        slot->key = key;
+    }
+    slot->last_used = ++blur_clock;
+
+    blur_composite(slot, area, tint, alpha);
+}
+
+/* ------------------------------------------------------------------------
+ * Display list
+ *
+ * Between gfx_dl_begin() and gfx_dl_end() the draw calls below only record
+ * commands. gfx_dl_end() then:
+ *   1. diffs the list against the previous frame's to find the damaged area,
+ *   2. walks it back to front, clipping away whatever later opaque commands
+ *      cover (dropping commands that end up fully hidden),
+ *   3. rasterizes the surviving pieces inside the damaged area only.
+ * Adjacent solid fills of the same colour are merged as they are recorded.
+ * ---------------------------------------------------------------------- */
+
+#define DL_MAX_CMDS       1024
+#define DL_MAX_TEXT       8192
+#define DL_MAX_PIECES     4096
+#define DL_MAX_SPLIT      16    /* pieces a single fill may be cut into */
+#define DL_MAX_OCCLUDERS  32
+#define DL_MIN_OCCLUDER   256   /* px; smaller opaque shapes aren't worth tracking */
+
+typedef enum {
+    DL_RECT,
+    DL_RECT_ALPHA,
+    DL_ROUNDED_RECT,
+    DL_GRADIENT,
+    DL_IMAGE,
+    DL_TEXT,
+    DL_BLUR
+} dl_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t alpha;
+    uint16_t text_len;
+    uint32_t x, y, w, h;
+    uint32_t r;
+    color_t c1, c2;
+    const uint32_t *image;
+    uint32_t text_off;
+    gfx_rect_t bounds;      /* On-screen extent */
+} dl_cmd_t;
+
+typedef struct {
+    dl_cmd_t cmds[DL_MAX_CMDS];
+    char text[DL_MAX_TEXT];
+    uint32_t count;
+    uint32_t text_used;
+} display_list_t;
+
+static display_list_t dl_lists[2];
+static display_list_t *dl_cur = &dl_lists[0];
+static display_list_t *dl_prev = &dl_lists[1];
+static int dl_recording = 0;
+static int dl_prev_valid = 0;
+
+static gfx_rect_t dl_pieces[DL_MAX_PIECES];
+static uint16_t dl_piece_start[DL_MAX_CMDS];
+static uint16_t dl_piece_count[DL_MAX_CMDS];
+
+static void dl_replay_cmd(const display_list_t *dl, const dl_cmd_t *c, uint64_t key);
+
+/* Anything drawn outside a display list makes the last recorded frame a
+ * poor reference, so the next list repaints in full. */
+static inline void immediate_draw() {
+    dl_prev_valid = 0;
+}
+
+/* Give up on recording for the rest of the frame: paint what we have */
+static void dl_overflow() {
+    gfx_rect_t saved = clip;
+    clip = screen_rect();
+    dl_recording = 0;
+    for (uint32_t i = 0; i < dl_cur->count; i++) dl_replay_cmd(dl_cur, &dl_cur->cmds[i], 0);
+    clip = saved;
+    dl_cur->count = 0;
+    immediate_draw();
+}
+
+static dl_cmd_t *dl_push(dl_type_t type, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (dl_cur->count >= DL_MAX_CMDS) {
+        dl_overflow();
+        return NULL;
+    }
+    dl_cmd_t *c = &dl_cur->cmds[dl_cur->count++];
+    *c = (dl_cmd_t){0};
+    c->type = type;
+    c->x = x; c->y = y; c->w = w; c->h = h;
+    c->bounds = rect_intersect(rect_make(x, y, w, h), screen_rect());
+    return c;
+}
+
+/* Fold a solid fill into the previous command when the two share a full edge */
+static int dl_merge_fill(dl_type_t type, uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha) {
+    if (dl_cur->count == 0) return 0;
+    dl_cmd_t *p = &dl_cur->cmds[dl_cur->count - 1];
+    if (p->type != type || p->c1 != color || p->alpha != alpha) return 0;
+
+    if (p->y == y && p->h == h && p->x + p->w == x) {
+        p->w += w;
+    } else if (p->x == x && p->w == w && p->y + p->h == y) {
+        p->h += h;
+    } else {
+        return 0;
+    }
+    p->bounds = rect_intersect(rect_make(p->x, p->y, p->w, p->h), screen_rect());
+    return 1;
+}
+
+static int dl_cmd_equal(const display_list_t *la, const dl_cmd_t *a, const display_list_t *lb, const dl_cmd_t *b) {
+    if (a->type != b->type || a->alpha != b->alpha || a->x != b->x || a->y != b->y ||
+        a->w != b->w || a->h != b->h || a->r != b->r || a->c1 != b->c1 || a->c2 != b->c2 ||
+        a->image != b->image || a->text_len != b->text_len)
+        return 0;
+    if (a->type == DL_TEXT) {
+        for (uint32_t i = 0; i < a->text_len; i++)
+            if (la->text[a->text_off + i] != lb->text[b->text_off + i]) return 0;
+    }
+    return 1;
+}
+
+/* Pixels change only where an entry differs between the two lists */
+static gfx_rect_t dl_compute_damage() {
+    if (!dl_prev_valid) return screen_rect();
+
+    gfx_rect_t dmg = { 0, 0, 0, 0 };
+    uint32_t n = dl_cur->count > dl_prev->count ? dl_cur->count : dl_prev->count;
+    for (uint32_t i = 0; i < n; i++) {
+        const dl_cmd_t *a = i < dl_cur->count ? &dl_cur->cmds[i] : NULL;
+        const dl_cmd_t *b = i < dl_prev->count ? &dl_prev->cmds[i] : NULL;
+        if (a && b && dl_cmd_equal(dl_cur, a, dl_prev, b)) continue;
+        if (a) rect_union(&dmg, a->bounds);
+        if (b) rect_union(&dmg, b->bounds);
+    }
+
+    /* A blur reads its whole backdrop, so touching any of it repaints all of it */
+    for (int grown = 1; grown;) {
+        grown = 0;
+        for (uint32_t i = 0; i < dl_cur->count; i++) {
+            const dl_cmd_t *c = &dl_cur->cmds[i];
+            if (c->type != DL_BLUR) continue;
+            gfx_rect_t in = rect_intersect(c->bounds, dmg);
+            if (rect_empty(&in)) continue;
+            if (in.x0 != c->bounds.x0 || in.y0 != c->bounds.y0 || in.x1 != c->bounds.x1 || in.y1 != c->bounds.y1) {
+                rect_union(&dmg, c->bounds);
+                grown = 1;
+            }
+        }
+    }
+    return dmg;
+}
+
+/* FNV-1a over every earlier command that paints under a blur */
+static uint64_t dl_backdrop_key(const display_list_t *dl, uint32_t index) {
+    const dl_cmd_t *blur = &dl->cmds[index];
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < index; i++) {
+        const dl_cmd_t *c = &dl->cmds[i];
+        gfx_rect_t in = rect_intersect(c->bounds, blur->bounds);
+        if (rect_empty(&in)) continue;
+        uint64_t fields[] = { c->type, c->alpha, c->x, c->y, c->w, c->h, c->r, c->c1, c->c2,
+                              (uint64_t)(uintptr_t)c->image, c->text_len };
+        for (uint32_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            hash ^= fields[f];
+            hash *= 0x100000001b3ULL;
+        }
+        for (uint32_t k = 0; c->type == DL_TEXT && k < c->text_len; k++) {
+            hash ^= (uint8_t)dl->text[c->text_off + k];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash ? hash : 1;
+}
+
+/* Regions a command is guaranteed to paint opaquely */
+static int dl_opaque_rects(const dl_cmd_t *c, gfx_rect_t out[2]) {
+    switch (c->type) {
+    case DL_RECT:
+    case DL_GRADIENT:
+        out[0] = c->bounds;
+        return 1;
+    case DL_RECT_ALPHA:
+        if (c->alpha != 255) return 0;
+        out[0] = c->bounds;
+        return 1;
+    case DL_ROUNDED_RECT:
+        if (c->w < 2 * c->r || c->h < 2 * c->r) return 0;
+        out[0] = rect_intersect(rect_make(c->x + c->r, c->y, c->w - 2 * c->r, c->h), screen_rect());
+        out[1] = rect_intersect(rect_make(c->x, c->y + c->r, c->w, c->h - 2 * c->r), screen_rect());
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/* piece -= occ; writes up to 4 remainders to out, returns how many */
+static int rect_subtract(gfx_rect_t p, gfx_rect_t occ, gfx_rect_t out[4]) {
+    gfx_rect_t in = rect_intersect(p, occ);
+    if (rect_empty(&in)) { out[0] = p; return 1; }
+
+    int n = 0;
+    if (p.y0 < in.y0) out[n++] = (gfx_rect_t){ p.x0, p.y0, p.x1, in.y0 };
+    if (in.y1 < p.y1) out[n++] = (gfx_rect_t){ p.x0, in.y1, p.x1, p.y1 };
+    if (p.x0 < in.x0) out[n++] = (gfx_rect_t){ p.x0, in.y0, in.x0, in.y1 };
+    if (in.x1 < p.x1) out[n++] = (gfx_rect_t){ in.x1, in.y0, p.x1, in.y1 };
+    return n;
+}
+
+/* Back-to-front pass: each command keeps only what no later opaque command covers */
+static void dl_cull(gfx_rect_t area) {
+    gfx_rect_t occ[DL_MAX_OCCLUDERS];
+    int occ_count = 0;
+    uint32_t used = 0;
+
+    for (int32_t i = (int32_t)dl_cur->count - 1; i >= 0; i--) {
+        const dl_cmd_t *c = &dl_cur->cmds[i];
+        gfx_rect_t work[DL_MAX_SPLIT], next[DL_MAX_SPLIT + 3];
+        int n = 0;
+
+        gfx_rect_t vis = rect_intersect(c->bounds, area);
+        if (!rect_empty(&vis)) work[n++] = vis;
+
+        for (int o = 0; o < occ_count && n > 0; o++) {
+            int m = 0, overflow = 0;
+            for (int k = 0; k < n; k++) {
+                gfx_rect_t rem[4];
+                int cnt = rect_subtract(work[k], occ[o], rem);
+                if (m + cnt > DL_MAX_SPLIT) { overflow = 1; break; }
+                for (int q = 0; q < cnt; q++) next[m++] = rem[q];
+            }
+            if (overflow) continue; /* Too fragmented: keep this occluder's area (conservative) */
+            for (int k = 0; k < m; k++) work[k] = next[k];
+            n = m;
+        }
+
+        /* Only fills are cheap to draw piecewise; the rest stay whole if any part shows */
+        if (n > 0 && c->type != DL_RECT && c->type != DL_RECT_ALPHA && c->type != DL_GRADIENT) {
+            work[0] = vis;
+            n = 1;
+        }
+        if (used + n > DL_MAX_PIECES) { /* Out of piece storage: draw unculled */
+            work[0] = vis;
+            n = rect_empty(&vis) ? 0 : 1;
+            if (used + n > DL_MAX_PIECES) n = 0;
+        }
+
+        dl_piece_start[i] = used;
+        dl_piece_count[i] = n;
+        for (int k = 0; k < n; k++) dl_pieces[used++] = work[k];
+
+        /* A visible blur samples everything beneath it, even what later
+         * commands hide, so stop occluding inside its bounds. */
+        if (c->type == DL_BLUR && n > 0) {
+            int kept = 0;
+            for (int o = 0; o < occ_count; o++) {
+                gfx_rect_t in = rect_intersect(occ[o], c->bounds);
+                if (rect_empty(&in)) occ[kept++] = occ[o];
+            }
+            occ_count = kept;
+        }
+
+        gfx_rect_t op[2];
+        int op_count = dl_opaque_rects(c, op);
+        for (int k = 0; k < op_count; k++) {
+            gfx_rect_t r = rect_intersect(op[k], area);
+            if (rect_empty(&r)) continue;
+            int64_t a = (int64_t)(r.x1 - r.x0) * (r.y1 - r.y0);
+            if (a < DL_MIN_OCCLUDER) continue;
+            if (occ_count < DL_MAX_OCCLUDERS) {
+                occ[occ_count++] = r;
+            } else {
+                /* Keep the biggest occluders */
+                int smallest = 0;
+                int64_t sa = INT64_MAX;
+                for (int q = 0; q < occ_count; q++) {
+                    int64_t qa = (int64_t)(occ[q].x1 - occ[q].x0) * (occ[q].y1 - occ[q].y0);
+                    if (qa < sa) { sa = qa; smallest = q; }
+                }
+                if (a > sa) occ[smallest] = r;
+            }
+        }
+    }
+}
+
+static void dl_replay_cmd(const display_list_t *dl, const dl_cmd_t *c, uint64_t key) {
+    switch (c->type) {
+    case DL_BLUR:         raster_blur(c->x, c->y, c->w, c->h, c->r, c->c1, c->alpha, key); break;
+    case DL_RECT:         raster_rect(c->x, c->y, c->w, c->h, c->c1); break;
+    case DL_RECT_ALPHA:   raster_rect_alpha(c->x, c->y, c->w, c->h, c->c1, c->alpha); break;
+    case DL_ROUNDED_RECT: raster_rounded_rect(c->x, c->y, c->w, c->h, c->r, c->c1); break;
+    case DL_GRADIENT:     raster_gradient(c->x, c->y, c->w, c->h, c->c1, c->c2); break;
+    case DL_IMAGE:        raster_image(c->x, c->y, c->w, c->h, c->image); break;
+    case DL_TEXT: {
+        char buf[256];
+        uint32_t len = c->text_len < sizeof(buf) - 1 ? c->text_len : sizeof(buf) - 1;
+        for (uint32_t i = 0; i < len; i++) buf[i] = dl->text[c->text_off + i];
+        buf[len] = 0;
+        rect_union(&damage, rect_intersect(c->bounds, clip));
+        font_draw_string(buf, c->x, c->y, c->c1);
+        break;
+    }
+    }
+}
+
+void gfx_dl_begin() {
+    dl_cur->count = 0;
+    dl_cur->text_used = 0;
+    dl_recording = 1;
+}
+
+void gfx_dl_end() {
+    if (!dl_recording) return; /* Overflowed and already painted */
+    dl_recording = 0;
+
+    gfx_rect_t area = rect_intersect(dl_compute_damage(), screen_rect());
+    if (!rect_empty(&area)) {
+        dl_cull(area);
+        for (uint32_t i = 0; i < dl_cur->count; i++) {
+            for (uint32_t k = 0; k < dl_piece_count[i]; k++) {
+                clip = dl_pieces[dl_piece_start[i] + k];
+                uint64_t key = dl_cur->cmds[i].type == DL_BLUR ? dl_backdrop_key(dl_cur, i) : 0;
+                dl_replay_cmd(dl_cur, &dl_cur->cmds[i], key);
+            }
+        }
+        clip = screen_rect();
+    }
+
+    display_list_t *t = dl_prev;
+    dl_prev = dl_cur;
+    dl_cur = t;
+    dl_prev_valid = 1;
+}
+
+int gfx_dl_is_recording() {
+    return dl_recording;
+}
+
+void gfx_dl_text(const char *str, uint32_t x, uint32_t y, color_t color) {
+    uint32_t len = 0;
+    while (str[len]) len++;
+    if (dl_cur->text_used + len > DL_MAX_TEXT) {
+        dl_overflow();
+        font_draw_string(str, x, y, color);
+        return;
+    }
+    dl_cmd_t *c = dl_push(DL_TEXT, x, y, len * 8, 8);
+    if (!c) {
+        font_draw_string(str, x, y, color);
+        return;
+    }
+    c->c1 = color;
+    c->text_off = dl_cur->text_used;
+    c->text_len = len;
+    for (uint32_t i = 0; i < len; i++) dl_cur->text[dl_cur->text_used++] = str[i];
+}
+
+/* ------------------------------------------------------------------------
+ * Public drawing API (records while a display list is open)
+ * ---------------------------------------------------------------------- */
+
+void gfx_put_pixel(uint32_t x, uint32_t y, color_t color) {
+    if (dl_recording) { gfx_draw_rect(x, y, 1, 1, color); return; }
+    if ((int32_t)x < clip.x0 || (int32_t)x >= clip.x1 || (int32_t)y < clip.y0 || (int32_t)y >= clip.y1) return;
+    immediate_draw();
+    rect_union(&damage, rect_make(x, y, 1, 1));
+    back_buffer.address[y * (back_buffer.width) + x] = color;
+}
+
+void gfx_blend_pixel(uint32_t x, uint32_t y, color_t color, uint8_t alpha) {
+    if (dl_recording) { gfx_draw_rect_alpha(x, y, 1, 1, color, alpha); return; }
+    if ((int32_t)x < clip.x0 || (int32_t)x >= clip.x1 || (int32_t)y < clip.y0 || (int32_t)y >= clip.y1) return;
+    immediate_draw();
+    rect_union(&damage, rect_make(x, y, 1, 1));
+
+    uint32_t idx = y * (back_buffer.width) + x;
+    back_buffer.address[idx] = blend(back_buffer.address[idx], color, alpha);
+}
+
+void gfx_draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color) {
+    if (dl_recording) {
+        if (dl_merge_fill(DL_RECT, x, y, w, h, color, 255)) return;
+        dl_cmd_t *c = dl_push(DL_RECT, x, y, w, h);
+        if (c) { c->c1 = color; c->alpha = 255; return; }
+    }
+    immediate_draw();
+    raster_rect(x, y, w, h, color);
+}
+
+void gfx_draw_rect_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha) {
+    if (dl_recording) {
+        if (dl_merge_fill(DL_RECT_ALPHA, x, y, w, h, color, alpha)) return;
+        dl_cmd_t *c = dl_push(DL_RECT_ALPHA, x, y, w, h);
+        if (c) { c->c1 = color; c->alpha = alpha; return; }
+    }
+    immediate_draw();
+    raster_rect_alpha(x, y, w, h, color, alpha);
+}
+
+void gfx_draw_rounded_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t r, color_t color) {
+    if (dl_recording) {
+        dl_cmd_t *c = dl_push(DL_ROUNDED_RECT, x, y, w, h);
+        if (c) { c->r = r; c->c1 = color; return; }
+    }
+    immediate_draw();
+    raster_rounded_rect(x, y, w, h, r, color);
+}
+
+void gfx_draw_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t c1, color_t c2) {
+    if (dl_recording) {
+        dl_cmd_t *c = dl_push(DL_GRADIENT, x, y, w, h);
+        if (c) { c->c1 = c1; c->c2 = c2; return; }
+    }
+    immediate_draw();
+    raster_gradient(x, y, w, h, c1, c2);
+}
+
+void gfx_draw_image(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t* data) {
+    if (dl_recording) {
+        dl_cmd_t *c = dl_push(DL_IMAGE, x, y, w, h);
+        if (c) { c->image = data; return; }
+    }
+    immediate_draw();
+    raster_image(x, y, w, h, data);
+}
+
+void gfx_draw_backdrop_blur(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t radius, color_t tint, uint8_t alpha) {
+    if (dl_recording) {
+        dl_cmd_t *c = dl_push(DL_BLUR, x, y, w, h);
+        if (c) { c->r = radius; c->c1 = tint; c->alpha = alpha; return; }
+    }
+    immediate_draw();
+    raster_blur(x, y, w, h, radius, tint, alpha, 0);
+}
+
 void gfx_clear(color_t color) {
-    for (uint32_t i = 0; i < back_buffer.width * back_buffer.height; i++) {
-        back_buffer.address[i] = color;
+    gfx_draw_rect(0, 0, back_buffer.width, back_buffer.height, color);
+}
+
+/* Clip a sprite against the front buffer. Returns 0 if nothing is visible. */
+static int overlay_clip(const gfx_sprite_t *s, uint32_t *x0, uint32_t *y0, uint32_t *x1, uint32_t *y1) {
+    int64_t l = s->x, t = s->y;
+    int64_t r = l + s->w, b = t + s->h;
+    if (l < 0) l = 0;
+    if (t < 0) t = 0;
+    if (r > (int64_t)front_buffer.width) r = front_buffer.width;
+    if (b > (int64_t)front_buffer.height) b = front_buffer.height;
+    if (l >= r || t >= b) return 0;
+    *x0 = l; *y0 = t; *x1 = r; *y1 = b;
+    return 1;
+}
+
+/* Put the saved pixels back, newest sprite first so overlapping sprites unwind correctly */
+static void overlay_hide() {
+    if (!overlay_visible) return;
+    uint32_t stride = front_buffer.pitch / 4;
+    for (int k = overlay_count - 1; k >= 0; k--) {
+        uint32_t x0, y0, x1, y1;
+        if (!overlay_clip(&overlay[k], &x0, &y0, &x1, &y1)) continue;
+        const uint32_t *saved = overlay_saved[k];
+        for (uint32_t i = y0; i < y1; i++) {
+            for (uint32_t j = x0; j < x1; j++) {
+                front_buffer.address[i * stride + j] = *saved++;
+            }
+        }
+    }
+    overlay_visible = 0;
+}
+
+/* Save what is under each sprite, then draw it straight into the front buffer */
+static void overlay_show() {
+    if (overlay_visible) return;
+    uint32_t stride = front_buffer.pitch / 4;
+    for (int k = 0; k < overlay_count; k++) {
+        uint32_t x0, y0, x1, y1;
+        if (!overlay_clip(&overlay[k], &x0, &y0, &x1, &y1)) continue;
+        uint32_t *saved = overlay_saved[k];
+        for (uint32_t i = y0; i < y1; i++) {
+            for (uint32_t j = x0; j < x1; j++) {
+                uint32_t *px = &front_buffer.address[i * stride + j];
+                *saved++ = *px;
+                *px = (overlay[k].alpha == 255) ? overlay[k].color : blend(*px, overlay[k].color, overlay[k].alpha);
+            }
+        }
     }
+    overlay_visible = 1;
+}
+
+int gfx_overlay_set(const gfx_sprite_t *sprites, int count) {
+    if (count > GFX_OVERLAY_MAX_SPRITES) count = GFX_OVERLAY_MAX_SPRITES;
+
+    /* Nothing moved: leave the front buffer alone */
+    if (overlay_visible && count == overlay_count) {
+        int same = 1;
+        for (int k = 0; k < count && same; k++) {
+            same = sprites[k].x == overlay[k].x && sprites[k].y == overlay[k].y &&
+                   sprites[k].w == overlay[k].w && sprites[k].h == overlay[k].h &&
+                   sprites[k].color == overlay[k].color && sprites[k].alpha == overlay[k].alpha;
+        }
+        if (same) return 0;
+    }
+
+    overlay_hide();
+    for (int k = 0; k < count; k++) {
+        overlay[k] = sprites[k];
+        if (overlay[k].w > GFX_OVERLAY_MAX_DIM) overlay[k].w = GFX_OVERLAY_MAX_DIM;
+        if (overlay[k].h > GFX_OVERLAY_MAX_DIM) overlay[k].h = GFX_OVERLAY_MAX_DIM;
+    }
+    overlay_count = count;
+    overlay_show();
+    return 1;
 }
 
 void gfx_swap_buffers() {
-    /* Copy backbuffer to frontbuffer (Clamped Region Only) */
-    for (uint32_t i = 0; i < back_buffer.height; i++) {
-        for (uint32_t j = 0; j < back_buffer.width; j++) {
+    /* The copy below overwrites the overlay, so lift it off first and put it
+     * back on top of the new frame (re-saving the fresh pixels underneath). */
+    overlay_hide();
+
+    /* Copy backbuffer to frontbuffer (Damaged Region Only) */
+    for (int32_t i = damage.y0; i < damage.y1; i++) {
+        for (int32_t j = damage.x0; j < damage.x1; j++) {
             front_buffer.address[i * (front_buffer.pitch / 4) + j] = back_buffer.address[i * (back_buffer.width) + j];
         }
     }
+    damage = (gfx_rect_t){ 0, 0, 0, 0 };
+
+    overlay_show();
 }
@@ -19,6 +19,12 @@ typedef struct {
     uint64_t pitch;
 } framebuffer_t;
 
+/* Half-open rectangle [x0, x1) x [y0, y1) */
+typedef struct {
+    int32_t x0, y0;
+    int32_t x1, y1;
+} gfx_rect_t;
+
 void gfx_init(struct limine_framebuffer *fb);
 void gfx_put_pixel(uint32_t x, uint32_t y, color_t color);
 void gfx_blend_pixel(uint32_t x, uint32_t y, color_t color, uint8_t alpha);
@@ -26,10 +32,34 @@ void gfx_draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color
 void gfx_draw_rect_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha);
 void gfx_draw_rounded_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t r, color_t color);
 void gfx_draw_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t c1, color_t c2);
+void gfx_draw_backdrop_blur(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t radius, color_t tint, uint8_t alpha);
 void gfx_draw_image(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t* data);
 void gfx_clear(color_t color);
 
-/* Double buffering support */
+/* Double buffering support (presents only what was drawn since the last swap) */
 void gfx_swap_buffers();
 
+/* Display list mode: draw calls between begin/end are recorded, culled
+ * against later opaque commands and replayed only where the frame differs
+ * from the previous list. */
+void gfx_dl_begin();
+void gfx_dl_end();
+int gfx_dl_is_recording();
+void gfx_dl_text(const char *str, uint32_t x, uint32_t y, color_t color);
+
+/* Cursor overlay plane: sprites live directly in the front buffer with
+ * the pixels underneath saved, so moving them never touches the back buffer. */
+#define GFX_OVERLAY_MAX_SPRITES 16
+#define GFX_OVERLAY_MAX_DIM     16
+
+typedef struct {
+    int32_t x, y;
+    uint32_t w, h;
+    color_t color;
+    uint8_t alpha;
+} gfx_sprite_t;
+
+/* Returns 1 if the front buffer was touched */
+int gfx_overlay_set(const gfx_sprite_t *sprites, int count);
+
 #endif
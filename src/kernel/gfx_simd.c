@@ -0,0 +1,63 @@
+#include "gfx_simd.h"
+#include <emmintrin.h>
+
+/* Two pixels widened to the 16-bit lanes used by gfx.c, alpha lanes cleared */
+static inline __m128i widen(__m128i px) {
+    __m128i w = _mm_unpacklo_epi8(px, _mm_setzero_si128());
+    return _mm_and_si128(w, _mm_set1_epi64x(0x0000FFFFFFFFFFFFLL));
+}
+
+/* sum * inv >> 16 per lane, repacked to opaque pixels in the low 64 bits */
+static inline __m128i narrow(__m128i sum, __m128i inv) {
+    __m128i q = _mm_mulhi_epu16(sum, inv);
+    return _mm_or_si128(_mm_packus_epi16(q, q), _mm_set1_epi32((int)0xFF000000));
+}
+
+void blur_cols_sse2(const uint32_t *src, uint32_t *dst, uint64_t *colsum, uint32_t w, uint32_t h, uint32_t r) {
+    __m128i inv = _mm_set1_epi16((short)((65536 + 2 * r) / (2 * r + 1)));
+    __m128i edge = _mm_set1_epi16((short)(r + 1));
+    uint32_t pairs = w & ~1u;
+
+    // Lanes never exceed 255 * (2r + 1), so 16-bit wraparound can't occur
+    for (uint32_t x = 0; x < pairs; x += 2) {
+        __m128i s = _mm_mullo_epi16(widen(_mm_loadl_epi64((const __m128i *)&src[x])), edge);
+        _mm_storeu_si128((__m128i *)&colsum[x], s);
+    }
+    if (pairs < w) {
+        __m128i s = _mm_mullo_epi16(widen(_mm_cvtsi32_si128((int)src[pairs])), edge);
+        _mm_storel_epi64((__m128i *)&colsum[pairs], s);
+    }
+    for (uint32_t i = 1; i <= r; i++) {
+        const uint32_t *in = &src[(i < h ? i : h - 1) * w];
+        for (uint32_t x = 0; x < pairs; x += 2) {
+            __m128i s = _mm_loadu_si128((const __m128i *)&colsum[x]);
+            s = _mm_add_epi16(s, widen(_mm_loadl_epi64((const __m128i *)&in[x])));
+            _mm_storeu_si128((__m128i *)&colsum[x], s);
+        }
+        if (pairs < w) {
+            __m128i s = _mm_loadl_epi64((const __m128i *)&colsum[pairs]);
+            s = _mm_add_epi16(s, widen(_mm_cvtsi32_si128((int)in[pairs])));
+            _mm_storel_epi64((__m128i *)&colsum[pairs], s);
+        }
+    }
+
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t *out = &dst[y * w];
+        const uint32_t *add = &src[(y + r + 1 < h ? y + r + 1 : h - 1) * w];
+        const uint32_t *sub = &src[(y >= r ? y - r : 0) * w];
+        for (uint32_t x = 0; x < pairs; x += 2) {
+            __m128i s = _mm_loadu_si128((const __m128i *)&colsum[x]);
+            _mm_storel_epi64((__m128i *)&out[x], narrow(s, inv));
+            s = _mm_add_epi16(s, widen(_mm_loadl_epi64((const __m128i *)&add[x])));
+            s = _mm_sub_epi16(s, widen(_mm_loadl_epi64((const __m128i *)&sub[x])));
+            _mm_storeu_si128((__m128i *)&colsum[x], s);
+        }
+        if (pairs < w) {
+            __m128i s = _mm_loadl_epi64((const __m128i *)&colsum[pairs]);
+            out[pairs] = (uint32_t)_mm_cvtsi128_si32(narrow(s, inv));
+            s = _mm_add_epi16(s, widen(_mm_cvtsi32_si128((int)add[pairs])));
+            s = _mm_sub_epi16(s, widen(_mm_cvtsi32_si128((int)sub[pairs])));
+            _mm_storel_epi64((__m128i *)&colsum[pairs], s);
+        }
+    }
+}
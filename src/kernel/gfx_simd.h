@@ -0,0 +1,16 @@
+#ifndef GFX_SIMD_H
+#define GFX_SIMD_H
+
+#include <stdint.h>
+
+/*
+ * SSE2 inner loops for gfx.c. This file's translation unit is built without
+ * -mgeneral-regs-only, so every call must sit inside kernel_fpu_begin() /
+ * kernel_fpu_end() (see fpu.h).
+ */
+
+/* Vertical box blur of radius r; matches blur_cols() in gfx.c bit for bit.
+ * `colsum` holds w running sums in the 16-bit b/g/r lane layout. */
+void blur_cols_sse2(const uint32_t *src, uint32_t *dst, uint64_t *colsum, uint32_t w, uint32_t h, uint32_t r);
+
+#endif
@@ -0,0 +1,205 @@
+#include "interrupts.h"
+#include "apic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "ports.h"
+#include "serial.h"
+#include "smp.h"
+#include "sync.h"
+#include "sched.h"
+#include "workqueue.h"
+#include "syscall.h"
+#include "ksym.h"
+#include "trace.h"
+
+static interrupt_handler_t handlers[256];
+static const char *handler_names[256];
+static uint64_t counts[256];
+static int using_apic = 0;
+DEFINE_SPINLOCK(alloc_lock, "irq_alloc");
+
+static const char *exception_names[32] = {
+    "Divide Error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound Range",
+    "Invalid Opcode", "Device Not Available", "Double Fault", "Coprocessor Overrun",
+    "Invalid TSS", "Segment Not Present", "Stack Fault", "General Protection",
+    "Page Fault", "Reserved", "x87 FP", "Alignment Check", "Machine Check",
+    "SIMD FP", "Virtualization", "Control Protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Hypervisor Injection",
+    "VMM Communication", "Security", "Reserved"
+};
+
+void exception_panic(interrupt_frame_t *frame) {
+    uint64_t cr2;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+    serial_panic();
+
+    serial_print("\n[PARADOX] EXCEPTION: ");
+    serial_print(exception_names[frame->vector]);
+    serial_print(" (vector ");
+    serial_print_dec(frame->vector);
+    serial_print(")\n  error=");
+    serial_print_hex(frame->error_code);
+    serial_print(" rip=");
+    serial_print_hex(frame->rip);
+    serial_print(" rsp=");
+    serial_print_hex(frame->rsp);
+    serial_print(" cr2=");
+    serial_print_hex(cr2);
+    serial_print("\n  at ");
+    ksym_print(frame->rip);
+    serial_print("\n");
+
+    uint64_t pcs[16];
+    int depth = ksym_backtrace(frame->rbp, frame->rsp, pcs, 16);
+    for (int i = 0; i < depth; i++) {
+        serial_print("  from ");
+        ksym_print(pcs[i]);
+        serial_print("\n");
+    }
+
+    for (;;) __asm__ volatile ("cli; hlt");
+}
+
+static void legacy_pic_eoi(uint8_t vector) {
+    if (vector >= IRQ_VECTOR_BASE + 8) outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+/* Called from isr_common with the stub-built frame */
+void interrupt_dispatch(interrupt_frame_t *frame) {
+    uint8_t vector = frame->vector;
+    percpu_t *cpu = this_cpu();
+    __atomic_fetch_add(&counts[vector], 1, __ATOMIC_RELAXED);
+    cpu->irq_count++;
+    cpu->irq_depth++;
+    void *outer_frame = cpu->irq_frame;
+    cpu->irq_frame = frame;
+    TRACE(TRACE_IRQ_ENTER, vector, 0, 0);
+
+    if (handlers[vector]) {
+        handlers[vector](frame);
+    } else if (vector < 32) {
+        if ((frame->cs & 3) == 3) { // A user bug, not a kernel one
+            cpu->irq_frame = outer_frame;
+            cpu->irq_depth--;
+            syscall_user_fault(frame);
+        }
+        exception_panic(frame);
+    }
+
+    TRACE(TRACE_IRQ_EXIT, vector, 0, 0);
+    cpu->irq_frame = outer_frame;
+    cpu->irq_depth--;
+    if (vector < IRQ_VECTOR_BASE || vector == APIC_SPURIOUS_VECTOR) return;
+    if (using_apic) {
+        lapic_eoi();
+    } else if (vector < IRQ_VECTOR_BASE + 16) {
+        legacy_pic_eoi(vector);
+    }
+
+    // Bottom halves run with interrupts re-enabled, after the EOI
+    softirq_irq_exit();
+
+    // Preemption point: may switch to another task's stack and return later
+    sched_irq_exit();
+}
+
+int interrupt_register(uint8_t vector, interrupt_handler_t handler, const char *name) {
+    if (handlers[vector] && handlers[vector] != handler) return 0;
+    handler_names[vector] = name;
+    handlers[vector] = handler;
+    return 1;
+}
+
+uint8_t interrupt_alloc(interrupt_handler_t handler, const char *name) {
+    uint8_t found = 0;
+    uint64_t flags = spin_lock_irqsave(&alloc_lock);
+    for (int v = IRQ_DYNAMIC_FIRST; v <= IRQ_DYNAMIC_LAST && !found; v++) {
+        if (handlers[v]) continue;
+        handler_names[v] = name;
+        handlers[v] = handler;
+        found = v;
+    }
+    spin_unlock_irqrestore(&alloc_lock, flags);
+    return found;
+}
+
+void interrupt_free(uint8_t vector) {
+    if (vector < IRQ_DYNAMIC_FIRST || vector > IRQ_DYNAMIC_LAST) return;
+    uint64_t flags = spin_lock_irqsave(&alloc_lock);
+    handlers[vector] = 0;
+    handler_names[vector] = 0;
+    spin_unlock_irqrestore(&alloc_lock, flags);
+}
+
+int interrupts_using_apic() {
+    return using_apic;
+}
+
+int irq_install(uint8_t irq, interrupt_handler_t handler, const char *name) {
+    uint8_t vector = IRQ_VECTOR_BASE + irq;
+    if (!interrupt_register(vector, handler, name)) return 0;
+
+    if (using_apic) return ioapic_route_irq(irq, vector, lapic_id());
+
+    if (irq < 8) {
+        outb(0x21, inb(0x21) & ~(1 << irq));
+    } else if (irq < 16) {
+        outb(0xA1, inb(0xA1) & ~(1 << (irq - 8)));
+        outb(0x21, inb(0x21) & ~(1 << 2)); // Cascade
+    }
+    return 1;
+}
+
+uint64_t interrupt_count(uint8_t vector) {
+    return counts[vector];
+}
+
+void interrupt_dump_stats() {
+    serial_print(using_apic ? "[IRQ] Delivery: LAPIC/IOAPIC\n" : "[IRQ] Delivery: legacy 8259\n");
+    for (int v = 0; v < 256; v++) {
+        if (!counts[v] && !handlers[v]) continue;
+        serial_print("[IRQ] vector ");
+        serial_print_dec(v);
+        serial_print(" ");
+        serial_print(handler_names[v] ? handler_names[v] : (v < 32 ? exception_names[v] : "unhandled"));
+        serial_print(": ");
+        serial_print_dec(counts[v]);
+        serial_print("\n");
+    }
+}
+
+static void irq_command(const char *args) {
+    (void)args;
+    interrupt_dump_stats();
+}
+
+static void spurious_handler(interrupt_frame_t *frame) {
+    (void)frame; // Never EOI'd
+}
+
+static void pic_remap() {
+    outb(0x20, 0x11);
+    outb(0xA0, 0x11);
+    outb(0x21, IRQ_VECTOR_BASE);     // Master offset 32
+    outb(0xA1, IRQ_VECTOR_BASE + 8); // Slave offset 40
+    outb(0x21, 0x04);
+    outb(0xA1, 0x02);
+    outb(0x21, 0x01);
+    outb(0xA1, 0x01);
+    outb(0x21, 0xFF);                // Everything masked until irq_install
+    outb(0xA1, 0xFF);
+}
+
+void interrupts_init() {
+    pic_remap();
+    if (acpi_init() && apic_init()) {
+        using_apic = 1;
+        serial_print("[PARADOX] LAPIC/IOAPIC interrupt delivery enabled.\n");
+    } else {
+        serial_print("[PARADOX] No MADT, falling back to the 8259 PIC.\n");
+    }
+
+    interrupt_register(APIC_SPURIOUS_VECTOR, spurious_handler, "spurious");
+    serial_register_command("irq", irq_command);
+}
@@ -0,0 +1,55 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+
+/* Legacy ISA IRQ n is delivered on vector IRQ_VECTOR_BASE + n */
+#define IRQ_VECTOR_BASE 0x20
+
+#define IRQ_KEYBOARD 1
+#define IRQ_COM1     4
+#define IRQ_MOUSE    12
+
+/* Register state pushed by the entry stubs in isr.S (lowest address first) */
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+} interrupt_frame_t;
+
+typedef void (*interrupt_handler_t)(interrupt_frame_t *frame);
+
+/* Masks the 8259s and switches to the LAPIC/IOAPIC when ACPI describes
+ * them; otherwise keeps the 8259s as a fallback. */
+void interrupts_init();
+
+/* Handlers run with interrupts disabled. IRQ vectors are acknowledged by
+ * the dispatcher after the handler returns, so handlers never EOI. Anything
+ * beyond reading the device belongs in a bottom half (workqueue.h). */
+int interrupt_register(uint8_t vector, interrupt_handler_t handler, const char *name);
+
+/* Device vectors (MSI/MSI-X) are handed out between the ISA range and the
+ * system vectors at 0xF0 and above */
+#define IRQ_DYNAMIC_FIRST (IRQ_VECTOR_BASE + 16)
+#define IRQ_DYNAMIC_LAST  0xEF
+
+/* Install a handler on an unused dynamic vector; returns it, or 0 if none
+ * is left */
+uint8_t interrupt_alloc(interrupt_handler_t handler, const char *name);
+/* Give back a vector from interrupt_alloc() once nothing can raise it */
+void interrupt_free(uint8_t vector);
+
+/* Register a handler for a legacy ISA IRQ and unmask it */
+int irq_install(uint8_t irq, interrupt_handler_t handler, const char *name);
+
+/* Dump the faulting context with a backtrace and halt this CPU */
+__attribute__((noreturn)) void exception_panic(interrupt_frame_t *frame);
+
+int interrupts_using_apic(); // 0 while the 8259s deliver IRQs
+
+uint64_t interrupt_count(uint8_t vector);
+void interrupt_dump_stats();
+
+#endif
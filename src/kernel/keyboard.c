@@ -1,6 +1,8 @@
 #include "keyboard.h"
 #include "ports.h"
-#include "cpu.h"
+#include "interrupts.h"
+#include "workqueue.h"
+#include "trace.h"
 #include "gfx.h"
 #include "font.h"
 
@@ -14,44 +16,175 @@ static const char scancode_map[] = {
     'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0, '*', 0, ' '
 };
 
-static char last_key = 0;
+static const char scancode_map_shift[] = {
+    0,  27, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~', 0, '|',
+    'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0, '*', 0, ' '
+};
+
+/* Keypad (0x47..0x53) with Num Lock on */
+static const char keypad_map[] = {
+    '7', '8', '9', '-', '4', '5', '6', '+', '1', '2', '3', '0', '.'
+};
+
+/*
+ * Single-producer / single-consumer ring: the bottom half only advances
+ * `head`, the render loop only advances `tail`, so neither side needs a lock.
+ */
+#define KEY_QUEUE_SIZE 256 // Power of two
+
+static key_event_t key_queue[KEY_QUEUE_SIZE];
+static volatile uint32_t key_head = 0;
+static volatile uint32_t key_tail = 0;
+static uint32_t key_dropped = 0;
+static sched_event_t *key_notify = 0;
+
+/* Raw scancodes from the IRQ handler, decoded later by keyboard_bh */
+#define KEY_RAW_SIZE 64 // Power of two
+
+static struct {
+    uint64_t tsc;
+    uint8_t scancode;
+} key_raw[KEY_RAW_SIZE];
+static volatile uint32_t raw_head = 0;
+static volatile uint32_t raw_tail = 0;
+static uint32_t raw_dropped = 0;
+static work_t key_work;
+
+/* Decoder state (bottom half only) */
+static uint8_t mods = 0;
+static uint8_t lshift = 0, rshift = 0, lctrl = 0, rctrl = 0, lalt = 0, ralt = 0, lgui = 0, rgui = 0;
+static uint8_t e0_pending = 0;
+static uint8_t e1_skip = 0;
+
+static char translate(uint16_t keycode) {
+    if (keycode == KEY_KP_ENTER) return '\n';
+    if (keycode == KEY_KP_DIVIDE) return '/';
+    if (keycode & KEY_EXTENDED) return 0;
 
-char keyboard_get_last_key() {
-    char c = last_key;
-    last_key = 0; // Consume the key
-    return c;
+    if (keycode == 0x4A || keycode == 0x4E) return keypad_map[keycode - 0x47];
+    if (keycode >= 0x47 && keycode <= 0x53) {
+        return (mods & KEY_MOD_NUM) ? keypad_map[keycode - 0x47] : 0;
+    }
+    if (keycode >= sizeof(scancode_map)) return 0;
+
+    char c = scancode_map[keycode];
+    int shift = (mods & KEY_MOD_SHIFT) != 0;
+    if (c >= 'a' && c <= 'z' && (mods & KEY_MOD_CAPS)) shift = !shift;
+    return shift ? scancode_map_shift[keycode] : c;
 }
 
-__attribute__((interrupt))
-void keyboard_handler(void* frame) {
-    uint8_t scancode = inb(0x60);
-    
-    // Only handle key press (ignore release)
-    if (!(scancode & 0x80)) {
-        if (scancode < sizeof(scancode_map)) {
-            last_key = scancode_map[scancode];
-            
+static void update_mods(uint16_t keycode, int pressed) {
+    switch (keycode) {
+    case KEY_LSHIFT: lshift = pressed; break;
+    case KEY_RSHIFT: rshift = pressed; break;
+    case KEY_LCTRL:  lctrl = pressed; break;
+    case KEY_RCTRL:  rctrl = pressed; break;
+    case KEY_LALT:   lalt = pressed; break;
+    case KEY_RALT:   ralt = pressed; break;
+    case KEY_LGUI:   lgui = pressed; break;
+    case KEY_RGUI:   rgui = pressed; break;
+    case KEY_CAPSLOCK: if (pressed) mods ^= KEY_MOD_CAPS; break;
+    case KEY_NUMLOCK:  if (pressed) mods ^= KEY_MOD_NUM; break;
+    default: return;
+    }
+    mods &= KEY_MOD_CAPS | KEY_MOD_NUM;
+    if (lshift || rshift) mods |= KEY_MOD_SHIFT;
+    if (lctrl || rctrl) mods |= KEY_MOD_CTRL;
+    if (lalt || ralt) mods |= KEY_MOD_ALT;
+    if (lgui || rgui) mods |= KEY_MOD_GUI;
+}
+
+static void push_event(uint64_t tsc, uint16_t keycode, uint8_t flags) {
+    uint32_t head = key_head;
+    if (head - __atomic_load_n(&key_tail, __ATOMIC_ACQUIRE) >= KEY_QUEUE_SIZE) {
+        key_dropped++;
+        return;
+    }
+
+    key_event_t *ev = &key_queue[head & (KEY_QUEUE_SIZE - 1)];
+    ev->tsc = tsc;
+    ev->keycode = keycode;
+    ev->flags = flags;
+    ev->mods = mods;
+    ev->ascii = (flags & KEY_EVENT_RELEASED) ? 0 : translate(keycode);
+
+    __atomic_store_n(&key_head, head + 1, __ATOMIC_RELEASE);
+}
+
+int keyboard_poll_event(key_event_t *ev) {
+    uint32_t tail = key_tail;
+    if (tail == __atomic_load_n(&key_head, __ATOMIC_ACQUIRE)) return 0;
+
+    *ev = key_queue[tail & (KEY_QUEUE_SIZE - 1)];
+    __atomic_store_n(&key_tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void keyboard_set_notify(sched_event_t *ev) {
+    key_notify = ev;
+}
+
+uint32_t keyboard_dropped_events() {
+    return key_dropped + raw_dropped;
+}
+
+static void decode(uint64_t tsc, uint8_t scancode) {
+    if (e1_skip) {
+        /* Pause/Break: E1 1D 45 E1 9D C5, reported once as a press */
+        if (--e1_skip == 0) push_event(tsc, KEY_PAUSE, 0);
+    } else if (scancode == 0xE1) {
+        e1_skip = 5;
+    } else if (scancode == 0xE0) {
+        e0_pending = 1;
+    } else {
+        uint16_t keycode = scancode & 0x7F;
+        uint8_t flags = 0;
+        if (e0_pending) {
+            keycode |= KEY_EXTENDED;
+            flags |= KEY_EVENT_EXTENDED;
+            e0_pending = 0;
         }
+        if (scancode & 0x80) flags |= KEY_EVENT_RELEASED;
+
+        update_mods(keycode, !(flags & KEY_EVENT_RELEASED));
+        push_event(tsc, keycode, flags);
+    }
+}
+
+/* Bottom half: decode everything the IRQ handler queued */
+static void keyboard_bh(work_t *work) {
+    (void)work;
+    uint32_t before = key_head;
+    uint32_t tail = raw_tail;
+    while (tail != __atomic_load_n(&raw_head, __ATOMIC_ACQUIRE)) {
+        TRACE(TRACE_INPUT_KEY, key_raw[tail & (KEY_RAW_SIZE - 1)].scancode, key_raw[tail & (KEY_RAW_SIZE - 1)].tsc, 0);
+        decode(key_raw[tail & (KEY_RAW_SIZE - 1)].tsc, key_raw[tail & (KEY_RAW_SIZE - 1)].scancode);
+        tail++;
+        __atomic_store_n(&raw_tail, tail, __ATOMIC_RELEASE);
     }
+    if (key_head != before && key_notify) sched_event_signal(key_notify);
+}
+
+/* Top half: timestamp and stash the byte, nothing else */
+void keyboard_handler(interrupt_frame_t *frame) {
+    uint64_t tsc = __builtin_ia32_rdtsc();
+    uint8_t scancode = inb(0x60);
 
-    // Acknowledge PIC
-    outb(0x20, 0x20);
+    uint32_t head = raw_head;
+    if (head - __atomic_load_n(&raw_tail, __ATOMIC_ACQUIRE) < KEY_RAW_SIZE) {
+        key_raw[head & (KEY_RAW_SIZE - 1)].tsc = tsc;
+        key_raw[head & (KEY_RAW_SIZE - 1)].scancode = scancode;
+        __atomic_store_n(&raw_head, head + 1, __ATOMIC_RELEASE);
+    } else {
+        raw_dropped++;
+    }
+    softirq_raise(&key_work);
     (void)frame;
 }
 
 void keyboard_init() {
-    /* 1. Remap PIC */
-    outb(0x20, 0x11);
-    outb(0xA0, 0x11);
-    outb(0x21, 0x20); // Master offset 32
-    outb(0xA1, 0x28); // Slave offset 40
-    outb(0x21, 0x04);
-    outb(0xA1, 0x02);
-    outb(0x21, 0x01);
-    outb(0xA1, 0x01);
-    outb(0x21, 0x0);
-    outb(0xA1, 0x0);
-
-    /* 2. Register Keyboard Interrupt (33 since Master PIT is 32) */
-    idt_set_descriptor(33, keyboard_handler, 0x8E);
+    work_init(&key_work, keyboard_bh, 0);
+    irq_install(IRQ_KEYBOARD, keyboard_handler, "ps2-keyboard");
 }
@@ -2,9 +2,76 @@
 #define KEYBOARD_H
 
 #include <stdint.h>
+#include "interrupts.h"
+#include "sched.h"
+
+/* Keycodes are PS/2 set-1 make codes; E0-prefixed keys get 0x100 added */
+#define KEY_EXTENDED    0x100
+
+#define KEY_ESCAPE      0x01
+#define KEY_BACKSPACE   0x0E
+#define KEY_TAB         0x0F
+#define KEY_ENTER       0x1C
+#define KEY_LCTRL       0x1D
+#define KEY_LSHIFT      0x2A
+#define KEY_RSHIFT      0x36
+#define KEY_LALT        0x38
+#define KEY_SPACE       0x39
+#define KEY_CAPSLOCK    0x3A
+#define KEY_F1          0x3B
+#define KEY_F10         0x44
+#define KEY_NUMLOCK     0x45
+#define KEY_SCROLLLOCK  0x46
+#define KEY_F11         0x57
+#define KEY_F12         0x58
+
+#define KEY_KP_ENTER    (KEY_EXTENDED | 0x1C)
+#define KEY_RCTRL       (KEY_EXTENDED | 0x1D)
+#define KEY_KP_DIVIDE   (KEY_EXTENDED | 0x35)
+#define KEY_RALT        (KEY_EXTENDED | 0x38)
+#define KEY_HOME        (KEY_EXTENDED | 0x47)
+#define KEY_UP          (KEY_EXTENDED | 0x48)
+#define KEY_PAGEUP      (KEY_EXTENDED | 0x49)
+#define KEY_LEFT        (KEY_EXTENDED | 0x4B)
+#define KEY_RIGHT       (KEY_EXTENDED | 0x4D)
+#define KEY_END         (KEY_EXTENDED | 0x4F)
+#define KEY_DOWN        (KEY_EXTENDED | 0x50)
+#define KEY_PAGEDOWN    (KEY_EXTENDED | 0x51)
+#define KEY_INSERT      (KEY_EXTENDED | 0x52)
+#define KEY_DELETE      (KEY_EXTENDED | 0x53)
+#define KEY_LGUI        (KEY_EXTENDED | 0x5B)
+#define KEY_RGUI        (KEY_EXTENDED | 0x5C)
+#define KEY_MENU        (KEY_EXTENDED | 0x5D)
+#define KEY_PAUSE       0x1FF
+
+/* key_event_t.flags */
+#define KEY_EVENT_RELEASED 0x01
+#define KEY_EVENT_EXTENDED 0x02
+
+/* key_event_t.mods (state after the event was applied) */
+#define KEY_MOD_SHIFT   0x01
+#define KEY_MOD_CTRL    0x02
+#define KEY_MOD_ALT     0x04
+#define KEY_MOD_GUI     0x08
+#define KEY_MOD_CAPS    0x10
+#define KEY_MOD_NUM     0x20
+
+typedef struct {
+    uint64_t tsc;       // Timestamp taken in the IRQ handler
+    uint16_t keycode;
+    uint8_t flags;
+    uint8_t mods;
+    char ascii;         // Translated character on press, 0 otherwise
+} key_event_t;
 
 void keyboard_init();
-void keyboard_handler();
-char keyboard_get_last_key();
+void keyboard_handler(interrupt_frame_t *frame);
+
+/* Dequeue the oldest pending event. Returns 0 when the queue is empty. */
+int keyboard_poll_event(key_event_t *ev);
+uint32_t keyboard_dropped_events();
+
+/* Signaled whenever an event is queued, so a consumer thread can sleep */
+void keyboard_set_notify(sched_event_t *ev);
 
 #endif
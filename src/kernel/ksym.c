@@ -0,0 +1,164 @@
+#include "ksym.h"
+#include "serial.h"
+#include "memory/pmm.h"
+#include "../boot/limine.h"
+
+__attribute__((used, section(".rodata"), aligned(8)))
+volatile struct limine_kernel_file_request kernel_file_request = {
+    .id = LIMINE_KERNEL_FILE_REQUEST,
+    .revision = 0
+};
+
+/* Just enough of the ELF64 format to find .symtab */
+typedef struct {
+    uint8_t ident[16];
+    uint16_t type, machine;
+    uint32_t version;
+    uint64_t entry, phoff, shoff;
+    uint32_t flags;
+    uint16_t ehsize, phentsize, phnum, shentsize, shnum, shstrndx;
+} elf64_ehdr_t;
+
+typedef struct {
+    uint32_t name, type;
+    uint64_t flags, addr, offset, size;
+    uint32_t link, info;
+    uint64_t addralign, entsize;
+} elf64_shdr_t;
+
+typedef struct {
+    uint32_t name;
+    uint8_t info, other;
+    uint16_t shndx;
+    uint64_t value, size;
+} elf64_sym_t;
+
+#define SHT_SYMTAB     2
+#define SHF_EXECINSTR  0x4
+#define STT_NOTYPE     0
+#define STT_FUNC       2
+
+typedef struct {
+    uint64_t addr;
+    uint64_t end;       // Start of the next symbol if the ELF gave no size
+    const char *name;   // Points into the loaded kernel file
+} ksym_t;
+
+static ksym_t *syms = 0;
+static int sym_count = 0;
+
+/* Code symbols only; asm entry points are NOTYPE, so take those too */
+static int wanted(const elf64_sym_t *s, const elf64_shdr_t *sh, uint16_t shnum, const char *strtab) {
+    uint8_t type = s->info & 0xF;
+    if (type != STT_FUNC && type != STT_NOTYPE) return 0;
+    if (!s->name || !s->value || s->shndx == 0 || s->shndx >= shnum) return 0;
+    if (!(sh[s->shndx].flags & SHF_EXECINSTR)) return 0;
+    const char *name = strtab + s->name;
+    return !(name[0] == '.' && name[1] == 'L');
+}
+
+void ksym_init() {
+    if (!kernel_file_request.response || !kernel_file_request.response->kernel_file) return;
+    uint8_t *file = kernel_file_request.response->kernel_file->address;
+    elf64_ehdr_t *eh = (elf64_ehdr_t *)file;
+    if (eh->ident[0] != 0x7F || eh->ident[1] != 'E' || eh->ident[2] != 'L' || eh->ident[3] != 'F') return;
+
+    elf64_shdr_t *sh = (elf64_shdr_t *)(file + eh->shoff);
+    elf64_shdr_t *symtab = 0;
+    for (int i = 0; i < eh->shnum; i++) {
+        if (sh[i].type == SHT_SYMTAB) symtab = &sh[i];
+    }
+    if (!symtab || symtab->link >= eh->shnum) return;
+
+    elf64_sym_t *esyms = (elf64_sym_t *)(file + symtab->offset);
+    uint64_t n = symtab->size / sizeof(elf64_sym_t);
+    const char *strtab = (const char *)(file + sh[symtab->link].offset);
+
+    int count = 0;
+    for (uint64_t i = 0; i < n; i++) count += wanted(&esyms[i], sh, eh->shnum, strtab);
+    if (!count) return;
+
+    syms = pmm_alloc((count * sizeof(ksym_t) + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (!syms) return;
+    for (uint64_t i = 0; i < n; i++) {
+        if (!wanted(&esyms[i], sh, eh->shnum, strtab)) continue;
+        syms[sym_count].addr = esyms[i].value;
+        syms[sym_count].end = esyms[i].value + esyms[i].size;
+        syms[sym_count].name = strtab + esyms[i].name;
+        sym_count++;
+    }
+
+    // Shell sort by address; a few thousand entries at most
+    for (int gap = sym_count / 2; gap > 0; gap /= 2) {
+        for (int i = gap; i < sym_count; i++) {
+            ksym_t tmp = syms[i];
+            int j = i;
+            for (; j >= gap && syms[j - gap].addr > tmp.addr; j -= gap) syms[j] = syms[j - gap];
+            syms[j] = tmp;
+        }
+    }
+    for (int i = 0; i < sym_count; i++) {
+        uint64_t next = i + 1 < sym_count ? syms[i + 1].addr : syms[i].addr + PAGE_SIZE;
+        if (syms[i].end == syms[i].addr || syms[i].end > next) syms[i].end = next;
+    }
+
+    serial_print("[PARADOX] Kernel symbols: ");
+    serial_print_dec(sym_count);
+    serial_print("\n");
+}
+
+int ksym_count() {
+    return sym_count;
+}
+
+int ksym_index(uint64_t addr) {
+    int lo = 0, hi = sym_count - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (syms[mid].addr <= addr) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 0 || addr >= syms[found].end) return -1;
+    return found;
+}
+
+const char *ksym_name(int index) {
+    return index >= 0 && index < sym_count ? syms[index].name : 0;
+}
+
+const char *ksym_lookup(uint64_t addr, uint64_t *offset) {
+    int i = ksym_index(addr);
+    if (i < 0) return 0;
+    if (offset) *offset = addr - syms[i].addr;
+    return syms[i].name;
+}
+
+void ksym_print(uint64_t addr) {
+    uint64_t off;
+    const char *name = ksym_lookup(addr, &off);
+    if (!name) {
+        serial_print_hex(addr);
+        return;
+    }
+    serial_print(name);
+    serial_print("+0x");
+    int shift = 60;
+    while (shift > 0 && !((off >> shift) & 0xF)) shift -= 4;
+    for (; shift >= 0; shift -= 4) serial_write("0123456789abcdef"[(off >> shift) & 0xF]);
+}
+
+int ksym_backtrace(uint64_t rbp, uint64_t sp, uint64_t *pcs, int max) {
+    int n = 0;
+    while (n < max && rbp >= sp && rbp + 16 <= sp + KSYM_STACK_WINDOW && !(rbp & 7)) {
+        uint64_t *fp = (uint64_t *)rbp;
+        if (fp[1] < KSYM_KERNEL_BASE) break;
+        pcs[n++] = fp[1];
+        if (fp[0] <= rbp) break; // Callers' frames sit higher up the stack
+        rbp = fp[0];
+    }
+    return n;
+}
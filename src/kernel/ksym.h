@@ -0,0 +1,28 @@
+#ifndef KSYM_H
+#define KSYM_H
+
+#include <stdint.h>
+
+/* Kernel symbol table, read out of the kernel.elf Limine loaded us from */
+void ksym_init();
+int ksym_count();
+
+/* Index of the function containing addr, or -1 */
+int ksym_index(uint64_t addr);
+const char *ksym_name(int index);
+
+/* Name of the function containing addr (and the offset into it), or NULL */
+const char *ksym_lookup(uint64_t addr, uint64_t *offset);
+
+/* Prints "name+0xoff", or the bare address when it can't be resolved */
+void ksym_print(uint64_t addr);
+
+#define KSYM_KERNEL_BASE  0xFFFFFFFF80000000ULL
+#define KSYM_STACK_WINDOW (16 * 1024)   // How far above sp a frame may live
+
+/* Follows the rbp chain (the kernel builds with frame pointers) and stores
+ * up to max return addresses. Stops at anything that doesn't look like a
+ * frame on the stack starting at sp. */
+int ksym_backtrace(uint64_t rbp, uint64_t sp, uint64_t *pcs, int max);
+
+#endif
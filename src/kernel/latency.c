@@ -0,0 +1,160 @@
+#include "latency.h"
+#include "serial.h"
+#include "gfx.h"
+#include "font.h"
+
+#define MAX_PENDING 64
+
+static const char* type_names[LAT_TYPE_COUNT] = {
+    "key", "mouse-move", "mouse-button", "mouse-wheel"
+};
+
+static const color_t type_colors[LAT_TYPE_COUNT] = {
+    0xFF00D4FF, 0xFF70FF70, 0xFFFFA500, 0xFFFF7070
+};
+
+static latency_hist_t hists[LAT_TYPE_COUNT];
+
+/* Events whose effect has not been presented yet */
+static struct {
+    uint64_t tsc;
+    uint8_t type;
+} pending[MAX_PENDING];
+static int pending_count = 0;
+static uint64_t pending_overflow = 0;
+
+static int overlay_on = 0;
+static uint32_t generation = 0;
+
+static int log2_bucket(uint64_t cycles) {
+    int b = cycles ? 63 - __builtin_clzll(cycles) : 0;
+    return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+static void record(latency_type_t type, uint64_t cycles) {
+    latency_hist_t *h = &hists[type];
+    if (h->count == 0 || cycles < h->min) h->min = cycles;
+    if (cycles > h->max) h->max = cycles;
+    h->count++;
+    h->sum += cycles;
+    h->buckets[log2_bucket(cycles)]++;
+}
+
+void latency_event(latency_type_t type, uint64_t irq_tsc) {
+    if (type >= LAT_TYPE_COUNT) return;
+    if (pending_count >= MAX_PENDING) {
+        pending_overflow++;
+        return;
+    }
+    pending[pending_count].tsc = irq_tsc;
+    pending[pending_count].type = type;
+    pending_count++;
+}
+
+void latency_present() {
+    if (pending_count == 0) return;
+    uint64_t now = __builtin_ia32_rdtsc();
+    for (int i = 0; i < pending_count; i++) {
+        uint64_t t = pending[i].tsc;
+        record(pending[i].type, now > t ? now - t : 0);
+    }
+    pending_count = 0;
+    generation++;
+}
+
+void latency_reset() {
+    for (int t = 0; t < LAT_TYPE_COUNT; t++) {
+        hists[t] = (latency_hist_t){0};
+    }
+    pending_count = 0;
+    pending_overflow = 0;
+    generation++;
+}
+
+const latency_hist_t* latency_get(latency_type_t type) {
+    return type < LAT_TYPE_COUNT ? &hists[type] : 0;
+}
+
+void latency_dump() {
+    serial_print("[LAT] Input-to-photon latency (TSC cycles)\n");
+    for (int t = 0; t < LAT_TYPE_COUNT; t++) {
+        const latency_hist_t *h = &hists[t];
+        serial_print("[LAT] ");
+        serial_print(type_names[t]);
+        serial_print(": n=");
+        serial_print_dec(h->count);
+        if (h->count) {
+            serial_print(" min=");
+            serial_print_dec(h->min);
+            serial_print(" avg=");
+            serial_print_dec(h->sum / h->count);
+            serial_print(" max=");
+            serial_print_dec(h->max);
+        }
+        serial_write('\n');
+        for (int b = 0; b < LAT_BUCKETS; b++) {
+            if (!h->buckets[b]) continue;
+            serial_print("[LAT]   >= 2^");
+            serial_print_dec(b);
+            serial_print(": ");
+            serial_print_dec(h->buckets[b]);
+            serial_write('\n');
+        }
+    }
+    if (pending_overflow) {
+        serial_print("[LAT] Unrecorded (pending list full): ");
+        serial_print_dec(pending_overflow);
+        serial_write('\n');
+    }
+}
+
+static void latency_command(const char* args) {
+    if (args[0] == 'r') {
+        latency_reset();
+        serial_print("[LAT] Histograms cleared.\n");
+    } else if (args[0] == 'o') {
+        latency_toggle_overlay();
+    } else {
+        latency_dump();
+    }
+}
+
+void latency_init() {
+    serial_register_command("lat", latency_command); // lat | lat reset | lat overlay
+}
+
+void latency_toggle_overlay() {
+    overlay_on = !overlay_on;
+    generation++;
+}
+
+int latency_overlay_enabled() {
+    return overlay_on;
+}
+
+uint32_t latency_generation() {
+    return generation;
+}
+
+/* One row of bars per event type, bar height proportional to the bucket count */
+void latency_draw_overlay(uint32_t x, uint32_t y) {
+    const uint32_t first = 10, last = 34; // 2^10 .. 2^33 cycles
+    const uint32_t bar_w = 6, row_h = 40;
+    uint32_t w = (last - first) * bar_w + 20;
+
+    gfx_draw_rect_alpha(x, y, w, LAT_TYPE_COUNT * row_h + 10, 0x000000, 190);
+    for (int t = 0; t < LAT_TYPE_COUNT; t++) {
+        const latency_hist_t *h = &hists[t];
+        uint32_t base = y + 10 + (t + 1) * row_h - 8;
+        uint32_t peak = 1;
+        for (uint32_t b = first; b < last; b++) if (h->buckets[b] > peak) peak = h->buckets[b];
+
+        font_draw_string(type_names[t], x + 10, base - row_h + 10, 0xFFAAAAAA);
+        gfx_draw_rect(x + 10, base, (last - first) * bar_w, 1, 0xFF444444);
+        for (uint32_t b = first; b < last; b++) {
+            uint32_t bh = (h->buckets[b] * (row_h - 14)) / peak;
+            if (h->buckets[b] && bh == 0) bh = 1;
+            gfx_draw_rect(x + 10 + (b - first) * bar_w, base - bh, bar_w - 1, bh, type_colors[t]);
+        }
+    }
+}
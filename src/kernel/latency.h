@@ -0,0 +1,44 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/*
+ * Input-to-photon latency: every input event carries the TSC value taken in
+ * its IRQ handler. The render loop reports events that change what is on
+ * screen with latency_event() and calls latency_present() once that change
+ * has reached the framebuffer.
+ */
+
+typedef enum {
+    LAT_KEY,
+    LAT_MOUSE_MOVE,
+    LAT_MOUSE_BUTTON,
+    LAT_MOUSE_WHEEL,
+    LAT_TYPE_COUNT
+} latency_type_t;
+
+#define LAT_BUCKETS 40 // log2(cycles) buckets
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint32_t buckets[LAT_BUCKETS];
+} latency_hist_t;
+
+void latency_init();
+void latency_event(latency_type_t type, uint64_t irq_tsc);
+void latency_present();
+void latency_reset();
+void latency_dump();
+const latency_hist_t* latency_get(latency_type_t type);
+
+/* On-screen histogram overlay */
+void latency_toggle_overlay();
+int latency_overlay_enabled();
+uint32_t latency_generation(); // Bumps whenever new samples land
+void latency_draw_overlay(uint32_t x, uint32_t y);
+
+#endif
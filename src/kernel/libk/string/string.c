@@ -1,14 +1,22 @@
 #include "libk/string/string.h"
 
+/* rep stos/movs run at cache-line width on anything with ERMS/FSRM */
 void *k_memset(void *s, int c, size_t n) {
-    unsigned char *p = (unsigned char *)s;
-    while (n--) *p++ = (unsigned char)c;
+    void *p = s;
+    __asm__ volatile ("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
     return s;
 }
 
 void *k_memcpy(void *dest, const void *src, size_t n) {
-    unsigned char *d = (unsigned char *)dest;
-    const unsigned char *s = (const unsigned char *)src;
-    while (n--) *d++ = *s++;
+    void *d = dest;
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
     return dest;
 }
+
+int k_memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *x = a, *y = b;
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] != y[i]) return x[i] < y[i] ? -1 : 1;
+    }
+    return 0;
+}
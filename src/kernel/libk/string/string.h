@@ -6,5 +6,6 @@
 
 void *k_memset(void *s, int c, size_t n);
 void *k_memcpy(void *dest, const void *src, size_t n);
+int k_memcmp(const void *a, const void *b, size_t n);
 
 #endif
@@ -4,14 +4,33 @@
 #include "gfx.h"
 #include "font.h"
 #include "cpu.h"
+#include "fpu.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "smp.h"
+#include "sync.h"
+#include "sched.h"
+#include "workqueue.h"
+#include "syscall.h"
+#include "ksym.h"
+#include "profile.h"
+#include "trace.h"
 #include "keyboard.h"
 #include "mouse.h"
 #include "user.h"
 #include "vfs.h"
+#include "aio.h"
 #include "ramdisk.h"
+#include "tmpfs.h"
+#include "devfs.h"
+#include "pci.h"
+#include "blk.h"
+#include "virtio_blk.h"
 #include "memory/pmm.h"
 #include "memory/slab.h"
 #include "ports.h"
+#include "serial.h"
+#include "latency.h"
 
 // #include "login_img.h"
 
@@ -23,14 +42,6 @@ const char *paradox_logo_ascii =
     "██║     ██║  ██║██║  ██║██║  ██║██████╔╝╚██████╔╝██╔╝ ██╗\n"
     "╚═╝     ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝  ╚═╝╚═════╝  ╚═════╝ ╚═╝  ╚═╝";
 
-static void serial_write(char c) {
-    while ((inb(0x3F8 + 5) & 0x20) == 0);
-    outb(0x3F8, c);
-}
-
-static void serial_print(const char* s) {
-    while (*s) serial_write(*s++);
-}
 // #include "splash_img.h" // Disabled for stability
 // #include "login_img.h"
 
@@ -69,6 +80,10 @@ typedef struct {
 } window_t;
 
 #define MAX_TRAILS 10
+#define TRAIL_SAMPLE_NS   (8 * NS_PER_MS)
+#define CARET_BLINK_NS    (500 * NS_PER_MS)
+#define SPLASH_PULSE_NS   (600 * NS_PER_MS)
+#define SPLASH_TIMEOUT_NS (4 * NS_PER_S)
 static int trail_x[MAX_TRAILS];
 static int trail_y[MAX_TRAILS];
 static int trail_ptr = 0;
@@ -87,13 +102,30 @@ static int input_ptr = 0;
 static int pass_ptr = 0;
 static int input_focus = 0; // 0 = Username, 1 = Password
 
+static volatile int splash_expired = 0;
+static sched_event_t ui_wakeup;
+
+/* Explorer preview, loaded in the background so opening the desktop never
+ * waits on the filesystem */
+#define PREVIEW_PATH "welcome.txt"
+#define PREVIEW_LEN  64
+static aio_cq_t ui_io;
+static aio_request_t preview_req;
+static char preview_text[PREVIEW_LEN + 1];
+static int preview_ready = 0;
+
+static void splash_timeout(ktimer_t *t, void *arg) {
+    (void)t; (void)arg;
+    splash_expired = 1;
+}
+
 void draw_splash_screen(uint32_t screen_w, uint32_t screen_h) {
     // Optimization: Draw procedural splash instead of large image
     gfx_clear(0);
     draw_logo(screen_w / 2 - 25, screen_h / 2 - 60);
 
     // Pulse text
-    if (((uint32_t)(__builtin_ia32_rdtsc() / 200000000) % 2) == 0) {
+    if ((ktime_get_ns() / SPLASH_PULSE_NS) % 2 == 0) {
         font_draw_string("Press ANY KEY to Start", screen_w / 2 - 80, screen_h - 100, COLOR_WHITE);
     }
 }
@@ -120,7 +152,7 @@ void draw_kali_login(uint32_t screen_w, uint32_t screen_h, const char* title) {
     font_draw_string("Username", x + 40, y + 180, 0xFFAAAAAA);
     gfx_draw_rect_alpha(x + 40, y + 200, 280, 40, 0x000000, 180);
     font_draw_string(input_buffer, x + 50, y + 212, COLOR_WHITE);
-    if (input_focus == 0 && ((uint32_t)(__builtin_ia32_rdtsc() / 150000000) % 2 == 0))
+    if (input_focus == 0 && (ktime_get_ns() / CARET_BLINK_NS) % 2 == 0)
         gfx_draw_rect(x + 50 + (input_ptr * 8), y + 212, 2, 16, COLOR_WHITE);
 
     // Password
@@ -129,7 +161,7 @@ void draw_kali_login(uint32_t screen_w, uint32_t screen_h, const char* title) {
     char stars[MAX_NAME_LEN] = {0};
     for(int i=0; i<pass_ptr; i++) stars[i] = '*';
     font_draw_string(stars, x + 50, y + 282, COLOR_WHITE);
-    if (input_focus == 1 && ((uint32_t)(__builtin_ia32_rdtsc() / 150000000) % 2 == 0))
+    if (input_focus == 1 && (ktime_get_ns() / CARET_BLINK_NS) % 2 == 0)
         gfx_draw_rect(x + 50 + (pass_ptr * 8), y + 282, 2, 16, COLOR_WHITE);
 
     font_draw_string("TAB: Switch | ENTER: Login", x + 60, y + 340, 0xFF666666);
@@ -137,6 +169,31 @@ void draw_kali_login(uint32_t screen_w, uint32_t screen_h, const char* title) {
         font_draw_string("Press 'R' to Register", x + 100, y + 370, COLOR_PURPLE);
 }
 
+static void handle_login_key(char key) {
+    if (key == '\t') input_focus = !input_focus;
+    else if (key == '\b') {
+        if (input_focus == 0 && input_ptr > 0) input_buffer[--input_ptr] = 0;
+        else if (input_focus == 1 && pass_ptr > 0) pass_buffer[--pass_ptr] = 0;
+    }
+    else if (key == '\n') {
+        if (sys_state == SYS_STATE_LOGIN) {
+            if (user_login(input_buffer, pass_buffer)) sys_state = SYS_STATE_DESKTOP;
+        } else {
+            if (user_register(input_buffer, pass_buffer)) sys_state = SYS_STATE_LOGIN;
+        }
+        for(int i=0; i<MAX_NAME_LEN; i++) input_buffer[i] = pass_buffer[i] = 0;
+        input_ptr = pass_ptr = 0;
+    }
+    else if (key == 'r' && sys_state == SYS_STATE_LOGIN) {
+        sys_state = SYS_STATE_REGISTER;
+        input_ptr = pass_ptr = 0;
+    }
+    else if (key >= 32 && key <= 126) {
+        if (input_focus == 0 && input_ptr < MAX_NAME_LEN - 1) input_buffer[input_ptr++] = key;
+        else if (input_focus == 1 && pass_ptr < MAX_NAME_LEN - 1) pass_buffer[pass_ptr++] = key;
+    }
+}
+
 void draw_desktop_icons() {
     struct { char* name; int x, y; color_t color; } icons[] = {
         {"Users",     50, 50,  0xFF00D4FF},
@@ -152,7 +209,233 @@ void draw_desktop_icons() {
     }
 }
 
+static window_t main_win;
+static int win_init = 0;
+
+void draw_desktop(uint32_t screen_w, uint32_t screen_h) {
+    gfx_draw_gradient(0, 0, screen_w, screen_h, 0xFF0A0A1F, 0xFF1A1A3F);
+    draw_desktop_icons();
+
+    // Neo-Glass Window
+    gfx_draw_rect_alpha(main_win.x + 8, main_win.y + 8, main_win.w, main_win.h, 0x000000, 100); // Shadow
+    gfx_draw_backdrop_blur(main_win.x, main_win.y, main_win.w, main_win.h, 12, 0x222222, 180); // Glass Body
+    
+    color_t title_color = main_win.is_dragging ? COLOR_ACCENT : COLOR_PURPLE;
+    gfx_draw_rounded_rect(main_win.x, main_win.y, main_win.w, 30, 5, title_color);
+    font_draw_string("Paradox Neo-Glass Explorer", main_win.x + 10, main_win.y + 10, COLOR_WHITE);
+
+    // Explorer File Listing
+    font_draw_string("Directory: /ramdisk/", main_win.x + 20, main_win.y + 50, 0xFFAAAAAA);
+    gfx_draw_rect(main_win.x + 20, main_win.y + 70, main_win.w - 40, 1, 0xFF444444);
+    
+    fs_node_t *de;
+    int file_idx = 0;
+    while ((de = vfs_readdir(fs_root, file_idx)) != 0) {
+        gfx_draw_rect(main_win.x + 30, main_win.y + 85 + (file_idx * 30), 20, 20, COLOR_PURPLE);
+        font_draw_string(vfs_name(de), main_win.x + 60, main_win.y + 87 + (file_idx * 30), COLOR_WHITE);
+        file_idx++;
+    }
+    
+    if (preview_ready) {
+        gfx_draw_rect(main_win.x + 20, main_win.y + main_win.h - 70, main_win.w - 40, 1, 0xFF444444);
+        font_draw_string(preview_text, main_win.x + 20, main_win.y + main_win.h - 55, 0xFFAAAAAA);
+    }
+
+    font_draw_string("VFS initialized. System stable.", main_win.x + 20, main_win.y + main_win.h - 30, 0xFF666666);
+    
+    /* Taskbar */
+    uint32_t bar_h = 50;
+    gfx_draw_rect_alpha(0, screen_h - bar_h, screen_w, bar_h, 0x111111, 200);
+    gfx_draw_rounded_rect(15, screen_h - bar_h + 7, 35, 35, 8, COLOR_PURPLE);
+    font_draw_string("P", 27, screen_h - bar_h + 17, COLOR_WHITE);
+}
+
+/* Returns 1 when the event changed the desktop scene */
+static int handle_pointer_event(const mouse_event_t *ev) {
+    if (ev->changed & MOUSE_BUTTON_LEFT) {
+        if (ev->buttons & MOUSE_BUTTON_LEFT) {
+            if (ev->x >= main_win.x && ev->x <= main_win.x + main_win.w &&
+                ev->y >= main_win.y && ev->y <= main_win.y + 30) {
+                main_win.is_dragging = 1;
+                main_win.drag_off_x = ev->x - main_win.x;
+                main_win.drag_off_y = ev->y - main_win.y;
+                return 1; // Title bar colour follows the drag state
+            }
+        } else if (main_win.is_dragging) {
+            main_win.is_dragging = 0;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (main_win.is_dragging && (ev->dx || ev->dy)) {
+        main_win.x = ev->x - main_win.drag_off_x;
+        main_win.y = ev->y - main_win.drag_off_y;
+        return 1;
+    }
+    return 0;
+}
+
+static void preview_start() {
+    fs_node_t *node = vfs_lookup(PREVIEW_PATH);
+    if (!node) return;
+    aio_prep(&preview_req, AIO_READ, node, 0, PREVIEW_LEN, preview_text, 0, &ui_io, 0);
+    aio_submit(&preview_req);
+}
+
+/* Keep the first line only */
+static void preview_done(aio_request_t *req) {
+    uint32_t n = req->result;
+    for (uint32_t i = 0; i < n; i++) {
+        if (preview_text[i] == '\n' || preview_text[i] == '\r') { n = i; break; }
+    }
+    preview_text[n] = 0;
+    preview_ready = 1;
+}
+
+/* The UI loop: drains input, recomposes dirty scenes and moves the cursor
+ * overlay. Sleeps between frames until input arrives or the next trail
+ * sample is due. */
+static void compositor_thread(void *arg) {
+    struct limine_framebuffer *framebuffer = arg;
+
+    static int in_splash = 1;
+    static int scene_dirty = 1;
+    static int last_blink = -1;
+    static uint64_t trail_tick = 0;
+    static uint32_t last_lat_gen = 0;
+    static int last_lat_overlay = 0;
+    static uint64_t frame = 0;
+
+    // Leave the splash on its own after a while (longer delay for logo visibility)
+    static ktimer_t splash_timer;
+    ktimer_setup(&splash_timer, splash_timeout, 0);
+    ktimer_arm_in(&splash_timer, SPLASH_TIMEOUT_NS, 0);
+
+    // Completions wake the same sleep as input does
+    aio_cq_init(&ui_io, &ui_wakeup);
+
+    for (;;) {
+        TRACE(TRACE_UI_FRAME_BEGIN, 0, frame, 0);
+        int repainted = 0;
+
+        /* Drain every pointer event; button edges are never coalesced away */
+        mouse_event_t mev;
+        while (mouse_poll_event(&mev)) {
+            if (!in_splash && sys_state == SYS_STATE_DESKTOP && win_init && handle_pointer_event(&mev)) {
+                scene_dirty = 1;
+                if (mev.changed) latency_event(LAT_MOUSE_BUTTON, mev.tsc);
+            }
+            if (!in_splash && (mev.dx || mev.dy)) latency_event(LAT_MOUSE_MOVE, mev.tsc);
+            if (!in_splash && mev.wheel) latency_event(LAT_MOUSE_WHEEL, mev.tsc);
+        }
+        mouse_state_t m;
+        mouse_get_state(&m);
+
+        /* Drain every key event queued since the last frame */
+        key_event_t kev;
+        while (keyboard_poll_event(&kev)) {
+            if (kev.flags & KEY_EVENT_RELEASED) continue;
+            if (kev.keycode == KEY_F12 && !in_splash) {
+                latency_toggle_overlay();
+                continue;
+            }
+            if (in_splash) {
+                in_splash = 0; // "Press ANY KEY to Start"
+                ktimer_cancel(&splash_timer);
+                continue;
+            }
+            if (kev.ascii && (sys_state == SYS_STATE_LOGIN || sys_state == SYS_STATE_REGISTER)) {
+                handle_login_key(kev.ascii);
+                scene_dirty = 1;
+                latency_event(LAT_KEY, kev.tsc);
+            }
+        }
+
+        /* Pick up file loads that finished since the last frame */
+        aio_request_t *io;
+        while ((io = aio_poll(&ui_io)) != 0) {
+            if (io == &preview_req) {
+                preview_done(io);
+                scene_dirty = 1;
+            }
+        }
+
+        if (latency_overlay_enabled() != last_lat_overlay || latency_generation() != last_lat_gen) {
+            if (latency_overlay_enabled() || last_lat_overlay) scene_dirty = 1;
+            last_lat_overlay = latency_overlay_enabled();
+            last_lat_gen = latency_generation();
+        }
+
+        if (in_splash) {
+            draw_splash_screen(framebuffer->width, framebuffer->height);
+            if (splash_expired) in_splash = 0;
+            gfx_swap_buffers();
+            TRACE(TRACE_UI_FRAME_END, 1, frame++, 0);
+            sched_event_wait(&ui_wakeup, TRAIL_SAMPLE_NS);
+            continue;
+        }
+
+        /* Input Handling */
+        if (sys_state == SYS_STATE_LOGIN || sys_state == SYS_STATE_REGISTER) {
+            // Caret blink only changes the scene twice a period
+            int blink = (ktime_get_ns() / CARET_BLINK_NS) % 2;
+            if (blink != last_blink) { last_blink = blink; scene_dirty = 1; }
+        } else {
+            /* Desktop Logic */
+            if (!win_init) {
+                main_win.x = (framebuffer->width - 700) / 2;
+                main_win.y = (framebuffer->height - 500) / 2;
+                main_win.w = 700; main_win.h = 500;
+                win_init = 1;
+                scene_dirty = 1;
+                preview_start();
+            }
+        }
+
+        /* Only recompose when the scene itself changed; pointer motion alone is
+         * handled by the cursor overlay below. */
+        if (scene_dirty) {
+            gfx_dl_begin();
+            if (sys_state == SYS_STATE_LOGIN) {
+                draw_kali_login(framebuffer->width, framebuffer->height, "Paradox Login");
+            } else if (sys_state == SYS_STATE_REGISTER) {
+                draw_kali_login(framebuffer->width, framebuffer->height, "User Registration");
+            } else {
+                draw_desktop(framebuffer->width, framebuffer->height);
+            }
+            if (latency_overlay_enabled()) latency_draw_overlay(framebuffer->width - 320, 20);
+            gfx_dl_end(); // Repaints only what differs from the last frame
+            gfx_swap_buffers();
+            latency_present();
+            scene_dirty = 0;
+            repainted = 1;
+        }
+
+        /* Mouse Cursor with Trails (overlay plane, sampled at a fixed rate) */
+        uint64_t tick = ktime_get_ns() / TRAIL_SAMPLE_NS;
+        if (tick != trail_tick) {
+            trail_tick = tick;
+            trail_x[trail_ptr] = m.x;
+            trail_y[trail_ptr] = m.y;
+            trail_ptr = (trail_ptr + 1) % MAX_TRAILS;
+        }
+
+        gfx_sprite_t sprites[MAX_TRAILS + 1];
+        for(int i=0; i<MAX_TRAILS; i++) {
+            int t_idx = (trail_ptr + i) % MAX_TRAILS;
+            sprites[i] = (gfx_sprite_t){ trail_x[t_idx], trail_y[t_idx], 4, 4, COLOR_ACCENT, (i * 255) / MAX_TRAILS };
+        }
+        sprites[MAX_TRAILS] = (gfx_sprite_t){ m.x, m.y, 8, 8, COLOR_WHITE, 255 };
+        if (gfx_overlay_set(sprites, MAX_TRAILS + 1)) latency_present();
+        TRACE(TRACE_UI_FRAME_END, repainted, frame++, 0);
+
+        sched_event_wait(&ui_wakeup, TRAIL_SAMPLE_NS);
+    }
+}
+
 void _start(void) {
+    percpu_init_bsp(); // Spinlocks and this_cpu() need GS from here on
     serial_print("\n[PARADOX] Entry Point Reached.\n");
 
     if (framebuffer_request.response == NULL || framebuffer_request.response->framebuffer_count < 1) {
@@ -197,135 +480,39 @@ void _start(void) {
         serial_print("[PARADOX] Memory System Ready.\n");
     }
 
+    ksym_init();
     cpu_init();
+    fpu_init();
+    interrupts_init();
+    timer_init();
+    sync_init();
+    sched_init();
+    syscall_init();
+    smp_init();
+    profile_init();
+    trace_init();
+    workqueue_init();
+    serial_init();
     keyboard_init();
     mouse_init();
     user_init();
+    vfs_init();
+    aio_init();
     fs_root = ramdisk_init();
+    vfs_mount("/tmp", tmpfs_init());
+    vfs_mount("/dev", devfs_init());
+    pci_init();
+    blk_init();
+    virtio_blk_init();
+    latency_init();
     serial_print("[PARADOX] Hardware Drivers Loaded.\n");
 
-    static int in_splash = 1;
-    static int splash_counter = 0;
+    keyboard_set_notify(&ui_wakeup);
+    mouse_set_notify(&ui_wakeup);
+    task_create("compositor", compositor_thread, framebuffer, SCHED_PRIO_UI, TASK_ANY_CPU);
 
-    // Finally enable interrupts just before loop
+    // Finally enable interrupts and let the scheduler take over
     cpu_enable_interrupts();
-
-    for (;;) {
-        mouse_state_t* m = mouse_get_state();
-        char key = keyboard_get_last_key();
-
-        // Trail Logic
-        trail_x[trail_ptr] = m->x;
-        trail_y[trail_ptr] = m->y;
-        trail_ptr = (trail_ptr + 1) % MAX_TRAILS;
-
-        if (in_splash) {
-            draw_splash_screen(framebuffer->width, framebuffer->height);
-            splash_counter++;
-            // Auto-transition after approx 200 frames (longer delay for logo visibility)
-            if (splash_counter > 200) in_splash = 0; 
-            gfx_swap_buffers();
-            continue;
-        }
-
-        /* Input Handling */
-        if (sys_state == SYS_STATE_LOGIN || sys_state == SYS_STATE_REGISTER) {
-            if (key == '\t') input_focus = !input_focus;
-            else if (key == '\b') {
-                if (input_focus == 0 && input_ptr > 0) input_buffer[--input_ptr] = 0;
-                else if (input_focus == 1 && pass_ptr > 0) pass_buffer[--pass_ptr] = 0;
-            }
-            else if (key == '\n') {
-                if (sys_state == SYS_STATE_LOGIN) {
-                    if (user_login(input_buffer, pass_buffer)) sys_state = SYS_STATE_DESKTOP;
-                } else {
-                    if (user_register(input_buffer, pass_buffer)) sys_state = SYS_STATE_LOGIN;
-                }
-                for(int i=0; i<MAX_NAME_LEN; i++) input_buffer[i] = pass_buffer[i] = 0;
-                input_ptr = pass_ptr = 0;
-            }
-            else if (key == 'r' && sys_state == SYS_STATE_LOGIN) {
-                sys_state = SYS_STATE_REGISTER;
-                input_ptr = pass_ptr = 0;
-            }
-            else if (key != 0 && key >= 32 && key <= 126) {
-                if (input_focus == 0 && input_ptr < MAX_NAME_LEN - 1) input_buffer[input_ptr++] = key;
-                else if (input_focus == 1 && pass_ptr < MAX_NAME_LEN - 1) pass_buffer[pass_ptr++] = key;
-            }
-        }
-
-        if (sys_state == SYS_STATE_LOGIN) {
-            draw_kali_login(framebuffer->width, framebuffer->height, "Paradox Login");
-        } else if (sys_state == SYS_STATE_REGISTER) {
-            draw_kali_login(framebuffer->width, framebuffer->height, "User Registration");
-        } else {
-            /* Desktop Logic */
-            static window_t main_win;
-            static int win_init = 0;
-            if (!win_init) {
-                main_win.x = (framebuffer->width - 700) / 2;
-                main_win.y = (framebuffer->height - 500) / 2;
-                main_win.w = 700; main_win.h = 500;
-                win_init = 1;
-            }
-            if (m->left_button) {
-                if (!main_win.is_dragging) {
-                    if (m->x >= main_win.x && m->x <= main_win.x + main_win.w &&
-                        m->y >= main_win.y && m->y <= main_win.y + 30) {
-                        main_win.is_dragging = 1;
-                        main_win.drag_off_x = m->x - main_win.x;
-                        main_win.drag_off_y = m->y - main_win.y;
-                    }
-                } else {
-                    main_win.x = m->x - main_win.drag_off_x;
-                    main_win.y = m->y - main_win.drag_off_y;
-                }
-            } else {
-                main_win.is_dragging = 0;
-            }
-
-            gfx_draw_gradient(0, 0, framebuffer->width, framebuffer->height, 0xFF0A0A1F, 0xFF1A1A3F);
-            draw_desktop_icons();
-
-            // Neo-Glass Window
-            gfx_draw_rect_alpha(main_win.x + 8, main_win.y + 8, main_win.w, main_win.h, 0x000000, 100); // Shadow
-            gfx_draw_rect_alpha(main_win.x, main_win.y, main_win.w, main_win.h, 0x222222, 180); // Glass Body
-            
-            color_t title_color = main_win.is_dragging ? COLOR_ACCENT : COLOR_PURPLE;
-            gfx_draw_rounded_rect(main_win.x, main_win.y, main_win.w, 30, 5, title_color);
-            font_draw_string("Paradox Neo-Glass Explorer", main_win.x + 10, main_win.y + 10, COLOR_WHITE);
-
-            // Explorer File Listing
-            font_draw_string("Directory: /ramdisk/", main_win.x + 20, main_win.y + 50, 0xFFAAAAAA);
-            gfx_draw_rect(main_win.x + 20, main_win.y + 70, main_win.w - 40, 1, 0xFF444444);
-            
-            struct dirent *de;
-            int file_idx = 0;
-            while ((de = vfs_readdir(fs_root, file_idx)) != 0) {
-                gfx_draw_rect(main_win.x + 30, main_win.y + 85 + (file_idx * 30), 20, 20, COLOR_PURPLE);
-                font_draw_string(de->name, main_win.x + 60, main_win.y + 87 + (file_idx * 30), COLOR_WHITE);
-                file_idx++;
-            }
-            
-            font_draw_string("VFS initialized. System stable.", main_win.x + 20, main_win.y + main_win.h - 30, 0xFF666666);
-            
-            /* Taskbar */
-            uint32_t bar_h = 50;
-            gfx_draw_rect_alpha(0, framebuffer->height - bar_h, framebuffer->width, bar_h, 0x111111, 200);
-            gfx_draw_rounded_rect(15, framebuffer->height - bar_h + 7, 35, 35, 8, COLOR_PURPLE);
-            font_draw_string("P", 27, framebuffer->height - bar_h + 17, COLOR_WHITE);
-        }
-
-        /* Mouse Cursor with Trails */
-        for(int i=0; i<MAX_TRAILS; i++) {
-            int t_idx = (trail_ptr + i) % MAX_TRAILS;
-            gfx_draw_rect_alpha(trail_x[t_idx], trail_y[t_idx], 4, 4, COLOR_ACCENT, (i * 255) / MAX_TRAILS);
-        }
-        gfx_draw_rect(m->x, m->y, 8, 8, COLOR_WHITE);
-        
-        gfx_swap_buffers();
-    }
+    sched_enter_idle();
 }
 
-
-
@@ -1,11 +1,14 @@
 #include "memory/pmm.h"
 #include "libk/string/string.h"
+#include "sync.h"
 
 static pmm_info_t pmm_info;
 static bitmap_t bitmap;
 static uint64_t hhdm_offset = 0;
 static uint64_t highest_address = 0;
 
+/* Guards bitmap and pmm_info; taken with interrupts off since IRQ-time code allocates */
+DEFINE_SPINLOCK(pmm_lock, "pmm");
 
 extern volatile struct limine_hhdm_request hhdm_request;
 
@@ -72,11 +75,12 @@ void pmm_init(struct limine_memmap_response *memmap_response) {
     bitmap_set_bit(&bitmap, 0);
 }
 
-void *pmm_alloc(size_t page_count) {
-    if (page_count == 0) return NULL;
+static pmm_reclaim_fn_t reclaim_fn = 0;
 
+static void *alloc_pages(size_t page_count) {
     size_t consecutive = 0;
     size_t start_page = 0;
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
 
     for (uint64_t i = 0; i < pmm_info.max_pages; i++) {
         if (!bitmap_check_bit(&bitmap, i)) {
@@ -88,6 +92,7 @@ void *pmm_alloc(size_t page_count) {
                     bitmap_set_bit(&bitmap, start_page + j);
                 }
                 pmm_info.used_pages += page_count;
+                spin_unlock_irqrestore(&pmm_lock, flags);
                 return (void *)(start_page * PAGE_SIZE + hhdm_offset);
             }
         } else {
@@ -95,18 +100,37 @@ void *pmm_alloc(size_t page_count) {
         }
     }
 
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return NULL; // Out of memory
 }
 
+void *pmm_alloc(size_t page_count) {
+    if (page_count == 0) return NULL;
+    void *p = alloc_pages(page_count);
+    // Caches give memory back under pressure; retry once if they did
+    if (!p && reclaim_fn && reclaim_fn(page_count)) p = alloc_pages(page_count);
+    return p;
+}
+
+uint64_t pmm_free_pages() {
+    return pmm_info.max_pages - __atomic_load_n(&pmm_info.used_pages, __ATOMIC_RELAXED);
+}
+
+void pmm_set_reclaim(pmm_reclaim_fn_t fn) {
+    reclaim_fn = fn;
+}
+
 void pmm_free(void *ptr, size_t page_count) {
     if (!ptr) return;
     uint64_t addr = (uintptr_t)ptr - hhdm_offset;
     uint64_t start_page = addr / PAGE_SIZE;
 
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
     for (size_t i = 0; i < page_count; i++) {
         if (bitmap_check_bit(&bitmap, start_page + i)) {
             bitmap_unset_bit(&bitmap, start_page + i);
             pmm_info.used_pages--;
         }
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
@@ -18,5 +18,12 @@ typedef struct {
 void pmm_init(struct limine_memmap_response *memmap);
 void *pmm_alloc(size_t page_count);
 void pmm_free(void *ptr, size_t page_count);
+uint64_t pmm_free_pages();
+
+/* Called once when an allocation fails, before giving up; returns the number
+ * of pages it released. May run in interrupt context with the caller's
+ * locks held, so it must only trylock and never sleep. */
+typedef size_t (*pmm_reclaim_fn_t)(size_t pages);
+void pmm_set_reclaim(pmm_reclaim_fn_t fn);
 
 #endif
@@ -1,11 +1,15 @@
 #include "memory/slab.h"
 #include "memory/pmm.h"
 #include "libk/string/string.h"
+#include "sync.h"
 
 static slab_t slabs[SLAB_COUNT];
 static void *internal_mem_ptr = NULL;
 static size_t internal_mem_len = 0;
 
+/* One lock for every size class; the critical sections are a short scan */
+DEFINE_SPINLOCK(slab_lock, "slab");
+
 static int32_t find_free_object(int32_t slab_index) {
     int32_t objects_per_slab = MAX_SLAB_SIZE / slabs[slab_index].size;
     for (int32_t i = 0; i < objects_per_slab; i++) {
@@ -58,16 +62,18 @@ void *slab_alloc(size_t size) {
 
     if (size > MAX_SLAB_SIZE) return pmm_alloc((size + PAGE_SIZE - 1) / PAGE_SIZE);
 
-    if (slabs[slab_idx].is_full) return NULL;
-
-    int32_t free_idx = find_free_object(slab_idx);
-    if (free_idx == -1) {
-        slabs[slab_idx].is_full = true;
-        return NULL;
+    uint64_t flags = spin_lock_irqsave(&slab_lock);
+    void *res = NULL;
+    if (!slabs[slab_idx].is_full) {
+        int32_t free_idx = find_free_object(slab_idx);
+        if (free_idx == -1) {
+            slabs[slab_idx].is_full = true;
+        } else {
+            res = slabs[slab_idx].objects[free_idx];
+            slabs[slab_idx].objects[free_idx] = NULL;
+        }
     }
-
-    void *res = slabs[slab_idx].objects[free_idx];
-    slabs[slab_idx].objects[free_idx] = NULL;
+    spin_unlock_irqrestore(&slab_lock, flags);
     return res;
 }
 
@@ -81,8 +87,10 @@ void slab_free(void *ptr) {
             if (offset % slabs[i].size == 0) {
                 // Return to pool
                 int32_t obj_idx = offset / slabs[i].size;
+                uint64_t flags = spin_lock_irqsave(&slab_lock);
                 slabs[i].objects[obj_idx] = ptr;
                 slabs[i].is_full = false;
+                spin_unlock_irqrestore(&slab_lock, flags);
                 return;
             }
         }
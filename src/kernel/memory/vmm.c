@@ -0,0 +1,114 @@
+#include "memory/vmm.h"
+#include "memory/pmm.h"
+#include "libk/string/string.h"
+#include "sync.h"
+
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+extern volatile struct limine_hhdm_request hhdm_request;
+
+/* Serializes page-table edits once APs run; lookups walk the tables unlocked */
+DEFINE_SPINLOCK(vmm_lock, "vmm");
+
+uint64_t vmm_hhdm_offset() {
+    return hhdm_request.response ? hhdm_request.response->offset : 0;
+}
+
+static inline uint64_t *phys_to_table(uint64_t phys) {
+    return (uint64_t *)(phys + vmm_hhdm_offset());
+}
+
+static inline uint64_t read_cr3() {
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+/* Returns the next-level table, creating it if asked. NULL if a huge page
+ * already maps this range or allocation failed. */
+static uint64_t *next_table(uint64_t *table, int index, int create, uint64_t flags) {
+    uint64_t e = table[index];
+    if (e & VMM_PRESENT) {
+        if (e & VMM_HUGE) return NULL;
+        /* Upper levels must allow whatever the leaf allows */
+        if ((flags & VMM_USER) && !(e & VMM_USER)) table[index] = e | VMM_USER;
+        return phys_to_table(e & PTE_ADDR_MASK);
+    }
+    if (!create) return NULL;
+
+    void *page = pmm_alloc(1);
+    if (!page) return NULL;
+    k_memset(page, 0, PAGE_SIZE);
+    uint64_t phys = (uint64_t)(uintptr_t)page - vmm_hhdm_offset();
+    table[index] = phys | VMM_PRESENT | VMM_WRITE | (flags & VMM_USER);
+    return (uint64_t *)page;
+}
+
+static int map_page_locked(uint64_t virt, uint64_t phys, uint64_t flags) {
+    uint64_t *pml4 = phys_to_table(read_cr3() & PTE_ADDR_MASK);
+    uint64_t *pdpt = next_table(pml4, (virt >> 39) & 0x1FF, 1, flags);
+    if (!pdpt) return 0;
+    uint64_t *pd = next_table(pdpt, (virt >> 30) & 0x1FF, 1, flags);
+    if (!pd) return 0;
+    uint64_t *pt = next_table(pd, (virt >> 21) & 0x1FF, 1, flags);
+    if (!pt) return 0;
+
+    pt[(virt >> 12) & 0x1FF] = (phys & PTE_ADDR_MASK) | flags | VMM_PRESENT;
+    __asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+    return 1;
+}
+
+int vmm_map_page(uint64_t virt, uint64_t phys, uint64_t flags) {
+    uint64_t irq = spin_lock_irqsave(&vmm_lock);
+    int ok = map_page_locked(virt, phys, flags);
+    spin_unlock_irqrestore(&vmm_lock, irq);
+    return ok;
+}
+
+void vmm_unmap_page(uint64_t virt) {
+    uint64_t flags = spin_lock_irqsave(&vmm_lock);
+    uint64_t *table = phys_to_table(read_cr3() & PTE_ADDR_MASK);
+    for (int level = 3; level > 0; level--) {
+        uint64_t e = table[(virt >> (12 + 9 * level)) & 0x1FF];
+        if (!(e & VMM_PRESENT) || (e & VMM_HUGE)) {
+            spin_unlock_irqrestore(&vmm_lock, flags);
+            return;
+        }
+        table = phys_to_table(e & PTE_ADDR_MASK);
+    }
+    table[(virt >> 12) & 0x1FF] = 0;
+    __asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+    spin_unlock_irqrestore(&vmm_lock, flags);
+}
+
+uint64_t vmm_virt_to_phys(uint64_t virt) {
+    uint64_t *table = phys_to_table(read_cr3() & PTE_ADDR_MASK);
+    for (int level = 3; level >= 0; level--) {
+        uint64_t e = table[(virt >> (12 + 9 * level)) & 0x1FF];
+        if (!(e & VMM_PRESENT)) return 0;
+        if (level == 0 || (e & VMM_HUGE)) {
+            uint64_t page_mask = (1ULL << (12 + 9 * level)) - 1;
+            return ((e & PTE_ADDR_MASK) & ~page_mask) | (virt & page_mask);
+        }
+        table = phys_to_table(e & PTE_ADDR_MASK);
+    }
+    return 0;
+}
+
+void *vmm_map_mmio(uint64_t phys, size_t size) {
+    uint64_t hhdm = vmm_hhdm_offset();
+    uint64_t start = phys & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = (phys + size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    /* Check and map under one hold so two CPUs can't both fill a page */
+    uint64_t flags = spin_lock_irqsave(&vmm_lock);
+    for (uint64_t p = start; p < end; p += PAGE_SIZE) {
+        if (vmm_virt_to_phys(hhdm + p) == p) continue; // Already in the HHDM
+        if (!map_page_locked(hhdm + p, p, VMM_WRITE | VMM_PCD | VMM_PWT | VMM_NX)) {
+            spin_unlock_irqrestore(&vmm_lock, flags);
+            return NULL;
+        }
+    }
+    spin_unlock_irqrestore(&vmm_lock, flags);
+    return (void *)(uintptr_t)(hhdm + phys);
+}
@@ -0,0 +1,28 @@
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VMM_PRESENT   (1ULL << 0)
+#define VMM_WRITE     (1ULL << 1)
+#define VMM_USER      (1ULL << 2)
+#define VMM_PWT       (1ULL << 3)
+#define VMM_PCD       (1ULL << 4)
+#define VMM_HUGE      (1ULL << 7)
+#define VMM_NX        (1ULL << 63)
+
+/* Edits the page tables Limine handed us (CR3) in place */
+int vmm_map_page(uint64_t virt, uint64_t phys, uint64_t flags);
+/* Clears a 4 KiB mapping; page tables stay allocated */
+void vmm_unmap_page(uint64_t virt);
+uint64_t vmm_virt_to_phys(uint64_t virt);
+
+/* Map a physical range (e.g. device registers) uncached into the HHDM and
+ * return its virtual address. Ranges already covered are left untouched. */
+void *vmm_map_mmio(uint64_t phys, size_t size);
+
+/* HHDM translation for memory the bootloader already maps */
+uint64_t vmm_hhdm_offset();
+
+#endif
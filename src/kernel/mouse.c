@@ -1,14 +1,53 @@
 #include "mouse.h"
 #include "ports.h"
-#include "cpu.h"
+#include "interrupts.h"
+#include "workqueue.h"
+#include "sync.h"
+#include "trace.h"
 #include "gfx.h"
 #include "../boot/limine.h"
 
 extern struct limine_framebuffer_request framebuffer_request;
 
-static mouse_state_t m_state = {0, 0, 0, 0, 0};
+/* Decoded packet, produced by the bottom half */
+typedef struct {
+    uint64_t tsc;
+    int16_t dx, dy;
+    int8_t dz;
+    uint8_t buttons;
+} mouse_packet_t;
+
+/* Single-producer / single-consumer ring between the bottom half and the render loop */
+#define MOUSE_QUEUE_SIZE 256 // Power of two
+
+static mouse_packet_t packet_queue[MOUSE_QUEUE_SIZE];
+static volatile uint32_t packet_head = 0;
+static volatile uint32_t packet_tail = 0;
+static uint32_t packets_dropped = 0;
+static sched_event_t *packet_notify = 0;
+
+/* Raw bytes from the IRQ handler, assembled into packets by mouse_bh */
+#define MOUSE_RAW_SIZE 128 // Power of two
+
+static struct {
+    uint64_t tsc;
+    uint8_t data;
+} mouse_raw[MOUSE_RAW_SIZE];
+static volatile uint32_t raw_head = 0;
+static volatile uint32_t raw_tail = 0;
+static uint32_t raw_dropped = 0;
+static work_t mouse_work;
+
+/* Bottom-half decoder state */
 static uint8_t mouse_cycle = 0;
-static int8_t mouse_byte[3];
+static uint8_t mouse_byte[4];
+static uint8_t packet_size = 3;
+
+/* Consumer-side state; readers on other CPUs go through the seqlock */
+static mouse_state_t m_state = {0, 0, 0, 0, 0};
+static seqlock_t m_state_lock = SEQLOCK_INIT;
+static uint8_t m_buttons = 0;
+static int screen_w = 0, screen_h = 0;
 
 static void mouse_wait(uint8_t type) {
     uint32_t timeout = 100000;
@@ -33,54 +72,142 @@ static uint8_t mouse_read() {
     return inb(0x60);
 }
 
-__attribute__((interrupt))
-void mouse_handler(void* frame) {
-    uint8_t status = inb(0x64);
-    if (!(status & 1) || !(status & 0x20)) {
-        goto end;
+static void mouse_set_sample_rate(uint8_t rate) {
+    mouse_write(0xF3);
+    mouse_read();
+    mouse_write(rate);
+    mouse_read();
+}
+
+static void push_packet(uint64_t tsc) {
+    uint32_t head = packet_head;
+    if (head - __atomic_load_n(&packet_tail, __ATOMIC_ACQUIRE) >= MOUSE_QUEUE_SIZE) {
+        packets_dropped++;
+        return;
     }
 
-    mouse_byte[mouse_cycle++] = inb(0x60);
+    int dx = mouse_byte[1];
+    int dy = mouse_byte[2];
+    if (mouse_byte[0] & 0x10) dx -= 256;
+    if (mouse_byte[0] & 0x20) dy -= 256;
+
+    mouse_packet_t *p = &packet_queue[head & (MOUSE_QUEUE_SIZE - 1)];
+    p->tsc = tsc;
+    p->dx = dx;
+    p->dy = -dy; // Y is inverted in PS/2 vs Screen coords
+    p->dz = (packet_size == 4) ? (int8_t)mouse_byte[3] : 0;
+    p->buttons = mouse_byte[0] & 0x07;
+
+    __atomic_store_n(&packet_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void assemble(uint64_t tsc, uint8_t data) {
+    // Bit 3 of the first byte is always set; use it to resynchronise
+    if (mouse_cycle == 0 && !(data & 0x08)) return;
+
+    mouse_byte[mouse_cycle++] = data;
 
-    if (mouse_cycle == 3) {
+    if (mouse_cycle == packet_size) {
         mouse_cycle = 0;
+        if (!(mouse_byte[0] & 0x80 || mouse_byte[0] & 0x40)) push_packet(tsc);
+    }
+}
 
-        if (mouse_byte[0] & 0x80 || mouse_byte[0] & 0x40) goto end;
+/* Bottom half: turn queued bytes into packets */
+static void mouse_bh(work_t *work) {
+    (void)work;
+    uint32_t before = packet_head;
+    uint32_t tail = raw_tail;
+    while (tail != __atomic_load_n(&raw_head, __ATOMIC_ACQUIRE)) {
+        assemble(mouse_raw[tail & (MOUSE_RAW_SIZE - 1)].tsc, mouse_raw[tail & (MOUSE_RAW_SIZE - 1)].data);
+        tail++;
+        __atomic_store_n(&raw_tail, tail, __ATOMIC_RELEASE);
+    }
+    if (packet_head != before) {
+        TRACE(TRACE_INPUT_MOUSE, packet_head - before, packet_queue[before & (MOUSE_QUEUE_SIZE - 1)].tsc, 0);
+        if (packet_notify) sched_event_signal(packet_notify);
+    }
+}
+
+/* Top half: timestamp and stash the byte, nothing else */
+void mouse_handler(interrupt_frame_t *frame) {
+    uint64_t tsc = __builtin_ia32_rdtsc();
+    uint8_t status = inb(0x64);
+    (void)frame;
+    if (!(status & 1) || !(status & 0x20)) return;
 
-        m_state.left_button = mouse_byte[0] & 1;
-        m_state.right_button = (mouse_byte[0] & 2) >> 1;
-        m_state.middle_button = (mouse_byte[0] & 4) >> 2;
+    uint8_t data = inb(0x60);
+    uint32_t head = raw_head;
+    if (head - __atomic_load_n(&raw_tail, __ATOMIC_ACQUIRE) < MOUSE_RAW_SIZE) {
+        mouse_raw[head & (MOUSE_RAW_SIZE - 1)].tsc = tsc;
+        mouse_raw[head & (MOUSE_RAW_SIZE - 1)].data = data;
+        __atomic_store_n(&raw_head, head + 1, __ATOMIC_RELEASE);
+    } else {
+        raw_dropped++;
+    }
+    softirq_raise(&mouse_work);
+}
 
-        int x_move = mouse_byte[1];
-        int y_move = mouse_byte[2];
+static void apply_motion(int dx, int dy) {
+    m_state.x += dx;
+    m_state.y += dy;
+
+    // Clamp to screen bounds
+    if (m_state.x < 0) m_state.x = 0;
+    if (m_state.y < 0) m_state.y = 0;
+    if (m_state.x > screen_w - 1) m_state.x = screen_w - 1;
+    if (m_state.y > screen_h - 1) m_state.y = screen_h - 1;
+}
 
-        if (mouse_byte[0] & 0x10) x_move -= 256;
-        if (mouse_byte[0] & 0x20) y_move -= 256;
+int mouse_poll_event(mouse_event_t *ev) {
+    uint32_t tail = packet_tail;
+    uint32_t head = __atomic_load_n(&packet_head, __ATOMIC_ACQUIRE);
+    if (tail == head) return 0;
 
-        m_state.x += x_move;
-        m_state.y -= y_move; // Y is inverted in PS/2 vs Screen coords
+    mouse_packet_t p = packet_queue[tail++ & (MOUSE_QUEUE_SIZE - 1)];
+    ev->tsc = p.tsc;
+    ev->dx = p.dx;
+    ev->dy = p.dy;
+    ev->wheel = p.dz;
+    ev->changed = p.buttons ^ m_buttons;
+    ev->packets = 1;
 
-        // Clamp to screen bounds
-        if (framebuffer_request.response) {
-            uint32_t w = framebuffer_request.response->framebuffers[0]->width;
-            uint32_t h = framebuffer_request.response->framebuffers[0]->height;
-            if (m_state.x < 0) m_state.x = 0;
-            if (m_state.y < 0) m_state.y = 0;
-            if (m_state.x > (int)w - 1) m_state.x = w - 1;
-            if (m_state.y > (int)h - 1) m_state.y = h - 1;
+    /* Pure motion: fold in every following packet that is also pure motion */
+    if (!ev->changed && !ev->wheel) {
+        while (tail != head) {
+            mouse_packet_t *n = &packet_queue[tail & (MOUSE_QUEUE_SIZE - 1)];
+            if (n->buttons != m_buttons || n->dz) break;
+            ev->dx += n->dx;
+            ev->dy += n->dy;
+            ev->packets++;
+            tail++;
         }
     }
+    __atomic_store_n(&packet_tail, tail, __ATOMIC_RELEASE);
 
-end:
-    // Acknowledge both PICs
-    outb(0xA0, 0x20);
-    outb(0x20, 0x20);
-    (void)frame;
+    m_buttons = p.buttons;
+    write_seqlock(&m_state_lock);
+    apply_motion(ev->dx, ev->dy);
+    m_state.left_button = (m_buttons & MOUSE_BUTTON_LEFT) != 0;
+    m_state.right_button = (m_buttons & MOUSE_BUTTON_RIGHT) != 0;
+    m_state.middle_button = (m_buttons & MOUSE_BUTTON_MIDDLE) != 0;
+    write_sequnlock(&m_state_lock);
+
+    ev->x = m_state.x;
+    ev->y = m_state.y;
+    ev->buttons = m_buttons;
+    return 1;
 }
 
 void mouse_init() {
     uint8_t status;
 
+    // Cache the screen bounds once; the IRQ path never touches the framebuffer
+    if (framebuffer_request.response && framebuffer_request.response->framebuffer_count > 0) {
+        screen_w = framebuffer_request.response->framebuffers[0]->width;
+        screen_h = framebuffer_request.response->framebuffers[0]->height;
+    }
+
     // Enable auxiliary mouse device
     mouse_wait(1);
     outb(0x64, 0xA8);
@@ -99,17 +226,34 @@ void mouse_init() {
     mouse_write(0xF6);
     mouse_read();
 
+    // IntelliMouse knock sequence (200, 100, 80) unlocks the wheel byte
+    mouse_set_sample_rate(200);
+    mouse_set_sample_rate(100);
+    mouse_set_sample_rate(80);
+    mouse_write(0xF2);
+    mouse_read(); // ACK
+    if (mouse_read() == 3) packet_size = 4;
+
     // Enable data reporting
     mouse_write(0xF4);
     mouse_read();
 
-    // Setup IDT entry (IRQ 12 is interrupt 44)
-    idt_set_descriptor(44, mouse_handler, 0x8E);
-    
-    // Unmask IRQ 12 on Slave PIC
-    outb(0xA1, inb(0xA1) & ~(1 << 4));
+    work_init(&mouse_work, mouse_bh, 0);
+    irq_install(IRQ_MOUSE, mouse_handler, "ps2-mouse");
+}
+
+void mouse_set_notify(sched_event_t *ev) {
+    packet_notify = ev;
+}
+
+uint32_t mouse_dropped_packets() {
+    return packets_dropped + raw_dropped;
 }
 
-mouse_state_t* mouse_get_state() {
-    return &m_state;
+void mouse_get_state(mouse_state_t *out) {
+    uint32_t seq;
+    do {
+        seq = read_seqbegin(&m_state_lock);
+        *out = *(volatile mouse_state_t *)&m_state;
+    } while (read_seqretry(&m_state_lock, seq));
 }
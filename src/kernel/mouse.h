@@ -2,9 +2,15 @@
 #define MOUSE_H
 
 #include <stdint.h>
+#include "interrupts.h"
+#include "sched.h"
 
 void mouse_init();
-void mouse_handler();
+void mouse_handler(interrupt_frame_t *frame);
+
+#define MOUSE_BUTTON_LEFT   0x01
+#define MOUSE_BUTTON_RIGHT  0x02
+#define MOUSE_BUTTON_MIDDLE 0x04
 
 typedef struct {
     int x;
@@ -14,6 +20,28 @@ typedef struct {
     uint8_t middle_button;
 } mouse_state_t;
 
-mouse_state_t* mouse_get_state();
+/* One or more raw packets, as seen by the consumer */
+typedef struct {
+    uint64_t tsc;       // IRQ timestamp of the oldest packet folded in
+    int x, y;           // Pointer position after the event (clamped)
+    int dx, dy;         // Accumulated motion
+    int8_t wheel;       // Wheel clicks (IntelliMouse only)
+    uint8_t buttons;    // MOUSE_BUTTON_* after the event
+    uint8_t changed;    // Buttons whose state flipped with this event
+    uint16_t packets;   // Raw packets coalesced into this event
+} mouse_event_t;
+
+/* Dequeue the next event. Consecutive pure-motion packets are merged;
+ * button edges and wheel steps are always reported individually. */
+int mouse_poll_event(mouse_event_t *ev);
+
+uint32_t mouse_dropped_packets();
+
+/* Signaled whenever a packet is queued, so a consumer thread can sleep */
+void mouse_set_notify(sched_event_t *ev);
+
+/* Snapshot of the consumer-side state as of the last mouse_poll_event().
+ * Lock-free for readers; safe to call from any CPU. */
+void mouse_get_state(mouse_state_t *out);
 
 #endif
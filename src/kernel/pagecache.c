@@ -0,0 +1,729 @@
+#include "pagecache.h"
+#include "sync.h"
+#include "sched.h"
+#include "serial.h"
+#include "workqueue.h"
+#include "memory/pmm.h"
+#include "memory/slab.h"
+#include "libk/string/string.h"
+
+#define PAGE_VALID     (1 << 0)
+#define PAGE_DIRTY     (1 << 1)
+#define PAGE_ERROR     (1 << 2)     // The filesystem read failed
+#define PAGE_GONE      (1 << 3)     // Unhashed; the last pagecache_put() frees it
+#define PAGE_READAHEAD (1 << 4)     // Brought in speculatively and not read yet
+
+#define RA_SLOTS    64  // Sequential-read trackers, direct-mapped by node
+#define SCAN_BATCH  32  // Pages pinned per pass by writeback and shrinking
+
+struct cache_page {
+    fs_node_t *node;
+    uint32_t index;
+    volatile uint32_t flags;
+    uint32_t refs;
+    uint8_t *data;
+    cache_page_t *hash_next;
+    cache_page_t *lru_prev;     // Also the free descriptor link
+    cache_page_t *lru_next;
+};
+
+/* Readahead state of one file */
+typedef struct {
+    fs_node_t *node;
+    uint32_t next;      // Page a sequential reader would start at next
+    uint32_t ahead;     // First page not yet requested from the filesystem
+    uint32_t window;    // 0 while the access pattern looks random
+} ra_state_t;
+
+/* A reader sleeping until someone else's load of `page` finishes */
+typedef struct page_waiter {
+    cache_page_t *page;
+    sched_event_t event;
+    struct page_waiter *next;
+    int linked;
+} page_waiter_t;
+
+static cache_page_t *buckets[PCACHE_BUCKETS];
+static cache_page_t lru;            // Sentinel: lru.lru_next is the most recently used
+static cache_page_t *free_descs = 0;
+static ra_state_t ra_slots[RA_SLOTS];
+static page_waiter_t *waiters = 0;  // Few and short-lived, so one list will do
+static uint64_t nr_pages = 0;
+static uint64_t nr_dirty = 0;
+
+/* Never held across allocation or filesystem calls; pmm reclaim only trylocks */
+DEFINE_SPINLOCK(pcache_lock, "pcache");
+
+static work_t flush_work;
+static ktimer_t flush_timer;
+static volatile int flush_armed = 0;
+
+/* Counters */
+static uint64_t hits = 0;
+static uint64_t misses = 0;
+static uint64_t fs_reads = 0;
+static uint64_t ra_pages = 0;
+static uint64_t ra_hits = 0;
+static uint64_t writebacks = 0;
+static uint64_t write_errors = 0;
+static uint64_t evictions = 0;
+static uint64_t reclaimed = 0;
+
+static inline uint32_t page_hash(fs_node_t *node, uint32_t index) {
+    uint64_t n = (uint64_t)(uintptr_t)node >> 4;
+    return ((uint32_t)(n * 0x9E3779B1u) ^ (index * 0x85EBCA6Bu)) & (PCACHE_BUCKETS - 1);
+}
+
+/* Page indices are 32-bit; nothing at or past this offset is cached */
+#define PCACHE_MAX_BYTES ((uint64_t)UINT32_MAX * PAGE_SIZE)
+
+static inline uint64_t min_u64(uint64_t a, uint64_t b) {
+    return a < b ? a : b;
+}
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
+static cache_page_t *find_locked(fs_node_t *node, uint32_t index) {
+    for (cache_page_t *p = buckets[page_hash(node, index)]; p; p = p->hash_next) {
+        if (p->node == node && p->index == index) return p;
+    }
+    return 0;
+}
+
+static void lru_unlink(cache_page_t *p) {
+    p->lru_prev->lru_next = p->lru_next;
+    p->lru_next->lru_prev = p->lru_prev;
+}
+
+static void lru_push_front(cache_page_t *p) {
+    p->lru_next = lru.lru_next;
+    p->lru_prev = &lru;
+    lru.lru_next->lru_prev = p;
+    lru.lru_next = p;
+}
+
+static void insert_locked(cache_page_t *p) {
+    uint32_t b = page_hash(p->node, p->index);
+    p->hash_next = buckets[b];
+    buckets[b] = p;
+    lru_push_front(p);
+    nr_pages++;
+}
+
+static void remove_locked(cache_page_t *p) {
+    cache_page_t **pp = &buckets[page_hash(p->node, p->index)];
+    while (*pp != p) pp = &(*pp)->hash_next;
+    *pp = p->hash_next;
+    lru_unlink(p);
+    nr_pages--;
+    if (p->flags & PAGE_DIRTY) nr_dirty--;
+    p->flags = (p->flags & ~PAGE_DIRTY) | PAGE_GONE;
+}
+
+/* Descriptors are recycled rather than kfree()d so reclaim, which can run
+ * under the slab lock, never re-enters the slab allocator */
+static void release_locked(cache_page_t *p) {
+    pmm_free(p->data, 1);
+    p->lru_prev = free_descs;
+    free_descs = p;
+}
+
+static cache_page_t *desc_alloc() {
+    spin_lock(&pcache_lock);
+    cache_page_t *p = free_descs;
+    if (p) free_descs = p->lru_prev;
+    spin_unlock(&pcache_lock);
+    return p ? p : kmalloc(sizeof(cache_page_t));
+}
+
+static void desc_free(cache_page_t *p) {
+    spin_lock(&pcache_lock);
+    p->lru_prev = free_descs;
+    free_descs = p;
+    spin_unlock(&pcache_lock);
+}
+
+/* Drop up to `want` clean, unpinned pages from the cold end of the LRU */
+static size_t shrink_locked(size_t want) {
+    size_t freed = 0;
+    cache_page_t *p = lru.lru_prev;
+    while (p != &lru && freed < want) {
+        cache_page_t *prev = p->lru_prev;
+        if (!p->refs && (p->flags & (PAGE_VALID | PAGE_DIRTY)) == PAGE_VALID) {
+            remove_locked(p);
+            release_locked(p);
+            freed++;
+        }
+        p = prev;
+    }
+    return freed;
+}
+
+static size_t pcache_reclaim(size_t pages) {
+    if (!spin_trylock(&pcache_lock)) return 0;
+    size_t freed = shrink_locked(pages + SCAN_BATCH);
+    reclaimed += freed;
+    spin_unlock(&pcache_lock);
+    return freed;
+}
+
+/* Write one pinned page back if it is still dirty; returns 1 if written */
+static int writeback_page(cache_page_t *p) {
+    spin_lock(&pcache_lock);
+    if (!(p->flags & PAGE_DIRTY)) {
+        spin_unlock(&pcache_lock);
+        return 0;
+    }
+    p->flags &= ~PAGE_DIRTY; // A write landing from here on dirties it again
+    nr_dirty--;
+    spin_unlock(&pcache_lock);
+
+    fs_node_t *node = p->node;
+    uint64_t pos = (uint64_t)p->index * PAGE_SIZE;
+    uint32_t len = node->length > pos ? (uint32_t)min_u64(PAGE_SIZE, node->length - pos) : 0;
+    if (len && node->ops->write(node, pos, len, p->data) < len) {
+        spin_lock(&pcache_lock);
+        if (!(p->flags & (PAGE_DIRTY | PAGE_GONE))) {
+            p->flags |= PAGE_DIRTY;
+            nr_dirty++;
+        }
+        write_errors++;
+        spin_unlock(&pcache_lock);
+        return 0;
+    }
+    __atomic_fetch_add(&writebacks, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/* Write back up to `max` dirty pages of `node` (0 = any), oldest first */
+static uint32_t writeback(fs_node_t *node, uint32_t max) {
+    uint32_t written = 0;
+    while (written < max) {
+        cache_page_t *batch[SCAN_BATCH];
+        uint32_t n = 0;
+        spin_lock(&pcache_lock);
+        for (cache_page_t *p = lru.lru_prev; p != &lru && n < SCAN_BATCH && n < max - written; p = p->lru_prev) {
+            if ((p->flags & PAGE_DIRTY) && (!node || p->node == node)) {
+                p->refs++;
+                batch[n++] = p;
+            }
+        }
+        spin_unlock(&pcache_lock);
+        if (!n) break;
+
+        uint32_t pass = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            pass += writeback_page(batch[i]);
+            pagecache_put(batch[i]);
+        }
+        written += pass;
+        if (!pass) break; // Everything left is failing
+    }
+    return written;
+}
+
+static void flush_fn(work_t *work) {
+    (void)work;
+    __atomic_store_n(&flush_armed, 0, __ATOMIC_RELEASE);
+    writeback(0, UINT32_MAX);
+}
+
+static void flush_timer_fired(ktimer_t *timer, void *arg) {
+    (void)timer; (void)arg;
+    work_schedule(&flush_work);
+}
+
+/* Called before the cache grows, from task context */
+static void make_room(uint32_t pages) {
+    if (pmm_free_pages() >= PCACHE_LOW_WATERMARK + pages) return;
+
+    spin_lock(&pcache_lock);
+    size_t freed = shrink_locked(pages + SCAN_BATCH);
+    evictions += freed;
+    int dirty = nr_dirty != 0;
+    spin_unlock(&pcache_lock);
+
+    // Nothing clean to drop: make some of it clean
+    if (!freed && dirty) {
+        writeback(0, SCAN_BATCH);
+        spin_lock(&pcache_lock);
+        evictions += shrink_locked(pages + SCAN_BATCH);
+        spin_unlock(&pcache_lock);
+    }
+}
+
+/* Sleep until the loader of a pinned page marks it valid or failed */
+static void wait_loaded(cache_page_t *p) {
+    page_waiter_t w = { p, { 0, 0 }, 0, 0 };
+    spin_lock(&pcache_lock);
+    while (!(p->flags & (PAGE_VALID | PAGE_ERROR))) {
+        if (!w.linked) {
+            w.next = waiters;
+            waiters = &w;
+            w.linked = 1;
+        }
+        spin_unlock(&pcache_lock);
+        sched_event_wait(&w.event, 0);
+        spin_lock(&pcache_lock);
+    }
+    if (w.linked) { // Woken some other way; the loader never saw us
+        page_waiter_t **pp = &waiters;
+        while (*pp != &w) pp = &(*pp)->next;
+        *pp = w.next;
+    }
+    // The loader signals with the lock held, so w is no longer touched
+    spin_unlock(&pcache_lock);
+}
+
+/* Wake everyone sleeping on p; the lock is held */
+static void wake_loaded_locked(cache_page_t *p) {
+    for (page_waiter_t **pp = &waiters; *pp;) {
+        page_waiter_t *w = *pp;
+        if (w->page != p) {
+            pp = &w->next;
+            continue;
+        }
+        *pp = w->next;
+        w->linked = 0;
+        sched_event_signal(&w->event);
+    }
+}
+
+/*
+ * Insert and read pages [start, start + count) that aren't cached yet,
+ * stopping at the first one that is, with a single filesystem read.
+ * Returns 0 only if memory ran out before anything could be inserted.
+ */
+static int load_run(fs_node_t *node, uint32_t start, uint32_t count, int speculative) {
+    uint32_t file_pages = (uint32_t)((min_u64(node->length, PCACHE_MAX_BYTES) + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (start >= file_pages) return 1;
+    count = min_u32(min_u32(count, file_pages - start), PCACHE_RA_MAX);
+
+    uint32_t n = 0;
+    spin_lock(&pcache_lock);
+    while (n < count && !find_locked(node, start + n)) n++;
+    spin_unlock(&pcache_lock);
+    if (!n) return 1;
+
+    make_room(n);
+    uint8_t *buf = pmm_alloc(n);
+    if (!buf) { // Fragmented: settle for the demanded page alone
+        n = 1;
+        buf = pmm_alloc(1);
+        if (!buf) return 0;
+    }
+    uint32_t allocated = n;
+
+    cache_page_t *pages[PCACHE_RA_MAX];
+    for (uint32_t i = 0; i < n; i++) {
+        pages[i] = desc_alloc();
+        if (!pages[i]) {
+            n = i;
+            break;
+        }
+    }
+
+    // Someone may have loaded part of the range meanwhile; stop there
+    uint32_t got = 0;
+    spin_lock(&pcache_lock);
+    while (got < n && !find_locked(node, start + got)) {
+        cache_page_t *p = pages[got];
+        p->node = node;
+        p->index = start + got;
+        p->flags = 0;
+        p->refs = 1; // Held by this loader until the data is in
+        p->data = buf + (uint64_t)got * PAGE_SIZE;
+        insert_locked(p);
+        got++;
+    }
+    spin_unlock(&pcache_lock);
+
+    for (uint32_t i = got; i < n; i++) desc_free(pages[i]);
+    if (allocated > got) pmm_free(buf + (uint64_t)got * PAGE_SIZE, allocated - got);
+    if (!got) return n != 0;
+
+    uint64_t pos = (uint64_t)start * PAGE_SIZE;
+    uint32_t want = (uint32_t)min_u64((uint64_t)got * PAGE_SIZE, node->length - pos);
+    uint32_t bytes = node->ops->read ? node->ops->read(node, pos, want, buf) : 0;
+    if (bytes > want) bytes = want;
+    k_memset(buf + bytes, 0, got * PAGE_SIZE - bytes);
+    __atomic_fetch_add(&fs_reads, 1, __ATOMIC_RELAXED);
+
+    spin_lock(&pcache_lock);
+    for (uint32_t i = 0; i < got; i++) {
+        cache_page_t *p = pages[i];
+        if (bytes == want || (uint64_t)i * PAGE_SIZE < bytes) {
+            p->flags |= PAGE_VALID;
+            if (speculative || i > 0) {
+                p->flags |= PAGE_READAHEAD;
+                ra_pages++;
+            }
+        } else {
+            p->flags |= PAGE_ERROR;
+            if (!(p->flags & PAGE_GONE)) remove_locked(p); // An invalidate may have beaten us to it
+        }
+        if (waiters) wake_loaded_locked(p);
+        if (--p->refs == 0 && (p->flags & PAGE_GONE)) release_locked(p);
+    }
+    spin_unlock(&pcache_lock);
+    return 1;
+}
+
+/*
+ * Pin page `index`. On a miss the page is read together with up to `extra`
+ * following pages; with `no_read` a missing page is created zero-filled.
+ */
+static cache_page_t *get_page(fs_node_t *node, uint32_t index, uint32_t extra, int no_read) {
+    int loaded = 0;
+    for (;;) {
+        spin_lock(&pcache_lock);
+        cache_page_t *p = find_locked(node, index);
+        if (p) {
+            p->refs++;
+            lru_unlink(p);
+            lru_push_front(p);
+            if (!loaded) hits++;
+            if (p->flags & PAGE_READAHEAD) {
+                p->flags &= ~PAGE_READAHEAD;
+                ra_hits++;
+            }
+            spin_unlock(&pcache_lock);
+
+            if (!(p->flags & (PAGE_VALID | PAGE_ERROR))) wait_loaded(p); // Another reader is loading it
+            if (p->flags & PAGE_ERROR) {
+                pagecache_put(p);
+                return 0;
+            }
+            return p;
+        }
+        spin_unlock(&pcache_lock);
+        if (loaded) return 0; // Evicted or failed before we got to it
+
+        misses++;
+        loaded = 1;
+        if (no_read) {
+            make_room(1);
+            p = desc_alloc();
+            uint8_t *data = p ? pmm_alloc(1) : 0;
+            if (!data) {
+                if (p) desc_free(p);
+                return 0;
+            }
+            k_memset(data, 0, PAGE_SIZE);
+            p->node = node;
+            p->index = index;
+            p->flags = PAGE_VALID;
+            p->refs = 1; // Pinned from the start, or reclaim could beat the caller to it
+            p->data = data;
+
+            spin_lock(&pcache_lock);
+            int raced = find_locked(node, index) != 0;
+            if (raced) release_locked(p); // Lost the race; use theirs
+            else insert_locked(p);
+            spin_unlock(&pcache_lock);
+            if (!raced) return p;
+            loaded = 0;
+        } else if (!load_run(node, index, 1 + extra, 0)) {
+            return 0;
+        }
+    }
+}
+
+cache_page_t *pagecache_get(fs_node_t *node, uint32_t index) {
+    if ((uint64_t)index * PAGE_SIZE >= node->length) return 0;
+    return get_page(node, index, 0, 0);
+}
+
+const uint8_t *pagecache_data(cache_page_t *page) {
+    return page->data;
+}
+
+void pagecache_put(cache_page_t *p) {
+    spin_lock(&pcache_lock);
+    if (--p->refs == 0 && (p->flags & PAGE_GONE)) release_locked(p);
+    spin_unlock(&pcache_lock);
+}
+
+/* Update the file's sequential-read tracker; returns the readahead window */
+static uint32_t ra_update(fs_node_t *node, uint32_t first, uint32_t last, uint32_t *ahead) {
+    ra_state_t *ra = &ra_slots[((uintptr_t)node >> 4) % RA_SLOTS];
+    spin_lock(&pcache_lock);
+    if (ra->node != node) {
+        ra->node = node;
+        ra->next = ~0u;
+        ra->window = 0;
+        ra->ahead = 0;
+    }
+    // A read that ended mid-page leaves the next one starting on that page
+    if (first == ra->next || first + 1 == ra->next) {
+        ra->window = ra->window ? min_u32(ra->window * 2, PCACHE_RA_MAX) : PCACHE_RA_MIN;
+        if (ra->ahead < last + 1) ra->ahead = last + 1;
+    } else {
+        ra->window = 0;
+        ra->ahead = last + 1;
+    }
+    ra->next = last + 1;
+    *ahead = ra->ahead;
+
+    // Refill once less than half a window is left in front of the reader
+    uint32_t window = ra->window;
+    if (window && ra->ahead - (last + 1) < window / 2) ra->ahead = last + 1 + window;
+    else window = 0;
+    spin_unlock(&pcache_lock);
+    return window;
+}
+
+uint32_t pagecache_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    uint64_t end = min_u64(node->length, PCACHE_MAX_BYTES);
+    if (offset >= end) return 0;
+    if (size > end - offset) size = end - offset;
+    if (!size) return 0;
+
+    uint32_t first = offset / PAGE_SIZE;
+    uint32_t last = (offset + size - 1) / PAGE_SIZE;
+    uint32_t ahead;
+    uint32_t window = ra_update(node, first, last, &ahead);
+
+    uint32_t done = 0;
+    for (uint32_t index = first; index <= last; index++) {
+        // A miss here pulls in the rest of the request in the same read
+        cache_page_t *p = get_page(node, index, last - index, 0);
+        if (!p) break;
+        uint32_t in_page = (offset + done) % PAGE_SIZE;
+        uint32_t chunk = min_u32(PAGE_SIZE - in_page, size - done);
+        k_memcpy(buffer + done, p->data + in_page, chunk);
+        pagecache_put(p);
+        done += chunk;
+    }
+
+    // Synchronous for now: the filesystem sees one large read per window
+    if (window) load_run(node, ahead, last + 1 + window - ahead, 1);
+    return done;
+}
+
+uint32_t pagecache_write(fs_node_t *node, uint64_t offset, uint32_t size, const uint8_t *buffer) {
+    if (!node->ops->write || offset >= PCACHE_MAX_BYTES) return 0;
+    if (size > PCACHE_MAX_BYTES - offset) size = PCACHE_MAX_BYTES - offset;
+    if ((node->flags & 0x07) == FS_DEVICE) {
+        // Devices don't grow
+        if (offset >= node->length) return 0;
+        if (size > node->length - offset) size = node->length - offset;
+    }
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint32_t index = (uint32_t)(pos / PAGE_SIZE), in_page = pos % PAGE_SIZE;
+        uint32_t chunk = min_u32(PAGE_SIZE - in_page, size - done);
+
+        // Whole-page overwrites and pages past EOF have nothing worth reading
+        int no_read = (in_page == 0 && chunk == PAGE_SIZE) || (uint64_t)index * PAGE_SIZE >= node->length;
+        cache_page_t *p = get_page(node, index, 0, no_read);
+        if (!p) break;
+        k_memcpy(p->data + in_page, buffer + done, chunk);
+
+        spin_lock(&pcache_lock);
+        if (!(p->flags & (PAGE_DIRTY | PAGE_GONE))) {
+            p->flags |= PAGE_DIRTY;
+            nr_dirty++;
+        }
+        spin_unlock(&pcache_lock);
+        pagecache_put(p);
+
+        done += chunk;
+        if (pos + chunk > node->length) node->length = pos + chunk; // Until writeback, the cache owns the size
+    }
+
+    // Throttle writers that outrun writeback; otherwise flush a little later
+    if (__atomic_load_n(&nr_dirty, __ATOMIC_RELAXED) > PCACHE_DIRTY_MAX) {
+        writeback(0, PCACHE_DIRTY_MAX / 2);
+    } else if (done && !__atomic_exchange_n(&flush_armed, 1, __ATOMIC_ACQ_REL)) {
+        ktimer_arm_in(&flush_timer, PCACHE_WRITEBACK_NS, 0);
+    }
+    return done;
+}
+
+uint32_t pagecache_sync(fs_node_t *node) {
+    return writeback(node, UINT32_MAX);
+}
+
+void pagecache_invalidate(fs_node_t *node) {
+    spin_lock(&pcache_lock);
+    cache_page_t *p = lru.lru_next;
+    while (p != &lru) {
+        cache_page_t *next = p->lru_next;
+        if (p->node == node) {
+            remove_locked(p);
+            if (!p->refs) release_locked(p);
+        }
+        p = next;
+    }
+    ra_state_t *ra = &ra_slots[((uintptr_t)node >> 4) % RA_SLOTS];
+    if (ra->node == node) ra->node = 0;
+    spin_unlock(&pcache_lock);
+}
+
+int pagecache_holds(fs_node_t *node, uint64_t offset, uint32_t size) {
+    if (!size || offset >= PCACHE_MAX_BYTES) return 0;
+    uint32_t first = (uint32_t)(offset / PAGE_SIZE);
+    uint32_t last = (uint32_t)(min_u64(offset + size - 1, PCACHE_MAX_BYTES - 1) / PAGE_SIZE);
+    int found = 0;
+    spin_lock(&pcache_lock);
+    for (uint32_t i = first; !found && i <= last; i++) found = find_locked(node, i) != 0;
+    spin_unlock(&pcache_lock);
+    return found;
+}
+
+void pagecache_dump() {
+    serial_print("[PCACHE] ");
+    serial_print_dec(nr_pages);
+    serial_print(" pages (");
+    serial_print_dec(nr_dirty);
+    serial_print(" dirty), hits ");
+    serial_print_dec(hits);
+    serial_print(", misses ");
+    serial_print_dec(misses);
+    serial_print(", fs reads ");
+    serial_print_dec(fs_reads);
+    serial_print("\n[PCACHE] readahead ");
+    serial_print_dec(ra_pages);
+    serial_print(" pages, ");
+    serial_print_dec(ra_hits);
+    serial_print(" used; writebacks ");
+    serial_print_dec(writebacks);
+    serial_print(" (");
+    serial_print_dec(write_errors);
+    serial_print(" failed); evicted ");
+    serial_print_dec(evictions);
+    serial_print(", reclaimed ");
+    serial_print_dec(reclaimed);
+    serial_print("\n");
+}
+
+#define TEST_CHUNK_PAGES 16
+
+static uint8_t test_pattern(uint64_t pos) {
+    return (uint8_t)(pos ^ (pos >> 12) * 131);
+}
+
+static void print_rate(const char *what, uint64_t bytes, uint64_t ns) {
+    serial_print("[PCACHE] ");
+    serial_print(what);
+    serial_print(" ");
+    serial_print_dec(bytes / 1024);
+    serial_print(" KiB, ");
+    serial_print_dec(ns ? bytes * 1000ULL / ns : 0);
+    serial_print(" MB/s");
+}
+
+/* "pcache read|write <path> [KiB]": streams the start of a cached file
+ * (16 MiB by default) through the cache. write fills it with a pattern,
+ * syncs, drops the file's pages and reads it back from the backing store
+ * to check it. Writes destroy the file's contents. */
+static void pcache_test(const char *args, int write) {
+    char path[128];
+    uint32_t len = 0;
+    uint64_t bytes = 16 * 1024 * 1024;
+    while (*args && *args != ' ') args++;
+    while (*args == ' ') args++;
+    while (*args && *args != ' ' && len < sizeof(path) - 1) path[len++] = *args++;
+    path[len] = 0;
+    while (*args == ' ') args++;
+    if (*args >= '0' && *args <= '9') {
+        bytes = 0;
+        while (*args >= '0' && *args <= '9') bytes = bytes * 10 + (*args++ - '0');
+        bytes *= 1024;
+    }
+
+    fs_node_t *node = len ? vfs_lookup(path) : 0;
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY || !(node->flags & FS_CACHED)) {
+        serial_print("[PCACHE] Not a cached file.\n");
+        return;
+    }
+    if (write && !node->ops->write) {
+        serial_print("[PCACHE] File is read-only.\n");
+        return;
+    }
+    uint8_t *buf = pmm_alloc(TEST_CHUNK_PAGES);
+    if (!buf) {
+        serial_print("[PCACHE] Out of memory.\n");
+        return;
+    }
+    vfs_open(node);
+    if (bytes > node->length) bytes = node->length;
+
+    uint64_t done, start = ktime_get_ns();
+    if (write) {
+        for (done = 0; done < bytes; ) {
+            uint32_t n = (uint32_t)min_u64(bytes - done, TEST_CHUNK_PAGES * PAGE_SIZE);
+            for (uint32_t i = 0; i < n; i++) buf[i] = test_pattern(done + i);
+            if (vfs_write(node, done, n, buf) != n) break;
+            done += n;
+        }
+        uint64_t failed_before = write_errors;
+        pagecache_sync(node);
+        print_rate("Wrote", done, ktime_get_ns() - start);
+        serial_print(write_errors != failed_before ? ", writeback failed\n" : "\n");
+        pagecache_invalidate(node);
+        bytes = done;
+        start = ktime_get_ns();
+    }
+
+    uint64_t reads_before = fs_reads, bad = 0;
+    for (done = 0; done < bytes; ) {
+        uint32_t n = (uint32_t)min_u64(bytes - done, TEST_CHUNK_PAGES * PAGE_SIZE);
+        if (vfs_read(node, done, n, buf) != n) break;
+        if (write) for (uint32_t i = 0; i < n; i++) bad += buf[i] != test_pattern(done + i);
+        done += n;
+    }
+    print_rate("Read", done, ktime_get_ns() - start);
+    serial_print(" in ");
+    serial_print_dec(fs_reads - reads_before);
+    serial_print(" fs reads");
+    if (write) {
+        serial_print(", ");
+        serial_print_dec(bad);
+        serial_print(" bytes wrong");
+    }
+    serial_print("\n");
+    vfs_close(node);
+    pmm_free(buf, TEST_CHUNK_PAGES);
+}
+
+/* "pcache" for stats, "pcache sync" to write everything back, "pcache drop"
+ * to shed clean pages, "pcache read|write" to exercise a file (see above) */
+static void pcache_command(const char *args) {
+    while (args && *args == ' ') args++;
+    if (args && (args[0] == 'r' || args[0] == 'w')) {
+        pcache_test(args, args[0] == 'w');
+        return;
+    }
+    if (args && args[0] == 's') {
+        uint32_t n = pagecache_sync(0);
+        serial_print("[PCACHE] Wrote back ");
+        serial_print_dec(n);
+        serial_print(" pages.\n");
+        return;
+    }
+    if (args && args[0] == 'd') {
+        spin_lock(&pcache_lock);
+        size_t n = shrink_locked(nr_pages);
+        evictions += n;
+        spin_unlock(&pcache_lock);
+        serial_print("[PCACHE] Dropped ");
+        serial_print_dec(n);
+        serial_print(" clean pages.\n");
+        return;
+    }
+    pagecache_dump();
+}
+
+void pagecache_init() {
+    lru.lru_next = lru.lru_prev = &lru;
+    work_init(&flush_work, flush_fn, 0);
+    ktimer_setup(&flush_timer, flush_timer_fired, 0);
+    pmm_set_reclaim(pcache_reclaim);
+    serial_register_command("pcache", pcache_command);
+}
@@ -0,0 +1,45 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "vfs.h"
+#include "timer.h"
+
+/*
+ * File data cache for nodes flagged FS_CACHED: PMM pages indexed by
+ * (node, page number). vfs_read()/vfs_write() on such nodes go through here,
+ * so the filesystem's read/write callbacks only see page-aligned, batched
+ * I/O. Sequential readers get a readahead window that doubles up to
+ * PCACHE_RA_MAX; random readers get none. Dirty pages are written back by a
+ * delayed kworker flush, by writers once too much is dirty, and by
+ * pagecache_sync(). Clean pages are dropped when PMM memory runs low.
+ */
+
+#define PCACHE_BUCKETS       1024   // Power of two
+#define PCACHE_RA_MIN        4      // Pages, first window of a sequential reader
+#define PCACHE_RA_MAX        64     // Also the largest single filesystem read
+#define PCACHE_DIRTY_MAX     256    // Writers flush synchronously beyond this
+#define PCACHE_LOW_WATERMARK 1024   // Free PMM pages kept before the cache grows
+#define PCACHE_WRITEBACK_NS  (5 * NS_PER_S)
+
+typedef struct cache_page cache_page_t;
+
+void pagecache_init();
+
+uint32_t pagecache_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer);
+uint32_t pagecache_write(fs_node_t *node, uint64_t offset, uint32_t size, const uint8_t *buffer);
+
+/* Pinned, up-to-date page `index` of the file, or 0; pagecache_put() unpins */
+cache_page_t *pagecache_get(fs_node_t *node, uint32_t index);
+const uint8_t *pagecache_data(cache_page_t *page);
+void pagecache_put(cache_page_t *page);
+
+uint32_t pagecache_sync(fs_node_t *node);       // 0 = every file; returns pages written
+void pagecache_invalidate(fs_node_t *node);     // Drops the file's pages, dirty ones too
+/* 1 if any page of [offset, offset + size) is cached, for I/O that wants
+ * to bypass the cache without reading stale data */
+int pagecache_holds(fs_node_t *node, uint64_t offset, uint32_t size);
+
+void pagecache_dump();
+
+#endif
@@ -0,0 +1,264 @@
+#include "pci.h"
+#include "ports.h"
+#include "sync.h"
+#include "serial.h"
+#include "memory/vmm.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static pci_device_t devices[PCI_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+/* The address/data port pair is one shared window */
+DEFINE_SPINLOCK(config_lock, "pci_config");
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t address = (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    uint64_t flags = spin_lock_irqsave(&config_lock);
+    outl(PCI_CONFIG_ADDRESS, address);
+    uint32_t value = inl(PCI_CONFIG_DATA);
+    spin_unlock_irqrestore(&config_lock, flags);
+    return value;
+}
+
+static void config_write(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    uint32_t address = (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    uint64_t flags = spin_lock_irqsave(&config_lock);
+    outl(PCI_CONFIG_ADDRESS, address);
+    outl(PCI_CONFIG_DATA, value);
+    spin_unlock_irqrestore(&config_lock, flags);
+}
+
+uint32_t pci_read32(const pci_device_t *dev, uint8_t offset) {
+    return config_read(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_read16(const pci_device_t *dev, uint8_t offset) {
+    return config_read(dev->bus, dev->slot, dev->func, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t pci_read8(const pci_device_t *dev, uint8_t offset) {
+    return config_read(dev->bus, dev->slot, dev->func, offset) >> ((offset & 3) * 8);
+}
+
+void pci_write32(const pci_device_t *dev, uint8_t offset, uint32_t value) {
+    config_write(dev->bus, dev->slot, dev->func, offset, value);
+}
+
+/* Read-modify-write of the containing dword. Fine for the command and
+ * MSI-X control registers; never use it next to write-1-to-clear bits. */
+void pci_write16(const pci_device_t *dev, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t old = config_read(dev->bus, dev->slot, dev->func, offset);
+    if (offset == PCI_COMMAND) old &= 0x0000FFFF; // Don't write status bits back
+    old = (old & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    config_write(dev->bus, dev->slot, dev->func, offset, old);
+}
+
+/* Size BARs by writing all ones and reading back which bits stuck, with
+ * decoding off so the probe value is never claimed as an address.
+ * Returns the number of BAR slots used (2 for a 64-bit one). */
+static int probe_bar(pci_device_t *dev, int index) {
+    uint8_t offset = PCI_BAR0 + index * 4;
+    pci_bar_t *bar = &dev->bar[index];
+    uint32_t low = pci_read32(dev, offset);
+
+    pci_write32(dev, offset, 0xFFFFFFFF);
+    uint32_t mask = pci_read32(dev, offset);
+    pci_write32(dev, offset, low);
+
+    if (low & 1) {
+        bar->io = 1;
+        bar->base = low & ~3u;
+        mask &= ~3u;
+        bar->size = mask ? (~mask & 0xFFFF) + 1 : 0;
+        return 1;
+    }
+
+    bar->prefetch = (low >> 3) & 1;
+    bar->base = low & ~0xFu;
+    uint64_t size_mask = 0xFFFFFFFF00000000ULL | (mask & ~0xFu);
+    if (((low >> 1) & 3) == 2 && index < 5) {
+        uint32_t high = pci_read32(dev, offset + 4);
+        pci_write32(dev, offset + 4, 0xFFFFFFFF);
+        uint32_t mask_high = pci_read32(dev, offset + 4);
+        pci_write32(dev, offset + 4, high);
+        bar->base |= (uint64_t)high << 32;
+        size_mask = ((uint64_t)mask_high << 32) | (mask & ~0xFu);
+        bar->size = (mask | mask_high) ? ~size_mask + 1 : 0;
+        return 2;
+    }
+    bar->size = (mask & ~0xFu) ? ~size_mask + 1 : 0;
+    return 1;
+}
+
+static void probe_function(uint8_t bus, uint8_t slot, uint8_t func) {
+    uint32_t id = config_read(bus, slot, func, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF || device_count == PCI_MAX_DEVICES) return;
+
+    pci_device_t *dev = &devices[device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor = id & 0xFFFF;
+    dev->device = id >> 16;
+    uint32_t class = pci_read32(dev, PCI_REVISION);
+    dev->class_code = class >> 24;
+    dev->subclass = class >> 16;
+    dev->prog_if = class >> 8;
+    dev->subsystem = pci_read16(dev, PCI_SUBSYSTEM_ID);
+    dev->irq_line = pci_read8(dev, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_read8(dev, PCI_INTERRUPT_PIN);
+
+    // Only type 0 headers have six BARs; bridges are just listed
+    if ((pci_read8(dev, PCI_HEADER_TYPE) & 0x7F) != 0) return;
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+    for (int i = 0; i < 6; i += probe_bar(dev, i));
+    pci_write16(dev, PCI_COMMAND, command);
+}
+
+static void scan() {
+    // Brute force over every bus: cheap, and needs no bridge bookkeeping
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            if ((config_read(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+            uint8_t header = config_read(bus, slot, 0, PCI_HEADER_TYPE) >> 16;
+            uint8_t funcs = (header & 0x80) ? 8 : 1;
+            for (uint8_t func = 0; func < funcs; func++) probe_function(bus, slot, func);
+        }
+    }
+}
+
+pci_device_t *pci_find(uint16_t vendor, uint16_t device, uint32_t index) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (devices[i].vendor != vendor || devices[i].device != device) continue;
+        if (index-- == 0) return &devices[i];
+    }
+    return 0;
+}
+
+void pci_enable(pci_device_t *dev) {
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_MASTER;
+    for (int i = 0; i < 6; i++) {
+        if (!dev->bar[i].size) continue;
+        command |= dev->bar[i].io ? PCI_COMMAND_IO : PCI_COMMAND_MEMORY;
+    }
+    pci_write16(dev, PCI_COMMAND, command);
+}
+
+uint8_t pci_find_capability(pci_device_t *dev, uint8_t id) {
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return 0;
+    uint8_t offset = pci_read8(dev, PCI_CAP_PTR) & 0xFC;
+    for (int guard = 0; offset && guard < 48; guard++) {
+        if (pci_read8(dev, offset) == id) return offset;
+        offset = pci_read8(dev, offset + 1) & 0xFC;
+    }
+    return 0;
+}
+
+/* --- MSI-X --- */
+
+#define MSIX_CONTROL_ENABLE   0x8000
+#define MSIX_CONTROL_MASK_ALL 0x4000
+#define MSIX_ENTRY_MASKED     1
+
+int pci_msix_enable(pci_device_t *dev, pci_msix_t *msix) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_MSIX);
+    if (!cap) return 0;
+
+    uint16_t control = pci_read16(dev, cap + 2);
+    uint32_t table = pci_read32(dev, cap + 4);
+    if ((table & 7) > 5) return 0; // BIR 6 and 7 are reserved
+    pci_bar_t *bar = &dev->bar[table & 7];
+    uint32_t entries = (control & 0x7FF) + 1;
+    if (bar->io || !bar->size || (table & ~7u) + entries * 16 > bar->size) return 0;
+
+    msix->dev = dev;
+    msix->cap = cap;
+    msix->entries = entries;
+    msix->table = (volatile uint32_t *)((uint8_t *)vmm_map_mmio(bar->base, bar->size) + (table & ~7u));
+    for (uint32_t i = 0; i < entries; i++) msix->table[i * 4 + 3] = MSIX_ENTRY_MASKED;
+
+    pci_write16(dev, cap + 2, (control & ~MSIX_CONTROL_MASK_ALL) | MSIX_CONTROL_ENABLE);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_DISABLE);
+    return 1;
+}
+
+void pci_msix_route(pci_msix_t *msix, uint16_t entry, uint8_t vector, uint32_t apic_id) {
+    volatile uint32_t *e = &msix->table[entry * 4];
+    e[3] = MSIX_ENTRY_MASKED;
+    e[0] = 0xFEE00000 | ((apic_id & 0xFF) << 12); // Physical destination, fixed delivery
+    e[1] = 0;
+    e[2] = vector;                                // Edge triggered
+    e[3] = 0;
+}
+
+void pci_msix_disable(pci_msix_t *msix) {
+    pci_device_t *dev = msix->dev;
+    for (uint32_t i = 0; i < msix->entries; i++) msix->table[i * 4 + 3] = MSIX_ENTRY_MASKED;
+    pci_write16(dev, msix->cap + 2, pci_read16(dev, msix->cap + 2) & ~MSIX_CONTROL_ENABLE);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) & ~PCI_COMMAND_INTX_DISABLE);
+}
+
+/* --- Shell --- */
+
+static const char *class_name(uint8_t class_code, uint8_t subclass) {
+    switch (class_code) {
+    case 0x01: return subclass == 0x01 ? "IDE" : subclass == 0x06 ? "SATA" :
+                      subclass == 0x08 ? "NVMe" : "storage";
+    case 0x02: return "network";
+    case 0x03: return "display";
+    case 0x04: return "multimedia";
+    case 0x06: return subclass == 0x00 ? "host bridge" : subclass == 0x01 ? "ISA bridge" : "bridge";
+    case 0x0C: return subclass == 0x03 ? "USB" : "serial bus";
+    default:   return "other";
+    }
+}
+
+/* "pci": every function found at boot */
+static void pci_command(const char *args) {
+    (void)args;
+    for (uint32_t i = 0; i < device_count; i++) {
+        pci_device_t *dev = &devices[i];
+        serial_print("[PCI] ");
+        serial_print_dec(dev->bus);
+        serial_print(":");
+        serial_print_dec(dev->slot);
+        serial_print(".");
+        serial_print_dec(dev->func);
+        serial_print(" ");
+        serial_print_hex(dev->vendor);
+        serial_print(":");
+        serial_print_hex(dev->device);
+        serial_print(" ");
+        serial_print(class_name(dev->class_code, dev->subclass));
+        if (dev->irq_pin) {
+            serial_print(" irq ");
+            serial_print_dec(dev->irq_line);
+        }
+        serial_print("\n");
+        for (int b = 0; b < 6; b++) {
+            if (!dev->bar[b].size) continue;
+            serial_print("       bar");
+            serial_print_dec(b);
+            serial_print(dev->bar[b].io ? " io " : " mem ");
+            serial_print_hex(dev->bar[b].base);
+            serial_print(" size ");
+            serial_print_dec(dev->bar[b].size);
+            serial_print("\n");
+        }
+    }
+}
+
+void pci_init() {
+    scan();
+    serial_print("[PCI] ");
+    serial_print_dec(device_count);
+    serial_print(" functions found.\n");
+    serial_register_command("pci", pci_command);
+}
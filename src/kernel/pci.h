@@ -0,0 +1,87 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+/*
+ * PCI bus enumeration over configuration mechanism #1 (ports 0xCF8/0xCFC).
+ * pci_init() walks every bus once and records each function it finds;
+ * drivers then look their devices up by vendor/device ID.
+ */
+
+#define PCI_MAX_DEVICES 64
+
+/* Configuration space offsets */
+#define PCI_VENDOR_ID     0x00
+#define PCI_DEVICE_ID     0x02
+#define PCI_COMMAND       0x04
+#define PCI_STATUS        0x06
+#define PCI_REVISION      0x08
+#define PCI_HEADER_TYPE   0x0E
+#define PCI_BAR0          0x10
+#define PCI_SUBSYSTEM_ID  0x2E
+#define PCI_CAP_PTR       0x34
+#define PCI_INTERRUPT_LINE 0x3C
+#define PCI_INTERRUPT_PIN 0x3D
+
+#define PCI_COMMAND_IO     0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_MASTER 0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+#define PCI_STATUS_CAP_LIST 0x0010
+
+#define PCI_CAP_MSIX 0x11
+
+typedef struct {
+    uint64_t base;      // Port number for I/O BARs, physical address otherwise
+    uint64_t size;
+    uint8_t io;         // 1 for an I/O port BAR
+    uint8_t prefetch;
+} pci_bar_t;
+
+typedef struct {
+    uint8_t bus, slot, func;
+    uint16_t vendor;
+    uint16_t device;
+    uint16_t subsystem;
+    uint8_t class_code, subclass, prog_if;
+    uint8_t irq_line;   // Legacy ISA IRQ the firmware wired INTx to
+    uint8_t irq_pin;    // 1-4 for INTA-INTD, 0 if none
+    pci_bar_t bar[6];
+} pci_device_t;
+
+/* An enabled MSI-X table, see pci_msix_enable() */
+typedef struct {
+    pci_device_t *dev;
+    uint8_t cap;                // Capability offset in config space
+    uint16_t entries;
+    volatile uint32_t *table;
+} pci_msix_t;
+
+uint32_t pci_read32(const pci_device_t *dev, uint8_t offset);
+uint16_t pci_read16(const pci_device_t *dev, uint8_t offset);
+uint8_t pci_read8(const pci_device_t *dev, uint8_t offset);
+void pci_write32(const pci_device_t *dev, uint8_t offset, uint32_t value);
+void pci_write16(const pci_device_t *dev, uint8_t offset, uint16_t value);
+
+void pci_init(); // Scans the buses and registers the "pci" command
+
+/* The index-th function matching vendor/device, or 0 */
+pci_device_t *pci_find(uint16_t vendor, uint16_t device, uint32_t index);
+
+/* Turn on decoding of the device's BARs and let it master the bus (DMA) */
+void pci_enable(pci_device_t *dev);
+
+/* Config offset of the first capability with this ID, or 0 */
+uint8_t pci_find_capability(pci_device_t *dev, uint8_t id);
+
+/* Map the MSI-X table with every entry masked and enable MSI-X, which also
+ * cuts off INTx. 0 if the device has no MSI-X. */
+int pci_msix_enable(pci_device_t *dev, pci_msix_t *msix);
+/* Point one table entry at a vector on one CPU and unmask it */
+void pci_msix_route(pci_msix_t *msix, uint16_t entry, uint8_t vector, uint32_t apic_id);
+/* Back to INTx, for a driver giving the device up */
+void pci_msix_disable(pci_msix_t *msix);
+
+#endif
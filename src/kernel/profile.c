@@ -0,0 +1,245 @@
+#include "profile.h"
+#include "ksym.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "smp.h"
+#include "serial.h"
+#include "memory/pmm.h"
+
+#define FLAT_TOP 25
+
+typedef struct {
+    uint64_t pc[PROFILE_DEPTH];     // pc[0] is the interrupted RIP, then return addresses
+    uint8_t depth;
+    uint8_t user;
+} profile_sample_t;
+
+typedef struct {
+    ktimer_t timer;
+    profile_sample_t *samples;
+    volatile uint32_t count;
+    uint32_t dropped;
+} profile_cpu_t;
+
+static profile_cpu_t prof_cpus[MAX_CPUS];
+static volatile int running = 0;
+static uint64_t period_ns = 0;
+
+/* Symbolized sample, frames outermost first, for sorting */
+typedef struct {
+    int32_t sym[PROFILE_DEPTH];
+    uint8_t depth;
+} folded_t;
+
+#define SYM_USER    -2
+#define SYM_UNKNOWN -1
+
+/* ktimer callback: runs inside timer_interrupt on the sampled CPU */
+static void take_sample(ktimer_t *timer, void *arg) {
+    (void)timer;
+    profile_cpu_t *pc = arg;
+    interrupt_frame_t *frame = this_cpu()->irq_frame;
+    if (!running || !frame) return;
+    if (pc->count >= PROFILE_SAMPLES) {
+        pc->dropped++;
+        return;
+    }
+
+    profile_sample_t *s = &pc->samples[pc->count];
+    s->pc[0] = frame->rip;
+    s->user = (frame->cs & 3) == 3;
+    s->depth = 1;
+    if (!s->user) s->depth += ksym_backtrace(frame->rbp, frame->rsp, &s->pc[1], PROFILE_DEPTH - 1);
+    __atomic_store_n(&pc->count, pc->count + 1, __ATOMIC_RELEASE);
+}
+
+static void arm_local(void *arg) {
+    (void)arg;
+    profile_cpu_t *pc = &prof_cpus[this_cpu()->cpu_id];
+    ktimer_arm_in(&pc->timer, period_ns, period_ns);
+}
+
+int profile_start(uint32_t hz) {
+    if (!hz || hz > PROFILE_MAX_HZ) return 0;
+    profile_stop();
+
+    uint32_t ncpu = smp_cpu_count();
+    size_t pages = (PROFILE_SAMPLES * sizeof(profile_sample_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (uint32_t c = 0; c < ncpu; c++) {
+        profile_cpu_t *pc = &prof_cpus[c];
+        if (!pc->samples && !(pc->samples = pmm_alloc(pages))) return 0;
+        pc->count = 0;
+        pc->dropped = 0;
+    }
+
+    period_ns = NS_PER_S / hz;
+    running = 1;
+    uint32_t self = this_cpu()->cpu_id;
+    for (uint32_t c = 0; c < ncpu; c++) {
+        if (c != self) smp_call(c, arm_local, 0);
+    }
+    arm_local(0);
+    return 1;
+}
+
+void profile_stop() {
+    running = 0;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) ktimer_cancel(&prof_cpus[c].timer);
+}
+
+static int symbolize(const profile_sample_t *s, int frame) {
+    if (s->user) return SYM_USER;
+    // Return addresses point past the call; step back into it
+    return ksym_index(frame ? s->pc[frame] - 1 : s->pc[frame]);
+}
+
+static const char *sym_label(int32_t sym) {
+    if (sym == SYM_USER) return "[user]";
+    if (sym == SYM_UNKNOWN) return "[unknown]";
+    return ksym_name(sym);
+}
+
+static uint32_t total_samples(uint32_t *dropped) {
+    uint32_t total = 0;
+    *dropped = 0;
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        total += prof_cpus[c].count;
+        *dropped += prof_cpus[c].dropped;
+    }
+    return total;
+}
+
+static void print_header(uint32_t total, uint32_t dropped) {
+    serial_print("[PROF] ");
+    serial_print_dec(total);
+    serial_print(" samples, ");
+    serial_print_dec(dropped);
+    serial_print(" dropped, ");
+    serial_print(running ? "running\n" : "stopped\n");
+}
+
+/* Samples per leaf function, hottest first */
+void profile_dump_flat() {
+    uint32_t dropped, total = total_samples(&dropped);
+    print_header(total, dropped);
+    if (!total) return;
+
+    // Two extra buckets at the front for user and unresolved samples
+    int nsyms = ksym_count() + 2;
+    size_t pages = (nsyms * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t *hits = pmm_alloc(pages);
+    if (!hits) return;
+    for (int i = 0; i < nsyms; i++) hits[i] = 0;
+
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        profile_cpu_t *pc = &prof_cpus[c];
+        for (uint32_t i = 0; i < pc->count; i++) hits[symbolize(&pc->samples[i], 0) + 2]++;
+    }
+
+    for (int shown = 0; shown < FLAT_TOP; shown++) {
+        int best = -1;
+        for (int i = 0; i < nsyms; i++) {
+            if (hits[i] && (best < 0 || hits[i] > hits[best])) best = i;
+        }
+        if (best < 0) break;
+
+        uint64_t permille = (uint64_t)hits[best] * 1000 / total;
+        serial_print("[PROF] ");
+        serial_print_dec(permille / 10);
+        serial_print(".");
+        serial_print_dec(permille % 10);
+        serial_print("% ");
+        serial_print_dec(hits[best]);
+        serial_print(" ");
+        serial_print(sym_label(best - 2));
+        serial_print("\n");
+        hits[best] = 0;
+    }
+    pmm_free(hits, pages);
+}
+
+static int folded_cmp(const folded_t *a, const folded_t *b) {
+    for (int i = 0; i < a->depth && i < b->depth; i++) {
+        if (a->sym[i] != b->sym[i]) return a->sym[i] < b->sym[i] ? -1 : 1;
+    }
+    return (int)a->depth - (int)b->depth;
+}
+
+/* One "outer;...;leaf count" line per distinct stack, between markers so
+ * the host can cut it out of the log and feed it to flamegraph.pl */
+void profile_dump_folded() {
+    uint32_t dropped, total = total_samples(&dropped);
+    print_header(total, dropped);
+    if (!total) return;
+
+    size_t pages = (total * sizeof(folded_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    folded_t *stacks = pmm_alloc(pages);
+    if (!stacks) return;
+
+    uint32_t n = 0;
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        profile_cpu_t *pc = &prof_cpus[c];
+        for (uint32_t i = 0; i < pc->count && n < total; i++, n++) {
+            profile_sample_t *s = &pc->samples[i];
+            stacks[n].depth = s->depth;
+            for (int f = 0; f < s->depth; f++) stacks[n].sym[s->depth - 1 - f] = symbolize(s, f);
+        }
+    }
+
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            folded_t tmp = stacks[i];
+            uint32_t j = i;
+            for (; j >= gap && folded_cmp(&stacks[j - gap], &tmp) > 0; j -= gap) stacks[j] = stacks[j - gap];
+            stacks[j] = tmp;
+        }
+    }
+
+    serial_print("--- folded begin ---\n");
+    for (uint32_t i = 0; i < n;) {
+        uint32_t run = 1;
+        while (i + run < n && folded_cmp(&stacks[i], &stacks[i + run]) == 0) run++;
+        for (int f = 0; f < stacks[i].depth; f++) {
+            if (f) serial_write(';');
+            serial_print(sym_label(stacks[i].sym[f]));
+        }
+        serial_print(" ");
+        serial_print_dec(run);
+        serial_print("\n");
+        i += run;
+    }
+    serial_print("--- folded end ---\n");
+    pmm_free(stacks, pages);
+}
+
+static int word_is(const char *args, const char *word) {
+    while (*word && *args == *word) {
+        args++;
+        word++;
+    }
+    return !*word && (*args == 0 || *args == ' ');
+}
+
+/* "prof start [hz]" | "prof stop" | "prof flat" | "prof folded" */
+static void prof_command(const char *args) {
+    while (*args == ' ') args++;
+    if (word_is(args, "start")) {
+        uint32_t hz = 0;
+        for (args += 5; *args == ' '; args++);
+        while (*args >= '0' && *args <= '9') hz = hz * 10 + (*args++ - '0');
+        if (!hz) hz = PROFILE_DEFAULT_HZ;
+        serial_print(profile_start(hz) ? "[PROF] Sampling started.\n" : "[PROF] Could not start sampling.\n");
+    } else if (word_is(args, "stop")) {
+        profile_stop();
+        serial_print("[PROF] Sampling stopped.\n");
+    } else if (word_is(args, "folded")) {
+        profile_dump_folded();
+    } else {
+        profile_dump_flat();
+    }
+}
+
+void profile_init() {
+    for (int c = 0; c < MAX_CPUS; c++) ktimer_setup(&prof_cpus[c].timer, take_sample, &prof_cpus[c]);
+    serial_register_command("prof", prof_command);
+}
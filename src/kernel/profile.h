@@ -0,0 +1,25 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Statistical profiler. Every CPU arms a periodic ktimer on its own LAPIC
+ * timer and records the interrupted RIP plus a frame-pointer backtrace
+ * into a private buffer. Results are symbolized against kernel.elf and
+ * printed over serial, flat or as folded stacks for flamegraph.pl.
+ */
+#define PROFILE_DEFAULT_HZ 997      // Prime, so sampling doesn't lock step with periodic work
+#define PROFILE_MAX_HZ     10000
+#define PROFILE_DEPTH      8        // Frames per sample, leaf first
+#define PROFILE_SAMPLES    2048     // Per CPU; later samples are dropped
+
+void profile_init(); // After smp_init() and ksym_init()
+
+int profile_start(uint32_t hz);
+void profile_stop();
+
+void profile_dump_flat();
+void profile_dump_folded();
+
+#endif
@@ -1,77 +1,325 @@
 #include "ramdisk.h"
 #include "user.h" // For k_strlen
-#include <string.h>
+#include "serial.h"
+#include "timer.h"
+#include "memory/pmm.h"
+#include "libk/string/string.h"
+#include "../boot/limine.h"
 
-#define MAX_RAMDISK_FILES 64
+__attribute__((used, section(".rodata"), aligned(8)))
+volatile struct limine_module_request module_request = {
+    .id = LIMINE_MODULE_REQUEST,
+    .revision = 0
+};
 
-static fs_node_t ramdisk_nodes[MAX_RAMDISK_FILES];
-static struct dirent dirent_list[MAX_RAMDISK_FILES];
-static int ramdisk_count = 0;
+#define TAR_BLOCK 512
+#define RD_NONE   0xFFFFFFFFu
 
-static uint32_t ramdisk_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if (offset > node->length) return 0;
-    if (offset + size > node->length) size = node->length - offset;
-    
-    uint8_t *data = (uint8_t*)(uintptr_t)node->impl;
-    for (uint32_t i = 0; i < size; i++) {
-        buffer[i] = data[offset + i];
+/* POSIX ustar header; numeric fields are NUL/space-terminated octal */
+typedef struct {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];      // "ustar"
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed)) tar_header_t;
+
+_Static_assert(sizeof(tar_header_t) == TAR_BLOCK, "ustar header is one block");
+
+/* Per-node tree links, indexed by fs_node_t.inode; node 0 is the root */
+typedef struct {
+    uint32_t parent;
+    uint32_t first_child;   // Directories: slice of `children`
+    uint32_t child_count;
+} rd_entry_t;
+
+/*
+ * Everything is sized from a first pass over the archive and built once,
+ * before the root is handed to the VFS; after that it is read-only, so
+ * lookups take no locks. File data is never copied: nodes point into the
+ * module, which Limine leaves in KERNEL_AND_MODULES memory.
+ */
+static fs_node_t *nodes;
+static rd_entry_t *entries;
+static uint32_t *children;
+static uint32_t *index_table;   // Open addressing over (parent, name), RD_NONE = empty
+static uint32_t index_mask;
+static uint32_t node_count = 0;
+static uint32_t node_cap = 0;
+static uint32_t file_count = 0;
+
+/* Index slot hash: the name's own hash folded with the parent */
+static inline uint32_t index_hash(uint32_t parent, uint32_t name_hash) {
+    return name_hash ^ (parent * 0x9E3779B1u);
+}
+
+static uint32_t lookup_child(uint32_t parent, const char *name, uint32_t len) {
+    uint32_t nh = strtab_hash(name, len);
+    for (uint32_t slot = index_hash(parent, nh) & index_mask;; slot = (slot + 1) & index_mask) {
+        uint32_t i = index_table[slot];
+        if (i == RD_NONE) return RD_NONE;
+        if (vfs_name_is(&nodes[i], name, len, nh) && entries[i].parent == parent) return i;
     }
+}
+
+static uint32_t ramdisk_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    if (offset > node->length) return 0;
+    if (size > node->length - offset) size = node->length - offset;
+    k_memcpy(buffer, (const uint8_t *)(uintptr_t)node->impl + offset, size);
     return size;
 }
 
-static struct dirent *ramdisk_readdir(fs_node_t *node, uint32_t index) {
-    if (index >= (uint32_t)ramdisk_count) return 0;
-    return &dirent_list[index];
+/* File contents already live in kernel memory; hand them out in place */
+static const uint8_t *ramdisk_map(fs_node_t *node, uint64_t offset, uint32_t size) {
+    (void)size;
+    return (const uint8_t *)(uintptr_t)node->impl + offset;
+}
+
+static fs_node_t *ramdisk_readdir(fs_node_t *node, uint32_t index) {
+    rd_entry_t *e = &entries[node->inode];
+    return index < e->child_count ? &nodes[children[e->first_child + index]] : 0;
+}
+
+static fs_node_t *ramdisk_finddir(fs_node_t *node, const char *name, uint32_t len) {
+    uint32_t i = lookup_child(node->inode, name, len);
+    return i == RD_NONE ? 0 : &nodes[i];
+}
+
+static const fs_ops_t ramdisk_file_ops = {
+    .read = ramdisk_read,
+    .map = ramdisk_map,
+};
+
+static const fs_ops_t ramdisk_dir_ops = {
+    .readdir = ramdisk_readdir,
+    .finddir = ramdisk_finddir,
+};
+
+static uint32_t add_node(uint32_t parent, const char *name, uint32_t len, int is_dir, const void *data, uint64_t size) {
+    if (node_count == node_cap) return RD_NONE;
+    uint32_t i = node_count;
+
+    fs_node_t *node = &nodes[i];
+    k_memset(node, 0, sizeof(fs_node_t));
+    if (!vfs_set_name(node, name, len)) return RD_NONE;
+    node_count++;
+    node->inode = i;
+    if (is_dir) {
+        node->flags = FS_DIRECTORY;
+        node->ops = &ramdisk_dir_ops;
+    } else {
+        node->flags = FS_FILE;
+        node->length = size;
+        node->impl = (uint64_t)(uintptr_t)data;
+        node->ops = &ramdisk_file_ops;
+        file_count++;
+    }
+
+    entries[i].parent = parent;
+    if (i == 0) return i; // The root has no name to index
+    uint32_t slot = index_hash(parent, node->name_hash) & index_mask;
+    while (index_table[slot] != RD_NONE) slot = (slot + 1) & index_mask;
+    index_table[slot] = i;
+    return i;
 }
 
-static fs_node_t *ramdisk_finddir(fs_node_t *node, char *name) {
-    for (int i = 0; i < ramdisk_count; i++) {
-        // Simple string compare (since we don't have full string.h yet, we'll implement it or use user.h)
-        const char* n1 = ramdisk_nodes[i].name;
-        const char* n2 = name;
-        int match = 1;
-        while (*n1 && *n2) {
-            if (*n1 != *n2) { match = 0; break; }
-            n1++; n2++;
+/* Create `path` under the root, making any missing parent directories */
+static void add_path(const char *path, int is_dir, const void *data, uint64_t size) {
+    uint32_t parent = 0;
+    const char *p = path;
+    for (;;) {
+        while (*p == '/') p++;
+        const char *name = p;
+        while (*p && *p != '/') p++;
+        uint32_t len = p - name;
+        while (*p == '/') p++;
+        int last = *p == 0;
+
+        if (len == 0 || len > STRTAB_MAX_LEN) return;
+        if (len == 1 && name[0] == '.') { // "./" from tar -C dir .
+            if (last) return;
+            continue;
         }
-        if (match && *n1 == 0 && *n2 == 0) return &ramdisk_nodes[i];
+
+        uint32_t child = lookup_child(parent, name, len);
+        if (last) {
+            if (child == RD_NONE) {
+                add_node(parent, name, len, is_dir, data, size);
+            } else if (!is_dir && (nodes[child].flags & 0x07) == FS_FILE) {
+                nodes[child].impl = (uint64_t)(uintptr_t)data; // Later members win, like tar -x
+                nodes[child].length = size;
+            }
+            return;
+        }
+        if (child == RD_NONE) child = add_node(parent, name, len, 1, 0, 0);
+        if (child == RD_NONE || (nodes[child].flags & 0x07) != FS_DIRECTORY) return;
+        parent = child;
     }
-    return 0;
 }
 
-static void ramdisk_add_file(char *name, char *contents) {
-    if (ramdisk_count >= MAX_RAMDISK_FILES) return;
-    
-    fs_node_t *node = &ramdisk_nodes[ramdisk_count];
+static uint64_t parse_octal(const char *s, int n) {
+    uint64_t v = 0;
     int i = 0;
-    while(name[i] && i < MAX_FILENAME-1) { node->name[i] = name[i]; i++; }
-    node->name[i] = 0;
-    
-    node->length = k_strlen(contents);
-    node->impl = (uint64_t)(uintptr_t)contents;
-    node->flags = FS_FILE;
-    node->read = ramdisk_read;
-    
-    // Update dirent
-    int j = 0;
-    while(name[j] && j < MAX_FILENAME-1) { dirent_list[ramdisk_count].name[j] = name[j]; j++; }
-    dirent_list[ramdisk_count].name[j] = 0;
-    dirent_list[ramdisk_count].inode = ramdisk_count;
-    
-    ramdisk_count++;
+    while (i < n && s[i] == ' ') i++;
+    for (; i < n && s[i] >= '0' && s[i] <= '7'; i++) v = v * 8 + (s[i] - '0');
+    return v;
+}
+
+static int header_valid(const tar_header_t *h) {
+    const uint8_t *b = (const uint8_t *)h;
+    uint32_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) sum += (i >= 148 && i < 156) ? ' ' : b[i]; // chksum counts as spaces
+    return h->magic[0] == 'u' && h->magic[1] == 's' && h->magic[2] == 't' &&
+           h->magic[3] == 'a' && h->magic[4] == 'r' && sum == parse_octal(h->chksum, 8);
+}
+
+/* "prefix/name" out of the two fixed-width fields; returns the length */
+static uint32_t header_path(const tar_header_t *h, char *out) {
+    uint32_t n = 0;
+    for (int i = 0; i < 155 && h->prefix[i]; i++) out[n++] = h->prefix[i];
+    if (n) out[n++] = '/';
+    for (int i = 0; i < 100 && h->name[i]; i++) out[n++] = h->name[i];
+    out[n] = 0;
+    return n;
+}
+
+typedef void (*tar_member_fn_t)(const char *path, uint32_t len, int is_dir, const void *data, uint64_t size);
+
+/* Calls fn for every regular file and directory up to the end marker */
+static void tar_walk(const uint8_t *tar, uint64_t size, tar_member_fn_t fn) {
+    char path[155 + 1 + 100 + 1];
+    uint64_t off = 0;
+    while (off + TAR_BLOCK <= size) {
+        const tar_header_t *h = (const tar_header_t *)(tar + off);
+        if (h->name[0] == 0 || !header_valid(h)) break;
+
+        uint64_t len = parse_octal(h->size, 12);
+        if (off + TAR_BLOCK + len > size) break; // Truncated archive
+
+        if (h->typeflag == '0' || h->typeflag == 0 || h->typeflag == '5') {
+            uint32_t n = header_path(h, path);
+            fn(path, n, h->typeflag == '5', tar + off + TAR_BLOCK, len);
+        }
+        off += TAR_BLOCK + ((len + TAR_BLOCK - 1) & ~(uint64_t)(TAR_BLOCK - 1));
+    }
+}
+
+/* Pass 1: every path component could become a node */
+static void count_member(const char *path, uint32_t len, int is_dir, const void *data, uint64_t size) {
+    (void)is_dir; (void)data; (void)size;
+    node_cap++;
+    for (uint32_t i = 0; i < len; i++) if (path[i] == '/') node_cap++;
+}
+
+static void add_member(const char *path, uint32_t len, int is_dir, const void *data, uint64_t size) {
+    (void)len;
+    add_path(path, is_dir, data, size);
+}
+
+static void *alloc_table(uint64_t bytes) {
+    return pmm_alloc((bytes + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+static int alloc_index(uint32_t cap) {
+    uint32_t slots = 16;
+    while (slots < cap * 2) slots <<= 1; // Load factor <= 0.5
+    nodes = alloc_table((uint64_t)cap * sizeof(fs_node_t));
+    entries = alloc_table((uint64_t)cap * sizeof(rd_entry_t));
+    children = alloc_table((uint64_t)cap * sizeof(uint32_t));
+    index_table = alloc_table((uint64_t)slots * sizeof(uint32_t));
+    if (!nodes || !entries || !children || !index_table) return 0;
+
+    k_memset(entries, 0, (uint64_t)cap * sizeof(rd_entry_t));
+    k_memset(index_table, 0xFF, (uint64_t)slots * sizeof(uint32_t));
+    index_mask = slots - 1;
+    node_cap = cap;
+    return 1;
+}
+
+/* Group children by parent, keeping archive order, so readdir is an array index */
+static void build_children() {
+    for (uint32_t i = 1; i < node_count; i++) entries[entries[i].parent].child_count++;
+
+    uint32_t end = 0;
+    for (uint32_t i = 0; i < node_count; i++) {
+        end += entries[i].child_count;
+        entries[i].first_child = end; // Filled downwards from here
+    }
+    for (uint32_t i = node_count - 1; i > 0; i--) children[--entries[entries[i].parent].first_child] = i;
+}
+
+static struct limine_file *find_initrd() {
+    struct limine_module_response *resp = module_request.response;
+    if (!resp || !resp->module_count) return 0;
+    for (uint64_t i = 0; i < resp->module_count; i++) {
+        const char *p = resp->modules[i]->path;
+        int n = k_strlen(p);
+        if (n >= 4 && p[n - 4] == '.' && p[n - 3] == 't' && p[n - 2] == 'a' && p[n - 1] == 'r') return resp->modules[i];
+    }
+    return resp->modules[0];
 }
 
+/* Served when the bootloader didn't load an initrd */
+static const char *builtin_files[][2] = {
+    { "welcome.txt", "Welcome to ParadoxOS!\nThis is the future of AI operating systems." },
+    { "admin.cfg", "USER=admin\nPASS=paradox" },
+    { "readme.md", "# Paradox Intelligence\nNeural OS initialized." },
+};
+
 fs_node_t *ramdisk_init() {
-    // Root Directory
-    static fs_node_t root;
-    root.flags = FS_DIRECTORY;
-    root.readdir = ramdisk_readdir;
-    root.finddir = ramdisk_finddir;
-    
-    // Some mock files for Phase 4
-    ramdisk_add_file("welcome.txt", "Welcome to ParadoxOS!\nThis is the future of AI operating systems.");
-    ramdisk_add_file("admin.cfg", "USER=admin\nPASS=paradox");
-    ramdisk_add_file("readme.md", "# Paradox Intelligence\nNeural OS initialized.");
-    
-    return &root;
+    uint64_t start = ktime_get_ns();
+    struct limine_file *initrd = find_initrd();
+    uint32_t builtin = sizeof(builtin_files) / sizeof(builtin_files[0]);
+
+    node_cap = 3; // Root, tmp/ and dev/
+    if (initrd) tar_walk(initrd->address, initrd->size, count_member);
+    else node_cap += builtin;
+
+    if (!alloc_index(node_cap)) {
+        serial_print("[RAMDISK] Out of memory for the file index.\n");
+        return 0;
+    }
+
+    add_node(0, "", 0, 1, 0, 0);
+    if (initrd) {
+        tar_walk(initrd->address, initrd->size, add_member);
+    } else {
+        for (uint32_t i = 0; i < builtin; i++) {
+            add_path(builtin_files[i][0], 0, builtin_files[i][1], k_strlen(builtin_files[i][1]));
+        }
+    }
+    add_path("tmp", 1, 0, 0); // Mountpoints for tmpfs and devfs, whatever the initrd holds
+    add_path("dev", 1, 0, 0);
+    build_children();
+
+    serial_print("[RAMDISK] ");
+    serial_print_dec(file_count);
+    serial_print(" files, ");
+    serial_print_dec(node_count - file_count - 1);
+    serial_print(" directories");
+    if (initrd) {
+        serial_print(" from ");
+        serial_print(initrd->path);
+        serial_print(" (");
+        serial_print_dec(initrd->size / 1024);
+        serial_print(" KiB)");
+    } else {
+        serial_print(" built in (no initrd module)");
+    }
+    serial_print(", indexed in ");
+    serial_print_dec((ktime_get_ns() - start) / NS_PER_US);
+    serial_print(" us\n");
+    return &nodes[0];
 }
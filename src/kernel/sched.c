@@ -0,0 +1,457 @@
+#include "sched.h"
+#include "smp.h"
+#include "sync.h"
+#include "apic.h"
+#include "interrupts.h"
+#include "fpu.h"
+#include "serial.h"
+#include "trace.h"
+#include "memory/pmm.h"
+#include "memory/slab.h"
+#include "libk/string/string.h"
+
+typedef struct {
+    spinlock_t lock;
+    lock_stats_t lock_stats;
+    task_t *head[SCHED_PRIORITIES];
+    task_t *tail[SCHED_PRIORITIES];
+    uint32_t ready_mask;        // Bit n set when head[n] is non-empty
+    volatile uint32_t nr_ready;
+    task_t *idle;
+    task_t *last;               // Switched away from, awaiting finish_switch()
+    ktimer_t slice_timer;
+    uint64_t switches;
+    uint64_t steals;
+} runqueue_t;
+
+static runqueue_t rqs[MAX_CPUS];
+static task_t idle_tasks[MAX_CPUS];
+
+DEFINE_SPINLOCK(tasks_lock, "tasks");
+static task_t *all_tasks = 0;
+static uint32_t next_task_id = 1;
+
+extern void sched_switch(uint64_t *prev_rsp, uint64_t next_rsp);
+extern void task_trampoline();
+
+task_t *task_current() {
+    return this_cpu()->current_task;
+}
+
+/* --- Run queues (caller holds rq->lock) --- */
+
+static void enqueue_locked(runqueue_t *rq, task_t *t) {
+    int p = t->priority;
+    t->next = 0;
+    if (rq->tail[p]) rq->tail[p]->next = t;
+    else rq->head[p] = t;
+    rq->tail[p] = t;
+    rq->ready_mask |= 1u << p;
+    rq->nr_ready++;
+}
+
+static void unlink_locked(runqueue_t *rq, task_t *t, task_t *prev) {
+    int p = t->priority;
+    if (prev) prev->next = t->next;
+    else rq->head[p] = t->next;
+    if (rq->tail[p] == t) rq->tail[p] = prev;
+    if (!rq->head[p]) rq->ready_mask &= ~(1u << p);
+    rq->nr_ready--;
+    t->next = 0;
+}
+
+static task_t *dequeue_locked(runqueue_t *rq) {
+    if (!rq->ready_mask) return 0;
+    int p = __builtin_ctz(rq->ready_mask);
+    task_t *t = rq->head[p];
+    unlink_locked(rq, t, 0);
+    return t;
+}
+
+/* Pull the highest-priority unpinned task from the busiest other CPU */
+static task_t *steal(uint32_t self) {
+    uint32_t ncpu = smp_cpu_count();
+    uint32_t victim = self;
+    uint32_t most = 0;
+    for (uint32_t i = 1; i < ncpu; i++) {
+        uint32_t c = (self + i) % ncpu;
+        uint32_t n = __atomic_load_n(&rqs[c].nr_ready, __ATOMIC_RELAXED);
+        if (n > most) {
+            most = n;
+            victim = c;
+        }
+    }
+    if (victim == self) return 0;
+
+    runqueue_t *rq = &rqs[victim];
+    task_t *found = 0;
+    spin_lock(&rq->lock);
+    for (int p = 0; p < SCHED_PRIORITIES && !found; p++) {
+        task_t *prev = 0;
+        for (task_t *t = rq->head[p]; t; prev = t, t = t->next) {
+            if (t->pinned_cpu != TASK_ANY_CPU) continue;
+            unlink_locked(rq, t, prev);
+            found = t;
+            break;
+        }
+    }
+    if (found) rq->steals++;
+    spin_unlock(&rq->lock);
+    return found;
+}
+
+/* Make sure someone notices a newly runnable task on `cpu` */
+static void check_preempt(uint32_t cpu, task_t *t) {
+    percpu_t *pc = smp_cpu(cpu);
+    task_t *cur = pc ? pc->current_task : 0;
+    if (!cur) return; // That CPU hasn't entered the scheduler yet
+
+    runqueue_t *rq = &rqs[cpu];
+    if (cur == rq->idle || t->priority < cur->priority) {
+        if (cpu == this_cpu()->cpu_id) pc->need_resched = 1;
+        else lapic_send_ipi(pc->lapic_id, SCHED_RESCHED_VECTOR);
+        return;
+    }
+    if (t->priority == cur->priority && cpu == this_cpu()->cpu_id) {
+        ktimer_arm_in(&rq->slice_timer, SCHED_SLICE_NS, 0); // Round-robin with it
+    }
+
+    /* The owner is busy; an idle CPU can steal it */
+    if (t->pinned_cpu != TASK_ANY_CPU) return;
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        percpu_t *other = smp_cpu(c);
+        if (c != cpu && other->current_task && other->current_task == rqs[c].idle) {
+            lapic_send_ipi(other->lapic_id, SCHED_RESCHED_VECTOR);
+            return;
+        }
+    }
+}
+
+static void make_ready(task_t *t) {
+    uint32_t cpu = t->pinned_cpu != TASK_ANY_CPU ? (uint32_t)t->pinned_cpu : t->cpu;
+    runqueue_t *rq = &rqs[cpu];
+    TRACE(TRACE_SCHED_WAKE, t->id, cpu, 0);
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    t->cpu = cpu;
+    enqueue_locked(rq, t);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    check_preempt(cpu, t);
+}
+
+/* --- Switching --- */
+
+static void reap(task_t *t) {
+    spin_lock(&tasks_lock);
+    for (task_t **pp = &all_tasks; *pp; pp = &(*pp)->all_next) {
+        if (*pp == t) {
+            *pp = t->all_next;
+            break;
+        }
+    }
+    spin_unlock(&tasks_lock);
+    fpu_release(t);
+    pmm_free((void *)t->stack_base, SCHED_STACK_PAGES);
+    kfree(t);
+}
+
+/* Runs on the incoming task's stack once the outgoing one is off-CPU */
+static void finish_switch() {
+    runqueue_t *rq = &rqs[this_cpu()->cpu_id];
+    task_t *last = rq->last;
+    rq->last = 0;
+    if (!last) return;
+    if (last->state == TASK_DEAD) reap(last);
+    else __atomic_store_n(&last->on_cpu, 0, __ATOMIC_RELEASE);
+}
+
+void schedule() {
+    uint64_t flags = cpu_irq_save();
+    percpu_t *cpu = this_cpu();
+    runqueue_t *rq = &rqs[cpu->cpu_id];
+    task_t *prev = cpu->current_task;
+    cpu->need_resched = 0;
+
+    spin_lock(&rq->lock);
+    if (prev != rq->idle && prev->state == TASK_RUNNING) {
+        prev->state = TASK_READY;
+        enqueue_locked(rq, prev);
+    }
+    task_t *next = dequeue_locked(rq);
+    spin_unlock(&rq->lock);
+
+    if (!next) next = steal(cpu->cpu_id);
+    if (!next) next = rq->idle;
+    next->state = TASK_RUNNING;
+
+    // Tickless: only slice when something else is waiting for this CPU
+    if (next != rq->idle && rq->nr_ready) ktimer_arm_in(&rq->slice_timer, SCHED_SLICE_NS, 0);
+    else ktimer_cancel(&rq->slice_timer);
+
+    if (next == prev) {
+        cpu_irq_restore(flags);
+        return;
+    }
+
+    uint64_t now = ktime_get_ns();
+    prev->runtime_ns += now - prev->last_start_ns;
+    next->last_start_ns = now;
+    next->switches++;
+    rq->switches++;
+
+    // A task woken or stolen from another CPU may still be switching out there
+    while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE)) __asm__ volatile ("pause");
+    next->on_cpu = 1;
+    if (next->cpu != cpu->cpu_id && next != rq->idle) next->migrations++;
+    next->cpu = cpu->cpu_id;
+
+    // Traps and SYSCALLs from user mode land on the incoming task's stack
+    if (next->stack_base) {
+        uint64_t top = next->stack_base + SCHED_STACK_PAGES * PAGE_SIZE;
+        cpu->syscall_stack = top;
+        cpu_set_kernel_stack(cpu->cpu_id, top);
+    }
+
+    fpu_switch(prev, next);
+    TRACE(TRACE_SCHED_SWITCH, prev->id, next->id, prev->state);
+    rq->last = prev;
+    cpu->current_task = next;
+    sched_switch(&prev->rsp, next->rsp);
+
+    finish_switch();
+    cpu_irq_restore(flags);
+}
+
+/* First code a new task runs, reached from task_trampoline */
+void sched_task_start() {
+    finish_switch();
+    cpu_enable_interrupts();
+
+    task_t *self = task_current();
+    self->entry(self->arg);
+    task_exit();
+}
+
+void preempt_enable() {
+    int zero;
+    __asm__ volatile ("decl %%gs:%c1" : "=@ccz"(zero) : "i"(PREEMPT_COUNT_OFFSET) : "memory");
+    if (!zero) return;
+    percpu_t *cpu = this_cpu();
+    if (cpu->need_resched && cpu->current_task && cpu_irqs_enabled()) schedule();
+}
+
+void sched_irq_exit() {
+    percpu_t *cpu = this_cpu();
+    if (cpu->need_resched && cpu->preempt_count == 0 && cpu->current_task) schedule();
+}
+
+/* --- Task API --- */
+
+task_t *task_create(const char *name, task_entry_t entry, void *arg, int priority, int cpu) {
+    task_t *t = kmalloc(sizeof(task_t));
+    if (!t) return 0;
+    void *stack = pmm_alloc(SCHED_STACK_PAGES);
+    if (!stack) {
+        kfree(t);
+        return 0;
+    }
+
+    k_memset(t, 0, sizeof(task_t));
+    for (int i = 0; name && name[i] && i < TASK_NAME_LEN - 1; i++) t->name[i] = name[i];
+    if (priority < 0) priority = 0;
+    if (priority >= SCHED_PRIORITIES) priority = SCHED_PRIORITIES - 1;
+    t->priority = priority;
+    t->pinned_cpu = cpu;
+    t->cpu = cpu != TASK_ANY_CPU ? (uint32_t)cpu : this_cpu()->cpu_id;
+    t->entry = entry;
+    t->arg = arg;
+    t->stack_base = (uint64_t)stack;
+    t->state = TASK_READY;
+    t->fpu_cpu = -1;
+    ktimer_setup(&t->sleep_timer, 0, t);
+
+    /* Initial frame popped by sched_switch: six callee-saved registers,
+     * then the return into task_trampoline, which leaves RSP 16-aligned
+     * for its call */
+    uint64_t *sp = (uint64_t *)(t->stack_base + SCHED_STACK_PAGES * PAGE_SIZE);
+    *--sp = (uint64_t)task_trampoline;
+    for (int i = 0; i < 6; i++) *--sp = 0;
+    t->rsp = (uint64_t)sp;
+
+    spin_lock(&tasks_lock);
+    t->id = next_task_id++;
+    t->all_next = all_tasks;
+    all_tasks = t;
+    spin_unlock(&tasks_lock);
+
+    make_ready(t);
+    return t;
+}
+
+void task_exit() {
+    __asm__ volatile ("cli");
+    task_current()->state = TASK_DEAD; // Reaped by the next task on this CPU
+    schedule();
+    __builtin_unreachable();
+}
+
+void sched_yield() {
+    schedule();
+}
+
+void sched_wake(task_t *t) {
+    uint32_t expected = TASK_BLOCKED;
+    if (__atomic_compare_exchange_n(&t->state, &expected, TASK_READY, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        make_ready(t);
+    }
+}
+
+static void sleep_timer_fired(ktimer_t *timer, void *arg) {
+    (void)timer;
+    sched_wake(arg);
+}
+
+void sched_sleep_ns(uint64_t ns) {
+    task_t *self = task_current();
+    uint64_t flags = cpu_irq_save();
+    self->state = TASK_BLOCKED;
+    self->sleep_timer.fn = sleep_timer_fired;
+    ktimer_arm_in(&self->sleep_timer, ns, 0);
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+void sched_event_signal(sched_event_t *ev) {
+    __atomic_store_n(&ev->signaled, 1, __ATOMIC_RELEASE);
+    task_t *waiter = __atomic_load_n(&ev->waiter, __ATOMIC_ACQUIRE);
+    if (waiter) sched_wake(waiter);
+}
+
+int sched_event_wait(sched_event_t *ev, uint64_t timeout_ns) {
+    task_t *self = task_current();
+    uint64_t flags = cpu_irq_save();
+
+    int signaled = __atomic_exchange_n(&ev->signaled, 0, __ATOMIC_ACQUIRE);
+    if (!signaled) {
+        self->state = TASK_BLOCKED;
+        __atomic_store_n(&ev->waiter, self, __ATOMIC_SEQ_CST);
+        if (timeout_ns) {
+            self->sleep_timer.fn = sleep_timer_fired;
+            ktimer_arm_in(&self->sleep_timer, timeout_ns, 0);
+        }
+
+        // A signal that raced with publishing the waiter: undo the block
+        uint32_t expected = TASK_BLOCKED;
+        if (!__atomic_load_n(&ev->signaled, __ATOMIC_SEQ_CST) ||
+            !__atomic_compare_exchange_n(&self->state, &expected, TASK_RUNNING, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            schedule();
+        }
+
+        __atomic_store_n(&ev->waiter, 0, __ATOMIC_RELEASE);
+        if (timeout_ns) ktimer_cancel(&self->sleep_timer);
+        signaled = __atomic_exchange_n(&ev->signaled, 0, __ATOMIC_ACQUIRE);
+    }
+
+    cpu_irq_restore(flags);
+    return signaled;
+}
+
+/* --- Setup --- */
+
+static void slice_expired(ktimer_t *timer, void *arg) {
+    (void)timer; (void)arg;
+    this_cpu()->need_resched = 1;
+}
+
+static void resched_ipi(interrupt_frame_t *frame) {
+    (void)frame;
+    this_cpu()->need_resched = 1;
+}
+
+void sched_for_each_task(void (*fn)(task_t *t, void *arg), void *arg) {
+    spin_lock(&tasks_lock);
+    for (task_t *t = all_tasks; t; t = t->all_next) fn(t, arg);
+    spin_unlock(&tasks_lock);
+}
+
+static const char *state_names[] = { "ready", "running", "blocked", "dead" };
+
+void sched_dump() {
+    serial_print("[SCHED] id  cpu prio state    runtime_ms switches migr name\n");
+    spin_lock(&tasks_lock);
+    for (task_t *t = all_tasks; t; t = t->all_next) {
+        serial_print("[SCHED] ");
+        serial_print_dec(t->id);
+        serial_print("   ");
+        serial_print_dec(t->cpu);
+        serial_print("   ");
+        serial_print_dec(t->priority);
+        serial_print("    ");
+        serial_print(state_names[t->state]);
+        serial_print("  ");
+        serial_print_dec(t->runtime_ns / NS_PER_MS);
+        serial_print("  ");
+        serial_print_dec(t->switches);
+        serial_print("  ");
+        serial_print_dec(t->migrations);
+        serial_print("  ");
+        serial_print(t->name);
+        serial_print("\n");
+    }
+    spin_unlock(&tasks_lock);
+
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        serial_print("[SCHED] cpu ");
+        serial_print_dec(c);
+        serial_print(": ready=");
+        serial_print_dec(rqs[c].nr_ready);
+        serial_print(" switches=");
+        serial_print_dec(rqs[c].switches);
+        serial_print(" stolen_from=");
+        serial_print_dec(rqs[c].steals);
+        serial_print(" idle_ms=");
+        serial_print_dec(idle_tasks[c].runtime_ns / NS_PER_MS);
+        serial_print("\n");
+    }
+}
+
+static void ps_command(const char *args) {
+    (void)args;
+    sched_dump();
+}
+
+void sched_init() {
+    for (int c = 0; c < MAX_CPUS; c++) {
+        rqs[c].lock_stats.name = "runqueue";
+        rqs[c].lock.stats = &rqs[c].lock_stats;
+    }
+    interrupt_register(SCHED_RESCHED_VECTOR, resched_ipi, "resched");
+    serial_register_command("ps", ps_command);
+}
+
+void sched_enter_idle() {
+    percpu_t *cpu = this_cpu();
+    runqueue_t *rq = &rqs[cpu->cpu_id];
+    task_t *idle = &idle_tasks[cpu->cpu_id];
+
+    k_memset(idle, 0, sizeof(task_t));
+    idle->name[0] = 'i'; idle->name[1] = 'd'; idle->name[2] = 'l'; idle->name[3] = 'e';
+    idle->priority = SCHED_PRIORITIES; // Below every real priority
+    idle->pinned_cpu = cpu->cpu_id;
+    idle->cpu = cpu->cpu_id;
+    idle->state = TASK_RUNNING;
+    idle->on_cpu = 1;
+    idle->last_start_ns = ktime_get_ns();
+
+    ktimer_setup(&rq->slice_timer, slice_expired, 0);
+    rq->idle = idle;
+    __atomic_store_n(&cpu->current_task, idle, __ATOMIC_RELEASE);
+
+    for (;;) {
+        __asm__ volatile ("cli");
+        schedule();
+        cpu->idle_halts++;
+        __asm__ volatile ("sti; hlt"); // An IPI or IRQ marks need_resched
+    }
+}
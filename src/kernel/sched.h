@@ -0,0 +1,89 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "timer.h"
+
+/* Lower number = higher priority. A runnable task always preempts one of
+ * lower priority; equal priorities share the CPU in SCHED_SLICE_NS slices. */
+#define SCHED_PRIORITIES   4
+#define SCHED_PRIO_UI      0   // Compositor and input
+#define SCHED_PRIO_HIGH    1   // Driver threads
+#define SCHED_PRIO_NORMAL  2
+#define SCHED_PRIO_LOW     3   // Background work
+
+#define SCHED_SLICE_NS       (5 * NS_PER_MS)
+#define SCHED_STACK_PAGES    4
+#define SCHED_RESCHED_VECTOR 0xF2
+
+#define TASK_NAME_LEN 16
+#define TASK_ANY_CPU  -1
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,
+    TASK_DEAD
+} task_state_t;
+
+typedef void (*task_entry_t)(void *arg);
+
+typedef struct task {
+    uint64_t rsp;               // Saved by sched_switch()
+    uint64_t stack_base;        // 0 for idle tasks, which run on boot stacks
+    uint32_t id;
+    char name[TASK_NAME_LEN];
+    uint8_t priority;
+    volatile uint32_t state;    // task_state_t
+    volatile int on_cpu;        // Set until its CPU has switched away from it
+    int32_t pinned_cpu;         // TASK_ANY_CPU unless pinned
+    uint32_t cpu;               // Run queue it is on, or the CPU it last ran on
+    struct task *next;          // Run queue link
+    struct task *all_next;      // Global task list
+    task_entry_t entry;
+    void *arg;
+    ktimer_t sleep_timer;
+
+    /* FPU context, allocated on the first #NM */
+    void *fpu_state;
+    int32_t fpu_cpu;            // CPU whose registers last held it, or -1
+
+    /* Accounting */
+    uint64_t runtime_ns;
+    uint64_t last_start_ns;
+    uint64_t switches;
+    uint64_t migrations;
+} task_t;
+
+/* One-shot wakeup flag that interrupt handlers can signal */
+typedef struct {
+    volatile int signaled;
+    task_t *volatile waiter;
+} sched_event_t;
+
+void sched_init(); // BSP, before smp_init()
+
+/* Turn the calling boot context into this CPU's idle task */
+__attribute__((noreturn)) void sched_enter_idle();
+
+task_t *task_create(const char *name, task_entry_t entry, void *arg, int priority, int cpu);
+__attribute__((noreturn)) void task_exit();
+task_t *task_current();
+
+void schedule();
+void sched_yield();
+void sched_sleep_ns(uint64_t ns);
+void sched_wake(task_t *task);
+
+/* Called by the interrupt dispatcher once the IRQ has been acknowledged */
+void sched_irq_exit();
+
+void sched_event_signal(sched_event_t *ev);
+int sched_event_wait(sched_event_t *ev, uint64_t timeout_ns); // 1 if signaled
+
+void sched_dump();
+
+/* Calls fn for every live task (idle tasks excluded) under the task list lock */
+void sched_for_each_task(void (*fn)(task_t *t, void *arg), void *arg);
+
+#endif
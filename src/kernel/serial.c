@@ -0,0 +1,316 @@
+#include "serial.h"
+#include "ports.h"
+#include "interrupts.h"
+#include "workqueue.h"
+#include "smp.h"
+#include "cpu.h"
+#include "sync.h"
+
+#define MAX_SERIAL_COMMANDS 32
+#define SERIAL_LINE_LEN     64
+
+/* 16550 registers, as offsets from the base port */
+#define UART_DATA 0     // THR on write, RBR on read; DLL while DLAB is set
+#define UART_IER  1     // DLM while DLAB is set
+#define UART_IIR  2     // FCR on write
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+#define UART_MSR  6
+
+#define IER_RX          0x01
+#define IER_TX          0x02
+#define LSR_DATA_READY  0x01
+#define LSR_THR_EMPTY   0x20
+#define UART_FIFO_DEPTH 16
+
+/* Output ring: any CPU reserves a run of bytes with a CAS on tx_head and
+ * stamps each cell's sequence once written, so the single drainer never
+ * reads a half-written string even when reservations commit out of order. */
+#define SERIAL_TX_SIZE 32768 // Power of two
+#define SERIAL_RX_SIZE 256   // Power of two
+
+static char tx_data[SERIAL_TX_SIZE];
+static volatile uint32_t tx_seq[SERIAL_TX_SIZE];   // pos + 1 once cell pos is filled
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile int tx_draining = 0;    // Held by whoever is feeding the UART
+static volatile int tx_irq_on = 0;      // IER_TX currently set
+static volatile int buffered = 0;       // Off until serial_init(), and after serial_panic()
+static uint64_t tx_dropped = 0;
+
+static char rx_data[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+static uint32_t rx_dropped = 0;
+static work_t rx_work;
+
+static struct {
+    const char* name;
+    serial_command_t handler;
+} commands[MAX_SERIAL_COMMANDS];
+static int command_count = 0;
+
+static char line[SERIAL_LINE_LEN];
+static int line_len = 0;
+
+static void uart_put_sync(char c) {
+    while ((inb(SERIAL_COM1 + UART_LSR) & LSR_THR_EMPTY) == 0) __asm__ volatile ("pause");
+    outb(SERIAL_COM1 + UART_DATA, c);
+}
+
+static inline int tx_ready(uint32_t pos) {
+    return __atomic_load_n(&tx_seq[pos & (SERIAL_TX_SIZE - 1)], __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+/* Make sure a THR-empty interrupt is coming; enabling it while THR is
+ * already empty raises one straight away */
+static void tx_kick() {
+    if (__atomic_exchange_n(&tx_irq_on, 1, __ATOMIC_ACQ_REL)) return;
+    outb(SERIAL_COM1 + UART_IER, IER_RX | IER_TX);
+}
+
+/* Feeds the UART from the ring. With room set, polls THR-empty until that
+ * many bytes of the ring are free (SERIAL_TX_SIZE drains it); with 0,
+ * fills the FIFO once and lets the next THR-empty interrupt continue.
+ * Returns 0 if someone else is draining. */
+static int tx_drain(uint32_t room) {
+    preempt_disable(); // Waiters spin on tx_draining; don't get switched out holding it
+    if (__atomic_exchange_n(&tx_draining, 1, __ATOMIC_ACQUIRE)) {
+        preempt_enable();
+        return 0;
+    }
+    uint32_t tail = tx_tail;
+    while (tx_ready(tail)) {
+        if (room && __atomic_load_n(&tx_head, __ATOMIC_RELAXED) + room - tail <= SERIAL_TX_SIZE) break;
+        if (!(inb(SERIAL_COM1 + UART_LSR) & LSR_THR_EMPTY)) {
+            if (!room) break;
+            __asm__ volatile ("pause");
+            continue;
+        }
+        for (int n = 0; n < UART_FIFO_DEPTH && tx_ready(tail); n++, tail++) {
+            outb(SERIAL_COM1 + UART_DATA, tx_data[tail & (SERIAL_TX_SIZE - 1)]);
+        }
+        __atomic_store_n(&tx_tail, tail, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&tx_draining, 0, __ATOMIC_RELEASE);
+    // An interrupt that found us draining has given up; arm the next one
+    if (room && buffered && tx_ready(tail)) tx_kick();
+    preempt_enable();
+    return 1;
+}
+
+/* Waits for room for len bytes, draining just that much itself when
+ * nobody else is. Interrupts, softirqs and anything holding preemption
+ * off can't wait on a drainer they may have displaced, so they give up. */
+static int tx_make_room(uint32_t len) {
+    percpu_t *cpu = this_cpu();
+    int atomic = cpu->irq_depth || cpu->in_softirq || cpu->preempt_count || !cpu_irqs_enabled();
+    while (tx_head + len - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE) > SERIAL_TX_SIZE) {
+        if (!tx_drain(len) && atomic) return 0;
+        __asm__ volatile ("pause");
+    }
+    return 1;
+}
+
+static void tx_write(const char *s, uint32_t len) {
+    if (!buffered) {
+        while (len--) uart_put_sync(*s++);
+        return;
+    }
+
+    // Each chunk is one reservation; other CPUs' output can fall between
+    // the chunks of a string longer than SERIAL_TX_SIZE / 4
+    while (len) {
+        uint32_t chunk = len > SERIAL_TX_SIZE / 4 ? SERIAL_TX_SIZE / 4 : len;
+        uint32_t head = __atomic_load_n(&tx_head, __ATOMIC_RELAXED);
+        if (head + chunk - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE) > SERIAL_TX_SIZE) {
+            if (!tx_make_room(chunk)) {
+                __atomic_fetch_add(&tx_dropped, len, __ATOMIC_RELAXED);
+                return;
+            }
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&tx_head, &head, head + chunk, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            uint32_t pos = head + i;
+            tx_data[pos & (SERIAL_TX_SIZE - 1)] = s[i];
+            __atomic_store_n(&tx_seq[pos & (SERIAL_TX_SIZE - 1)], pos + 1, __ATOMIC_RELEASE);
+        }
+        s += chunk;
+        len -= chunk;
+    }
+    tx_kick();
+}
+
+void serial_write(char c) {
+    tx_write(&c, 1);
+}
+
+void serial_print(const char* s) {
+    uint32_t len = 0;
+    while (s[len]) len++;
+    tx_write(s, len);
+}
+
+void serial_print_dec(uint64_t value) {
+    char buf[21];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    tx_write(&buf[i], sizeof(buf) - i);
+}
+
+void serial_print_hex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    char buf[18] = { '0', 'x' };
+    for (int i = 0; i < 16; i++) buf[2 + i] = digits[(value >> (60 - 4 * i)) & 0xF];
+    tx_write(buf, sizeof(buf));
+}
+
+void serial_panic() {
+    buffered = 0;
+    tx_draining = 0; // Its holder may be the CPU that just died
+    tx_drain(SERIAL_TX_SIZE);
+}
+
+int serial_register_command(const char* name, serial_command_t handler) {
+    if (command_count >= MAX_SERIAL_COMMANDS) return 0;
+    commands[command_count].name = name;
+    commands[command_count].handler = handler;
+    command_count++;
+    return 1;
+}
+
+static void dispatch_line() {
+    int i = 0;
+    while (line[i] == ' ') i++;
+    const char* word = &line[i];
+    while (line[i] && line[i] != ' ') i++;
+    int word_len = &line[i] - word;
+    while (line[i] == ' ') i++;
+    if (word_len == 0) return;
+
+    for (int c = 0; c < command_count; c++) {
+        const char* n = commands[c].name;
+        int k = 0;
+        while (k < word_len && n[k] == word[k]) k++;
+        if (k == word_len && n[k] == 0) {
+            commands[c].handler(&line[i]);
+            return;
+        }
+    }
+
+    serial_print("[SERIAL] Unknown command. Available:");
+    for (int c = 0; c < command_count; c++) {
+        serial_write(' ');
+        serial_print(commands[c].name);
+    }
+    serial_write('\n');
+}
+
+/* kworker: line editing and command dispatch, free to block or print a lot */
+static void rx_process(work_t *work) {
+    (void)work;
+    uint32_t tail = rx_tail;
+    while (tail != __atomic_load_n(&rx_head, __ATOMIC_ACQUIRE)) {
+        char c = rx_data[tail++ & (SERIAL_RX_SIZE - 1)];
+        __atomic_store_n(&rx_tail, tail, __ATOMIC_RELEASE);
+
+        if (c == '\r' || c == '\n') {
+            serial_write('\n');
+            line[line_len] = 0;
+            dispatch_line();
+            line_len = 0;
+        } else if ((c == '\b' || c == 0x7F) && line_len > 0) {
+            line_len--;
+        } else if (c >= 32 && c <= 126 && line_len < SERIAL_LINE_LEN - 1) {
+            line[line_len++] = c;
+            serial_write(c);
+        }
+    }
+}
+
+static void rx_pull() {
+    uint32_t head = rx_head;
+    while (inb(SERIAL_COM1 + UART_LSR) & LSR_DATA_READY) {
+        char c = inb(SERIAL_COM1 + UART_DATA);
+        if (head - __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE) < SERIAL_RX_SIZE) {
+            rx_data[head++ & (SERIAL_RX_SIZE - 1)] = c;
+        } else {
+            rx_dropped++;
+        }
+    }
+    __atomic_store_n(&rx_head, head, __ATOMIC_RELEASE);
+    work_schedule(&rx_work);
+}
+
+/* Reading IIR consumed this THR-empty interrupt, so none is coming until
+ * THR is written or IER_TX is set again. Say so before draining: if a
+ * thread holds the ring, it arms the next interrupt when it lets go. */
+static void tx_service() {
+    __atomic_store_n(&tx_irq_on, 0, __ATOMIC_RELEASE);
+    outb(SERIAL_COM1 + UART_IER, IER_RX);
+    if (!tx_drain(0)) return;
+
+    // More to send (or a writer raced the empty check): wait for THR again
+    if (tx_ready(__atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE))) {
+        __atomic_store_n(&tx_irq_on, 1, __ATOMIC_RELEASE);
+        outb(SERIAL_COM1 + UART_IER, IER_RX | IER_TX);
+    }
+}
+
+static void serial_irq(interrupt_frame_t *frame) {
+    (void)frame;
+    uint8_t iir;
+    while (!((iir = inb(SERIAL_COM1 + UART_IIR)) & 0x01)) {
+        switch (iir & 0x0E) {
+        case 0x04: // Received data
+        case 0x0C: // FIFO timeout
+            rx_pull();
+            break;
+        case 0x02: // THR empty
+            tx_service();
+            break;
+        case 0x06: // Line status
+            inb(SERIAL_COM1 + UART_LSR);
+            break;
+        default:   // Modem status
+            inb(SERIAL_COM1 + UART_MSR);
+            break;
+        }
+    }
+}
+
+static void serial_command(const char* args) {
+    (void)args;
+    serial_print("[SERIAL] tx ring ");
+    serial_print_dec(tx_head - tx_tail);
+    serial_print("/");
+    serial_print_dec(SERIAL_TX_SIZE);
+    serial_print(" bytes, ");
+    serial_print_dec(tx_dropped);
+    serial_print(" dropped; rx ");
+    serial_print_dec(rx_dropped);
+    serial_print(" dropped\n");
+}
+
+void serial_init() {
+    outb(SERIAL_COM1 + UART_IER, 0);
+    outb(SERIAL_COM1 + UART_LCR, 0x80);  // DLAB on
+    outb(SERIAL_COM1 + UART_DATA, 1);    // 115200 baud
+    outb(SERIAL_COM1 + UART_IER, 0);
+    outb(SERIAL_COM1 + UART_LCR, 0x03);  // 8N1, DLAB off
+    outb(SERIAL_COM1 + UART_IIR, 0xC7);  // Enable and clear FIFOs, 14-byte RX trigger
+    outb(SERIAL_COM1 + UART_MCR, 0x0B);  // DTR, RTS, OUT2 gates the IRQ line
+
+    work_init(&rx_work, rx_process, 0);
+    if (!irq_install(IRQ_COM1, serial_irq, "com1")) return; // Stay synchronous
+
+    buffered = 1;
+    outb(SERIAL_COM1 + UART_IER, IER_RX);
+    serial_register_command("serial", serial_command);
+}
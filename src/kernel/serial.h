@@ -0,0 +1,29 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+#define SERIAL_COM1 0x3F8
+
+/*
+ * COM1 console. Until serial_init() output is written synchronously; after
+ * it, writers copy into a lock-free ring that the UART's THR-empty
+ * interrupt drains in the background, and received bytes arrive by
+ * interrupt and are parsed into commands in a kworker.
+ */
+void serial_init(); // After workqueue_init()
+
+/* Flush the ring and go back to synchronous output for good; for panics */
+void serial_panic();
+
+void serial_write(char c);
+void serial_print(const char* s);
+void serial_print_dec(uint64_t value);
+void serial_print_hex(uint64_t value);
+
+/* Debug commands typed on the host side of COM1 ("name args...\n") */
+typedef void (*serial_command_t)(const char* args);
+
+int serial_register_command(const char* name, serial_command_t handler);
+
+#endif
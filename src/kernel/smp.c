@@ -0,0 +1,235 @@
+#include "smp.h"
+#include "apic.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "sched.h"
+#include "syscall.h"
+#include "fpu.h"
+#include "serial.h"
+#include "memory/pmm.h"
+#include "../boot/limine.h"
+
+#define AP_START_TIMEOUT_US 1000000
+
+/* Mailbox reserved by a sender that hasn't filled in the argument yet */
+#define CALL_CLAIMED ((smp_call_fn_t)1)
+
+__attribute__((used, section(".rodata"), aligned(8)))
+volatile struct limine_smp_request smp_request = {
+    .id = LIMINE_SMP_REQUEST,
+    .revision = 0,
+    .flags = 0 // xAPIC mode; apic.c drives the LAPIC through MMIO
+};
+
+static percpu_t cpus[MAX_CPUS];
+static uint32_t cpu_count = 1;
+static uint32_t online_count = 1;
+
+/* APIC ID bit layout, from CPUID leaf 0xB (or leaves 1/4 as a fallback) */
+static uint32_t smt_shift = 0;
+static uint32_t core_shift = 0;
+
+static void percpu_install(percpu_t *cpu) {
+    cpu->self = cpu;
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+}
+
+void percpu_init_bsp() {
+    cpus[0].cpu_id = 0;
+    cpus[0].online = 1;
+    percpu_install(&cpus[0]);
+}
+
+static void detect_topology() {
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+
+    if (max_leaf >= 0xB) {
+        for (uint32_t level = 0; level < 8; level++) {
+            cpuid(0xB, level, &a, &b, &c, &d);
+            uint32_t type = (c >> 8) & 0xFF;
+            if (type == 0) break;
+            if (type == 1) smt_shift = a & 0x1F;
+            if (type == 2) core_shift = a & 0x1F;
+        }
+        if (core_shift) return;
+    }
+
+    /* Legacy: logical CPUs per package and cores per package */
+    cpuid(1, 0, &a, &b, &c, &d);
+    uint32_t logical = (d & (1 << 28)) ? (b >> 16) & 0xFF : 1;
+    uint32_t cores = 1;
+    if (max_leaf >= 4) {
+        cpuid(4, 0, &a, &b, &c, &d);
+        cores = ((a >> 26) & 0x3F) + 1;
+    }
+    uint32_t threads = logical > cores ? logical / cores : 1;
+    while ((1u << smt_shift) < threads) smt_shift++;
+    core_shift = smt_shift;
+    while ((1u << core_shift) < logical) core_shift++;
+}
+
+static void decode_topology(percpu_t *cpu) {
+    cpu->thread = cpu->lapic_id & ((1u << smt_shift) - 1);
+    cpu->core = (cpu->lapic_id >> smt_shift) & ((1u << (core_shift - smt_shift)) - 1);
+    cpu->package = cpu->lapic_id >> core_shift;
+}
+
+static void smp_command(const char *args);
+
+static void smp_call_handler(interrupt_frame_t *frame) {
+    (void)frame;
+    percpu_t *cpu = this_cpu();
+    smp_call_fn_t fn = cpu->call_fn;
+    void *arg = cpu->call_arg;
+    if (!fn || fn == CALL_CLAIMED) return;
+    __atomic_store_n(&cpu->call_fn, 0, __ATOMIC_RELEASE);
+    cpu->calls_run++;
+    fn(arg);
+}
+
+int smp_call(uint32_t cpu_id, smp_call_fn_t fn, void *arg) {
+    if (cpu_id >= cpu_count || !cpus[cpu_id].online) return 0;
+    percpu_t *cpu = &cpus[cpu_id];
+
+    if (cpu == this_cpu()) {
+        uint64_t flags = cpu_irq_save();
+        fn(arg);
+        cpu_irq_restore(flags);
+        return 1;
+    }
+
+    smp_call_fn_t expected = 0;
+    while (!__atomic_compare_exchange_n(&cpu->call_fn, &expected, CALL_CLAIMED, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        expected = 0;
+        __asm__ volatile ("pause");
+    }
+    cpu->call_arg = arg;
+    __atomic_store_n(&cpu->call_fn, fn, __ATOMIC_RELEASE);
+    lapic_send_ipi(cpu->lapic_id, SMP_CALL_VECTOR);
+    return 1;
+}
+
+/* Runs on the AP's own stack; everything Limine set up is replaced here */
+static __attribute__((used, noreturn)) void ap_main(percpu_t *cpu) {
+    cpu_load_tables(cpu->cpu_id, cpu->kernel_stack);
+    percpu_install(cpu);
+    lapic_init();
+    timer_init_ap();
+    fpu_init_ap();
+    syscall_init_ap();
+
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&online_count, 1, __ATOMIC_RELEASE);
+    sched_enter_idle(); // Parks in hlt until there is work to run or steal
+}
+
+static void ap_entry(struct limine_smp_info *info) {
+    percpu_t *cpu = (percpu_t *)info->extra_argument;
+    __asm__ volatile (
+        "movq %0, %%rsp\n"
+        "xorl %%ebp, %%ebp\n"
+        "call ap_main\n"
+        : : "r"(cpu->kernel_stack), "D"(cpu) : "memory");
+    __builtin_unreachable();
+}
+
+void smp_init() {
+    detect_topology();
+    interrupt_register(SMP_CALL_VECTOR, smp_call_handler, "smp-call");
+    serial_register_command("smp", smp_command);
+
+    struct limine_smp_response *resp = smp_request.response;
+    cpus[0].lapic_id = resp ? resp->bsp_lapic_id : lapic_id();
+    decode_topology(&cpus[0]);
+
+    if (!resp || !apic_available()) {
+        serial_print("[SMP] No SMP response or LAPIC, running on the BSP only.\n");
+        smp_dump_topology();
+        return;
+    }
+
+    for (uint64_t i = 0; i < resp->cpu_count; i++) {
+        struct limine_smp_info *info = resp->cpus[i];
+        if (info->lapic_id == resp->bsp_lapic_id) continue;
+        if (cpu_count >= MAX_CPUS) {
+            serial_print("[SMP] Too many CPUs, ignoring the rest.\n");
+            break;
+        }
+
+        void *stack = pmm_alloc(SMP_STACK_PAGES);
+        if (!stack) break;
+
+        percpu_t *cpu = &cpus[cpu_count];
+        cpu->cpu_id = cpu_count;
+        cpu->lapic_id = info->lapic_id;
+        cpu->kernel_stack = (uint64_t)stack + SMP_STACK_PAGES * PAGE_SIZE;
+        decode_topology(cpu);
+        cpu_count++;
+
+        info->extra_argument = (uint64_t)cpu;
+        __atomic_store_n(&info->goto_address, ap_entry, __ATOMIC_RELEASE);
+
+        /* One AP at a time so online ids stay dense: if this one hangs we
+         * stop here, and should it turn up late it still gets the next id. */
+        uint64_t deadline = ktime_get_ns() + AP_START_TIMEOUT_US * NS_PER_US;
+        while (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE) && ktime_get_ns() < deadline) {
+            __asm__ volatile ("pause");
+        }
+        if (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            serial_print("[SMP] CPU ");
+            serial_print_dec(cpu->cpu_id);
+            serial_print(" did not come up, not starting the rest.\n");
+            break;
+        }
+    }
+
+    smp_dump_topology();
+}
+
+uint32_t smp_cpu_count() {
+    return __atomic_load_n(&online_count, __ATOMIC_ACQUIRE);
+}
+
+percpu_t *smp_cpu(uint32_t cpu_id) {
+    return cpu_id < cpu_count ? &cpus[cpu_id] : 0;
+}
+
+void smp_dump_topology() {
+    serial_print("[SMP] ");
+    serial_print_dec(online_count);
+    serial_print("/");
+    serial_print_dec(cpu_count);
+    serial_print(" CPUs online, APIC ID bits: thread ");
+    serial_print_dec(smt_shift);
+    serial_print(", core ");
+    serial_print_dec(core_shift - smt_shift);
+    serial_print("\n");
+
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        percpu_t *cpu = &cpus[i];
+        serial_print("[SMP]   cpu ");
+        serial_print_dec(cpu->cpu_id);
+        serial_print(": lapic ");
+        serial_print_dec(cpu->lapic_id);
+        serial_print(" package ");
+        serial_print_dec(cpu->package);
+        serial_print(" core ");
+        serial_print_dec(cpu->core);
+        serial_print(" thread ");
+        serial_print_dec(cpu->thread);
+        serial_print(" irqs ");
+        serial_print_dec(cpu->irq_count);
+        serial_print(" halts ");
+        serial_print_dec(cpu->idle_halts);
+        serial_print(cpu->online ? (i == 0 ? " (BSP)\n" : "\n") : " OFFLINE\n");
+    }
+}
+
+static void smp_command(const char *args) {
+    (void)args;
+    smp_dump_topology();
+}
@@ -0,0 +1,77 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define SMP_CALL_VECTOR    0xF1
+#define SMP_STACK_PAGES    4
+
+typedef void (*smp_call_fn_t)(void *arg);
+
+/*
+ * Per-CPU data block, reached through the GS base. `self` must stay first
+ * so this_cpu() is a single gs-relative load.
+ */
+typedef struct percpu {
+    struct percpu *self;
+    uint64_t scratch[4];        // Stash space for entry paths (gs:8..gs:32)
+    uint32_t cpu_id;            // Dense index, the BSP is 0
+    uint32_t lapic_id;
+    void *current_task;
+    uint64_t kernel_stack;      // Top of this CPU's boot/idle stack
+    uint64_t syscall_stack;     // Top of the running task's stack (gs:64)
+
+    /* Topology from CPUID, decoded out of the APIC ID */
+    uint32_t package;
+    uint32_t core;
+    uint32_t thread;
+
+    volatile int online;
+
+    /* Scheduler state */
+    int preempt_count;          // >0 while spinlocks are held or softirqs run
+    volatile int need_resched;  // Set from IRQs, acted on at IRQ exit
+    int irq_depth;              // Nesting of interrupt_dispatch()
+    int in_softirq;
+    void *irq_frame;            // interrupt_frame_t of the innermost interrupt
+
+    /* Lazy FPU, see fpu.c */
+    void *fpu_owner;            // Task whose state is loaded in the FPU registers
+    int fpu_depth;              // Nesting of kernel_fpu_begin()
+
+    /* Counters */
+    uint64_t irq_count;
+    uint64_t idle_halts;
+    uint64_t calls_run;
+
+    /* Cross-CPU call mailbox, see smp_call() */
+    volatile smp_call_fn_t call_fn;
+    void *volatile call_arg;
+} percpu_t;
+
+static inline percpu_t *this_cpu() {
+    percpu_t *cpu;
+    __asm__ volatile ("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/* Give the BSP its per-CPU block. Call first thing in _start, before any
+ * spinlock or this_cpu() use; cpu_init() keeps GS base when it reloads GS. */
+void percpu_init_bsp();
+
+/* Start the APs reported by Limine one by one, each parked before the next */
+void smp_init();
+
+/* CPUs online. Ids are dense: smp_cpu(i) is online for every
+ * i < smp_cpu_count(), so per-CPU loops can use it as their bound. */
+uint32_t smp_cpu_count();
+percpu_t *smp_cpu(uint32_t cpu_id);
+
+/* Run fn(arg) on another CPU from its IPI handler. Returns 0 if the CPU
+ * is offline; spins while a previous call to that CPU is still queued. */
+int smp_call(uint32_t cpu_id, smp_call_fn_t fn, void *arg);
+
+void smp_dump_topology();
+
+#endif
@@ -0,0 +1,130 @@
+#include "strtab.h"
+#include "sync.h"
+#include "serial.h"
+#include "memory/pmm.h"
+#include "libk/string/string.h"
+
+typedef struct {
+    uint32_t next;      // Hash chain, or free list while unused
+    uint32_t hash;
+    uint32_t refs;
+    uint16_t len;
+    uint16_t size;      // Bytes reserved, header included
+    char str[];
+} str_entry_t;
+
+#define STR_ALIGN   16
+#define STR_CLASSES ((sizeof(str_entry_t) + STRTAB_MAX_LEN + 1 + STR_ALIGN - 1) / STR_ALIGN + 1)
+
+static char *chunks[STRTAB_MAX_CHUNKS];
+static uint32_t chunk_count = 0;
+static uint32_t chunk_used = STRTAB_CHUNK_SIZE;   // Bump position in the last chunk
+static uint32_t buckets[STRTAB_BUCKETS];          // 0 = empty; offset 0 is never an entry
+static uint32_t free_lists[STR_CLASSES];
+
+DEFINE_SPINLOCK(strtab_lock, "strtab");
+
+/* Counters */
+static uint64_t live_strings = 0;
+static uint64_t live_bytes = 0;
+static uint64_t intern_hits = 0;
+
+static inline str_entry_t *entry_at(uint32_t off) {
+    return (str_entry_t *)(chunks[off >> 16] + (off & 0xFFFF));
+}
+
+static uint32_t alloc_locked(uint32_t size) {
+    uint32_t cls = size / STR_ALIGN;
+    if (free_lists[cls]) {
+        uint32_t off = free_lists[cls];
+        free_lists[cls] = entry_at(off)->next;
+        return off;
+    }
+
+    if (chunk_used + size > STRTAB_CHUNK_SIZE) {
+        if (chunk_count == STRTAB_MAX_CHUNKS) return STRTAB_NONE;
+        char *c = pmm_alloc(STRTAB_CHUNK_SIZE / PAGE_SIZE);
+        if (!c) return STRTAB_NONE;
+        // Published before any offset into it can be handed out
+        __atomic_store_n(&chunks[chunk_count], c, __ATOMIC_RELEASE);
+        chunk_used = chunk_count == 0 ? STR_ALIGN : 0; // Keep offset 0 free
+        chunk_count++;
+    }
+    uint32_t off = (chunk_count - 1) << 16 | chunk_used;
+    chunk_used += size;
+    return off;
+}
+
+uint32_t strtab_intern(const char *s, uint32_t len, uint32_t hash) {
+    if (len == 0) return 0;
+    if (len > STRTAB_MAX_LEN) return STRTAB_NONE;
+
+    spin_lock(&strtab_lock);
+    uint32_t *bucket = &buckets[hash & (STRTAB_BUCKETS - 1)];
+    for (uint32_t off = *bucket; off; off = entry_at(off)->next) {
+        str_entry_t *e = entry_at(off);
+        if (e->hash != hash || e->len != len || k_memcmp(e->str, s, len) != 0) continue;
+        e->refs++;
+        intern_hits++;
+        spin_unlock(&strtab_lock);
+        return off;
+    }
+
+    uint32_t size = (sizeof(str_entry_t) + len + 1 + STR_ALIGN - 1) & ~(STR_ALIGN - 1);
+    uint32_t off = alloc_locked(size);
+    if (off != STRTAB_NONE) {
+        str_entry_t *e = entry_at(off);
+        e->hash = hash;
+        e->refs = 1;
+        e->len = len;
+        e->size = size;
+        k_memcpy(e->str, s, len);
+        e->str[len] = 0;
+        e->next = *bucket;
+        *bucket = off;
+        live_strings++;
+        live_bytes += size;
+    }
+    spin_unlock(&strtab_lock);
+    return off;
+}
+
+void strtab_release(uint32_t off) {
+    if (off == 0 || off == STRTAB_NONE) return;
+    spin_lock(&strtab_lock);
+    str_entry_t *e = entry_at(off);
+    if (--e->refs == 0) {
+        uint32_t *link = &buckets[e->hash & (STRTAB_BUCKETS - 1)];
+        while (*link != off) link = &entry_at(*link)->next;
+        *link = e->next;
+        e->next = free_lists[e->size / STR_ALIGN];
+        free_lists[e->size / STR_ALIGN] = off;
+        live_strings--;
+        live_bytes -= e->size;
+    }
+    spin_unlock(&strtab_lock);
+}
+
+const char *strtab_get(uint32_t off) {
+    if (off == 0 || off == STRTAB_NONE) return "";
+    return entry_at(off)->str;
+}
+
+static void strtab_command(const char *args) {
+    (void)args;
+    serial_print("[STRTAB] ");
+    serial_print_dec(live_strings);
+    serial_print(" names in ");
+    serial_print_dec(live_bytes);
+    serial_print(" bytes, ");
+    serial_print_dec(chunk_count);
+    serial_print(" chunks of ");
+    serial_print_dec(STRTAB_CHUNK_SIZE / 1024);
+    serial_print(" KiB, ");
+    serial_print_dec(intern_hits);
+    serial_print(" shared\n");
+}
+
+void strtab_init() {
+    serial_register_command("strtab", strtab_command);
+}
@@ -0,0 +1,40 @@
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include <stdint.h>
+
+/*
+ * Interned, reference-counted strings for file names. A name is stored once
+ * however many nodes carry it and is referred to by a 32-bit offset, so
+ * fs_node_t keeps an offset plus length and hash instead of a char array.
+ * Offset 0 is the empty string and needs no reference.
+ *
+ * Strings live in STRTAB_CHUNK_SIZE chunks that never move, so
+ * strtab_get() takes no lock; freed slots are reused by size class.
+ */
+
+#define STRTAB_CHUNK_SIZE  65536    // Offset = chunk << 16 | position
+#define STRTAB_MAX_CHUNKS  256
+#define STRTAB_BUCKETS     4096     // Power of two
+#define STRTAB_MAX_LEN     255
+#define STRTAB_NONE        0xFFFFFFFFu
+
+/* FNV-1a; what fs_node_t.name_hash holds */
+static inline uint32_t strtab_hash(const char *s, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Takes a reference; STRTAB_NONE if too long or out of memory */
+uint32_t strtab_intern(const char *s, uint32_t len, uint32_t hash);
+void strtab_release(uint32_t off);
+
+const char *strtab_get(uint32_t off); // NUL-terminated
+
+void strtab_init(); // Registers the "strtab" serial command
+
+#endif
@@ -0,0 +1,176 @@
+#include "sync.h"
+#include "serial.h"
+#include "timer.h"
+
+static lock_stats_t *volatile stats_list = 0;
+
+void lock_stats_register(lock_stats_t *stats) {
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&stats->registered, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return;
+
+    lock_stats_t *head = __atomic_load_n(&stats_list, __ATOMIC_RELAXED);
+    do {
+        stats->next = head;
+    } while (!__atomic_compare_exchange_n(&stats_list, &head, stats, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static inline void account_spin(lock_stats_t *stats, uint64_t start) {
+#if LOCK_STATS
+    if (!stats) return;
+    uint64_t cycles = __builtin_ia32_rdtsc() - start;
+    stats->contended++; // We own the lock by now
+    stats->spin_cycles += cycles;
+    if (cycles > stats->max_spin_cycles) stats->max_spin_cycles = cycles;
+#else
+    (void)stats;
+    (void)start;
+#endif
+}
+
+/* --- Ticket spinlock --- */
+
+void spin_lock_slow(spinlock_t *lock, uint16_t ticket) {
+    uint64_t start = __builtin_ia32_rdtsc();
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ volatile ("pause");
+    }
+    account_spin(lock->stats, start);
+}
+
+/* --- Reader/writer lock --- */
+
+void read_lock(rwlock_t *lock) {
+    preempt_disable();
+    uint64_t start = 0;
+    for (;;) {
+        int32_t r = __atomic_load_n(&lock->readers, __ATOMIC_RELAXED);
+        if (r >= 0 && !__atomic_load_n(&lock->writers_waiting, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&lock->readers, &r, r + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (!start) start = __builtin_ia32_rdtsc();
+        __asm__ volatile ("pause");
+    }
+    // Readers share the counters, so only account with atomics here
+#if LOCK_STATS
+    lock_stats_t *stats = lock->stats;
+    if (stats) {
+        if (!stats->registered) lock_stats_register(stats);
+        __atomic_fetch_add(&stats->acquisitions, 1, __ATOMIC_RELAXED);
+        if (start) {
+            __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stats->spin_cycles, __builtin_ia32_rdtsc() - start, __ATOMIC_RELAXED);
+        }
+    }
+#endif
+}
+
+void read_unlock(rwlock_t *lock) {
+    __atomic_fetch_sub(&lock->readers, 1, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+void write_lock(rwlock_t *lock) {
+    preempt_disable();
+    int32_t r = 0;
+    if (__atomic_compare_exchange_n(&lock->readers, &r, -1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        if (LOCK_STATS && lock->stats) {
+            if (!lock->stats->registered) lock_stats_register(lock->stats);
+            __atomic_fetch_add(&lock->stats->acquisitions, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    // Announce ourselves so new readers stop piling in, then wait for the rest to drain
+    uint64_t start = __builtin_ia32_rdtsc();
+    __atomic_fetch_add(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    for (;;) {
+        r = 0;
+        if (__atomic_load_n(&lock->readers, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&lock->readers, &r, -1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        __asm__ volatile ("pause");
+    }
+    __atomic_fetch_sub(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+
+#if LOCK_STATS
+    lock_stats_t *stats = lock->stats;
+    if (stats) {
+        if (!stats->registered) lock_stats_register(stats);
+        uint64_t cycles = __builtin_ia32_rdtsc() - start;
+        __atomic_fetch_add(&stats->acquisitions, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->spin_cycles, cycles, __ATOMIC_RELAXED);
+        if (cycles > stats->max_spin_cycles) stats->max_spin_cycles = cycles; // Racy, but only a high-water mark
+    }
+#else
+    (void)start;
+#endif
+}
+
+void write_unlock(rwlock_t *lock) {
+    __atomic_store_n(&lock->readers, 0, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+/* --- Contention report --- */
+
+#define LOCKS_SHOWN 16
+
+static void print_stats(lock_stats_t *s) {
+    serial_print("[LOCK] ");
+    serial_print(s->name ? s->name : "?");
+    serial_print(": acquired ");
+    serial_print_dec(s->acquisitions);
+    serial_print(", contended ");
+    serial_print_dec(s->contended);
+    serial_print(", spun ");
+    serial_print_dec(tsc_to_ns(s->spin_cycles) / NS_PER_US);
+    serial_print(" us (max ");
+    serial_print_dec(tsc_to_ns(s->max_spin_cycles));
+    serial_print(" ns)\n");
+}
+
+/* Hottest locks first, by total time spent spinning */
+void lock_stats_dump() {
+    lock_stats_t *top[LOCKS_SHOWN];
+    int n = 0, total = 0;
+
+    for (lock_stats_t *s = __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE); s; s = s->next) {
+        total++;
+        int i = n;
+        if (n < LOCKS_SHOWN) {
+            n++;
+        } else if (top[n - 1]->spin_cycles >= s->spin_cycles) {
+            continue;
+        } else {
+            i = n - 1;
+        }
+        while (i > 0 && top[i - 1]->spin_cycles < s->spin_cycles) {
+            top[i] = top[i - 1];
+            i--;
+        }
+        top[i] = s;
+    }
+
+    serial_print("[LOCK] ");
+    serial_print_dec(total);
+    serial_print(" profiled locks\n");
+    for (int i = 0; i < n; i++) print_stats(top[i]);
+}
+
+static void locks_command(const char *args) {
+    if (args && args[0] == 'r') { // "locks reset"
+        for (lock_stats_t *s = __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE); s; s = s->next) {
+            s->acquisitions = s->contended = s->spin_cycles = s->max_spin_cycles = 0;
+        }
+        serial_print("[LOCK] Counters cleared.\n");
+        return;
+    }
+    lock_stats_dump();
+}
+
+void sync_init() {
+    serial_register_command("locks", locks_command);
+}
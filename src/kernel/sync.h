@@ -0,0 +1,214 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "smp.h"
+
+/*
+ * Kernel synchronization primitives.
+ *
+ *  - spinlock_t: ticket lock (FIFO hand-off, so no CPU starves)
+ *  - rwlock_t:   spinning reader/writer lock that prefers writers
+ *  - seqlock_t:  lock-free readers that retry if a writer raced them
+ *
+ * Holding a spinlock or rwlock disables preemption on the local CPU. Use
+ * the _irqsave variants for data that interrupt handlers also touch.
+ *
+ * A lock declared with a lock_stats_t (DEFINE_SPINLOCK, or .stats set by
+ * hand) counts acquisitions, contended acquisitions and cycles spent
+ * spinning; the "locks" serial command lists the hottest ones.
+ */
+
+#ifndef LOCK_STATS
+#define LOCK_STATS 1
+#endif
+
+typedef struct lock_stats {
+    const char *name;
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t spin_cycles;
+    uint64_t max_spin_cycles;
+    struct lock_stats *next;
+    volatile int registered;
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(lname) { .name = (lname) }
+
+/* The count is changed with one gs-relative instruction: with a separate
+ * this_cpu() load the task could migrate between reading the pointer and
+ * writing the old CPU's count */
+#define PREEMPT_COUNT_OFFSET offsetof(percpu_t, preempt_count)
+
+/* Reschedules if a preemption was requested while the count was raised */
+void preempt_enable();
+
+static inline void preempt_disable() {
+    __asm__ volatile ("incl %%gs:%c0" : : "i"(PREEMPT_COUNT_OFFSET) : "memory");
+}
+
+void sync_init(); // Registers the "locks" serial command
+void lock_stats_register(lock_stats_t *stats);
+void lock_stats_dump();
+
+static inline void lock_stats_hit(lock_stats_t *stats) {
+#if LOCK_STATS
+    if (!stats) return;
+    if (!stats->registered) lock_stats_register(stats);
+    stats->acquisitions++; // Updated while holding the lock
+#else
+    (void)stats;
+#endif
+}
+
+/* --- Ticket spinlock --- */
+
+typedef struct {
+    union {
+        volatile uint32_t val;
+        struct {
+            volatile uint16_t owner;    // Ticket now being served
+            volatile uint16_t next;     // Next ticket to hand out
+        };
+    };
+    lock_stats_t *stats;
+} spinlock_t;
+
+#define SPINLOCK_INIT { { 0 }, 0 }
+
+#define DEFINE_SPINLOCK(var, lname) \
+    static lock_stats_t var##_stats = LOCK_STATS_INIT(lname); \
+    static spinlock_t var = { { 0 }, &var##_stats }
+
+void spin_lock_slow(spinlock_t *lock, uint16_t ticket);
+
+static inline void spin_lock_init(spinlock_t *lock, lock_stats_t *stats) {
+    lock->val = 0;
+    lock->stats = stats;
+}
+
+static inline void spin_lock(spinlock_t *lock) {
+    preempt_disable();
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) spin_lock_slow(lock, ticket);
+    lock_stats_hit(lock->stats);
+}
+
+static inline int spin_trylock(spinlock_t *lock) {
+    preempt_disable();
+    uint32_t v = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+    if ((v & 0xFFFF) == (v >> 16) &&
+        __atomic_compare_exchange_n(&lock->val, &v, v + 0x10000, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        lock_stats_hit(lock->stats);
+        return 1;
+    }
+    preempt_enable();
+    return 0;
+}
+
+static inline void spin_release(spinlock_t *lock) {
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    spin_release(lock);
+    preempt_enable();
+}
+
+static inline int spin_is_locked(spinlock_t *lock) {
+    uint32_t v = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+    return (v & 0xFFFF) != (v >> 16);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags = cpu_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_release(lock);
+    cpu_irq_restore(flags);
+    preempt_enable();
+}
+
+/* --- Reader/writer lock --- */
+
+typedef struct {
+    volatile int32_t readers;           // -1 while a writer holds it
+    volatile uint32_t writers_waiting;  // New readers back off while non-zero
+    lock_stats_t *stats;
+} rwlock_t;
+
+#define RWLOCK_INIT { 0, 0, 0 }
+
+#define DEFINE_RWLOCK(var, lname) \
+    static lock_stats_t var##_stats = LOCK_STATS_INIT(lname); \
+    static rwlock_t var = { 0, 0, &var##_stats }
+
+void read_lock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+
+static inline uint64_t read_lock_irqsave(rwlock_t *lock) {
+    uint64_t flags = cpu_irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t *lock, uint64_t flags) {
+    preempt_disable(); // Defer the reschedule until interrupts are back on
+    read_unlock(lock);
+    cpu_irq_restore(flags);
+    preempt_enable();
+}
+
+static inline uint64_t write_lock_irqsave(rwlock_t *lock) {
+    uint64_t flags = cpu_irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t *lock, uint64_t flags) {
+    preempt_disable();
+    write_unlock(lock);
+    cpu_irq_restore(flags);
+    preempt_enable();
+}
+
+/* --- Sequence lock --- */
+
+typedef struct {
+    volatile uint32_t seq;  // Odd while a write is in progress
+    spinlock_t lock;        // Serialises writers
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl) {
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1) __asm__ volatile ("pause");
+    return seq;
+}
+
+/* Non-zero if the data read since read_seqbegin() may be torn */
+static inline int read_seqretry(const seqlock_t *sl, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqlock(seqlock_t *sl) {
+    spin_lock(&sl->lock);
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_sequnlock(seqlock_t *sl) {
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+    spin_unlock(&sl->lock);
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include "syscall.h"
+#include "cpu.h"
+#include "smp.h"
+#include "sched.h"
+#include "serial.h"
+#include "timer.h"
+#include "trace.h"
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "libk/string/string.h"
+#include <stddef.h>
+
+#define EFER_SCE (1ULL << 0)
+#define EFER_NXE (1ULL << 11)
+
+/* RFLAGS bits cleared on entry: TF, IF, DF, IOPL, NT, AC */
+#define SYSCALL_RFLAGS_MASK 0x47700
+
+#define UBENCH_DEFAULT_ITERATIONS 100000
+
+_Static_assert(offsetof(percpu_t, scratch) == 8, "entry.S expects scratch at gs:8");
+_Static_assert(offsetof(percpu_t, syscall_stack) == 64, "entry.S expects syscall_stack at gs:64");
+
+typedef uint64_t (*syscall_fn_t)(syscall_frame_t *frame);
+
+extern void syscall_entry();
+extern uint8_t ubench_start[], ubench_end[];
+
+static vtime_page_t *time_page = 0;
+static int user_ready = 0;
+static volatile int bench_running = 0;
+static uint64_t syscall_counts[SYS_COUNT];
+
+static const char *ubench_names[] = { "null syscall", "time page read", "clock syscall" };
+
+static uint64_t sys_exit(syscall_frame_t *frame) {
+    (void)frame;
+    serial_print("[SYSCALL] ");
+    serial_print(task_current()->name);
+    serial_print(" exited.\n");
+    __atomic_store_n(&bench_running, 0, __ATOMIC_RELEASE);
+    task_exit();
+}
+
+static uint64_t sys_null(syscall_frame_t *frame) {
+    (void)frame;
+    return 0;
+}
+
+static uint64_t sys_clock(syscall_frame_t *frame) {
+    (void)frame;
+    return ktime_get_ns();
+}
+
+static uint64_t sys_report(syscall_frame_t *frame) {
+    uint64_t kind = frame->rdi, cycles = frame->rsi, iterations = frame->rdx;
+    if (kind > UBENCH_CLOCK_SYSCALL || !iterations) return SYSCALL_ENOSYS;
+
+    serial_print("[SYSCALL] ");
+    serial_print(ubench_names[kind]);
+    serial_print(": ");
+    serial_print_dec(cycles / iterations);
+    serial_print(" cycles, ");
+    serial_print_dec(tsc_to_ns(cycles) / iterations);
+    serial_print(" ns per call");
+    if (kind != UBENCH_NULL_SYSCALL) {
+        serial_print(" (last read ");
+        serial_print_dec(frame->r10);
+        serial_print(" ns)");
+    }
+    serial_print("\n");
+    return 0;
+}
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_NULL] = sys_null,
+    [SYS_CLOCK] = sys_clock,
+    [SYS_REPORT] = sys_report,
+};
+
+/* Called from syscall_entry on the task's kernel stack, interrupts on */
+uint64_t syscall_dispatch(syscall_frame_t *frame) {
+    uint64_t nr = frame->rax;
+    if (nr >= SYS_COUNT) return SYSCALL_ENOSYS;
+    syscall_counts[nr]++;
+    TRACE(TRACE_SYSCALL_ENTER, nr, 0, 0);
+    uint64_t ret = syscall_table[nr](frame);
+    TRACE(TRACE_SYSCALL_EXIT, nr, ret, 0);
+    return ret;
+}
+
+void syscall_user_fault(interrupt_frame_t *frame) {
+    serial_print("[SYSCALL] ");
+    serial_print(task_current()->name);
+    serial_print(" faulted in user mode: vector ");
+    serial_print_dec(frame->vector);
+    serial_print(" rip=");
+    serial_print_hex(frame->rip);
+    serial_print(" error=");
+    serial_print_hex(frame->error_code);
+    serial_print(", killed.\n");
+    __atomic_store_n(&bench_running, 0, __ATOMIC_RELEASE);
+    task_exit();
+}
+
+static void ubench_thread(void *arg) {
+    user_enter(USER_CODE_BASE, USER_STACK_TOP, (uint64_t)(uintptr_t)arg, USER_TIME_PAGE);
+}
+
+/* "sysbench [iterations]": run the ring 3 round-trip benchmark */
+static void sysbench_command(const char *args) {
+    if (!user_ready) {
+        serial_print("[SYSCALL] User mode unavailable.\n");
+        return;
+    }
+
+    uint64_t iterations = 0;
+    while (*args == ' ') args++;
+    while (*args >= '0' && *args <= '9') iterations = iterations * 10 + (*args++ - '0');
+    if (!iterations) iterations = UBENCH_DEFAULT_ITERATIONS;
+
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&bench_running, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        serial_print("[SYSCALL] Benchmark already running.\n");
+        return;
+    }
+    if (!task_create("ubench", ubench_thread, (void *)(uintptr_t)iterations, SCHED_PRIO_NORMAL, TASK_ANY_CPU)) {
+        __atomic_store_n(&bench_running, 0, __ATOMIC_RELEASE);
+        serial_print("[SYSCALL] Could not start the benchmark task.\n");
+    }
+}
+
+/* Backs [virt, virt + pages) with fresh zeroed memory; returns the first page's kernel alias */
+static void *map_user_pages(uint64_t virt, size_t pages, uint64_t flags) {
+    void *mem = pmm_alloc(pages);
+    if (!mem) return 0;
+    k_memset(mem, 0, pages * PAGE_SIZE);
+    uint64_t phys = (uint64_t)(uintptr_t)mem - vmm_hhdm_offset();
+    for (size_t i = 0; i < pages; i++) {
+        if (!vmm_map_page(virt + i * PAGE_SIZE, phys + i * PAGE_SIZE, flags | VMM_USER)) {
+            while (i--) vmm_unmap_page(virt + i * PAGE_SIZE);
+            pmm_free(mem, pages);
+            return 0;
+        }
+    }
+    return mem;
+}
+
+static void unmap_user_pages(uint64_t virt, void *mem, size_t pages) {
+    for (size_t i = 0; i < pages; i++) vmm_unmap_page(virt + i * PAGE_SIZE);
+    pmm_free(mem, pages);
+}
+
+static void setup_user_space() {
+    size_t blob = ubench_end - ubench_start;
+    if (blob > PAGE_SIZE) return;
+
+    void *code = map_user_pages(USER_CODE_BASE, 1, 0);
+    time_page = map_user_pages(USER_TIME_PAGE, 1, VMM_NX);
+    void *stack = map_user_pages(USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE, USER_STACK_PAGES, VMM_WRITE | VMM_NX);
+    if (!code || !time_page || !stack) {
+        if (code) unmap_user_pages(USER_CODE_BASE, code, 1);
+        if (time_page) unmap_user_pages(USER_TIME_PAGE, time_page, 1);
+        if (stack) unmap_user_pages(USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE, stack, USER_STACK_PAGES);
+        time_page = 0;
+        return;
+    }
+
+    k_memcpy(code, ubench_start, blob);
+
+    // Calibration never changes after boot, but keep the seq protocol honest
+    time_page->seq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ktime_get_calibration(&time_page->tsc_base, &time_page->mult);
+    time_page->shift = 32;
+    time_page->tsc_hz = tsc_frequency();
+    __atomic_store_n(&time_page->seq, time_page->seq + 1, __ATOMIC_RELEASE);
+
+    user_ready = 1;
+}
+
+void syscall_init_ap() {
+    uint32_t a, b, c, d;
+    cpuid(0x80000001, 0, &a, &b, &c, &d);
+    uint64_t efer = rdmsr(MSR_EFER) | EFER_SCE;
+    if (d & (1 << 20)) efer |= EFER_NXE;
+    wrmsr(MSR_EFER, efer);
+
+    // SYSCALL loads CS/SS from STAR[47:32]; SYSRET uses STAR[63:48] + 16 / + 8
+    wrmsr(MSR_STAR, ((uint64_t)(GDT_USER_DATA - 8) << 48) | ((uint64_t)GDT_KERNEL_CODE << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+    wrmsr(MSR_KERNEL_GS_BASE, 0); // User GS base while in ring 3
+}
+
+void syscall_init() {
+    syscall_init_ap();
+    setup_user_space();
+
+    serial_print(user_ready ? "[PARADOX] SYSCALL/SYSRET ready, time page at " : "[PARADOX] User mappings failed; SYSCALL only at ");
+    serial_print_hex(USER_TIME_PAGE);
+    serial_print("\n");
+    serial_register_command("sysbench", sysbench_command);
+}
@@ -0,0 +1,65 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+#include "interrupts.h"
+
+/*
+ * Ring 3 entry through SYSCALL/SYSRET.
+ *
+ * ABI: number in rax, arguments in rdi, rsi, rdx, r10, r8, r9, result in
+ * rax. rcx and r11 are clobbered by the instruction itself; every other
+ * register is preserved.
+ */
+#define SYS_EXIT    0
+#define SYS_NULL    1   // Returns 0; measures the bare round trip
+#define SYS_CLOCK   2   // Returns ktime_get_ns()
+#define SYS_REPORT  3   // (kind, cycles, iterations, last_value) from the benchmark
+#define SYS_COUNT   4
+
+#define SYSCALL_ENOSYS ((uint64_t)-1)
+
+/* SYS_REPORT kinds sent by the user-mode benchmark (ubench.S) */
+#define UBENCH_NULL_SYSCALL 0
+#define UBENCH_VTIME_READ   1
+#define UBENCH_CLOCK_SYSCALL 2
+
+/* Fixed user-space layout; every user task shares the kernel's page tables */
+#define USER_CODE_BASE   0x400000ULL
+#define USER_TIME_PAGE   0x600000ULL    // Read-only vtime_page_t
+#define USER_STACK_TOP   0x800000ULL
+#define USER_STACK_PAGES 4
+
+/*
+ * Read-only page shared with user space so it can read the clock without
+ * entering the kernel, vDSO style. Readers retry while seq is odd or changed.
+ * Offsets are relied upon by user code; only append fields.
+ */
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t shift;         // Always 32
+    uint64_t tsc_base;      // ns = (rdtsc - tsc_base) * mult >> shift
+    uint64_t mult;
+    uint64_t tsc_hz;
+} vtime_page_t;
+
+/* Saved by syscall_entry, in push order reversed */
+typedef struct {
+    uint64_t rdi, rsi, rdx, r10, r8, r9;
+    uint64_t rax;           // Syscall number
+    uint64_t rip;           // User rcx
+    uint64_t rflags;        // User r11
+    uint64_t rsp;
+} syscall_frame_t;
+
+/* MSR setup, user mappings and the "sysbench" serial command; after timer_init() */
+void syscall_init();
+void syscall_init_ap();
+
+/* Drop to ring 3 at entry with the given stack; never returns */
+void __attribute__((noreturn)) user_enter(uint64_t entry, uint64_t stack, uint64_t arg0, uint64_t arg1);
+
+/* Kills the current task after a fault in user mode */
+void __attribute__((noreturn)) syscall_user_fault(interrupt_frame_t *frame);
+
+#endif
@@ -0,0 +1,400 @@
+#include "timer.h"
+#include "apic.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "ports.h"
+#include "serial.h"
+#include "smp.h"
+#include "sync.h"
+#include "trace.h"
+
+#define PIT_HZ          1193182ULL
+#define CALIBRATE_MS    10
+#define CALIBRATE_RUNS  3
+#define PIT_MAX_NS      (50 * NS_PER_MS)
+
+#define LVT_TIMER_ONESHOT     (0 << 17)
+#define LVT_TIMER_TSCDEADLINE (2 << 17)
+
+typedef enum {
+    TIMER_HW_NONE,
+    TIMER_HW_TSC_DEADLINE,
+    TIMER_HW_LAPIC_ONESHOT,
+    TIMER_HW_PIT
+} timer_hw_t;
+
+static const char *hw_names[] = { "none", "tsc-deadline", "lapic-oneshot", "pit" };
+
+static timer_hw_t hw = TIMER_HW_NONE;
+static uint64_t tsc_hz = 0;
+static uint64_t lapic_hz = 0;
+static uint64_t tsc_base = 0;
+
+/* Fixed-point scale factors so the hot paths never divide */
+static uint64_t ns_per_cycle_fp = 0;    // ns = cycles * x >> 32
+static uint64_t cycles_per_ns_fp = 0;   // cycles = ns * x >> 24
+static uint64_t lapic_per_ns_fp = 0;    // ticks = ns * x >> 24
+
+/* Each CPU owns a heap and programs only its own LAPIC timer */
+typedef struct {
+    spinlock_t lock;
+    lock_stats_t lock_stats;
+    ktimer_t *heap[TIMER_MAX_ARMED];
+    int size;
+    uint64_t irqs;
+    uint64_t fired;
+} timer_cpu_t;
+
+static timer_cpu_t timer_cpus[MAX_CPUS];
+
+static inline uint64_t mul_shift(uint64_t a, uint64_t b, int shift) {
+    return (uint64_t)(((unsigned __int128)a * b) >> shift);
+}
+
+uint64_t tsc_to_ns(uint64_t cycles) {
+    return mul_shift(cycles, ns_per_cycle_fp, 32);
+}
+
+uint64_t tsc_frequency() {
+    return tsc_hz;
+}
+
+void ktime_get_calibration(uint64_t *base, uint64_t *mult) {
+    *base = tsc_base;
+    *mult = ns_per_cycle_fp;
+}
+
+uint64_t ktime_get_ns() {
+    return tsc_to_ns(__builtin_ia32_rdtsc() - tsc_base);
+}
+
+void ktime_delay_us(uint64_t us) {
+    if (!tsc_hz) return;
+    uint64_t end = __builtin_ia32_rdtsc() + mul_shift(us * NS_PER_US, cycles_per_ns_fp, 24);
+    while (__builtin_ia32_rdtsc() < end) __asm__ volatile ("pause");
+}
+
+/* --- Calibration --- */
+
+/* Time CALIBRATE_MS of PIT channel 2 in TSC cycles (and LAPIC ticks at
+ * divide-by-16 when an APIC is present). Returns 0 if the PIT never
+ * reached terminal count. */
+static uint64_t pit_measure(uint64_t *lapic_ticks) {
+    uint16_t count = PIT_HZ * CALIBRATE_MS / 1000;
+    uint8_t gate = inb(0x61) & ~0x03; // Speaker off, gate low
+
+    outb(0x61, gate);
+    outb(0x43, 0xB0);                  // Channel 2, lo/hi, mode 0
+    outb(0x42, count & 0xFF);
+    outb(0x42, count >> 8);
+
+    if (apic_available()) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_DIV, 0x3);
+    }
+
+    outb(0x61, gate | 1);              // Gate high starts the count
+    uint64_t start = __builtin_ia32_rdtsc();
+    if (apic_available()) lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+    for (uint32_t spins = 0; !(inb(0x61) & 0x20); spins++) {
+        if (spins > 100000000) return 0;
+    }
+
+    uint64_t end = __builtin_ia32_rdtsc();
+    if (apic_available()) {
+        *lapic_ticks = 0xFFFFFFFFULL - lapic_read(LAPIC_TIMER_COUNT);
+        lapic_write(LAPIC_TIMER_INIT, 0);
+    }
+    outb(0x61, gate);
+    return end - start;
+}
+
+/* Leaf 0x15 (crystal ratio) or 0x16 (base MHz) when the PIT is missing */
+static uint64_t tsc_from_cpuid() {
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, 0, &a, &b, &c, &d);
+        if (a && b && c) return (uint64_t)c * b / a;
+    }
+    if (max_leaf >= 0x16) {
+        cpuid(0x16, 0, &a, &b, &c, &d);
+        if (a) return (uint64_t)a * 1000000;
+    }
+    return 0;
+}
+
+static void calibrate() {
+    uint64_t best = 0, best_lapic = 0;
+    for (int i = 0; i < CALIBRATE_RUNS; i++) {
+        uint64_t ticks = 0;
+        uint64_t cycles = pit_measure(&ticks);
+        if (cycles && (!best || cycles < best)) {
+            best = cycles;
+            best_lapic = ticks;
+        }
+    }
+
+    if (best) {
+        tsc_hz = best * 1000 / CALIBRATE_MS;
+        lapic_hz = best_lapic * 1000 / CALIBRATE_MS;
+    } else {
+        tsc_hz = tsc_from_cpuid();
+    }
+    if (!tsc_hz) tsc_hz = 1000000000; // Last resort: pretend 1 GHz
+
+    ns_per_cycle_fp = (NS_PER_S << 32) / tsc_hz;
+    cycles_per_ns_fp = (tsc_hz << 24) / NS_PER_S;
+    lapic_per_ns_fp = (lapic_hz << 24) / NS_PER_S;
+}
+
+/* --- Hardware programming --- */
+
+/* Arm the local timer for tc's earliest deadline; tc must be this CPU's */
+static void program_hw(timer_cpu_t *tc) {
+    if (tc->size == 0) {
+        if (hw == TIMER_HW_TSC_DEADLINE) wrmsr(MSR_TSC_DEADLINE, 0);
+        else if (hw == TIMER_HW_LAPIC_ONESHOT) lapic_write(LAPIC_TIMER_INIT, 0);
+        return; // A stray PIT one-shot just finds nothing due
+    }
+
+    uint64_t deadline = tc->heap[0]->deadline;
+    if (hw == TIMER_HW_TSC_DEADLINE) {
+        uint64_t target = tsc_base + mul_shift(deadline, cycles_per_ns_fp, 24);
+        __asm__ volatile ("mfence" : : : "memory");
+        wrmsr(MSR_TSC_DEADLINE, target ? target : 1);
+        return;
+    }
+
+    uint64_t now = ktime_get_ns();
+    uint64_t delta = deadline > now ? deadline - now : 0;
+
+    if (hw == TIMER_HW_LAPIC_ONESHOT) {
+        uint64_t ticks = mul_shift(delta, lapic_per_ns_fp, 24);
+        if (ticks == 0) ticks = 1;
+        if (ticks > 0xFFFFFFFF) ticks = 0xFFFFFFFF; // Fires early and re-arms
+        lapic_write(LAPIC_TIMER_INIT, (uint32_t)ticks);
+    } else if (hw == TIMER_HW_PIT) {
+        if (delta > PIT_MAX_NS) delta = PIT_MAX_NS;
+        uint64_t count = delta * PIT_HZ / NS_PER_S;
+        if (count == 0) count = 1;
+        outb(0x43, 0x30);              // Channel 0, lo/hi, mode 0 (one-shot)
+        outb(0x40, count & 0xFF);
+        outb(0x40, (count >> 8) & 0xFF);
+    }
+}
+
+/* --- Min-heap keyed on deadline --- */
+
+static void heap_place(timer_cpu_t *tc, int i, ktimer_t *t) {
+    tc->heap[i] = t;
+    t->slot = i;
+}
+
+static void sift_up(timer_cpu_t *tc, int i) {
+    ktimer_t *t = tc->heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (tc->heap[parent]->deadline <= t->deadline) break;
+        heap_place(tc, i, tc->heap[parent]);
+        i = parent;
+    }
+    heap_place(tc, i, t);
+}
+
+static void sift_down(timer_cpu_t *tc, int i) {
+    ktimer_t *t = tc->heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= tc->size) break;
+        if (child + 1 < tc->size && tc->heap[child + 1]->deadline < tc->heap[child]->deadline) child++;
+        if (t->deadline <= tc->heap[child]->deadline) break;
+        heap_place(tc, i, tc->heap[child]);
+        i = child;
+    }
+    heap_place(tc, i, t);
+}
+
+static void heap_remove(timer_cpu_t *tc, ktimer_t *t) {
+    int i = t->slot;
+    t->slot = -1;
+    ktimer_t *last = tc->heap[--tc->size];
+    if (last == t) return;
+    heap_place(tc, i, last);
+    sift_up(tc, i);
+    sift_down(tc, last->slot);
+}
+
+static int heap_insert(timer_cpu_t *tc, ktimer_t *t) {
+    if (tc->size >= TIMER_MAX_ARMED) return 0;
+    heap_place(tc, tc->size++, t);
+    sift_up(tc, t->slot);
+    return 1;
+}
+
+/* --- Public API --- */
+
+void ktimer_setup(ktimer_t *t, ktimer_fn_t fn, void *arg) {
+    t->deadline = 0;
+    t->period = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->slot = -1;
+    t->cpu = -1;
+}
+
+/* Unlink t from whichever CPU's heap holds it. A remote CPU may then take
+ * one early interrupt, which finds nothing due and re-arms. */
+static int detach(ktimer_t *t) {
+    for (;;) {
+        int cpu = __atomic_load_n(&t->cpu, __ATOMIC_ACQUIRE);
+        if (cpu < 0) return 0;
+        timer_cpu_t *tc = &timer_cpus[cpu];
+        spin_lock(&tc->lock);
+        if (t->cpu != cpu) { // Moved while we were taking the lock
+            spin_unlock(&tc->lock);
+            continue;
+        }
+        int was_first = t->slot == 0;
+        heap_remove(tc, t);
+        t->cpu = -1;
+        if (was_first && tc == &timer_cpus[this_cpu()->cpu_id]) program_hw(tc);
+        spin_unlock(&tc->lock);
+        return 1;
+    }
+}
+
+/* Timers fire on the CPU that armed them */
+int ktimer_arm(ktimer_t *t, uint64_t deadline_ns, uint64_t period_ns) {
+    uint64_t flags = cpu_irq_save();
+    detach(t);
+
+    uint32_t cpu = this_cpu()->cpu_id;
+    timer_cpu_t *tc = &timer_cpus[cpu];
+    spin_lock(&tc->lock);
+    t->deadline = deadline_ns;
+    t->period = period_ns;
+    int ok = heap_insert(tc, t);
+    if (ok) {
+        t->cpu = cpu;
+        if (t->slot == 0) program_hw(tc);
+    }
+    spin_unlock(&tc->lock);
+
+    cpu_irq_restore(flags);
+    return ok;
+}
+
+int ktimer_arm_in(ktimer_t *t, uint64_t delay_ns, uint64_t period_ns) {
+    return ktimer_arm(t, ktime_get_ns() + delay_ns, period_ns);
+}
+
+int ktimer_cancel(ktimer_t *t) {
+    uint64_t flags = cpu_irq_save();
+    int pending = detach(t);
+    cpu_irq_restore(flags);
+    return pending;
+}
+
+static void timer_interrupt(interrupt_frame_t *frame) {
+    (void)frame;
+    timer_cpu_t *tc = &timer_cpus[this_cpu()->cpu_id];
+    tc->irqs++;
+
+    uint64_t now = ktime_get_ns();
+    spin_lock(&tc->lock);
+    while (tc->size && tc->heap[0]->deadline <= now) {
+        ktimer_t *t = tc->heap[0];
+        TRACE(TRACE_TIMER_FIRE, 0, now - t->deadline, t->fn);
+        heap_remove(tc, t);
+        if (t->period) {
+            t->deadline += t->period;
+            if (t->deadline <= now) t->deadline = now + t->period; // Don't replay missed periods
+            heap_insert(tc, t);
+        } else {
+            t->cpu = -1;
+        }
+        tc->fired++;
+
+        // Callbacks may re-arm or cancel timers, so drop the lock around them
+        spin_unlock(&tc->lock);
+        t->fn(t, t->arg);
+        spin_lock(&tc->lock);
+    }
+    program_hw(tc);
+    spin_unlock(&tc->lock);
+}
+
+static void timers_command(const char *args) {
+    (void)args;
+    serial_print("[TIMER] mode=");
+    serial_print(hw_names[hw]);
+    serial_print(" tsc_hz=");
+    serial_print_dec(tsc_hz);
+    serial_print(" lapic_hz=");
+    serial_print_dec(lapic_hz);
+    serial_print(" now_ns=");
+    serial_print_dec(ktime_get_ns());
+    serial_print("\n");
+    for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+        timer_cpu_t *tc = &timer_cpus[cpu];
+        serial_print("[TIMER]   cpu ");
+        serial_print_dec(cpu);
+        serial_print(": armed=");
+        serial_print_dec(tc->size);
+        serial_print(" irqs=");
+        serial_print_dec(tc->irqs);
+        serial_print(" fired=");
+        serial_print_dec(tc->fired);
+        serial_print("\n");
+    }
+}
+
+/* Put this CPU's LAPIC timer in the mode timer_init() picked */
+static void lapic_timer_setup() {
+    if (hw == TIMER_HW_TSC_DEADLINE) {
+        lapic_write(LAPIC_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_TSCDEADLINE);
+    } else if (hw == TIMER_HW_LAPIC_ONESHOT) {
+        lapic_write(LAPIC_TIMER_DIV, 0x3);
+        lapic_write(LAPIC_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_ONESHOT);
+    }
+}
+
+void timer_init_ap() {
+    lapic_timer_setup();
+}
+
+void timer_init() {
+    for (int c = 0; c < MAX_CPUS; c++) {
+        timer_cpus[c].lock_stats.name = "timer-heap";
+        timer_cpus[c].lock.stats = &timer_cpus[c].lock_stats;
+    }
+    calibrate();
+    tsc_base = __builtin_ia32_rdtsc();
+
+    if (apic_available()) {
+        uint32_t a, b, c, d;
+        cpuid(1, 0, &a, &b, &c, &d);
+        interrupt_register(TIMER_VECTOR, timer_interrupt, "lapic-timer");
+        if (c & (1 << 24)) hw = TIMER_HW_TSC_DEADLINE;
+        else if (lapic_hz) hw = TIMER_HW_LAPIC_ONESHOT;
+        lapic_timer_setup();
+    }
+    if (hw == TIMER_HW_NONE) {
+        // Replace the firmware's periodic 18.2 Hz tick with a one-shot
+        outb(0x43, 0x30);
+        outb(0x40, 0xFF);
+        outb(0x40, 0xFF);
+        if (irq_install(0, timer_interrupt, "pit")) hw = TIMER_HW_PIT;
+    }
+    program_hw(&timer_cpus[0]);
+
+    serial_print("[PARADOX] Timer: ");
+    serial_print(hw_names[hw]);
+    serial_print(", TSC ");
+    serial_print_dec(tsc_hz / 1000000);
+    serial_print(" MHz\n");
+    serial_register_command("timers", timers_command);
+}
@@ -0,0 +1,51 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_VECTOR     0xF0
+#define TIMER_MAX_ARMED  64
+
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+#define NS_PER_S  1000000000ULL
+
+/*
+ * Tickless timers: the hardware is armed for the earliest pending deadline
+ * only (LAPIC TSC-deadline, LAPIC one-shot, or the PIT when there is no
+ * APIC), so nothing fires while the heap is empty.
+ *
+ * Every CPU keeps its own heap; a timer fires on the CPU that armed it.
+ * Callbacks run in interrupt context and must not block.
+ */
+typedef struct ktimer ktimer_t;
+typedef void (*ktimer_fn_t)(ktimer_t *timer, void *arg);
+
+struct ktimer {
+    uint64_t deadline;  // ktime_get_ns() value
+    uint64_t period;    // Re-armed automatically when non-zero
+    ktimer_fn_t fn;
+    void *arg;
+    int32_t slot;       // Heap index, -1 while idle
+    int32_t cpu;        // Owning CPU's heap, -1 while idle
+};
+
+/* Calibrates the TSC (and LAPIC timer) against PIT channel 2 */
+void timer_init();
+void timer_init_ap(); // Per-AP LAPIC timer setup, after timer_init()
+
+/* Monotonic time since timer_init() */
+uint64_t ktime_get_ns();
+uint64_t tsc_to_ns(uint64_t cycles);
+uint64_t tsc_frequency();
+
+/* ktime_get_ns() == (rdtsc - *tsc_base) * *mult >> 32, for the time page */
+void ktime_get_calibration(uint64_t *tsc_base, uint64_t *mult);
+void ktime_delay_us(uint64_t us); // Busy-wait, usable before interrupts are on
+
+void ktimer_setup(ktimer_t *t, ktimer_fn_t fn, void *arg);
+int ktimer_arm(ktimer_t *t, uint64_t deadline_ns, uint64_t period_ns);
+int ktimer_arm_in(ktimer_t *t, uint64_t delay_ns, uint64_t period_ns);
+int ktimer_cancel(ktimer_t *t); // Returns 1 if it was pending
+
+#endif
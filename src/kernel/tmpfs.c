@@ -0,0 +1,440 @@
+#include "tmpfs.h"
+#include "dcache.h"
+#include "sync.h"
+#include "serial.h"
+#include "memory/pmm.h"
+#include "libk/string/string.h"
+
+typedef struct {
+    uint64_t first;     // File page held by data[0]
+    uint64_t pages;
+    uint8_t *data;      // `pages` contiguous PMM pages
+} tmp_extent_t;
+
+typedef struct tmp_inode {
+    fs_node_t node;     // First, so a node pointer is an inode pointer
+    union {
+        struct {
+            tmp_extent_t *ext;      // Sorted by first, never overlapping
+            uint32_t count;
+            uint32_t cap;
+            tmp_extent_t one;       // Used as `ext` until a second extent is needed
+        } file;
+        struct {
+            struct tmp_inode **child;
+            uint32_t count;
+            uint32_t cap;
+        } dir;
+    };
+    uint64_t pages;     // Data pages held
+    struct tmp_inode *free_next;
+    uint32_t refs;      // vfs_open()s not yet closed
+} tmp_inode_t;
+
+_Static_assert(sizeof(tmp_inode_t) == 128, "tmp_inode_t should span two cache lines");
+
+#define INODES_PER_PAGE (PAGE_SIZE / sizeof(tmp_inode_t))
+#define TMP_UNLINKED    0x100   // Private node flag: no longer in any directory
+
+/*
+ * One lock for the whole filesystem: readers share it, anything that
+ * changes a directory or a file's extents takes it exclusively. Copies
+ * drop it every TMPFS_COPY_CHUNK bytes so a large transfer doesn't keep
+ * preemption off for long.
+ */
+DEFINE_RWLOCK(tmpfs_lock, "tmpfs");
+
+static tmp_inode_t *free_inodes = 0;   // Inode pages are kept once allocated
+static tmp_inode_t *root = 0;
+static uint32_t next_ino = 1;
+
+/* Counters */
+static uint64_t files = 0;
+static uint64_t dirs = 0;
+static uint64_t data_pages = 0;
+static uint64_t extents = 0;
+
+static const fs_ops_t tmpfs_file_ops;
+static const fs_ops_t tmpfs_dir_ops;
+
+static inline uint64_t min_u64(uint64_t a, uint64_t b) {
+    return a < b ? a : b;
+}
+
+static uint32_t array_pages(uint32_t cap, uint32_t elem) {
+    return ((uint64_t)cap * elem + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+/* --- Inodes --- */
+
+static tmp_inode_t *inode_alloc(uint32_t type) {
+    if (!free_inodes) {
+        tmp_inode_t *page = pmm_alloc(1);
+        if (!page) return 0;
+        for (uint32_t i = 0; i < INODES_PER_PAGE; i++) {
+            page[i].free_next = free_inodes;
+            free_inodes = &page[i];
+        }
+    }
+    tmp_inode_t *ino = free_inodes;
+    free_inodes = ino->free_next;
+    k_memset(ino, 0, sizeof(*ino));
+
+    ino->node.inode = next_ino++;
+    ino->node.flags = type;
+    if (type == FS_DIRECTORY) {
+        ino->node.ops = &tmpfs_dir_ops;
+        dirs++;
+    } else {
+        ino->node.ops = &tmpfs_file_ops;
+        ino->file.ext = &ino->file.one;
+        ino->file.cap = 1;
+        files++;
+    }
+    return ino;
+}
+
+static void inode_free(tmp_inode_t *ino) {
+    if ((ino->node.flags & 0x07) == FS_DIRECTORY) dirs--;
+    else files--;
+    ino->node.length = 0;
+    ino->free_next = free_inodes;
+    free_inodes = ino;
+}
+
+/* Unlinked and unreferenced: the node can be reused. Called unlocked. */
+static void inode_retire(tmp_inode_t *ino) {
+    vfs_release_name(&ino->node);
+    write_lock(&tmpfs_lock);
+    inode_free(ino);
+    write_unlock(&tmpfs_lock);
+}
+
+/* --- Extents --- */
+
+/* Index of the first extent starting after `page` */
+static uint32_t extent_after(tmp_inode_t *ino, uint64_t page) {
+    uint32_t lo = 0, hi = ino->file.count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (ino->file.ext[mid].first <= page) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static tmp_extent_t *extent_find(tmp_inode_t *ino, uint64_t page) {
+    uint32_t i = extent_after(ino, page);
+    if (i == 0) return 0;
+    tmp_extent_t *e = &ino->file.ext[i - 1];
+    return page < e->first + e->pages ? e : 0;
+}
+
+static int extents_reserve(tmp_inode_t *ino) {
+    if (ino->file.count < ino->file.cap) return 1;
+    uint32_t old_cap = ino->file.cap;
+    uint32_t cap = old_cap == 1 ? PAGE_SIZE / sizeof(tmp_extent_t) : old_cap * 2;
+    tmp_extent_t *ext = pmm_alloc(array_pages(cap, sizeof(tmp_extent_t)));
+    if (!ext) return 0;
+    k_memcpy(ext, ino->file.ext, ino->file.count * sizeof(tmp_extent_t));
+    if (old_cap > 1) pmm_free(ino->file.ext, array_pages(old_cap, sizeof(tmp_extent_t)));
+    ino->file.ext = ext;
+    ino->file.cap = cap;
+    return 1;
+}
+
+/*
+ * Back file page `page` with a new extent of about `want` pages. Past the
+ * end of the file's extents it grows geometrically; inside a hole it stops
+ * short of the next extent. Called with the lock held for writing.
+ */
+static tmp_extent_t *extent_add(tmp_inode_t *ino, uint64_t page, uint64_t want) {
+    if (!extents_reserve(ino)) return 0;
+
+    uint32_t at = extent_after(ino, page);
+    uint64_t n = want;
+    if (at == ino->file.count) {
+        if (n < ino->pages) n = ino->pages; // Double what the file holds
+    } else {
+        n = min_u64(n, ino->file.ext[at].first - page);
+    }
+    n = min_u64(n, TMPFS_EXTENT_MAX);
+
+    uint8_t *data = 0;
+    while (n && !(data = pmm_alloc(n))) n /= 2; // Fragmented: settle for less
+    if (!data) return 0;
+    k_memset(data, 0, n * PAGE_SIZE); // Holes and bytes past EOF read as zeros
+    ino->pages += n;
+    data_pages += n;
+
+    // Physically and logically adjacent to the previous extent: just extend it
+    if (at > 0) {
+        tmp_extent_t *prev = &ino->file.ext[at - 1];
+        if (prev->first + prev->pages == page && prev->data + prev->pages * PAGE_SIZE == data) {
+            prev->pages += n;
+            return prev;
+        }
+    }
+
+    tmp_extent_t *ext = ino->file.ext;
+    for (uint32_t i = ino->file.count; i > at; i--) ext[i] = ext[i - 1];
+    ext[at].first = page;
+    ext[at].pages = n;
+    ext[at].data = data;
+    ino->file.count++;
+    extents++;
+    return &ext[at];
+}
+
+/* Free every data page from file page `keep` on */
+static void extents_trim(tmp_inode_t *ino, uint64_t keep) {
+    while (ino->file.count) {
+        tmp_extent_t *e = &ino->file.ext[ino->file.count - 1];
+        if (e->first + e->pages <= keep) break;
+        uint64_t stay = e->first < keep ? keep - e->first : 0;
+        pmm_free(e->data + stay * PAGE_SIZE, e->pages - stay);
+        ino->pages -= e->pages - stay;
+        data_pages -= e->pages - stay;
+        e->pages = stay;
+        if (stay) break;
+        ino->file.count--;
+        extents--;
+    }
+    if (ino->file.count == 0 && ino->file.cap > 1) {
+        pmm_free(ino->file.ext, array_pages(ino->file.cap, sizeof(tmp_extent_t)));
+        ino->file.ext = &ino->file.one;
+        ino->file.cap = 1;
+    }
+}
+
+/* --- File operations --- */
+
+static uint32_t tmpfs_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    tmp_inode_t *ino = (tmp_inode_t *)node;
+    uint32_t done = 0;
+    while (done < size) {
+        read_lock(&tmpfs_lock);
+        uint64_t pos = offset + done;
+        if (pos >= node->length) {
+            read_unlock(&tmpfs_lock);
+            break;
+        }
+        uint64_t left = min_u64(size - done, node->length - pos);
+        uint64_t page = pos / PAGE_SIZE;
+        uint32_t i = extent_after(ino, page);
+        tmp_extent_t *e = i ? &ino->file.ext[i - 1] : 0;
+
+        uint32_t chunk;
+        if (e && page < e->first + e->pages) {
+            uint64_t in_ext = pos - e->first * PAGE_SIZE;
+            chunk = min_u64(min_u64(left, e->pages * PAGE_SIZE - in_ext), TMPFS_COPY_CHUNK);
+            k_memcpy(buffer + done, e->data + in_ext, chunk);
+        } else {
+            // A hole, up to the next extent
+            uint64_t hole_end = i < ino->file.count ? ino->file.ext[i].first * PAGE_SIZE : UINT64_MAX;
+            chunk = min_u64(min_u64(left, hole_end - pos), TMPFS_COPY_CHUNK);
+            k_memset(buffer + done, 0, chunk);
+        }
+        read_unlock(&tmpfs_lock);
+        done += chunk;
+    }
+    return done;
+}
+
+static uint32_t tmpfs_write(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    tmp_inode_t *ino = (tmp_inode_t *)node;
+    if (size > UINT64_MAX - offset) size = UINT64_MAX - offset;
+    if (!size) return 0;
+    uint64_t last_page = (offset + size - 1) / PAGE_SIZE;
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint64_t page = pos / PAGE_SIZE;
+        write_lock(&tmpfs_lock);
+        if (node->flags & TMP_UNLINKED) {
+            write_unlock(&tmpfs_lock);
+            break;
+        }
+        tmp_extent_t *e = extent_find(ino, page);
+        if (!e) e = extent_add(ino, page, last_page - page + 1);
+        if (!e) {
+            write_unlock(&tmpfs_lock);
+            break;
+        }
+        uint64_t in_ext = pos - e->first * PAGE_SIZE;
+        uint32_t chunk = min_u64(min_u64(size - done, e->pages * PAGE_SIZE - in_ext), TMPFS_COPY_CHUNK);
+        k_memcpy(e->data + in_ext, buffer + done, chunk);
+        if (pos + chunk > node->length) node->length = pos + chunk;
+        write_unlock(&tmpfs_lock);
+        done += chunk;
+    }
+    return done;
+}
+
+/* No map(): truncate and unlink free extents at once, so vfs_map() copies */
+
+/* An open node outlives its unlink: its data is gone, but the inode isn't
+ * reused until the last close, so a late write can't land in a new file */
+static void tmpfs_open(fs_node_t *node) {
+    write_lock(&tmpfs_lock);
+    ((tmp_inode_t *)node)->refs++;
+    write_unlock(&tmpfs_lock);
+}
+
+static void tmpfs_close(fs_node_t *node) {
+    tmp_inode_t *ino = (tmp_inode_t *)node;
+    write_lock(&tmpfs_lock);
+    int last = --ino->refs == 0 && (node->flags & TMP_UNLINKED);
+    write_unlock(&tmpfs_lock);
+    if (last) inode_retire(ino);
+}
+
+static int tmpfs_truncate(fs_node_t *node, uint64_t length) {
+    tmp_inode_t *ino = (tmp_inode_t *)node;
+    write_lock(&tmpfs_lock);
+    if (length < node->length) {
+        extents_trim(ino, (length + PAGE_SIZE - 1) / PAGE_SIZE);
+        // Keep the tail of the last page zero, in case the file grows again
+        tmp_extent_t *e = length % PAGE_SIZE ? extent_find(ino, length / PAGE_SIZE) : 0;
+        if (e) {
+            uint64_t in_ext = length - e->first * PAGE_SIZE;
+            k_memset(e->data + in_ext, 0, PAGE_SIZE - length % PAGE_SIZE);
+        }
+    }
+    node->length = length;
+    write_unlock(&tmpfs_lock);
+    return 1;
+}
+
+/* --- Directory operations --- */
+
+/* Index of the named child, or -1; lock held */
+static int32_t child_index(tmp_inode_t *dir, const char *name, uint32_t len, uint32_t hash) {
+    for (uint32_t i = 0; i < dir->dir.count; i++) {
+        if (vfs_name_is(&dir->dir.child[i]->node, name, len, hash)) return i;
+    }
+    return -1;
+}
+
+static fs_node_t *tmpfs_readdir(fs_node_t *node, uint32_t index) {
+    tmp_inode_t *dir = (tmp_inode_t *)node;
+    read_lock(&tmpfs_lock);
+    fs_node_t *child = index < dir->dir.count ? &dir->dir.child[index]->node : 0;
+    read_unlock(&tmpfs_lock);
+    return child;
+}
+
+static fs_node_t *tmpfs_finddir(fs_node_t *node, const char *name, uint32_t len) {
+    tmp_inode_t *dir = (tmp_inode_t *)node;
+    uint32_t hash = strtab_hash(name, len);
+    read_lock(&tmpfs_lock);
+    int32_t i = child_index(dir, name, len, hash);
+    fs_node_t *child = i >= 0 ? &dir->dir.child[i]->node : 0;
+    read_unlock(&tmpfs_lock);
+    return child;
+}
+
+static fs_node_t *tmpfs_create(fs_node_t *node, const char *name, uint32_t len, uint32_t type) {
+    tmp_inode_t *dir = (tmp_inode_t *)node;
+    if (type != FS_FILE && type != FS_DIRECTORY) return 0;
+    uint32_t hash = strtab_hash(name, len);
+    tmp_inode_t *ino = 0;
+
+    write_lock(&tmpfs_lock);
+    if ((node->flags & TMP_UNLINKED) || child_index(dir, name, len, hash) >= 0) goto out;
+
+    if (dir->dir.count == dir->dir.cap) {
+        uint32_t cap = dir->dir.cap ? dir->dir.cap * 2 : PAGE_SIZE / sizeof(tmp_inode_t *);
+        tmp_inode_t **child = pmm_alloc(array_pages(cap, sizeof(tmp_inode_t *)));
+        if (!child) goto out;
+        k_memcpy(child, dir->dir.child, dir->dir.count * sizeof(tmp_inode_t *));
+        if (dir->dir.cap) pmm_free(dir->dir.child, array_pages(dir->dir.cap, sizeof(tmp_inode_t *)));
+        dir->dir.child = child;
+        dir->dir.cap = cap;
+    }
+
+    ino = inode_alloc(type);
+    if (!ino) goto out;
+    if (!vfs_set_name(&ino->node, name, len)) {
+        inode_free(ino);
+        ino = 0;
+        goto out;
+    }
+    dir->dir.child[dir->dir.count++] = ino;
+
+out:
+    write_unlock(&tmpfs_lock);
+    if (ino) dcache_invalidate(node, name, len); // Drop the negative entry
+    return ino ? &ino->node : 0;
+}
+
+static int tmpfs_unlink(fs_node_t *node, const char *name, uint32_t len) {
+    tmp_inode_t *dir = (tmp_inode_t *)node;
+    uint32_t hash = strtab_hash(name, len);
+
+    write_lock(&tmpfs_lock);
+    int32_t i = child_index(dir, name, len, hash);
+    tmp_inode_t *ino = i >= 0 ? dir->dir.child[i] : 0;
+    if (ino && (ino->node.flags & 0x07) == FS_DIRECTORY && ino->dir.count) ino = 0; // Not empty
+    if (!ino) {
+        write_unlock(&tmpfs_lock);
+        return 0;
+    }
+    dir->dir.child[i] = dir->dir.child[--dir->dir.count];
+    ino->node.flags |= TMP_UNLINKED;
+
+    if ((ino->node.flags & 0x07) == FS_DIRECTORY) {
+        if (ino->dir.cap) pmm_free(ino->dir.child, array_pages(ino->dir.cap, sizeof(tmp_inode_t *)));
+        ino->dir.child = 0;
+        ino->dir.cap = 0;
+    } else {
+        extents_trim(ino, 0);
+    }
+    ino->node.length = 0;
+    int unused = ino->refs == 0;
+    write_unlock(&tmpfs_lock);
+
+    // Nothing can look it up any more; retire it now or at the last close
+    dcache_invalidate(node, name, len);
+    dcache_forget(&ino->node);
+    if (unused) inode_retire(ino);
+    return 1;
+}
+
+static const fs_ops_t tmpfs_file_ops = {
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .open = tmpfs_open,
+    .close = tmpfs_close,
+    .truncate = tmpfs_truncate,
+};
+
+static const fs_ops_t tmpfs_dir_ops = {
+    .open = tmpfs_open,
+    .close = tmpfs_close,
+    .readdir = tmpfs_readdir,
+    .finddir = tmpfs_finddir,
+    .create = tmpfs_create,
+    .unlink = tmpfs_unlink,
+};
+
+static void tmpfs_command(const char *args) {
+    (void)args;
+    serial_print("[TMPFS] ");
+    serial_print_dec(files);
+    serial_print(" files, ");
+    serial_print_dec(dirs);
+    serial_print(" directories, ");
+    serial_print_dec(data_pages * PAGE_SIZE / 1024);
+    serial_print(" KiB in ");
+    serial_print_dec(extents);
+    serial_print(" extents\n");
+}
+
+fs_node_t *tmpfs_init() {
+    root = inode_alloc(FS_DIRECTORY);
+    if (!root) return 0;
+    serial_register_command("tmpfs", tmpfs_command);
+    return &root->node;
+}
@@ -0,0 +1,24 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+/*
+ * Writable in-memory filesystem. File data lives in extents of contiguous
+ * PMM pages, sorted by file offset; pages that were never written are holes
+ * and read as zeros. Writing past the last extent allocates a new one at
+ * least as large as everything the file already holds (up to
+ * TMPFS_EXTENT_MAX pages), so appends cost amortized O(1) allocations.
+ * Unlink and truncate give the pages straight back to the PMM, so files
+ * are never mapped in place. A node stays valid after its unlink while it
+ * is open (vfs_open()); anything else must not hold it across an unlink.
+ */
+
+#define TMPFS_EXTENT_MAX  256           // Pages in one growth step (1 MiB)
+#define TMPFS_COPY_CHUNK  (64 * 1024)   // Bytes copied per lock hold
+
+/* Returns the root directory, ready for vfs_mount() */
+fs_node_t *tmpfs_init();
+
+#endif
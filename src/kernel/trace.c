@@ -0,0 +1,152 @@
+#include "trace.h"
+#include "cpu.h"
+#include "smp.h"
+#include "sched.h"
+#include "serial.h"
+#include "timer.h"
+#include "memory/pmm.h"
+
+volatile uint32_t trace_mask = 0;
+
+typedef struct {
+    trace_record_t *ring;
+    uint64_t head;      // Records ever written; only the owning CPU advances it
+} trace_cpu_t;
+
+static trace_cpu_t trace_cpus[MAX_CPUS];
+
+static const char *category_names[TRACE_CATEGORIES] = {
+    "irq", "sched", "timer", "work", "input", "ui", "syscall"
+};
+
+void trace_record(uint16_t event, uint32_t arg0, uint64_t arg1, uint64_t arg2) {
+    // Interrupts off so a nested tracepoint can't claim the same slot
+    uint64_t flags = cpu_irq_save();
+    percpu_t *cpu = this_cpu();
+    trace_cpu_t *tc = &trace_cpus[cpu->cpu_id];
+    if (tc->ring) {
+        trace_record_t *r = &tc->ring[tc->head++ & (TRACE_RING_SIZE - 1)];
+        r->tsc = __builtin_ia32_rdtsc();
+        r->event = event;
+        r->cpu = cpu->cpu_id;
+        r->arg0 = arg0;
+        r->arg1 = arg1;
+        r->arg2 = arg2;
+    }
+    cpu_irq_restore(flags);
+}
+
+int trace_enable(uint32_t mask) {
+    size_t pages = (TRACE_RING_SIZE * sizeof(trace_record_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (uint32_t c = 0; mask && c < smp_cpu_count(); c++) {
+        if (!trace_cpus[c].ring && !(trace_cpus[c].ring = pmm_alloc(pages))) return 0;
+    }
+    trace_mask = mask;
+    return 1;
+}
+
+static void print_hex_bytes(const void *data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        serial_write(digits[p[i] >> 4]);
+        serial_write(digits[p[i] & 0xF]);
+    }
+}
+
+static void print_task_name(task_t *t, void *arg) {
+    (void)arg;
+    serial_print("N ");
+    serial_print_dec(t->id);
+    serial_print(" ");
+    serial_print(t->name);
+    serial_print("\n");
+}
+
+/* Streams every ring, oldest record first, as "R <hex>" lines. Tracing is
+ * paused meanwhile so the rings hold still. */
+void trace_dump() {
+    uint32_t mask = trace_mask;
+    trace_mask = 0;
+
+    serial_print("--- trace begin ---\nH ");
+    serial_print_dec(tsc_frequency());
+    serial_print(" ");
+    serial_print_dec(smp_cpu_count());
+    serial_print("\n");
+    sched_for_each_task(print_task_name, 0);
+
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        trace_cpu_t *tc = &trace_cpus[c];
+        if (!tc->ring) continue;
+        uint64_t head = __atomic_load_n(&tc->head, __ATOMIC_ACQUIRE);
+        uint64_t i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (; i < head; i++) {
+            serial_print("R ");
+            print_hex_bytes(&tc->ring[i & (TRACE_RING_SIZE - 1)], sizeof(trace_record_t));
+            serial_print("\n");
+        }
+    }
+    serial_print("--- trace end ---\n");
+
+    trace_mask = mask;
+}
+
+static void print_status() {
+    serial_print("[TRACE] enabled:");
+    for (int i = 0; i < TRACE_CATEGORIES; i++) {
+        if (!(trace_mask & (1u << i))) continue;
+        serial_print(" ");
+        serial_print(category_names[i]);
+    }
+    serial_print(trace_mask ? "\n" : " none\n");
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        if (!trace_cpus[c].ring) continue;
+        serial_print("[TRACE] cpu ");
+        serial_print_dec(c);
+        serial_print(": ");
+        serial_print_dec(trace_cpus[c].head);
+        serial_print(" records\n");
+    }
+}
+
+/* Parses "irq sched ..." or "all" into a category mask */
+static uint32_t parse_categories(const char *args) {
+    uint32_t mask = 0;
+    while (*args) {
+        while (*args == ' ' || *args == ',') args++;
+        const char *word = args;
+        while (*args && *args != ' ' && *args != ',') args++;
+        int len = args - word;
+        if (!len) break;
+        if (len == 3 && word[0] == 'a' && word[1] == 'l' && word[2] == 'l') mask |= (1u << TRACE_CATEGORIES) - 1;
+        for (int i = 0; i < TRACE_CATEGORIES; i++) {
+            const char *name = category_names[i];
+            int n = 0;
+            while (n < len && name[n] == word[n]) n++;
+            if (n == len && !name[n]) mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/* "trace on <categories|all>" | "trace off" | "trace dump" */
+static void trace_command(const char *args) {
+    while (*args == ' ') args++;
+    if (args[0] == 'o' && args[1] == 'n') {
+        uint32_t mask = parse_categories(args + 2);
+        if (!trace_enable(mask)) serial_print("[TRACE] Out of memory for trace rings.\n");
+        print_status();
+    } else if (args[0] == 'o' && args[1] == 'f') {
+        trace_mask = 0;
+        print_status();
+    } else if (args[0] == 'd') {
+        trace_dump();
+    } else {
+        print_status();
+    }
+}
+
+void trace_init() {
+    serial_register_command("trace", trace_command);
+}
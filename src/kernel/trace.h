@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Static tracepoints into per-CPU binary ring buffers.
+ *
+ * A tracepoint costs one load and a predicted branch while its category is
+ * off. When on, it writes a 32-byte record into the local CPU's ring with
+ * interrupts briefly masked; nothing is shared between CPUs. The rings
+ * wrap, keeping the newest records, and are streamed out as hex by
+ * "trace dump" for scripts/trace_decode.py.
+ *
+ * Event ids carry their category index in the high byte.
+ */
+#define TRACE_CAT_IRQ     0
+#define TRACE_CAT_SCHED   1
+#define TRACE_CAT_TIMER   2
+#define TRACE_CAT_WORK    3
+#define TRACE_CAT_INPUT   4
+#define TRACE_CAT_UI      5
+#define TRACE_CAT_SYSCALL 6
+#define TRACE_CATEGORIES  7
+
+#define TRACE_IRQ_ENTER      0x0000  // vector
+#define TRACE_IRQ_EXIT       0x0001  // vector
+#define TRACE_SCHED_SWITCH   0x0100  // prev id, next id, prev state
+#define TRACE_SCHED_WAKE     0x0101  // task id, target cpu
+#define TRACE_TIMER_FIRE     0x0200  // -, lateness ns, callback
+#define TRACE_WORK_BEGIN     0x0300  // in softirq, callback
+#define TRACE_WORK_END       0x0301  // in softirq, callback
+#define TRACE_INPUT_KEY      0x0400  // scancode byte, irq tsc
+#define TRACE_INPUT_MOUSE    0x0401  // packets, irq tsc of the first
+#define TRACE_UI_FRAME_BEGIN 0x0500  // frame number
+#define TRACE_UI_FRAME_END   0x0501  // frame number, repainted
+#define TRACE_SYSCALL_ENTER  0x0600  // number
+#define TRACE_SYSCALL_EXIT   0x0601  // number, result
+
+#define TRACE_RING_SIZE 4096 // Records per CPU, power of two
+
+typedef struct {
+    uint64_t tsc;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t arg0;
+    uint64_t arg1;
+    uint64_t arg2;
+} trace_record_t;
+
+extern volatile uint32_t trace_mask; // Bit n enables category n
+
+void trace_record(uint16_t event, uint32_t arg0, uint64_t arg1, uint64_t arg2);
+
+#define TRACE(event, a0, a1, a2) do { \
+    if (__builtin_expect(trace_mask & (1u << ((event) >> 8)), 0)) \
+        trace_record((event), (uint32_t)(a0), (uint64_t)(a1), (uint64_t)(a2)); \
+} while (0)
+
+/* Registers the "trace" serial command; after smp_init() */
+void trace_init();
+
+/* Allocates the rings on first use; returns 0 if memory ran out */
+int trace_enable(uint32_t mask);
+void trace_dump();
+
+#endif
@@ -1,10 +1,14 @@
 #include "user.h"
+#include "sync.h"
 #include <stddef.h>
 
 static user_t user_db[MAX_USERS];
 static int user_count = 0;
 static user_t* current_user = NULL;
 
+/* Logins only read the table; registration is the rare writer */
+DEFINE_RWLOCK(user_lock, "user_db");
+
 /* Simple string comparison for freestanding kernel */
 static int k_strcmp(const char* s1, const char* s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -30,24 +34,33 @@ void user_init() {
 }
 
 int user_register(const char* username, const char* password) {
-    if (user_count >= MAX_USERS) return 0;
-    
+    write_lock(&user_lock);
+    if (user_count >= MAX_USERS) {
+        write_unlock(&user_lock);
+        return 0;
+    }
+
     k_strcpy(user_db[user_count].username, username);
     k_strcpy(user_db[user_count].password, password);
     user_db[user_count].is_active = 1;
     user_count++;
+    write_unlock(&user_lock);
     return 1;
 }
 
 int user_login(const char* username, const char* password) {
+    int found = 0;
+    read_lock(&user_lock);
     for (int i = 0; i < user_count; i++) {
         if (k_strcmp(user_db[i].username, username) == 0 &&
             k_strcmp(user_db[i].password, password) == 0) {
-            current_user = &user_db[i];
-            return 1;
+            __atomic_store_n(&current_user, &user_db[i], __ATOMIC_RELEASE);
+            found = 1;
+            break;
         }
     }
-    return 0;
+    read_unlock(&user_lock);
+    return found;
 }
 
 user_t* user_get_current() {
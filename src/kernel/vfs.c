@@ -1,37 +1,311 @@
 #include "vfs.h"
+#include "dcache.h"
+#include "pagecache.h"
+#include "serial.h"
+#include "memory/pmm.h"
 
 fs_node_t *fs_root = 0;
 
-uint32_t vfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if (!node || !node->read) return 0;
-    return node->read(node, offset, size, buffer);
+uint32_t vfs_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    if (!node || !node->ops->read) return 0;
+    if (node->flags & FS_CACHED) return pagecache_read(node, offset, size, buffer);
+    return node->ops->read(node, offset, size, buffer);
 }
 
-uint32_t vfs_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if (!node || !node->write) return 0;
-    return node->write(node, offset, size, buffer);
+uint32_t vfs_write(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer) {
+    if (!node || !node->ops->write) return 0;
+    if (node->flags & FS_CACHED) return pagecache_write(node, offset, size, buffer);
+    return node->ops->write(node, offset, size, buffer);
 }
 
 void vfs_open(fs_node_t *node) {
-    if (node->open != 0)
-        return node->open(node);
+    if (node->ops->open != 0)
+        return node->ops->open(node);
 }
 
 void vfs_close(fs_node_t *node) {
-    if (node->close != 0)
-        return node->close(node);
+    if (node->ops->close != 0)
+        return node->ops->close(node);
 }
 
-struct dirent *vfs_readdir(fs_node_t *node, uint32_t index) {
-    if (node && (node->flags & 0x07) == FS_DIRECTORY && node->readdir != 0)
-        return node->readdir(node, index);
+static inline fs_node_t *follow_mount(fs_node_t *node) {
+    while (node && (node->flags & FS_MOUNTPOINT) && node->ptr) node = node->ptr;
+    return node;
+}
+
+fs_node_t *vfs_readdir(fs_node_t *node, uint32_t index) {
+    node = follow_mount(node);
+    if (node && (node->flags & 0x07) == FS_DIRECTORY && node->ops->readdir != 0)
+        return node->ops->readdir(node, index);
     else
         return 0;
 }
 
-fs_node_t *vfs_finddir(fs_node_t *node, char *name) {
-    if (node && (node->flags & 0x07) == FS_DIRECTORY && node->finddir != 0)
-        return node->finddir(node, name);
+fs_node_t *vfs_finddir(fs_node_t *node, const char *name, uint32_t len) {
+    node = follow_mount(node);
+    if (node && (node->flags & 0x07) == FS_DIRECTORY && node->ops->finddir != 0)
+        return node->ops->finddir(node, name, len);
     else
         return 0;
 }
+
+fs_node_t *vfs_create(fs_node_t *dir, const char *name, uint32_t len, uint32_t type) {
+    dir = follow_mount(dir);
+    if (!dir || (dir->flags & 0x07) != FS_DIRECTORY || !dir->ops->create) return 0;
+    if (len == 0 || len >= MAX_FILENAME) return 0;
+    if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) return 0;
+    return dir->ops->create(dir, name, len, type);
+}
+
+int vfs_unlink(fs_node_t *dir, const char *name, uint32_t len) {
+    dir = follow_mount(dir);
+    if (!dir || (dir->flags & 0x07) != FS_DIRECTORY || !dir->ops->unlink) return 0;
+    return dir->ops->unlink(dir, name, len);
+}
+
+int vfs_truncate(fs_node_t *node, uint64_t length) {
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY || !node->ops->truncate) return 0;
+    if (node->flags & FS_CACHED) pagecache_sync(node); // Nothing dirty may land past the new end
+    int ok = node->ops->truncate(node, length);
+    if (node->flags & FS_CACHED) pagecache_invalidate(node);
+    return ok;
+}
+
+int vfs_mount(const char *path, fs_node_t *root) {
+    fs_node_t *dir = vfs_lookup(path);
+    if (!dir || !root || (dir->flags & 0x07) != FS_DIRECTORY) return 0;
+    dir->ptr = root;
+    __atomic_or_fetch(&dir->flags, FS_MOUNTPOINT, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int vfs_set_name(fs_node_t *node, const char *name, uint32_t len) {
+    uint32_t hash = strtab_hash(name, len);
+    uint32_t off = strtab_intern(name, len, hash);
+    if (off == STRTAB_NONE) return 0;
+    strtab_release(node->name);
+    node->name = off;
+    node->name_hash = hash;
+    node->name_len = len;
+    return 1;
+}
+
+void vfs_release_name(fs_node_t *node) {
+    strtab_release(node->name);
+    node->name = 0;
+    node->name_hash = strtab_hash("", 0);
+    node->name_len = 0;
+}
+
+/* One component: a hash probe when cached, the filesystem's finddir otherwise */
+static fs_node_t *lookup_component(fs_node_t *dir, const char *name, uint32_t len) {
+    fs_node_t *node;
+    if (dcache_lookup(dir, name, len, &node)) return node;
+
+    uint32_t gen = dcache_generation();
+    node = vfs_finddir(dir, name, len);
+    dcache_insert(dir, name, len, node, gen);
+    return node;
+}
+
+fs_node_t *vfs_lookup(const char *path) {
+    fs_node_t *stack[VFS_MAX_DEPTH]; // Ancestors, for ".."
+    int depth = 0;
+    fs_node_t *node = fs_root;
+    if (!node || !path) return 0;
+
+    while (*path) {
+        while (*path == '/') path++;
+        const char *name = path;
+        while (*path && *path != '/') path++;
+        uint32_t len = path - name;
+
+        if (len == 0 || (len == 1 && name[0] == '.')) continue;
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            if (depth > 0) node = stack[--depth];
+            continue;
+        }
+        if (len >= MAX_FILENAME || depth == VFS_MAX_DEPTH) return 0;
+        if ((node->flags & 0x07) != FS_DIRECTORY) return 0;
+
+        stack[depth++] = node;
+        node = follow_mount(lookup_component(node, name, len));
+        if (!node) return 0;
+    }
+    return node;
+}
+
+int vfs_map(fs_node_t *node, uint64_t offset, uint32_t size, vfs_mapping_t *m) {
+    m->data = 0;
+    m->length = 0;
+    m->copy = 0;
+    m->copy_pages = 0;
+    m->page = 0;
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY) return 0;
+    if (offset >= node->length) return 1;
+    if (size > node->length - offset) size = node->length - offset;
+    if (size == 0) return 1;
+
+    if (node->ops->map) {
+        const uint8_t *p = node->ops->map(node, offset, size);
+        if (p) {
+            m->data = p;
+            m->length = size;
+            return 1;
+        }
+    }
+
+    // A range inside one cached page can be handed out pinned in place
+    if ((node->flags & FS_CACHED) && offset / PAGE_SIZE == (offset + size - 1) / PAGE_SIZE) {
+        cache_page_t *page = pagecache_get(node, offset / PAGE_SIZE);
+        if (page) {
+            m->page = page;
+            m->data = pagecache_data(page) + offset % PAGE_SIZE;
+            m->length = size;
+            return 1;
+        }
+    }
+
+    // Copying fallback for filesystems without the data in memory
+    if (!node->ops->read) return 0;
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint8_t *buf = pmm_alloc(pages);
+    if (!buf) return 0;
+    m->copy = buf;
+    m->copy_pages = pages;
+    m->data = buf;
+    m->length = vfs_read(node, offset, size, buf);
+    return 1;
+}
+
+void vfs_unmap(vfs_mapping_t *m) {
+    if (m->copy) pmm_free(m->copy, m->copy_pages);
+    if (m->page) pagecache_put(m->page);
+    m->data = 0;
+    m->length = 0;
+    m->copy = 0;
+    m->copy_pages = 0;
+    m->page = 0;
+}
+
+#define CAT_CHUNK (64 * 1024)
+
+/* "cat <path>": print a file straight out of its mappings, a chunk at a
+ * time so a large file or device never needs one huge copy */
+static void cat_command(const char *args) {
+    while (args && *args == ' ') args++;
+    fs_node_t *node = args && *args ? vfs_lookup(args) : 0;
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY) {
+        serial_print("[VFS] No such file.\n");
+        return;
+    }
+    if (!node->ops->map && !node->ops->read) {
+        serial_print("[VFS] Can't read that.\n");
+        return;
+    }
+
+    vfs_open(node);
+    int copied = 0;
+    uint64_t offset = 0;
+    while (offset < node->length) {
+        vfs_mapping_t m;
+        uint32_t size = node->length - offset < CAT_CHUNK ? node->length - offset : CAT_CHUNK;
+        if (!vfs_map(node, offset, size, &m)) {
+            serial_print("\n[VFS] Out of memory.\n");
+            vfs_close(node);
+            return;
+        }
+        for (uint32_t i = 0; i < m.length; i++) serial_write(m.data[i]);
+        copied |= m.copy != 0;
+        uint32_t got = m.length;
+        vfs_unmap(&m);
+        if (got < size) break; // Short read
+        offset += got;
+    }
+    serial_print(copied ? "\n[VFS] (copied)\n" : "\n[VFS] (mapped)\n");
+    vfs_close(node);
+}
+
+/* Directory holding the last component of `path`, which is returned in
+ * name/len; 0 if that directory doesn't exist or there is no component */
+static fs_node_t *lookup_parent(const char *path, const char **name, uint32_t *len) {
+    char dir[MAX_FILENAME];
+    while (*path == ' ') path++;
+    uint32_t end = 0, slash = 0;
+    for (; path[end] && path[end] != ' '; end++) if (path[end] == '/') slash = end + 1;
+    if (slash == end || slash >= MAX_FILENAME) return 0;
+    for (uint32_t i = 0; i < slash; i++) dir[i] = path[i];
+    dir[slash] = 0;
+    *name = path + slash;
+    *len = end - slash;
+    return vfs_lookup(dir);
+}
+
+/* "ls [path]" */
+static void ls_command(const char *args) {
+    while (args && *args == ' ') args++;
+    fs_node_t *dir = vfs_lookup(args && *args ? args : "/");
+    fs_node_t *child;
+    if (!dir) {
+        serial_print("[VFS] No such directory.\n");
+        return;
+    }
+    for (uint32_t i = 0; (child = vfs_readdir(dir, i)) != 0; i++) {
+        serial_print(vfs_name(child));
+        if ((child->flags & 0x07) == FS_DIRECTORY) {
+            serial_print("/\n");
+            continue;
+        }
+        serial_print("  ");
+        serial_print_dec(child->length);
+        serial_print("\n");
+    }
+}
+
+/* "mkdir <path>" */
+static void mkdir_command(const char *args) {
+    const char *name;
+    uint32_t len;
+    fs_node_t *dir = args ? lookup_parent(args, &name, &len) : 0;
+    if (!dir || !vfs_create(dir, name, len, FS_DIRECTORY)) serial_print("[VFS] Can't create that.\n");
+}
+
+/* "rm <path>" */
+static void rm_command(const char *args) {
+    const char *name;
+    uint32_t len;
+    fs_node_t *dir = args ? lookup_parent(args, &name, &len) : 0;
+    if (!dir || !vfs_unlink(dir, name, len)) serial_print("[VFS] Can't remove that.\n");
+}
+
+/* "append <path> <text>": add a line to a file, creating it if needed */
+static void append_command(const char *args) {
+    const char *name;
+    uint32_t len;
+    fs_node_t *dir = args ? lookup_parent(args, &name, &len) : 0;
+    fs_node_t *node = dir ? vfs_finddir(dir, name, len) : 0;
+    if (dir && !node) node = vfs_create(dir, name, len, FS_FILE);
+    if (!node || (node->flags & 0x07) == FS_DIRECTORY) {
+        serial_print("[VFS] Can't write that.\n");
+        return;
+    }
+
+    const char *text = name + len;
+    while (*text == ' ') text++;
+    uint32_t n = 0;
+    while (text[n]) n++;
+    uint32_t done = vfs_write(node, node->length, n, (uint8_t *)text);
+    done += vfs_write(node, node->length, 1, (uint8_t *)"\n");
+    if (done != n + 1) serial_print("[VFS] Short write.\n");
+}
+
+void vfs_init() {
+    strtab_init();
+    dcache_init();
+    pagecache_init();
+    serial_register_command("cat", cat_command);
+    serial_register_command("ls", ls_command);
+    serial_register_command("mkdir", mkdir_command);
+    serial_register_command("rm", rm_command);
+    serial_register_command("append", append_command);
+}
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "strtab.h"
+
 #define MAX_FILENAME 256
 #define MAX_FILES 1024
 
@@ -13,46 +15,119 @@ typedef enum {
     FS_DEVICE
 } fs_node_type_t;
 
+#define FS_MOUNTPOINT 0x08 // Directory covered by the filesystem root in ptr
+#define FS_CACHED     0x10 // Data goes through the page cache (pagecache.h)
+
 struct fs_node;
 
-typedef uint32_t (*read_type_t)(struct fs_node*, uint32_t, uint32_t, uint8_t*);
-typedef uint32_t (*write_type_t)(struct fs_node*, uint32_t, uint32_t, uint8_t*);
+/* Offsets are 64-bit; a single transfer is at most 4 GiB */
+typedef uint32_t (*read_type_t)(struct fs_node*, uint64_t, uint32_t, uint8_t*);
+typedef uint32_t (*write_type_t)(struct fs_node*, uint64_t, uint32_t, uint8_t*);
 typedef void (*open_type_t)(struct fs_node*);
 typedef void (*close_type_t)(struct fs_node*);
-typedef struct dirent * (*readdir_type_t)(struct fs_node*, uint32_t);
-typedef struct fs_node * (*finddir_type_t)(struct fs_node*, char *name);
+/* The index-th entry of a directory, or 0 past the end */
+typedef struct fs_node * (*readdir_type_t)(struct fs_node*, uint32_t index);
+/* `name` is `len` bytes, not NUL-terminated */
+typedef struct fs_node * (*finddir_type_t)(struct fs_node*, const char *name, uint32_t len);
+/* Pointer to `size` contiguous bytes at `offset` (already clamped to the
+ * file), valid while the node exists; 0 if this range can't be mapped */
+typedef const uint8_t * (*map_type_t)(struct fs_node*, uint64_t offset, uint32_t size);
+/* New entry `name` (`len` bytes) of type FS_FILE or FS_DIRECTORY; 0 if it
+ * exists or can't be made */
+typedef struct fs_node * (*create_type_t)(struct fs_node*, const char *name, uint32_t len, uint32_t type);
+/* 1 once the entry is gone; directories must be empty */
+typedef int (*unlink_type_t)(struct fs_node*, const char *name, uint32_t len);
+/* Set the file size; growing leaves a hole that reads as zeros */
+typedef int (*truncate_type_t)(struct fs_node*, uint64_t length);
 
-typedef struct fs_node {
-    char name[MAX_FILENAME];
-    uint32_t mask;        // Permissions
-    uint32_t uid;         // User ID
-    uint32_t gid;         // Group ID
-    uint32_t flags;       // Node type
-    uint32_t inode;       // Device specific
-    uint32_t length;      // Size in bytes
-    uint64_t impl;        // Implementation defined (Pointer in 64-bit)
+/* Shared by every node of one kind; any member may be 0 */
+typedef struct fs_ops {
     read_type_t read;
     write_type_t write;
     open_type_t open;
     close_type_t close;
     readdir_type_t readdir;
     finddir_type_t finddir;
+    map_type_t map;
+    create_type_t create;
+    unlink_type_t unlink;
+    truncate_type_t truncate;
+} fs_ops_t;
+
+/* Exactly one cache line; the name lives in the string table (strtab.h) */
+typedef struct fs_node {
+    const fs_ops_t *ops;
+    uint64_t impl;        // Implementation defined (Pointer in 64-bit)
     struct fs_node *ptr;  // Used by mountpoints and symlinks
-} fs_node_t;
+    uint64_t length;      // Size in bytes
+    uint32_t inode;       // Device specific
+    uint32_t flags;       // Node type
+    uint32_t name;        // String table offset, see vfs_name()
+    uint32_t name_hash;   // strtab_hash() of the name
+    uint16_t name_len;
+    uint16_t mask;        // Permissions
+    uint16_t uid;         // User ID
+    uint16_t gid;         // Group ID
+} __attribute__((aligned(64))) fs_node_t;
+
+_Static_assert(sizeof(fs_node_t) == 64, "fs_node_t should fill one cache line");
 
-struct dirent {
-    char name[MAX_FILENAME];
-    uint32_t inode;
-};
+/* Read-only view of part of a file, see vfs_map() */
+typedef struct {
+    const uint8_t *data;
+    uint32_t length;      // May be shorter than asked for at end of file
+    void *copy;           // Pages holding a fallback copy, 0 when zero-copy
+    uint32_t copy_pages;
+    void *page;           // Pinned page cache page, if that is what data points into
+} vfs_mapping_t;
 
 extern fs_node_t *fs_root; // Root of the file system
 
 // Helper functions
-uint32_t vfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-uint32_t vfs_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+uint32_t vfs_read(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer);
+uint32_t vfs_write(fs_node_t *node, uint64_t offset, uint32_t size, uint8_t *buffer);
+/* Keeps the node valid across an unlink until the matching close */
 void vfs_open(fs_node_t *node);
 void vfs_close(fs_node_t *node);
-struct dirent *vfs_readdir(fs_node_t *node, uint32_t index);
-fs_node_t *vfs_finddir(fs_node_t *node, char *name);
+fs_node_t *vfs_readdir(fs_node_t *node, uint32_t index);
+fs_node_t *vfs_finddir(fs_node_t *node, const char *name, uint32_t len);
+
+static inline const char *vfs_name(const fs_node_t *node) {
+    return strtab_get(node->name);
+}
+
+static inline int vfs_name_is(const fs_node_t *node, const char *name, uint32_t len, uint32_t hash) {
+    if (node->name_hash != hash || node->name_len != len) return 0;
+    const char *s = vfs_name(node);
+    for (uint32_t i = 0; i < len; i++) if (s[i] != name[i]) return 0;
+    return 1;
+}
+
+/* Namespace changes; dir may be a mountpoint. The filesystem keeps the
+ * dentry cache in step. */
+fs_node_t *vfs_create(fs_node_t *dir, const char *name, uint32_t len, uint32_t type);
+int vfs_unlink(fs_node_t *dir, const char *name, uint32_t len);
+int vfs_truncate(fs_node_t *node, uint64_t length);
+
+/* Cover the directory at `path` with `root`; 0 if it isn't a directory */
+int vfs_mount(const char *path, fs_node_t *root);
+
+/* Interns the name and drops the node's reference to the old one; 0 if it
+ * couldn't be stored (the node keeps its old name) */
+int vfs_set_name(fs_node_t *node, const char *name, uint32_t len);
+void vfs_release_name(fs_node_t *node); // Before a node is freed
+
+/* Map [offset, offset + size) of a file without copying when the filesystem
+ * holds it in memory; otherwise read it into freshly allocated pages.
+ * Returns 0 on failure. Every successful map needs a vfs_unmap(). */
+int vfs_map(fs_node_t *node, uint64_t offset, uint32_t size, vfs_mapping_t *m);
+void vfs_unmap(vfs_mapping_t *m);
+
+/* Resolve a '/'-separated path from fs_root through the dentry cache.
+ * Handles "." and ".." (never above the root); 0 if any component is missing. */
+#define VFS_MAX_DEPTH 32
+fs_node_t *vfs_lookup(const char *path);
+
+void vfs_init(); // Dentry cache and shell commands, before mounting fs_root
 
 #endif
@@ -0,0 +1,461 @@
+#include "virtio_blk.h"
+#include "blk.h"
+#include "pci.h"
+#include "interrupts.h"
+#include "workqueue.h"
+#include "ports.h"
+#include "smp.h"
+#include "sync.h"
+#include "serial.h"
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "libk/string/string.h"
+
+#define VIRTIO_VENDOR        0x1AF4
+#define VIRTIO_BLK_LEGACY_ID 0x1001
+
+/* Legacy register block at the start of BAR0 */
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES  0x04
+#define VIRTIO_REG_QUEUE_PFN       0x08
+#define VIRTIO_REG_QUEUE_SIZE      0x0C
+#define VIRTIO_REG_QUEUE_SELECT    0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY    0x10
+#define VIRTIO_REG_STATUS          0x12
+#define VIRTIO_REG_ISR             0x13
+#define VIRTIO_REG_CONFIG_VECTOR   0x14 // These two only exist while MSI-X is on,
+#define VIRTIO_REG_QUEUE_VECTOR    0x16 // and push the device config back to 0x18
+
+#define VIRTIO_STATUS_ACK       0x01
+#define VIRTIO_STATUS_DRIVER    0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED    0x80
+
+#define VIRTIO_MSI_NO_VECTOR 0xFFFF
+
+#define VIRTIO_BLK_F_SEG_MAX   (1u << 2)
+#define VIRTIO_BLK_F_RO        (1u << 5)
+#define VIRTIO_BLK_F_FLUSH     (1u << 9)
+#define VIRTIO_BLK_F_MQ        (1u << 12)
+#define VIRTIO_RING_F_INDIRECT (1u << 28)
+
+#define VIRTIO_BLK_FEATURES (VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH | \
+                             VIRTIO_BLK_F_MQ | VIRTIO_RING_F_INDIRECT)
+
+/* struct virtio_blk_config */
+#define VIRTIO_BLK_CFG_CAPACITY   0
+#define VIRTIO_BLK_CFG_SEG_MAX    12
+#define VIRTIO_BLK_CFG_NUM_QUEUES 34
+
+#define VIRTIO_BLK_T_IN    0
+#define VIRTIO_BLK_T_OUT   1
+#define VIRTIO_BLK_T_FLUSH 4
+
+#define VIRTIO_BLK_S_OK     0
+#define VIRTIO_BLK_S_UNSUPP 2
+
+#define VRING_DESC_F_NEXT      1
+#define VRING_DESC_F_WRITE     2    // Device writes the buffer
+#define VRING_DESC_F_INDIRECT  4
+#define VRING_USED_F_NO_NOTIFY 1
+#define VRING_ALIGN            4096
+
+#define VBLK_MAX_SECTORS 2048       // 1 MiB per dispatched request
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} vring_avail_t;
+
+typedef struct {
+    uint32_t id;                // Head descriptor of the finished chain
+    uint32_t len;
+} vring_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    vring_used_elem_t ring[];
+} vring_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_hdr_t;
+
+typedef struct vblk vblk_t;
+
+typedef struct {
+    vblk_t *vb;
+    spinlock_t lock;
+    lock_stats_t lock_stats;
+    uint16_t index;
+    uint16_t size;              // Ring entries, fixed by the device
+    uint16_t free_head;         // Free descriptors, linked through .next
+    uint16_t num_free;
+    uint16_t avail_idx;         // Published to the device by vblk_commit()
+    uint16_t last_used;
+    uint8_t vector;             // MSI-X vector, 0 on INTx
+    vring_desc_t *desc;
+    vring_avail_t *avail;
+    volatile vring_used_t *used;
+
+    /* Indexed by a request's head descriptor */
+    blk_request_t **reqs;
+    virtio_blk_hdr_t *hdrs;
+    volatile uint8_t *status;
+    vring_desc_t *tables;       // Indirect tables, 0 when the device has none
+    uint8_t *mem;               // The whole allocation, rings first
+    uint32_t pages;
+
+    work_t done_work;           // Softirq reaping the used ring
+    uint64_t kicks;
+    uint64_t irqs;
+} virtq_t;
+
+struct vblk {
+    blk_device_t blk;
+    pci_device_t *pci;
+    uint16_t io;
+    int msix;
+    uint32_t features;
+    char name[4];
+    virtq_t vqs[BLK_MAX_HW_QUEUES];
+};
+
+static vblk_t devices[BLK_MAX_DEVICES];
+static uint32_t device_count = 0;
+static virtq_t *vector_queue[256];
+
+/* Ring and request memory comes from the PMM, so it is in the HHDM */
+static inline uint64_t dma_addr(const volatile void *p) {
+    return (uint64_t)(uintptr_t)p - vmm_hhdm_offset();
+}
+
+static inline uint32_t align_up(uint32_t n, uint32_t a) {
+    return (n + a - 1) & ~(a - 1);
+}
+
+/* --- Request path --- */
+
+/* Fill the next descriptor of a chain: the next slot of an indirect table,
+ * or the next free ring descriptor (the free list is already linked) */
+static vring_desc_t *chain_add(virtq_t *vq, vring_desc_t *table, uint16_t *cursor,
+                               uint64_t addr, uint32_t len, uint16_t flags) {
+    vring_desc_t *d = table ? &table[*cursor] : &vq->desc[*cursor];
+    d->addr = addr;
+    d->len = len;
+    d->flags = flags | VRING_DESC_F_NEXT;
+    if (table) d->next = *cursor + 1;
+    *cursor = d->next;
+    return d;
+}
+
+static int vblk_queue_rq(blk_device_t *dev, uint32_t hwq, blk_request_t *req) {
+    vblk_t *vb = dev->driver;
+    virtq_t *vq = &vb->vqs[hwq];
+    uint32_t needed = vq->tables ? 1 : req->total_segs + 2;
+
+    uint64_t flags = spin_lock_irqsave(&vq->lock);
+    if (vq->num_free < needed) {
+        spin_unlock_irqrestore(&vq->lock, flags);
+        return 0;
+    }
+
+    uint16_t head = vq->free_head;
+    virtio_blk_hdr_t *hdr = &vq->hdrs[head];
+    hdr->type = req->op == BLK_READ ? VIRTIO_BLK_T_IN : req->op == BLK_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+    hdr->reserved = 0;
+    hdr->sector = req->op == BLK_FLUSH ? 0 : req->sector;
+    vq->status[head] = 0xFF;
+    vq->reqs[head] = req;
+    req->tag = head;
+
+    // Header, every segment of every merged request, status byte
+    vring_desc_t *table = vq->tables ? &vq->tables[head * (VIRTIO_BLK_MAX_SEGS + 2)] : 0;
+    uint16_t cursor = table ? 0 : head;
+    uint16_t data_flags = req->op == BLK_READ ? VRING_DESC_F_WRITE : 0;
+    chain_add(vq, table, &cursor, dma_addr(hdr), sizeof(*hdr), 0);
+    for (blk_request_t *r = req; r; r = r->merged) {
+        for (uint32_t i = 0; i < r->nsegs; i++) chain_add(vq, table, &cursor, r->segs[i].phys, r->segs[i].len, data_flags);
+    }
+    vring_desc_t *last = chain_add(vq, table, &cursor, dma_addr(&vq->status[head]), 1, VRING_DESC_F_WRITE);
+    last->flags &= ~VRING_DESC_F_NEXT;
+
+    if (table) {
+        vq->free_head = vq->desc[head].next;
+        vq->desc[head].addr = dma_addr(table);
+        vq->desc[head].len = cursor * sizeof(vring_desc_t);
+        vq->desc[head].flags = VRING_DESC_F_INDIRECT;
+    } else {
+        vq->free_head = cursor;
+    }
+    vq->num_free -= needed;
+
+    vq->avail->ring[vq->avail_idx % vq->size] = head;
+    vq->avail_idx++;
+    spin_unlock_irqrestore(&vq->lock, flags);
+    return 1;
+}
+
+static void vblk_commit(blk_device_t *dev, uint32_t hwq) {
+    vblk_t *vb = dev->driver;
+    virtq_t *vq = &vb->vqs[hwq];
+    uint64_t flags = spin_lock_irqsave(&vq->lock);
+    __atomic_store_n(&vq->avail->idx, vq->avail_idx, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // The index is visible before we look at used->flags
+    if (!(vq->used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(vb->io + VIRTIO_REG_QUEUE_NOTIFY, vq->index);
+        vq->kicks++;
+    }
+    spin_unlock_irqrestore(&vq->lock, flags);
+}
+
+static const blk_ops_t vblk_ops = {
+    .queue_rq = vblk_queue_rq,
+    .commit = vblk_commit,
+};
+
+/* --- Completion --- */
+
+/* Softirq: hand back every chain the device has finished, then refill */
+static void vq_reap(work_t *work) {
+    virtq_t *vq = work->arg;
+    vblk_t *vb = vq->vb;
+    uint64_t flags = spin_lock_irqsave(&vq->lock);
+    while (vq->last_used != __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE)) {
+        uint16_t head = vq->used->ring[vq->last_used % vq->size].id;
+        vq->last_used++;
+        blk_request_t *req = vq->reqs[head];
+        uint8_t status = vq->status[head];
+        vq->reqs[head] = 0;
+
+        uint16_t tail = head, n = 1;
+        while (!vq->tables && (vq->desc[tail].flags & VRING_DESC_F_NEXT)) {
+            tail = vq->desc[tail].next;
+            n++;
+        }
+        vq->desc[tail].next = vq->free_head;
+        vq->free_head = head;
+        vq->num_free += n;
+
+        if (!req) continue;
+        spin_unlock_irqrestore(&vq->lock, flags);
+        blk_complete(&vb->blk, req, status == VIRTIO_BLK_S_OK ? BLK_OK :
+                                    status == VIRTIO_BLK_S_UNSUPP ? BLK_UNSUPPORTED : BLK_EIO);
+        flags = spin_lock_irqsave(&vq->lock);
+    }
+    spin_unlock_irqrestore(&vq->lock, flags);
+    blk_run_queue(&vb->blk, vq->index);
+}
+
+/* MSI-X: one vector per queue, delivered to the CPU that submits on it */
+static void vblk_queue_irq(interrupt_frame_t *frame) {
+    virtq_t *vq = vector_queue[frame->vector];
+    if (!vq) return;
+    vq->irqs++;
+    softirq_raise(&vq->done_work);
+}
+
+/* INTx: shared by every queue; reading the ISR deasserts the line */
+static void vblk_intx_irq(interrupt_frame_t *frame) {
+    (void)frame;
+    for (uint32_t d = 0; d < device_count; d++) {
+        vblk_t *vb = &devices[d];
+        if (vb->msix || !(inb(vb->io + VIRTIO_REG_ISR) & 1)) continue;
+        for (uint32_t q = 0; q < vb->blk.nr_hw_queues; q++) {
+            vb->vqs[q].irqs++;
+            softirq_raise(&vb->vqs[q].done_work);
+        }
+    }
+}
+
+/* --- Setup --- */
+
+/* Legacy layout: descriptors and the avail ring, then the used ring on the
+ * next page. Per-request headers, status bytes and indirect tables share
+ * the allocation. */
+static int vq_setup(vblk_t *vb, uint16_t index) {
+    virtq_t *vq = &vb->vqs[index];
+    outw(vb->io + VIRTIO_REG_QUEUE_SELECT, index);
+    uint16_t size = inw(vb->io + VIRTIO_REG_QUEUE_SIZE);
+    if (!size || inl(vb->io + VIRTIO_REG_QUEUE_PFN)) return 0;
+
+    int indirect = (vb->features & VIRTIO_RING_F_INDIRECT) != 0;
+    uint32_t heads = indirect && size > VIRTIO_BLK_MAX_DEPTH ? VIRTIO_BLK_MAX_DEPTH : size;
+    uint32_t used_off = align_up(sizeof(vring_desc_t) * size + 6 + 2 * size, VRING_ALIGN);
+    uint32_t ring_bytes = used_off + align_up(6 + sizeof(vring_used_elem_t) * size, VRING_ALIGN);
+    uint32_t table_bytes = indirect ? heads * (VIRTIO_BLK_MAX_SEGS + 2) * sizeof(vring_desc_t) : 0;
+    uint32_t bytes = ring_bytes + size * sizeof(virtio_blk_hdr_t) + table_bytes +
+                     size * sizeof(blk_request_t *) + size;
+    uint32_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint8_t *mem = pmm_alloc(pages);
+    if (!mem) return 0;
+    k_memset(mem, 0, pages * PAGE_SIZE);
+
+    vq->vb = vb;
+    vq->mem = mem;
+    vq->pages = pages;
+    vq->lock = (spinlock_t)SPINLOCK_INIT;
+    vq->lock_stats.name = "virtq";
+    vq->lock.stats = &vq->lock_stats;
+    vq->index = index;
+    vq->size = size;
+    vq->desc = (vring_desc_t *)mem;
+    vq->avail = (vring_avail_t *)(mem + sizeof(vring_desc_t) * size);
+    vq->used = (volatile vring_used_t *)(mem + used_off);
+    uint8_t *p = mem + ring_bytes;
+    vq->hdrs = (virtio_blk_hdr_t *)p;
+    p += size * sizeof(virtio_blk_hdr_t);
+    vq->tables = indirect ? (vring_desc_t *)p : 0;
+    p += table_bytes;
+    vq->reqs = (blk_request_t **)p;
+    p += size * sizeof(blk_request_t *);
+    vq->status = p;
+
+    // With indirect tables only the first `heads` descriptors are ever used
+    for (uint16_t i = 0; i < size; i++) vq->desc[i].next = i + 1;
+    vq->free_head = 0;
+    vq->num_free = heads;
+    work_init(&vq->done_work, vq_reap, vq);
+
+    outl(vb->io + VIRTIO_REG_QUEUE_PFN, dma_addr(mem) / VRING_ALIGN);
+    return 1;
+}
+
+/* Release a queue the device no longer owns: after a reset, or once its
+ * PFN has been cleared */
+static void vq_free(virtq_t *vq) {
+    if (vq->vector) {
+        vector_queue[vq->vector] = 0;
+        interrupt_free(vq->vector);
+        vq->vector = 0;
+    }
+    pmm_free(vq->mem, vq->pages);
+    vq->mem = 0;
+}
+
+/* Route queue `index`'s completions to CPU `index`; 0 if the device
+ * refuses the vector */
+static int vq_route_msix(vblk_t *vb, pci_msix_t *msix, uint16_t index) {
+    virtq_t *vq = &vb->vqs[index];
+    uint8_t vector = interrupt_alloc(vblk_queue_irq, "virtio-blk");
+    if (!vector) return 0;
+    vq->vector = vector;
+    vector_queue[vector] = vq;
+    pci_msix_route(msix, index, vector, smp_cpu(index)->lapic_id);
+
+    outw(vb->io + VIRTIO_REG_QUEUE_SELECT, index);
+    outw(vb->io + VIRTIO_REG_QUEUE_VECTOR, index);
+    return inw(vb->io + VIRTIO_REG_QUEUE_VECTOR) == index;
+}
+
+/* Give the device up after `ready` queues were set up: a reset drops every
+ * queue address, so the rings can be freed */
+static void probe_abort(vblk_t *vb, pci_msix_t *msix, uint32_t ready, const char *why) {
+    outb(vb->io + VIRTIO_REG_STATUS, 0);
+    for (uint32_t i = 0; i < ready; i++) vq_free(&vb->vqs[i]);
+    if (vb->msix) pci_msix_disable(msix);
+    vb->msix = 0;
+    outb(vb->io + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+    serial_print("[VIRTIO] blk: ");
+    serial_print(why);
+    serial_print(".\n");
+}
+
+static void probe(pci_device_t *pci) {
+    if (device_count == BLK_MAX_DEVICES || !pci->bar[0].io || !pci->bar[0].size) return;
+    vblk_t *vb = &devices[device_count];
+    vb->pci = pci;
+    vb->io = pci->bar[0].base;
+    pci_enable(pci);
+
+    outb(vb->io + VIRTIO_REG_STATUS, 0); // Reset
+    outb(vb->io + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK);
+    outb(vb->io + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+    vb->features = inl(vb->io + VIRTIO_REG_DEVICE_FEATURES) & VIRTIO_BLK_FEATURES;
+    outl(vb->io + VIRTIO_REG_GUEST_FEATURES, vb->features);
+
+    // MSI-X needs the LAPIC; its table must be live before the config moves
+    pci_msix_t msix = { 0 };
+    vb->msix = interrupts_using_apic() && pci_msix_enable(pci, &msix);
+    uint16_t cfg = vb->io + (vb->msix ? 0x18 : 0x14);
+    uint64_t sectors = inl(cfg + VIRTIO_BLK_CFG_CAPACITY) |
+                       ((uint64_t)inl(cfg + VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+
+    // One queue per CPU, as far as the device and the MSI-X table stretch
+    uint32_t queues = (vb->features & VIRTIO_BLK_F_MQ) ? inw(cfg + VIRTIO_BLK_CFG_NUM_QUEUES) : 1;
+    if (queues > smp_cpu_count()) queues = smp_cpu_count();
+    if (queues > BLK_MAX_HW_QUEUES) queues = BLK_MAX_HW_QUEUES;
+    if (vb->msix && queues > msix.entries) queues = msix.entries;
+    if (!queues) queues = 1;
+
+    uint32_t ready = 0;
+    while (ready < queues && vq_setup(vb, ready)) {
+        if (vb->msix && !vq_route_msix(vb, &msix, ready)) {
+            outw(vb->io + VIRTIO_REG_QUEUE_SELECT, ready);
+            outl(vb->io + VIRTIO_REG_QUEUE_PFN, 0);
+            vq_free(&vb->vqs[ready]);
+            break;
+        }
+        ready++;
+    }
+    const char *failure = 0;
+    if (!ready) failure = "no usable virtqueue";
+    else if (vb->msix) outw(vb->io + VIRTIO_REG_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+    else if (!irq_install(pci->irq_line, vblk_intx_irq, "virtio-blk")) failure = "IRQ line busy";
+    if (failure) {
+        probe_abort(vb, &msix, ready, failure);
+        return;
+    }
+
+    // Headers and the status byte take two descriptors of every chain
+    uint32_t segs = VIRTIO_BLK_MAX_SEGS;
+    if (!(vb->features & VIRTIO_RING_F_INDIRECT) && segs > vb->vqs[0].size - 2u) segs = vb->vqs[0].size - 2;
+    if (vb->features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t seg_max = inl(cfg + VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max && seg_max < segs) segs = seg_max;
+    }
+
+    vb->name[0] = 'v';
+    vb->name[1] = 'd';
+    vb->name[2] = 'a' + device_count;
+    vb->name[3] = 0;
+    vb->blk.name = vb->name;
+    vb->blk.ops = &vblk_ops;
+    vb->blk.driver = vb;
+    vb->blk.sectors = sectors;
+    vb->blk.max_segs = segs;
+    vb->blk.max_sectors = VBLK_MAX_SECTORS;
+    vb->blk.read_only = (vb->features & VIRTIO_BLK_F_RO) != 0;
+    vb->blk.nr_hw_queues = ready;
+    device_count++;
+
+    outb(vb->io + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    if (!blk_register(&vb->blk)) {
+        device_count--;
+        probe_abort(vb, &msix, ready, "block layer full");
+        return;
+    }
+
+    serial_print("[VIRTIO] ");
+    serial_print(vb->name);
+    serial_print(vb->msix ? ": MSI-X, " : ": INTx, ");
+    serial_print((vb->features & VIRTIO_RING_F_INDIRECT) ? "indirect descriptors, " : "");
+    serial_print_dec(vb->vqs[0].size);
+    serial_print(" entries per queue\n");
+}
+
+void virtio_blk_init() {
+    pci_device_t *pci;
+    for (uint32_t i = 0; (pci = pci_find(VIRTIO_VENDOR, VIRTIO_BLK_LEGACY_ID, i)) != 0; i++) probe(pci);
+}
@@ -0,0 +1,25 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+/*
+ * virtio-blk over the legacy (virtio 0.9.5) PCI transport, as QEMU's
+ * transitional virtio-blk-pci exposes it:
+ *
+ *   -drive file=disk.img,if=none,id=vd0,format=raw
+ *   -device virtio-blk-pci,drive=vd0,num-queues=4
+ *
+ * Each CPU gets a virtqueue of its own when the device offers enough
+ * (VIRTIO_BLK_F_MQ), and with MSI-X each queue's completion interrupt is
+ * routed to the CPU that submits on it, so a request never touches another
+ * CPU's cache lines. Without MSI-X all queues share the INTx line.
+ * Devices register with the block layer (blk.h) as vda, vdb, ...
+ */
+
+#define VIRTIO_BLK_MAX_SEGS  32     // Data segments per request (indirect table size)
+#define VIRTIO_BLK_MAX_DEPTH 128    // Requests in flight per queue
+
+void virtio_blk_init(); // After pci_init() and smp_init()
+
+#endif
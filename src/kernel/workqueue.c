@@ -0,0 +1,174 @@
+#include "workqueue.h"
+#include "sched.h"
+#include "smp.h"
+#include "sync.h"
+#include "trace.h"
+#include "serial.h"
+
+typedef struct {
+    work_t *head;
+    work_t *tail;
+} work_list_t;
+
+/* Softirq lists are only touched by their own CPU with interrupts off; the
+ * kworker list takes work_schedule() calls from any CPU, hence the lock. */
+typedef struct {
+    work_list_t softirq;
+    work_list_t deferred;
+    spinlock_t deferred_lock;
+    lock_stats_t lock_stats;
+    task_t *kworker;
+    sched_event_t kick;
+    uint64_t softirq_runs;
+    uint64_t softirq_overflows;     // Budget exhausted, handed to the kworker
+    uint64_t worker_runs;
+} work_cpu_t;
+
+static work_cpu_t work_cpus[MAX_CPUS];
+
+static void list_push(work_list_t *l, work_t *w) {
+    w->next = 0;
+    if (l->tail) l->tail->next = w;
+    else l->head = w;
+    l->tail = w;
+}
+
+static work_t *list_take(work_list_t *l) {
+    work_t *w = l->head;
+    l->head = l->tail = 0;
+    return w;
+}
+
+void work_init(work_t *work, work_fn_t fn, void *arg) {
+    work->fn = fn;
+    work->arg = arg;
+    work->next = 0;
+    work->pending = 0;
+    work->runs = 0;
+}
+
+static void run_list(work_t *w) {
+    int in_softirq = this_cpu()->in_softirq;
+    while (w) {
+        work_t *next = w->next;
+        __atomic_store_n(&w->pending, 0, __ATOMIC_RELEASE); // May be re-raised from fn
+        w->runs++;
+        TRACE(TRACE_WORK_BEGIN, in_softirq, w->fn, 0);
+        w->fn(w);
+        TRACE(TRACE_WORK_END, in_softirq, w->fn, 0);
+        w = next;
+    }
+}
+
+static void kick_worker(work_cpu_t *wc) {
+    if (wc->kworker) sched_event_signal(&wc->kick);
+}
+
+int softirq_raise(work_t *work) {
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL)) return 0;
+
+    uint64_t flags = cpu_irq_save();
+    percpu_t *cpu = this_cpu();
+    work_cpu_t *wc = &work_cpus[cpu->cpu_id];
+    list_push(&wc->softirq, work);
+    // Outside an interrupt there's no exit path to drain it; use the kworker
+    if (cpu->irq_depth == 0 && !cpu->in_softirq) kick_worker(wc);
+    cpu_irq_restore(flags);
+    return 1;
+}
+
+int work_schedule(work_t *work) {
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL)) return 0;
+
+    work_cpu_t *wc = &work_cpus[this_cpu()->cpu_id];
+    uint64_t flags = spin_lock_irqsave(&wc->deferred_lock);
+    list_push(&wc->deferred, work);
+    spin_unlock_irqrestore(&wc->deferred_lock, flags);
+    kick_worker(wc);
+    return 1;
+}
+
+/* Drain this CPU's softirq list with interrupts enabled. Entered and left
+ * with interrupts disabled. Returns 1 if work remains past the budget. */
+static int softirq_run(percpu_t *cpu, uint64_t budget_ns) {
+    work_cpu_t *wc = &work_cpus[cpu->cpu_id];
+    uint64_t deadline = ktime_get_ns() + budget_ns;
+
+    cpu->in_softirq = 1;
+    cpu->preempt_count++;
+    while (wc->softirq.head) {
+        work_t *batch = list_take(&wc->softirq);
+        __asm__ volatile ("sti" : : : "memory");
+        run_list(batch);
+        __asm__ volatile ("cli" : : : "memory");
+        wc->softirq_runs++;
+        if (ktime_get_ns() >= deadline) break;
+    }
+    cpu->preempt_count--;
+    cpu->in_softirq = 0;
+    return wc->softirq.head != 0;
+}
+
+void softirq_irq_exit() {
+    percpu_t *cpu = this_cpu();
+    if (cpu->irq_depth != 0 || cpu->in_softirq) return; // Outermost exit only
+    work_cpu_t *wc = &work_cpus[cpu->cpu_id];
+    if (!wc->softirq.head) return;
+
+    if (softirq_run(cpu, SOFTIRQ_BUDGET_NS)) {
+        wc->softirq_overflows++;
+        kick_worker(wc);
+    }
+}
+
+static void kworker_thread(void *arg) {
+    work_cpu_t *wc = arg;
+    percpu_t *cpu = this_cpu();
+
+    for (;;) {
+        uint64_t flags = cpu_irq_save();
+        if (wc->softirq.head) softirq_run(cpu, SOFTIRQ_BUDGET_NS);
+        cpu_irq_restore(flags);
+
+        flags = spin_lock_irqsave(&wc->deferred_lock);
+        work_t *batch = list_take(&wc->deferred);
+        spin_unlock_irqrestore(&wc->deferred_lock, flags);
+        if (batch) {
+            wc->worker_runs++;
+            run_list(batch);
+            continue;
+        }
+
+        if (!wc->softirq.head) sched_event_wait(&wc->kick, 0);
+        else sched_yield(); // Let equal-priority work in between bursts
+    }
+}
+
+static void work_command(const char *args) {
+    (void)args;
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        work_cpu_t *wc = &work_cpus[c];
+        serial_print("[WORK] cpu ");
+        serial_print_dec(c);
+        serial_print(": softirq_batches=");
+        serial_print_dec(wc->softirq_runs);
+        serial_print(" overflows=");
+        serial_print_dec(wc->softirq_overflows);
+        serial_print(" kworker_batches=");
+        serial_print_dec(wc->worker_runs);
+        serial_print("\n");
+    }
+}
+
+void workqueue_init() {
+    for (uint32_t c = 0; c < smp_cpu_count(); c++) {
+        work_cpu_t *wc = &work_cpus[c];
+        wc->lock_stats.name = "workqueue";
+        wc->deferred_lock.stats = &wc->lock_stats;
+        char name[TASK_NAME_LEN] = "kworker/";
+        name[8] = c >= 10 ? '0' + c / 10 : '0' + c;
+        name[9] = c >= 10 ? '0' + c % 10 : 0;
+        wc->kworker = task_create(name, kworker_thread, wc, SCHED_PRIO_HIGH, c);
+    }
+    serial_register_command("work", work_command);
+}
@@ -0,0 +1,42 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Deferred interrupt work ("bottom halves").
+ *
+ * Top halves acknowledge the device, stash raw data and raise a work item.
+ * softirq_raise() items run on the same CPU when the outermost interrupt
+ * returns, with interrupts enabled but preemption off, so they must not
+ * sleep. work_schedule() items run in that CPU's kworker thread and may
+ * block. Softirq work left over after SOFTIRQ_BUDGET_NS is handed to the
+ * kworker too, so a flood can't starve threads.
+ */
+
+#define SOFTIRQ_BUDGET_NS (2 * 1000000ULL)
+
+typedef struct work work_t;
+typedef void (*work_fn_t)(work_t *work);
+
+struct work {
+    work_fn_t fn;
+    void *arg;
+    work_t *next;
+    volatile int pending;   // Queued and not yet started
+    uint64_t runs;
+};
+
+void work_init(work_t *work, work_fn_t fn, void *arg);
+
+/* Both return 0 if the item was already pending (it will still run once) */
+int softirq_raise(work_t *work);
+int work_schedule(work_t *work);
+
+/* Starts one kworker per online CPU; after sched_init() and smp_init() */
+void workqueue_init();
+
+/* Called by the interrupt dispatcher before it considers preemption */
+void softirq_irq_exit();
+
+#endif